@@ -0,0 +1,21 @@
+#include <cstdint>
+
+#ifndef ATTACKS_DEFINE
+#define ATTACKS_DEFINE
+
+/**
+ * Squares attacked by each kind of piece, worked out from bitboards alone.
+ * Unlike the threat map these hold no state, so they are correct for any
+ * board at any point in a search and are safe to use from any thread.
+ */
+uint64_t Attacks_Pawn(uint8_t idx, bool white);
+uint64_t Attacks_Knight(uint8_t idx);
+uint64_t Attacks_King(uint8_t idx);
+uint64_t Attacks_Bishop(uint8_t idx, uint64_t occupied);
+uint64_t Attacks_Rook(uint8_t idx, uint64_t occupied);
+uint64_t Attacks_Queen(uint8_t idx, uint64_t occupied);
+
+uint64_t Attacks_AttackersTo(const uint64_t *pieces, uint64_t occupied, uint8_t idx);
+bool     Attacks_IsSquareAttacked(const uint64_t *pieces, uint64_t occupied, uint8_t idx, bool byWhite);
+
+#endif // ATTACKS_DEFINE
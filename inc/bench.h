@@ -0,0 +1,20 @@
+#include <cstdint>
+
+#ifndef BENCH_DEFINE
+#define BENCH_DEFINE
+
+// Depth each bench position is searched to unless told otherwise
+#define BENCH_DEFAULT_DEPTH 4
+
+// Transposition table size for comparing page sizes, big enough to outgrow the TLB
+#define BENCH_DEFAULT_HUGE_PAGES_HASH_MB 1024
+
+// Moves between full board verifications when soak testing
+#define BENCH_DEFAULT_VERIFY_INTERVAL 1000
+
+uint64_t Bench_Run(uint64_t depth, uint64_t hashMb);
+uint64_t Bench_Profile(uint64_t depth);
+uint64_t Bench_Soak(uint64_t depth, uint64_t verifyInterval);
+uint64_t Bench_CompareHugePages(uint64_t depth, uint64_t hashMb);
+
+#endif // BENCH_DEFINE
@@ -0,0 +1,44 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef BOOK_BUILDER_DEFINE
+#define BOOK_BUILDER_DEFINE
+
+// Moves into each game which are still considered opening theory
+#define BOOK_BUILDER_DEFAULT_MAX_PLY    30
+
+// Moves played in fewer games than this are left out of the book
+#define BOOK_BUILDER_DEFAULT_MIN_GAMES  3
+
+// Memory shared between the ingest threads before they spill to disk
+#define BOOK_BUILDER_DEFAULT_MEMORY_MB  1024
+
+/**
+ * How a book should be built
+ */
+typedef struct bookBuilderConfig_s
+{
+    uint64_t maxPly;        // Plies of each game added to the book
+    uint64_t minGames;      // Games a move needs to be kept
+    uint64_t numThreads;    // Files read at once, 0 for one per core
+    uint64_t memoryMb;      // Records held in memory before sorting to disk
+} bookBuilderConfig_t;
+
+/**
+ * The statistics gathered for a move played from a position. Score counts 2
+ * for each win and 1 for each draw by the side making the move, which is the
+ * weight Polyglot books normally give.
+ */
+typedef struct bookBuilderRecord_s
+{
+    uint64_t key;
+    uint32_t games;
+    uint32_t score;
+    uint16_t move;
+} bookBuilderRecord_t;
+
+void     BookBuilder_DefaultConfig(bookBuilderConfig_t *config);
+uint64_t BookBuilder_Build(std::vector<std::string> pgnPaths, std::string outPath, bookBuilderConfig_t *config);
+
+#endif // BOOK_BUILDER_DEFINE
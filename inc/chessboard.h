@@ -1,6 +1,8 @@
 #include <cstdint>
 #include <string>
 #include "chessboard_defs.h"
+#include "evaluation.h"
+#include "nnue.h"
 
 #ifndef CHESSBOARD_DEFINE
 #define CHESSBOARD_DEFINE
@@ -20,12 +22,39 @@ typedef struct moveType_s
     uint32_t ptCaptured: 4; // What piece type we captured, if any
     uint32_t moveVal: 7; // What type of move this is
     uint32_t legalMove: 1; // Is this move actually legal
-    uint32_t reserved: 4;
+    uint32_t promotion: 3; // White piece type a pawn promotes to, PROMOTION_NONE otherwise
+    uint32_t enPassant: 1; // Is this a pawn taking en passant
 
     // Another 4 bytes of padding will be added by the compiler
 
 } moveType_t;
 
+/**
+ * The evaluation terms kept up to date move by move, see piecetables.h. The
+ * two scores are blended by the phase only when a position is evaluated.
+ */
+typedef struct evalScores_s
+{
+    int32_t midgame;
+    int32_t endgame;
+    int32_t phase;
+} evalScores_t;
+
+/**
+ * Everything a move destroys which cannot be worked back out from the move
+ * itself, kept so the move can be undone
+ */
+typedef struct undoState_s
+{
+    uint64_t hashKey;       // Key of the position the move was played from
+    uint64_t pawnKey;       // Key of its pawns alone
+    evalScores_t scores;    // Evaluation terms of that position
+    uint16_t halfmoveClock;
+    uint8_t ptCaptured;     // Piece type taken, NUM_PIECE_TYPES if none
+    uint8_t castlingRights;
+    uint8_t epIdx;
+} undoState_t;
+
 class ChessBoard
 {
 private:
@@ -38,20 +67,55 @@ private:
     /* Positions of all empty squares */
     uint64_t empty;
 
-    // The current value of the chessboard
-    //      Positive = white's advantage
-    //      Negative = black's advantage
-    int64_t value;
-    int64_t prevValue;
+    // The evaluation terms of the position, positive in white's favour
+    evalScores_t scores;
+
+    // First layer of the network for the position, kept up to date by every
+    // move while it is current for the loaded network, see nnue.h
+    nnueAccumulator_t accumulator;
 
     // Set when we have assessed the best response to an input move
     moveType_t *bestMove;
 
+    // The depth the current search was started at, best moves are recorded there
+    uint64_t rootDepth;
+
+    // Which color is next to move, WHITE_PIECES or BLACK_PIECES
+    uint8_t colorToMove;
+
+    // Castling rights still available, see CASTLE_* definitions
+    uint8_t castlingRights;
+
+    // Square a pawn may be captured en passant on, EN_PASSANT_NONE otherwise
+    uint8_t epIdx;
+
+    // Zobrist key of the position, see zobrist.h
+    uint64_t hashKey;
+
+    // Zobrist key of the pawns alone, which the pawn hash table is keyed by
+    uint64_t pawnKey;
+
+    // Plies since the last capture or pawn move
+    uint16_t halfmoveClock;
+
+    // Undo state of every move currently applied, most recent last. This runs
+    // through the game and on down the line being searched, so the keys in it
+    // are everything a repetition has to be checked against.
+    undoState_t history[MAX_GAME_PLY];
+    uint64_t historyLen;
+
 public:
 
     ChessBoard(void);
     ChessBoard(uint64_t *pieces, uint64_t occupied, uint64_t searchDepth, moveType_t *lastMove);
 
+    uint64_t SetBoardFromFEN(std::string fen);
+    bool VerifyBoardConsistency(void) const;
+    uint64_t ComputeHashKey(void) const;
+    uint64_t ComputePawnKey(void) const;
+    evalScores_t ComputeScores(void) const;
+    bool IsDrawByRule(void) const;
+
     uint64_t *GetPieces() const { return (uint64_t *) pieces; };
     uint64_t GetPiece(uint8_t pt) const { return pieces[pt]; };
     uint64_t GetOccupied() const { return occupied; };
@@ -72,16 +136,30 @@ public:
     uint64_t GetBlackQueen() const { return pieces[BLACK_QUEEN]; };
     uint64_t GetBlackKing() const { return pieces[BLACK_KING]; };
     moveType_t *GetAddrOfBestMove() const {return bestMove; };
-
-    int64_t GetCurrentValue() const {return value;}
+    uint8_t GetColorToMove() const { return colorToMove; };
+    uint8_t GetCastlingRights() const { return castlingRights; };
+    uint8_t GetEnPassantIdx() const { return epIdx; };
+    uint64_t GetHashKey() const { return hashKey; };
+    uint64_t GetPawnKey() const { return pawnKey; };
+    uint16_t GetHalfmoveClock() const { return halfmoveClock; };
+
+    int64_t GetCurrentValue() {return EvaluateCurrentBoardValue(this);}
     static int64_t EvaluateCurrentBoardValue(ChessBoard *cb);
+    static int64_t EvaluateBreakdown(ChessBoard *cb, evalBreakdown_t *breakdown);
+    static int64_t EvaluateLazy(ChessBoard *cb, int32_t alpha, int32_t beta);
 
+    int32_t SearchFromRoot(uint64_t depth, moveType_t *rootMoves);
     int32_t GetBestMove(uint64_t depth, bool playerToMaximize,
                          moveType_t *movesToEvaluateAtThisDepth, int32_t alpha, int32_t beta);
+    int32_t Quiescence(bool playerToMaximize, int32_t alpha, int32_t beta, uint64_t ply);
     moveType_t *GenerateMoves(uint8_t pt);
+    uint64_t GenerateCaptures(moveType_t *captures);
     void BuildMove(uint8_t pt, uint8_t startIdx, uint8_t endIdx, uint8_t moveVal, moveType_t **moveList);
     uint64_t ApplyMoveToBoard(moveType_t *moveToApply);
     uint64_t UndoMoveFromBoard(moveType_t *moveToUndo);
+    bool IsSquareAttacked(uint8_t idx, uint8_t byColor) const;
+    bool IsInCheck(uint8_t color) const;
+    bool IsMoveLegal(moveType_t *move);
 
     static bool IsValidRookMove(ChessBoard *cb, uint8_t idxToAssess, uint8_t endIdx);
     static bool IsValidKnightMove(uint8_t idxToAssess, uint8_t endIdx);
@@ -97,11 +175,19 @@ public:
     void GenerateKnightMoves(uint8_t pt, moveType_t **moveList);
     void GenerateQueenMoves(uint8_t pt, moveType_t **moveList);
     void GenerateKingMoves(uint8_t pt, moveType_t **moveList);
+    void GenerateCastlingMoves(uint8_t pt, moveType_t **moveList);
+    void BuildPawnMove(uint8_t pt, uint8_t startIdx, uint8_t endIdx, uint8_t moveVal, moveType_t **moveList);
 
 };
 
-moveType_t *ConvertStringToMove(ChessBoard* cb, std::string str);
-std::string ConvertMoveToString(ChessBoard *cb, moveType_t *move);
-int64_t GetPositionValueFromTable(uint64_t pieceTypeBase, uint64_t idx);
+void FreeMoveList(moveType_t *moveList);
+
+void Search_SetTimeLimit(uint64_t timeLimitMs);
+void Search_SetNodeLimit(uint64_t maxNodes);
+bool Search_WasAborted(void);
+void Search_SetVerifyInterval(uint64_t verifyInterval);
+uint64_t Search_GetVerifyCount(void);
+void Search_NewSearch(void);
+void Search_ClearHistory(void);
 
 #endif // CHESSBOARD_DEFINE
\ No newline at end of file
@@ -17,10 +17,10 @@
 #define WHITE_BISHOP_START  0x24
 #define BLACK_BISHOP_START  0x2400000000000000
 
-#define WHITE_QUEEN_START   0x10
+#define WHITE_QUEEN_START   0x08
 #define BLACK_QUEEN_START   0x800000000000000
 
-#define WHITE_KING_START    0x08
+#define WHITE_KING_START    0x10
 #define BLACK_KING_START    0x1000000000000000
 
 // Starting positions for board
@@ -45,6 +45,41 @@
 #define MOVE_VALID_MATE         0x20
 #define MOVE_VALID_UNDO         0x40
 
+// Castling rights, as tracked in the board state
+#define CASTLE_WHITE_KING       0x1
+#define CASTLE_WHITE_QUEEN      0x2
+#define CASTLE_BLACK_KING       0x4
+#define CASTLE_BLACK_QUEEN      0x8
+
+// Marker for no en passant square being available
+#define EN_PASSANT_NONE         0xFF
+
+// Marker for a move which does not promote, otherwise the promotion holds the
+// white piece type promoted to (WHITE_ROOK through WHITE_QUEEN)
+#define PROMOTION_NONE          0x0
+
+// Most moves a board can have applied at once, each needs its undo state kept
+#define MAX_GAME_PLY            1024
+
+// Most moves a single position can have, with room to spare
+#define SEARCH_MAX_MOVES        256
+
+// Score assigned to a line in which a king is captured
+#define MATE_SCORE              100000
+
+// Deepest a search can go, the transposition table keeps depths in a byte.
+// Mate scores never stray further than this from MATE_SCORE.
+#define MAX_SEARCH_DEPTH        255
+
+// Score of a position drawn by repetition or the fifty move rule
+#define DRAW_SCORE              0
+
+// Plies without a capture or pawn move after which the game is drawn
+#define FIFTY_MOVE_PLIES        100
+
+// FEN for the standard starting position
+#define START_POSITION_FEN  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
 // Piece definitions
 #define WHITE_PAWN 0x0
 #define WHITE_ROOK 0x1
@@ -0,0 +1,46 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef EPD_SUITE_DEFINE
+#define EPD_SUITE_DEFINE
+
+// Default time given to the engine for each position of a suite
+#define EPD_DEFAULT_TIME_PER_POSITION_MS    1000
+
+// Deepest iteration we will attempt for any one position
+#define EPD_MAX_SEARCH_DEPTH                64
+
+/**
+ * A single test position read from an EPD suite. Moves are kept in the SAN
+ * form they were written in.
+ */
+typedef struct epdPosition_s
+{
+    std::string fen;
+    std::string id;
+    std::vector<std::string> bestMoves;  // bm operands, any of these solves it
+    std::vector<std::string> avoidMoves; // am operands, none of these may be played
+} epdPosition_t;
+
+/**
+ * The outcome of searching a single suite position
+ */
+typedef struct epdResult_s
+{
+    bool solved;
+    uint64_t solvedDepth;   // Iteration from which the solution was held, 0 if never
+    uint64_t solvedNodes;   // Moves assessed when the solution was first held
+    uint64_t solvedTimeMs;  // Time taken when the solution was first held
+    uint64_t depthReached;  // Deepest completed iteration
+    uint64_t nodes;         // Moves assessed over the whole search
+    uint64_t timeMs;        // Time spent over the whole search
+    std::string moveFound;  // UCI form of the final best move
+} epdResult_t;
+
+uint64_t EpdSuite_ParseLine(std::string line, epdPosition_t *position);
+uint64_t EpdSuite_SolvePosition(epdPosition_t *position, uint64_t timePerPositionMs,
+                                uint64_t maxDepth, epdResult_t *result);
+uint64_t EpdSuite_Run(std::string suitePath, uint64_t timePerPositionMs, uint64_t maxDepth);
+
+#endif // EPD_SUITE_DEFINE
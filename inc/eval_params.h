@@ -0,0 +1,55 @@
+#include <cstdint>
+#include <string>
+#include "chessboard_defs.h"
+
+#ifndef EVAL_PARAMS_DEFINE
+#define EVAL_PARAMS_DEFINE
+
+/**
+ * The weights of the hand written evaluation for one phase of the game. Every
+ * field is int32_t, so the whole can also be taken as a flat vector of
+ * EVAL_NUM_TERMS weights, which is how the tuner and the parameter files see
+ * it. The same layout holds the count of each term in a position, white's
+ * less black's, when the evaluation is traced.
+ */
+typedef struct evalTerms_s
+{
+    int32_t material[NUM_PIECE_TYPES/2];                    // By white piece type
+    int32_t squares[NUM_PIECE_TYPES/2][NUM_BOARD_INDICES];  // Drawn from white's side, a8 first
+    int32_t doubled;
+    int32_t isolated;
+    int32_t backward;
+    int32_t connected;
+    int32_t passed[8];                                      // By rank, counted from the pawn's own side
+    int32_t mobility[NUM_PIECE_TYPES/2];                    // Each safe square over the typical number
+} evalTerms_t;
+
+#define EVAL_NUM_TERMS  (sizeof(evalTerms_t) / sizeof(int32_t))
+
+/**
+ * The weights the evaluation runs on, tapered from the middlegame values to
+ * the endgame ones as the pieces come off
+ */
+typedef struct evalParams_s
+{
+    evalTerms_t midgame;
+    evalTerms_t endgame;
+} evalParams_t;
+
+extern evalParams_t evalParams;
+
+static inline int32_t *EvalParams_Flat(evalTerms_t *terms)
+{
+    return (int32_t *) terms;
+}
+
+static inline const int32_t *EvalParams_Flat(const evalTerms_t *terms)
+{
+    return (const int32_t *) terms;
+}
+
+std::string EvalParams_TermName(uint64_t term);
+uint64_t    EvalParams_Load(std::string path);
+uint64_t    EvalParams_Save(std::string path, const evalParams_t *params);
+
+#endif // EVAL_PARAMS_DEFINE
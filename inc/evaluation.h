@@ -0,0 +1,64 @@
+#include <cstdint>
+#include "chessboard_defs.h"
+#include "eval_params.h"
+
+#ifndef EVALUATION_DEFINE
+#define EVALUATION_DEFINE
+
+/**
+ * The evaluation of a position split into its terms, each as a middlegame and
+ * an endgame score in white's favour, for looking into why a position scores
+ * the way it does
+ */
+typedef struct evalBreakdown_s
+{
+    int32_t material[2];    // Material and piece placement
+    int32_t pawns[2];
+    int32_t mobility[2];
+    int32_t kingSafety[2];
+    int32_t phase;
+    int64_t total;
+} evalBreakdown_t;
+
+/**
+ * Settle leaves well outside the search window on material and placement
+ * alone. Set from the build with -DLAZY_EVAL=0 to measure what it is worth.
+ */
+#ifndef LAZY_EVAL
+#define LAZY_EVAL (1)
+#endif
+
+/**
+ * How far outside the window material and placement must put a leaf for the
+ * pawn, mobility and king safety terms to be skipped. This is a heuristic
+ * margin, not a bound: king safety alone reaches 400 with the most attack
+ * units, before mobility and pawns, so now and then a skipped leaf is on the
+ * wrong side of the window. Build with -DLAZY_EVAL_CHECK=1 to have the search
+ * evaluate skipped leaves in full anyway and count how often that happens.
+ */
+#define LAZY_EVAL_MARGIN    300
+
+#ifndef LAZY_EVAL_CHECK
+#define LAZY_EVAL_CHECK (0)
+#endif
+
+// Entries in each thread's evaluation cache, a power of two
+#define EVAL_CACHE_ENTRIES  (1 << 16)
+
+/**
+ * A full evaluation kept for when the position comes up again, which it often
+ * does by another order of the same moves
+ */
+typedef struct evalCacheEntry_s
+{
+    uint64_t key;           // Hash key of the position
+    int64_t value;          // Positive in white's favour
+} evalCacheEntry_t;
+
+bool Evaluation_ProbeCache(uint64_t key, int64_t *value);
+void Evaluation_StoreCache(uint64_t key, int64_t value);
+void Evaluation_ClearCache(void);
+void Evaluation_PieceActivity(const uint64_t *pieces, uint64_t occupied, int32_t *midgame, int32_t *endgame,
+                              evalBreakdown_t *breakdown, evalTerms_t *trace);
+
+#endif // EVALUATION_DEFINE
@@ -0,0 +1,14 @@
+#include <cstdint>
+
+#ifndef MICROBENCH_DEFINE
+#define MICROBENCH_DEFINE
+
+// Number of timed samples taken for each measurement, variance is across these
+#define MICROBENCH_NUM_SAMPLES  15
+
+// Times each position is run through an operation within a single sample
+#define MICROBENCH_REPETITIONS  200
+
+uint64_t Microbench_Run(void);
+
+#endif // MICROBENCH_DEFINE
@@ -0,0 +1,124 @@
+#include <cstdint>
+#include <string>
+#include "chessboard_defs.h"
+
+#ifndef NNUE_DEFINE
+#define NNUE_DEFINE
+
+/**
+ * The network is HalfKP: each side sees every piece but the kings from where
+ * its own king stands, so the first layer has an input for each king square,
+ * piece and square. Its output for each side, the accumulator, is kept up to
+ * date by every move and fed through two small quantised layers to the score.
+ */
+#define NNUE_KING_SQUARES       64
+#define NNUE_PIECE_KINDS        10      // Pawn to queen, ours and theirs
+#define NNUE_NUM_FEATURES       (NNUE_KING_SQUARES * NNUE_PIECE_KINDS * NUM_BOARD_INDICES)
+#define NNUE_HALF_DIMS          256     // Accumulator width for each side
+#define NNUE_HIDDEN_DIMS        32
+
+// Activations are clipped to [0, NNUE_ACTIVATION_MAX], and hidden layer sums
+// come down by NNUE_WEIGHT_SHIFT to land back in that range
+#define NNUE_ACTIVATION_MAX     127
+#define NNUE_WEIGHT_SHIFT       6
+
+// The network output in centipawns is its raw output over this
+#define NNUE_OUTPUT_SCALE       16
+
+// Most features a move can take away, or add: the piece moving and the one it takes
+#define NNUE_MAX_CHANGES        2
+
+// Feature index of a piece which is not an input, the kings
+#define NNUE_NO_FEATURE         0xFFFFFFFF
+
+#define NNUE_FILE_MAGIC         0x4E4E5243  // "CRNN"
+#define NNUE_FILE_VERSION       1
+
+// Every section of a network file starts on a boundary of this, so the
+// weights can be used straight from the mapping by aligned vector loads
+#define NNUE_FILE_ALIGNMENT     64
+
+/**
+ * The start of a network file. The sections follow in the order of the
+ * pointers in nnueNetwork_t, each padded to NNUE_FILE_ALIGNMENT.
+ */
+typedef struct nnueFileHeader_s
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numFeatures;
+    uint32_t halfDims;
+    uint32_t hiddenDims;
+    uint32_t reserved[11];
+} nnueFileHeader_t;
+
+/**
+ * A loaded network, every pointer into the mapping of its file
+ */
+typedef struct nnueNetwork_s
+{
+    const int16_t *featureBiases;   // [NNUE_HALF_DIMS]
+    const int16_t *featureWeights;  // [NNUE_NUM_FEATURES][NNUE_HALF_DIMS]
+    const int32_t *hidden1Biases;   // [NNUE_HIDDEN_DIMS]
+    const int8_t  *hidden1Weights;  // [NNUE_HIDDEN_DIMS][2*NNUE_HALF_DIMS]
+    const int32_t *hidden2Biases;   // [NNUE_HIDDEN_DIMS]
+    const int8_t  *hidden2Weights;  // [NNUE_HIDDEN_DIMS][NNUE_HIDDEN_DIMS]
+    const int32_t *outputBias;      // [1]
+    const int8_t  *outputWeights;   // [NNUE_HIDDEN_DIMS]
+
+    void *mapping;
+    uint64_t mappingSize;
+
+    // Bumped by every load, accumulators built for an earlier network are stale
+    uint32_t generation;
+} nnueNetwork_t;
+
+/**
+ * The first layer output for both sides, white's first. Only good for the
+ * network of the generation it was built for, 0 for never built.
+ */
+typedef struct alignas(32) nnueAccumulator_s
+{
+    int16_t values[2][NNUE_HALF_DIMS];
+    uint32_t generation;
+} nnueAccumulator_t;
+
+/**
+ * The features a move takes away and adds, as piece type and square. A king
+ * move changes the view of its own side altogether, which is rebuilt instead.
+ */
+typedef struct nnueDelta_s
+{
+    uint8_t removedPt[NNUE_MAX_CHANGES];
+    uint8_t removedIdx[NNUE_MAX_CHANGES];
+    uint8_t addedPt[NNUE_MAX_CHANGES];
+    uint8_t addedIdx[NNUE_MAX_CHANGES];
+    uint8_t numRemoved;
+    uint8_t numAdded;
+    uint8_t kingMoved;      // WHITE_PIECES or BLACK_PIECES if that king moved, 0 otherwise
+} nnueDelta_t;
+
+extern nnueNetwork_t nnueNetwork;
+
+/**
+ * @return  True if the accumulator was built for the loaded network, so it
+ *          can be updated move by move rather than being left to rebuild
+ */
+static inline bool Nnue_IsCurrent(const nnueAccumulator_t *acc)
+{
+    return acc->generation != 0 && acc->generation == nnueNetwork.generation;
+}
+
+uint32_t    Nnue_FeatureIndex(uint8_t side, uint8_t kingIdx, uint8_t pt, uint8_t idx);
+uint64_t    Nnue_Load(std::string path);
+void        Nnue_Unload(void);
+bool        Nnue_IsLoaded(void);
+uint64_t    Nnue_SelectKernels(std::string name);
+const char *Nnue_GetKernelsName(void);
+void        Nnue_RefreshAccumulator(nnueAccumulator_t *acc, const uint64_t *pieces);
+void        Nnue_UpdateAccumulator(nnueAccumulator_t *acc, const uint64_t *pieces,
+                                   const nnueDelta_t *delta, bool undo);
+bool        Nnue_VerifyAccumulator(const nnueAccumulator_t *acc, const uint64_t *pieces);
+int32_t     Nnue_Evaluate(nnueAccumulator_t *acc, const uint64_t *pieces, bool whiteToMove);
+
+#endif // NNUE_DEFINE
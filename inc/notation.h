@@ -0,0 +1,17 @@
+#include <cstdint>
+#include <cstddef>
+#include "chessboard.h"
+
+#ifndef NOTATION_DEFINE
+#define NOTATION_DEFINE
+
+// Room needed to write any move in any notation, with its terminator
+#define NOTATION_MAX_MOVE_LENGTH    12
+
+uint64_t Notation_BuildMove(ChessBoard *cb, uint8_t startIdx, uint8_t endIdx, uint8_t promotion, moveType_t *move);
+uint64_t Notation_ParseSan(ChessBoard *cb, const char *san, size_t length, moveType_t *move);
+size_t   Notation_FormatUci(const moveType_t *move, char *buffer);
+size_t   Notation_FormatLan(ChessBoard *cb, moveType_t *move, char *buffer);
+size_t   Notation_FormatSan(ChessBoard *cb, moveType_t *move, char *buffer);
+
+#endif // NOTATION_DEFINE
@@ -0,0 +1,108 @@
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <fstream>
+#include "util.h"
+#include "packed_position.h"
+
+#ifndef PACKED_FILE_DEFINE
+#define PACKED_FILE_DEFINE
+
+// "RCPK" when the file is looked at as bytes
+#define PACKED_FILE_MAGIC       0x4B504352
+#define PACKED_FILE_VERSION     1
+
+// Records a writer holds before it goes to the file, 1MB of them
+#define PACKED_WRITER_BUFFER_RECORDS    (1 << 15)
+
+/**
+ * Leads every packed file, the same size as a record so that the records
+ * after it keep their alignment. The records follow back to back until the
+ * end of the file.
+ */
+typedef struct packedFileHeader_s
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t reserved[5];
+} packedFileHeader_t;
+
+static_assert(sizeof(packedFileHeader_t) == sizeof(packedPosition_t), "The header must keep records aligned");
+
+/**
+ * Appends records to a packed file, going to the file a buffer at a time
+ */
+typedef struct packedWriter_s
+{
+    std::ofstream file;
+    std::vector<packedPosition_t> buffer;
+    uint64_t numBuffered;
+    uint64_t numRecords;            // In the file, the buffered ones included
+    bool failed;
+} packedWriter_t;
+
+/**
+ * A packed file mapped into memory. Reads walk through the records from
+ * start to end, the whole file unless a shard of it was picked, while any
+ * record can be looked at directly.
+ */
+typedef struct packedReader_s
+{
+    void *mapping;
+    size_t mappingSize;
+    const packedPosition_t *records;
+    uint64_t numRecords;
+    uint64_t start;
+    uint64_t end;
+    uint64_t pos;
+} packedReader_t;
+
+uint64_t PackedFile_OpenWriter(packedWriter_t *writer, std::string path, bool append);
+uint64_t PackedFile_Flush(packedWriter_t *writer);
+uint64_t PackedFile_CloseWriter(packedWriter_t *writer);
+
+uint64_t PackedFile_OpenReader(packedReader_t *reader, std::string path);
+void     PackedFile_CloseReader(packedReader_t *reader);
+void     PackedFile_SetShard(packedReader_t *reader, uint64_t shardIdx, uint64_t numShards);
+uint64_t PackedFile_Read(packedReader_t *reader, const packedPosition_t **records, uint64_t maxRecords);
+
+/**
+ * Adds a record to the end of the file
+ *
+ * @param writer:   The writer
+ * @param record:   The record
+ *
+ * @return  STATUS_SUCCESS, or STATUS_FAIL if writing has failed
+ */
+static inline uint64_t PackedFile_Write(packedWriter_t *writer, const packedPosition_t *record)
+{
+    writer->buffer[writer->numBuffered++] = *record;
+    writer->numRecords++;
+    return (writer->numBuffered == PACKED_WRITER_BUFFER_RECORDS) ? PackedFile_Flush(writer) 
+         : (writer->failed ? STATUS_FAIL : STATUS_SUCCESS);
+}
+
+/**
+ * Looks at any record of the file, whatever shard was picked
+ *
+ * @param reader:   The reader
+ * @param idx:      Index of the record, below reader->numRecords
+ *
+ * @return  The record, within the mapping
+ */
+static inline const packedPosition_t *PackedFile_Get(const packedReader_t *reader, uint64_t idx)
+{
+    return &reader->records[idx];
+}
+
+/**
+ * Goes back to the first record of the shard
+ */
+static inline void PackedFile_Rewind(packedReader_t *reader)
+{
+    reader->pos = reader->start;
+}
+
+#endif // PACKED_FILE_DEFINE
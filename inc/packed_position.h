@@ -0,0 +1,51 @@
+#include <cstdint>
+#include <string>
+#include "chessboard_defs.h"
+#include "chessboard.h"
+
+#ifndef PACKED_POSITION_DEFINE
+#define PACKED_POSITION_DEFINE
+
+// Most pieces a record has room for, which no legal position goes over
+#define PACKED_MAX_PIECES   32
+
+// Scores are kept within this, mate scores included
+#define PACKED_SCORE_MAX    32000
+
+// Results, from white's point of view
+#define PACKED_RESULT_BLACK_WIN     (-1)
+#define PACKED_RESULT_DRAW          0
+#define PACKED_RESULT_WHITE_WIN     1
+
+/**
+ * A position with its search score and the result of the game it came from,
+ * in 32 bytes. The occupied squares are listed by the occupancy board, and
+ * the piece type on each, in square order, by the nibbles of pieces.
+ */
+typedef struct packedPosition_s
+{
+    uint64_t occupied;
+    uint8_t pieces[PACKED_MAX_PIECES/2];    // Low nibble first
+    int16_t score;              // Centipawns, positive in white's favour
+    uint16_t ply;               // Plies into the game the position came from
+    uint8_t flags;              // Black to move in bit 0, castling rights in bits 4-7
+    uint8_t epIdx;              // EN_PASSANT_NONE if there is none
+    uint8_t halfmoveClock;
+    int8_t result;              // See PACKED_RESULT_*
+} packedPosition_t;
+
+static_assert(sizeof(packedPosition_t) == 32, "Packed positions must stay 32 bytes");
+
+#define PACKED_BLACK_TO_MOVE(r)     (((r)->flags & 0x1) != 0)
+#define PACKED_CASTLING_RIGHTS(r)   ((uint8_t) ((r)->flags >> 4))
+
+uint64_t PackedPosition_Pack(ChessBoard *cb, int32_t score, int8_t result, uint16_t ply, packedPosition_t *record);
+uint8_t  PackedPosition_GetPieces(const packedPosition_t *record, uint8_t *pts, uint8_t *idxs);
+std::string PackedPosition_ToFen(const packedPosition_t *record);
+uint64_t PackedPosition_Unpack(const packedPosition_t *record, ChessBoard *cb);
+uint64_t PackedPosition_FromFen(ChessBoard *cb, std::string fen, int32_t score, int8_t result,
+                                packedPosition_t *record);
+std::string PackedPosition_ToEpd(const packedPosition_t *record);
+uint64_t PackedPosition_FromEpd(ChessBoard *cb, std::string line, packedPosition_t *record);
+
+#endif // PACKED_POSITION_DEFINE
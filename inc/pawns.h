@@ -0,0 +1,28 @@
+#include <cstdint>
+#include "chessboard_defs.h"
+#include "eval_params.h"
+
+#ifndef PAWNS_DEFINE
+#define PAWNS_DEFINE
+
+// Entries in the pawn hash table, a power of two. Pawn structures repeat so
+// often through a search that a small table catches nearly all of them.
+#define PAWN_HASH_ENTRIES   (1 << 14)
+
+/**
+ * The pawn structure terms of a position, which depend on nothing but where
+ * the pawns are, so are worked out once for each structure and kept
+ */
+typedef struct pawnEntry_s
+{
+    uint64_t key;           // Pawn key of the structure, see ChessBoard::ComputePawnKey
+    uint64_t passed;        // Passed pawns of both colors
+    int32_t midgame;        // Positive in white's favour
+    int32_t endgame;
+} pawnEntry_t;
+
+const pawnEntry_t *Pawns_Evaluate(uint64_t pawnKey, uint64_t whitePawns, uint64_t blackPawns);
+void               Pawns_Clear(void);
+void               Pawns_Trace(uint64_t whitePawns, uint64_t blackPawns, evalTerms_t *trace);
+
+#endif // PAWNS_DEFINE
@@ -0,0 +1,39 @@
+#include <cstdint>
+#include <ostream>
+
+#ifndef PERF_COUNTERS_DEFINE
+#define PERF_COUNTERS_DEFINE
+
+/**
+ * The hardware events counted while profiling
+ */
+typedef enum
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_REFERENCES,
+    PERF_CACHE_MISSES,
+    PERF_BRANCHES,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_READ_MISSES,
+    NUM_PERF_COUNTERS
+} perfCounter_e;
+
+/**
+ * A set of counters opened on the calling thread. Any counter the kernel or
+ * container refuses is left closed and reported as unavailable, rather than
+ * failing the whole set.
+ */
+typedef struct perfCounters_s
+{
+    int fds[NUM_PERF_COUNTERS];         // -1 where the counter could not be opened
+    uint64_t values[NUM_PERF_COUNTERS]; // Counts scaled up for any time spent multiplexed out
+} perfCounters_t;
+
+uint64_t PerfCounters_Open(perfCounters_t *counters);
+void     PerfCounters_Start(perfCounters_t *counters);
+void     PerfCounters_Stop(perfCounters_t *counters);
+void     PerfCounters_Close(perfCounters_t *counters);
+void     PerfCounters_Print(perfCounters_t *counters, uint64_t nodes, std::ostream &out);
+
+#endif // PERF_COUNTERS_DEFINE
@@ -0,0 +1,68 @@
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include "chessboard.h"
+
+#ifndef PGN_DEFINE
+#define PGN_DEFINE
+
+// Longest game, in plies, a reader will hold on to
+#define PGN_MAX_MOVES   MAX_GAME_PLY
+
+// Read every move of a game rather than only the opening
+#define PGN_ALL_MOVES   PGN_MAX_MOVES
+
+/**
+ * How a game finished, as given by its Result tag or termination marker
+ */
+typedef enum
+{
+    PGN_RESULT_UNKNOWN,
+    PGN_RESULT_WHITE_WIN,
+    PGN_RESULT_BLACK_WIN,
+    PGN_RESULT_DRAW,
+} pgnResult_e;
+
+/**
+ * A move as kept in a game, packed into 16 bits: start square in bits 0-5,
+ * end square in bits 6-11 and the white piece type promoted to in bits 12-14
+ */
+typedef uint16_t pgnMove_t;
+
+#define PGN_MOVE_START(m)       ((m) & 0x3F)
+#define PGN_MOVE_END(m)         (((m) >> 6) & 0x3F)
+#define PGN_MOVE_PROMOTION(m)   (((m) >> 12) & 0x7)
+#define PGN_MOVE(s, e, p)       ((pgnMove_t) ((s) | ((e) << 6) | ((p) << 12)))
+
+/**
+ * A single game read from a PGN file. Only the main line is kept, comments
+ * and variations are dropped. The game is reused from one read to the next,
+ * so reading a game allocates nothing.
+ */
+typedef struct pgnGame_s
+{
+    pgnResult_e result;
+    const char *fen;                // Starting position within the file, NULL for the standard one
+    size_t fenLength;
+    bool truncated;                 // A move could not be played, the moves stop before it
+    uint64_t numMoves;
+    pgnMove_t moves[PGN_MAX_MOVES]; // Main line moves, as played from the start position
+} pgnGame_t;
+
+/**
+ * A PGN file mapped into memory, along with how far through it we are
+ */
+typedef struct pgnReader_s
+{
+    const char *data;
+    size_t size;
+    size_t pos;
+} pgnReader_t;
+
+uint64_t Pgn_Open(pgnReader_t *reader, std::string path);
+void     Pgn_Close(pgnReader_t *reader);
+uint64_t Pgn_ReadGame(pgnReader_t *reader, ChessBoard *cb, uint64_t maxPly, pgnGame_t *game);
+uint64_t Pgn_SetStartPosition(ChessBoard *cb, pgnGame_t *game);
+uint64_t Pgn_DecodeMove(ChessBoard *cb, pgnMove_t packed, moveType_t *move);
+
+#endif // PGN_DEFINE
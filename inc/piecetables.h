@@ -0,0 +1,34 @@
+#include <cstdint>
+#include "chessboard_defs.h"
+#include "eval_params.h"
+
+#ifndef PIECETABLES_DEFINE
+#define PIECETABLES_DEFINE
+
+// Game phase each piece is worth, the phase runs from PHASE_MAX with every
+// piece on the board down to 0 with only kings and pawns left
+#define PHASE_KNIGHT    1
+#define PHASE_BISHOP    1
+#define PHASE_ROOK      2
+#define PHASE_QUEEN     4
+#define PHASE_MAX       (4*PHASE_KNIGHT + 4*PHASE_BISHOP + 4*PHASE_ROOK + 2*PHASE_QUEEN)
+
+/**
+ * What each piece is worth on each square, material included, once for the
+ * middlegame and once for the endgame, built from the evaluation weights. Black pieces hold negative values, so
+ * a move only ever adds and subtracts entries. The phase each piece is worth
+ * is kept alongside so it can be updated the same way.
+ */
+typedef struct pieceSquareTables_s
+{
+    int32_t midgame[NUM_PIECE_TYPES][NUM_BOARD_INDICES];
+    int32_t endgame[NUM_PIECE_TYPES][NUM_BOARD_INDICES];
+    int32_t phase[NUM_PIECE_TYPES];
+} pieceSquareTables_t;
+
+extern pieceSquareTables_t pieceSquareTables;
+
+void PieceTables_Rebuild(void);
+void PieceTables_Trace(const uint64_t *pieces, evalTerms_t *trace);
+
+#endif // PIECETABLES_DEFINE
@@ -0,0 +1,52 @@
+#include <cstdint>
+#include <string>
+#include "chessboard.h"
+
+#ifndef POLYGLOT_BOOK_DEFINE
+#define POLYGLOT_BOOK_DEFINE
+
+// Book and key table the interactive game looks for in the working directory
+#define POLYGLOT_DEFAULT_BOOK_PATH      "book.bin"
+#define POLYGLOT_DEFAULT_RANDOMS_PATH   "polyglot_random64.txt"
+
+/**
+ * Polyglot keys are built from a fixed table of 781 random numbers: 768 for
+ * the pieces, 4 for castling rights, 8 for en passant files and 1 for white
+ * to move. The standard start position hashes to POLYGLOT_START_KEY, which is
+ * how a loaded table is checked.
+ */
+#define POLYGLOT_NUM_RANDOMS        781
+#define POLYGLOT_RANDOM_CASTLE      768
+#define POLYGLOT_RANDOM_EN_PASSANT  772
+#define POLYGLOT_RANDOM_TURN        780
+#define POLYGLOT_START_KEY          0x463b96181691fc9cULL
+
+/**
+ * How a move is picked when the book has several for the position
+ */
+typedef enum
+{
+    BOOK_SELECT_WEIGHTED,   // At random, in proportion to the weights
+    BOOK_SELECT_BEST,       // Always the highest weight
+} bookSelect_e;
+
+/**
+ * A single book entry as stored on disk. Every field is big endian.
+ */
+typedef struct polyglotEntry_s
+{
+    uint64_t key;
+    uint16_t move;
+    uint16_t weight;
+    uint32_t learn;
+} polyglotEntry_t;
+
+uint64_t PolyglotBook_LoadRandoms(std::string path);
+uint64_t PolyglotBook_ComputeKey(ChessBoard *cb);
+uint64_t PolyglotBook_Open(std::string path);
+void     PolyglotBook_Close(void);
+bool     PolyglotBook_IsOpen(void);
+uint16_t PolyglotBook_EncodeMove(moveType_t *move);
+uint64_t PolyglotBook_Probe(ChessBoard *cb, bookSelect_e selection, moveType_t *bookMove);
+
+#endif // POLYGLOT_BOOK_DEFINE
@@ -0,0 +1,56 @@
+#include <cstdint>
+#include <ostream>
+
+#ifndef SEARCH_STATS_DEFINE
+#define SEARCH_STATS_DEFINE
+
+// Deepest ply we keep per depth counters for
+#define STATS_MAX_PLY 128
+
+/**
+ * The ways in which the search can cut a line short, counted separately
+ */
+typedef enum
+{
+    PRUNE_KING_CAPTURED,    // Line ended because a king was taken
+    PRUNE_DRAW,             // Line ended by repetition or the fifty move rule
+    PRUNE_SEE_QSEARCH,      // Capture skipped by quiescence for losing material
+    PRUNE_SEE,              // Capture skipped near the leaves for losing material
+    NUM_PRUNE_TYPES
+} pruneType_e;
+
+/**
+ * Statistics gathered by a search. Each thread searching keeps its own block,
+ * so nothing here needs to be atomic.
+ */
+typedef struct searchStats_s
+{
+    uint64_t nodes;             // Moves made by the main search
+    uint64_t qnodes;            // Moves made by the quiescence search
+    uint64_t betaCutoffs;       // Moves which failed high
+    uint64_t firstMoveCutoffs;  // Fail highs on the first move searched
+    uint64_t ttProbes;          // Transposition table lookups
+    uint64_t ttHits;            // Transposition table lookups which found the position
+    uint64_t pawnProbes;        // Pawn hash table lookups
+    uint64_t pawnHits;          // Pawn hash table lookups which found the structure
+    uint64_t evalProbes;        // Evaluation cache lookups, one for every leaf evaluated
+    uint64_t evalHits;          // Evaluation cache lookups which found the position
+    uint64_t lazySkips;         // Leaves settled by material alone, missing the cache
+    uint64_t lazyMisses;        // Of those, the ones the full evaluation puts back across the bound, see LAZY_EVAL_CHECK
+    uint64_t selDepth;          // Deepest ply reached
+    uint64_t pruned[NUM_PRUNE_TYPES];
+
+    uint64_t nodesAtPly[STATS_MAX_PLY];    // Moves made at each ply from the root
+
+    uint64_t depth;                         // Last completed iteration
+    uint64_t iterationNodes[STATS_MAX_PLY]; // Moves made by each completed iteration
+} searchStats_t;
+
+searchStats_t  *SearchStats_Get(void);
+void            SearchStats_Reset(void);
+void            SearchStats_CompleteIteration(uint64_t depth);
+double          SearchStats_GetBranchingFactor(void);
+void            SearchStats_PrintUciInfo(std::ostream &out, int32_t score, uint64_t elapsedMs, const char *pv);
+void            SearchStats_PrintJson(std::ostream &out);
+
+#endif // SEARCH_STATS_DEFINE
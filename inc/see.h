@@ -0,0 +1,18 @@
+#include <cstdint>
+#include "chessboard.h"
+
+#ifndef SEE_DEFINE
+#define SEE_DEFINE
+
+// Piece values the exchange is counted in, by white piece type
+#define SEE_PAWN_VALUE      100
+#define SEE_ROOK_VALUE      500
+#define SEE_BISHOP_VALUE    330
+#define SEE_KNIGHT_VALUE    320
+#define SEE_QUEEN_VALUE     900
+#define SEE_KING_VALUE      20000
+
+int32_t See_Evaluate(ChessBoard *cb, const moveType_t *move);
+int32_t See_PieceValue(uint8_t pt);
+
+#endif // SEE_DEFINE
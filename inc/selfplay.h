@@ -0,0 +1,35 @@
+#include <cstdint>
+#include <string>
+
+#ifndef SELFPLAY_DEFINE
+#define SELFPLAY_DEFINE
+
+// Positions a run stops at unless told otherwise
+#define SELFPLAY_DEFAULT_POSITIONS      1000000
+
+// Nodes searched for each move, quiescence included
+#define SELFPLAY_DEFAULT_NODES          5000
+
+// Random moves opening each game, so no two games are alike
+#define SELFPLAY_DEFAULT_RANDOM_PLIES   8
+
+// Transposition table of each game being played
+#define SELFPLAY_DEFAULT_HASH_MB        16
+
+/**
+ * How self-play data should be generated
+ */
+typedef struct selfPlayConfig_s
+{
+    uint64_t numPositions;  // Positions the output should hold, those of earlier runs included
+    uint64_t numThreads;    // Games played at once, 0 for one per core
+    uint64_t nodesPerMove;  // Nodes each move is searched for
+    uint64_t randomPlies;   // Random moves opening each game, one more in half of them
+    uint64_t hashMb;        // Transposition table of each thread
+    uint64_t seed;
+} selfPlayConfig_t;
+
+void     SelfPlay_DefaultConfig(selfPlayConfig_t *config);
+uint64_t SelfPlay_Generate(std::string outPath, selfPlayConfig_t *config);
+
+#endif // SELFPLAY_DEFINE
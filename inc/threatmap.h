@@ -31,6 +31,7 @@ typedef std::list<threatMapEntry_t*> threatMapIndexList_t;
 
 void        ThreatMap_RevertState(void);
 void        ThreatMap_WipeMap(void);
+void        ThreatMap_Clear(void);
 void        ThreatMap_Generate(uint64_t *pieces, uint64_t occupied);
 void        ThreatMap_Update(moveType_t *moveApplied, uint64_t *pieces, uint64_t occupied, bool realMove);
 void        ThreatMap_RemoveThreatFromMap(uint8_t pt, uint8_t threatIdx, uint8_t mapIdx);
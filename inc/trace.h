@@ -0,0 +1,125 @@
+#include <cstdint>
+#include <string>
+#include <ostream>
+
+#ifndef TRACE_DEFINE
+#define TRACE_DEFINE
+
+/**
+ * Hot path tracing, set from the build with -DENABLE_TRACE=1. When off the
+ * trace points compile away to nothing, so release builds pay no cost at all.
+ */
+#ifndef ENABLE_TRACE
+#define ENABLE_TRACE (0)
+#endif
+
+// Records kept per thread, must be a power of two. The oldest are overwritten.
+#define TRACE_RING_SIZE     (1 << 16)
+
+// Most threads which can trace at once
+#define TRACE_MAX_THREADS   64
+
+/**
+ * The phases of a search node which can be traced
+ */
+typedef enum
+{
+    TRACE_SEARCH,               // One call of the search recursion
+    TRACE_GENERATE_MOVES,
+    TRACE_THREATMAP_UPDATE,
+    TRACE_EVALUATE,
+    TRACE_EVAL_PAWNS,           // Pawn structure, within the evaluation
+    TRACE_EVAL_ACTIVITY,        // Mobility and king safety, within the evaluation
+    TRACE_APPLY_MOVE,
+    NUM_TRACE_EVENTS
+} traceEvent_e;
+
+/**
+ * A single completed trace point, timed in TSC ticks
+ */
+typedef struct traceRecord_s
+{
+    uint64_t startTsc;
+    uint32_t durationTsc;
+    uint8_t  event;
+} traceRecord_t;
+
+/**
+ * The records of a single thread. Only the owning thread writes to its ring,
+ * so recording needs no locks or atomics. Totals are kept separately so the
+ * per phase timing covers every trace point, not only those still in the ring.
+ */
+typedef struct traceRing_s
+{
+    uint64_t threadId;
+    uint64_t head;  // Number of records ever written
+    uint64_t totalTsc[NUM_TRACE_EVENTS];
+    uint64_t totalCount[NUM_TRACE_EVENTS];
+    traceRecord_t records[TRACE_RING_SIZE];
+} traceRing_t;
+
+traceRing_t    *Trace_GetRing(void);
+void            Trace_Reset(void);
+uint64_t        Trace_DumpChromeJson(std::string path);
+void            Trace_PrintSummary(std::ostream &out);
+
+#if ENABLE_TRACE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t Trace_ReadTsc(void)
+{
+    return __rdtsc();
+}
+#else
+#include <chrono>
+static inline uint64_t Trace_ReadTsc(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+/**
+ * Times the scope it is declared in, recording it when the scope is left
+ */
+class TraceScope
+{
+    public:
+        explicit TraceScope(traceEvent_e event)
+        {
+            this->event = event;
+            this->startTsc = Trace_ReadTsc();
+        }
+
+        ~TraceScope()
+        {
+            traceRing_t *ring = Trace_GetRing();
+            uint64_t durationTsc = Trace_ReadTsc() - this->startTsc;
+            traceRecord_t *record = &ring->records[ring->head & (TRACE_RING_SIZE - 1)];
+
+            record->startTsc = this->startTsc;
+            record->durationTsc = (uint32_t) durationTsc;
+            record->event = this->event;
+            ring->head++;
+
+            ring->totalTsc[this->event] += durationTsc;
+            ring->totalCount[this->event]++;
+        }
+
+    private:
+        traceEvent_e event;
+        uint64_t startTsc;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(event) TraceScope TRACE_CONCAT(traceScope, __LINE__)(event)
+
+#else
+
+#define TRACE_SCOPE(event) do { } while(0)
+
+#endif // ENABLE_TRACE
+
+#endif // TRACE_DEFINE
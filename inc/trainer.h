@@ -0,0 +1,35 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef TRAINER_DEFINE
+#define TRAINER_DEFINE
+
+#define TRAINER_DEFAULT_EPOCHS          10
+#define TRAINER_DEFAULT_BATCH_SIZE      16384
+#define TRAINER_DEFAULT_LEARNING_RATE   0.001
+
+// Share of the target taken from the search score, the rest from the game result
+#define TRAINER_DEFAULT_LAMBDA          0.75
+
+// Centipawns over which scores are squashed into win probabilities
+#define TRAINER_DEFAULT_SCORE_SCALE     400.0
+
+/**
+ * How a network should be trained
+ */
+typedef struct trainerConfig_s
+{
+    uint64_t epochs;        // Passes over the data
+    uint64_t batchSize;     // Positions per step of the optimiser
+    uint64_t numThreads;    // Threads working on each batch, 0 for one per core
+    double learningRate;
+    double lambda;          // See TRAINER_DEFAULT_LAMBDA
+    double scoreScale;      // See TRAINER_DEFAULT_SCORE_SCALE
+    uint64_t seed;          // Seeds the starting weights
+} trainerConfig_t;
+
+void     Trainer_DefaultConfig(trainerConfig_t *config);
+uint64_t Trainer_Train(std::vector<std::string> dataPaths, std::string outPath, trainerConfig_t *config);
+
+#endif // TRAINER_DEFINE
@@ -0,0 +1,85 @@
+#include <cstdint>
+#include <string>
+
+#ifndef TRANSPOSITION_DEFINE
+#define TRANSPOSITION_DEFINE
+
+// Size of the table unless told otherwise
+#define TT_DEFAULT_SIZE_MB      64
+
+// Entries sharing a bucket, a bucket fills a single cache line
+#define TT_BUCKET_ENTRIES       4
+
+// Huge pages come in 2MB, the table is sized and aligned to whole ones
+#define TT_HUGE_PAGE_SIZE       (2 << 20)
+
+/**
+ * Prefetch the bucket of each position as soon as the move to it is made, so
+ * the probe finds it in cache. Set from the build with -DTT_PREFETCH=0 to
+ * measure what it is worth.
+ */
+#ifndef TT_PREFETCH
+#define TT_PREFETCH (1)
+#endif
+
+// Generations are kept in 6 bits and wrap around
+#define TT_GENERATION_MASK      0x3F
+
+/**
+ * What a stored score says about the true score of the position
+ */
+typedef enum
+{
+    TT_BOUND_NONE,
+    TT_BOUND_UPPER,     // The search failed low, the score is at most this
+    TT_BOUND_LOWER,     // The search failed high, the score is at least this
+    TT_BOUND_EXACT,
+} ttBound_e;
+
+/**
+ * The pages backing the table. Probes land all over the table, so with small
+ * pages nearly every one misses the TLB, each huge page covers 512 times as much.
+ */
+typedef enum
+{
+    TT_PAGES_SMALL,         // Ordinary 4KB pages
+    TT_PAGES_TRANSPARENT,   // Transparent huge pages, granted by the kernel where it can
+    TT_PAGES_HUGETLB,       // Huge pages reserved up front through hugetlbfs
+} ttPageMode_e;
+
+/**
+ * A single search result. The move is packed as start square in bits 0-5,
+ * end square in bits 6-11 and promotion in bits 12-14, 0 for no move.
+ */
+typedef struct ttEntry_s
+{
+    uint64_t key;
+    int32_t score;
+    uint16_t move;
+    uint8_t depth;
+    uint8_t boundAndGeneration; // Bound in the low 2 bits, the search it came from above
+} ttEntry_t;
+
+#define TT_ENTRY_BOUND(e)   ((ttBound_e) ((e)->boundAndGeneration & 0x3))
+
+typedef struct alignas(64) ttBucket_s
+{
+    ttEntry_t entries[TT_BUCKET_ENTRIES];
+} ttBucket_t;
+
+void     TT_SetHugePages(bool enabled);
+ttPageMode_e TT_GetPageMode(void);
+const char *TT_GetPageModeName(void);
+uint64_t TT_Resize(uint64_t sizeMb);
+void     TT_Free(void);
+void     TT_Clear(void);
+void     TT_NewSearch(void);
+void     TT_Prefetch(uint64_t key);
+bool     TT_Probe(uint64_t key, uint8_t depth, ttEntry_t *entry);
+void     TT_Store(uint64_t key, uint8_t depth, int32_t score, ttBound_e bound, uint16_t move);
+uint64_t TT_GetSizeMb(void);
+uint64_t TT_Hashfull(void);
+uint64_t TT_Save(std::string path);
+uint64_t TT_Load(std::string path);
+
+#endif // TRANSPOSITION_DEFINE
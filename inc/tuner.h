@@ -0,0 +1,36 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef TUNER_DEFINE
+#define TUNER_DEFINE
+
+#define TUNER_DEFAULT_ITERATIONS        1000
+
+// Adam step size, in centipawns
+#define TUNER_DEFAULT_LEARNING_RATE     1.0
+
+// Range searched for the centipawns the win probability sigmoid is stretched
+// over, when the scale is fitted to the data rather than given
+#define TUNER_SCALE_MIN                 50.0
+#define TUNER_SCALE_MAX                 1000.0
+
+// Iterations between reports of the error
+#define TUNER_REPORT_INTERVAL           50
+
+/**
+ * How the evaluation weights should be tuned
+ */
+typedef struct tunerConfig_s
+{
+    uint64_t iterations;    // Gradient steps over the whole position set
+    uint64_t numThreads;    // Threads the positions are split between, 0 for one per core
+    uint64_t maxPositions;  // Records read from the data, 0 for all of them
+    double learningRate;    // See TUNER_DEFAULT_LEARNING_RATE
+    double scale;           // Centipawns per unit of the sigmoid, 0 to fit it to the data
+} tunerConfig_t;
+
+void     Tuner_DefaultConfig(tunerConfig_t *config);
+uint64_t Tuner_Tune(std::vector<std::string> dataPaths, std::string outPath, tunerConfig_t *config);
+
+#endif // TUNER_DEFINE
@@ -5,8 +5,27 @@
 #ifndef UTIL_DEFINE
 #define UTIL_DEFINE
 
-// @todo: Move this to build flag eventually
+// Set from the build, ie. -DDEBUG_BUILD=0 for release
+#ifndef DEBUG_BUILD
 #define DEBUG_BUILD (1)
+#endif
+
+/**
+ * How much runtime validation is compiled in, set from the build with
+ * -DVALIDATION_LEVEL=<level>. Debug builds default to the cheap checks and
+ * release builds to none at all.
+ */
+#define VALIDATION_OFF      (0) // Nothing is checked, no code is generated
+#define VALIDATION_CHEAP    (1) // Constant time argument and state checks
+#define VALIDATION_PARANOID (2) // Also full board verification on every move
+
+#ifndef VALIDATION_LEVEL
+#if DEBUG_BUILD
+#define VALIDATION_LEVEL VALIDATION_CHEAP
+#else
+#define VALIDATION_LEVEL VALIDATION_OFF
+#endif
+#endif
 
 #define STATUS_SUCCESS  (0)
 #define STATUS_FAIL     (1)
@@ -15,6 +34,24 @@ char Util_ConvertPieceTypeToChar(uint8_t pt);
 std::string Util_ConvertPieceTypeToString(uint8_t pt);
 void Util_Reverse64BitInteger(uint64_t *toReverse);
 void Util_AssignFriendAndFoe(uint8_t pt, uint8_t *friendlyPieces, uint8_t *enemyPieces);
-void Util_Assert(bool expr, std::string str);
+void Util_AssertFailed(const char *str, const char *file, int line);
+
+/**
+ * Assertions are macros so the message is only ever built once a check has
+ * failed, and so disabled levels leave nothing behind. The expression is still
+ * type checked when disabled, but never evaluated.
+ */
+#if VALIDATION_LEVEL >= VALIDATION_CHEAP
+#define Util_Assert(expr, str) \
+    do { if(__builtin_expect(!(expr), 0)) { Util_AssertFailed((str), __FILE__, __LINE__); } } while(0)
+#else
+#define Util_Assert(expr, str) do { (void) sizeof(expr); } while(0)
+#endif
+
+#if VALIDATION_LEVEL >= VALIDATION_PARANOID
+#define Util_AssertParanoid(expr, str) Util_Assert(expr, str)
+#else
+#define Util_AssertParanoid(expr, str) do { (void) sizeof(expr); } while(0)
+#endif
 
 #endif // UTIL_DEFINE
\ No newline at end of file
@@ -0,0 +1,23 @@
+#include <cstdint>
+#include "chessboard_defs.h"
+
+#ifndef ZOBRIST_DEFINE
+#define ZOBRIST_DEFINE
+
+/**
+ * The random numbers position keys are built from. A key is the XOR of the
+ * number for each piece on its square, the number for the castling rights,
+ * the number for the en passant file if there is one, and the side number
+ * when black is to move. Keys are updated move by move rather than rebuilt.
+ */
+typedef struct zobristKeys_s
+{
+    uint64_t pieces[NUM_PIECE_TYPES][NUM_BOARD_INDICES];
+    uint64_t castling[16];      // Indexed by the full set of CASTLE_* rights
+    uint64_t enPassantFile[8];
+    uint64_t blackToMove;
+} zobristKeys_t;
+
+extern const zobristKeys_t zobristKeys;
+
+#endif // ZOBRIST_DEFINE
@@ -0,0 +1,194 @@
+/* This file is responsible for working out which squares pieces attack */
+
+#include "util.h"
+#include "chessboard_defs.h"
+#include "attacks.h"
+
+#define FILE_A_MASK 0x0101010101010101ULL
+#define FILE_H_MASK 0x8080808080808080ULL
+
+/**
+ * The directions a piece can slide in. Those which step up the board come
+ * first, along them the nearest piece is the lowest set bit.
+ */
+typedef enum
+{
+    RAY_NORTH,
+    RAY_EAST,
+    RAY_NORTH_EAST,
+    RAY_NORTH_WEST,
+    RAY_SOUTH,
+    RAY_WEST,
+    RAY_SOUTH_WEST,
+    RAY_SOUTH_EAST,
+    NUM_RAYS
+} rayDirection_e;
+
+#define RAY_NUM_ASCENDING   RAY_SOUTH
+
+static const int8_t rayFileSteps[NUM_RAYS] = { 0, 1, 1, -1, 0, -1, -1, 1 };
+static const int8_t rayRankSteps[NUM_RAYS] = { 1, 0, 1, 1, -1, 0, -1, -1 };
+
+/**
+ * Attacks of the pieces which do not slide never change, so they are worked
+ * out once up front. So are the rays of the sliding pieces across an empty
+ * board, which only need cutting short at the first piece in the way.
+ */
+typedef struct attackTables_s
+{
+    uint64_t whitePawn[NUM_BOARD_INDICES];
+    uint64_t blackPawn[NUM_BOARD_INDICES];
+    uint64_t knight[NUM_BOARD_INDICES];
+    uint64_t king[NUM_BOARD_INDICES];
+    uint64_t rays[NUM_RAYS][NUM_BOARD_INDICES];
+} attackTables_t;
+
+static attackTables_t Attacks_BuildTables(void)
+{
+    attackTables_t tables;
+    uint64_t sq, notA, notH, notAB, notGH;
+    int8_t file, rank;
+
+    for(uint8_t idx = 0; idx < NUM_BOARD_INDICES; ++idx)
+    {
+        sq = (uint64_t) 1 << idx;
+        notA = sq & ~FILE_A_MASK;
+        notH = sq & ~FILE_H_MASK;
+        notAB = notA & ~(FILE_A_MASK << 1);
+        notGH = notH & ~(FILE_H_MASK >> 1);
+
+        tables.whitePawn[idx] = (notA << 7) | (notH << 9);
+        tables.blackPawn[idx] = (notH >> 7) | (notA >> 9);
+
+        tables.knight[idx] = (notH << 17) | (notA << 15) | (notGH << 10) | (notAB << 6)
+                           | (notA >> 17) | (notH >> 15) | (notAB >> 10) | (notGH >> 6);
+
+        tables.king[idx] = (sq << 8) | (sq >> 8) | (notH << 1) | (notA >> 1)
+                         | (notH << 9) | (notA << 7) | (notH >> 7) | (notA >> 9);
+
+        for(uint8_t dir = 0; dir < NUM_RAYS; ++dir)
+        {
+            tables.rays[dir][idx] = 0;
+            file = idx % 8 + rayFileSteps[dir];
+            rank = idx / 8 + rayRankSteps[dir];
+            while(file >= 0 && file < 8 && rank >= 0 && rank < 8)
+            {
+                tables.rays[dir][idx] |= (uint64_t) 1 << (rank*8 + file);
+                file += rayFileSteps[dir];
+                rank += rayRankSteps[dir];
+            }
+        }
+    }
+    return tables;
+}
+
+static const attackTables_t attackTables = Attacks_BuildTables();
+
+/**
+ * Follows a ray from a square until it leaves the board or hits a piece,
+ * which is included since it can be taken. Everything on the ray beyond the
+ * nearest piece is the ray from that piece, so it is simply cut away.
+ *
+ * @param idx:          The square the ray starts from, which is not included
+ * @param dir:          The direction of the ray
+ * @param occupied:     Every piece on the board
+ */
+static inline uint64_t Attacks_Ray(uint8_t idx, uint8_t dir, uint64_t occupied)
+{
+    uint64_t ray = attackTables.rays[dir][idx], blockers = ray & occupied;
+
+    if(blockers != 0)
+    {
+        ray ^= attackTables.rays[dir][(dir < RAY_NUM_ASCENDING) ? __builtin_ctzll(blockers)
+                                                                 : 63 - __builtin_clzll(blockers)];
+    }
+    return ray;
+}
+
+/**
+ * @param white:    True for a white pawn, which attacks up the board
+ *
+ * @return  The squares a pawn on idx attacks
+ */
+uint64_t Attacks_Pawn(uint8_t idx, bool white)
+{
+    return white ? attackTables.whitePawn[idx] : attackTables.blackPawn[idx];
+}
+
+uint64_t Attacks_Knight(uint8_t idx)
+{
+    return attackTables.knight[idx];
+}
+
+uint64_t Attacks_King(uint8_t idx)
+{
+    return attackTables.king[idx];
+}
+
+uint64_t Attacks_Bishop(uint8_t idx, uint64_t occupied)
+{
+    return Attacks_Ray(idx, RAY_NORTH_EAST, occupied) | Attacks_Ray(idx, RAY_NORTH_WEST, occupied)
+         | Attacks_Ray(idx, RAY_SOUTH_EAST, occupied) | Attacks_Ray(idx, RAY_SOUTH_WEST, occupied);
+}
+
+uint64_t Attacks_Rook(uint8_t idx, uint64_t occupied)
+{
+    return Attacks_Ray(idx, RAY_EAST, occupied) | Attacks_Ray(idx, RAY_WEST, occupied)
+         | Attacks_Ray(idx, RAY_NORTH, occupied) | Attacks_Ray(idx, RAY_SOUTH, occupied);
+}
+
+uint64_t Attacks_Queen(uint8_t idx, uint64_t occupied)
+{
+    return Attacks_Bishop(idx, occupied) | Attacks_Rook(idx, occupied);
+}
+
+/**
+ * Finds every piece of either color attacking a square
+ *
+ * @param pieces:       The piece boards of the position
+ * @param occupied:     Every piece on the board, pieces removed from here are
+ *                      seen through, which lets x-rays be followed
+ * @param idx:          The square attacked
+ *
+ * @return  The squares of all the attackers
+ */
+uint64_t Attacks_AttackersTo(const uint64_t *pieces, uint64_t occupied, uint8_t idx)
+{
+    uint64_t diagonal = pieces[WHITE_BISHOP] | pieces[BLACK_BISHOP] | pieces[WHITE_QUEEN] | pieces[BLACK_QUEEN];
+    uint64_t straight = pieces[WHITE_ROOK] | pieces[BLACK_ROOK] | pieces[WHITE_QUEEN] | pieces[BLACK_QUEEN];
+
+    Util_Assert(idx < NUM_BOARD_INDICES, "Bad square given to Attacks_AttackersTo");
+
+    // A white pawn attacks this square from wherever a black pawn here would attack
+    return ((Attacks_Pawn(idx, false) & pieces[WHITE_PAWN])
+          | (Attacks_Pawn(idx, true) & pieces[BLACK_PAWN])
+          | (Attacks_Knight(idx) & (pieces[WHITE_KNIGHT] | pieces[BLACK_KNIGHT]))
+          | (Attacks_King(idx) & (pieces[WHITE_KING] | pieces[BLACK_KING]))
+          | (Attacks_Bishop(idx, occupied) & diagonal)
+          | (Attacks_Rook(idx, occupied) & straight)) & occupied;
+}
+
+/**
+ * @param byWhite:  True to look for white attackers, false for black
+ *
+ * @return  True if any piece of the given color attacks the square
+ */
+bool Attacks_IsSquareAttacked(const uint64_t *pieces, uint64_t occupied, uint8_t idx, bool byWhite)
+{
+    uint8_t base = byWhite ? WHITE_PAWN : BLACK_PAWN;
+
+    Util_Assert(idx < NUM_BOARD_INDICES, "Bad square given to Attacks_IsSquareAttacked");
+
+    if((Attacks_Pawn(idx, !byWhite) & pieces[base + WHITE_PAWN])
+        || (Attacks_Knight(idx) & pieces[base + WHITE_KNIGHT])
+        || (Attacks_King(idx) & pieces[base + WHITE_KING]))
+    {
+        return true;
+    }
+
+    if(Attacks_Bishop(idx, occupied) & (pieces[base + WHITE_BISHOP] | pieces[base + WHITE_QUEEN]))
+    {
+        return true;
+    }
+    return (Attacks_Rook(idx, occupied) & (pieces[base + WHITE_ROOK] | pieces[base + WHITE_QUEEN])) != 0;
+}
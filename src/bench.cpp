@@ -0,0 +1,262 @@
+/* This file is responsible for the fixed benchmark used to track search speed */
+
+#include <iostream>
+#include <chrono>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "chessboard.h"
+#include "threatmap.h"
+#include "search_stats.h"
+#include "perf_counters.h"
+#include "transposition.h"
+#include "bench.h"
+
+/**
+ * The positions searched by the benchmark. Changing this list (or anything
+ * the search does) changes the node count signature, so only ever append to
+ * it alongside a note of the new signature.
+ */
+static const char *benchPositions[] =
+{
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+    "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+    "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+    "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+    "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+    "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16",
+    "4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17",
+    "2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11",
+    "r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16",
+    "3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22",
+    "r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - - 2 18",
+    "4k2r/1pb2ppp/1p2p3/1R1p4/3P4/2r1PN2/P4PPP/1R4K1 b - - 3 22",
+    "3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - - 4 26",
+    "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+    "3b4/5kp1/1p1p1p1p/pP1PpP1P/P1P1P3/3KN3/8/8 w - - 0 1",
+    "2K5/p7/7P/5pR1/8/5k2/r7/8 w - - 0 1",
+    "8/6pk/1p6/8/PP3p1p/5P2/4KP1q/3Q4 w - - 0 1",
+    "7k/3p2pp/4q3/8/4Q3/5Kp1/P6b/8 w - - 0 1",
+    "8/2p5/8/2kPKp1p/2p4P/2P5/3P4/8 w - - 0 1",
+    "8/1p3pp1/7p/5P1P/2k3P1/8/2K2P2/8 w - - 0 1",
+    "8/pp2r1k1/2p1p3/3pP2p/1P1P1P1P/P5KR/8/8 w - - 0 1",
+    "8/3p4/p1bk3p/Pp6/1Kp1PpPp/2P2P1P/2P5/5B2 b - - 0 1",
+    "5k2/7R/4P2p/5K2/p1r2P1p/8/8/8 b - - 0 1",
+    "6k1/6p1/P6p/r1N5/5p2/7P/1b3PP1/4R1K1 w - - 0 1",
+    "1r3k2/4q3/2Pp3b/3Bp3/2Q2p2/1p1P2P1/1P2KP2/3N4 w - - 0 1",
+    "6k1/4pp1p/3p2p1/P1pPb3/R7/1r2P1PP/3B1P2/6K1 w - - 0 1",
+    "8/3p3B/5p2/5P2/p7/PP5b/k7/6K1 w - - 0 1",
+    "5rk1/q6p/2p3bR/1pPp1rP1/1P1Pp3/P3B1Q1/1K3P2/R7 w - - 93 90",
+    "4rrk1/1p1nq3/p7/2p1P1pp/3P2bp/3Q1Bn1/PPPB4/1K2R1NR w - - 40 21",
+    "r3k2r/3nnpbp/q2pp1p1/p7/Pp1PPPP1/4BNN1/1P5P/R2Q1RK1 w kq - 0 16",
+    "3Qb1k1/1r2ppb1/pN1n2q1/Pp1Pp1Pr/4P2p/4BP2/4B1R1/1R5K b - - 11 40",
+    "4k3/3q1r2/1N2r1b1/3ppN2/2nPP3/1B1R2n1/2R1Q3/3K4 w - - 5 1",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "r1bqkbnr/pp1ppppp/2n5/2p5/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+    "rnbqkb1r/pp2pppp/3p1n2/8/3NP3/8/PPP2PPP/RNBQKB1R w KQkq - 1 5",
+    "rnbqk2r/ppp1bppp/4pn2/3p4/2PP4/2N2N2/PP2PPPP/R1BQKB1R w KQkq - 4 5",
+    "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP1B1PPP/R2QKB1R w KQ - 3 8",
+    "r2q1rk1/pp1bbppp/2nppn2/8/3NP3/2N1B3/PPPQBPPP/R3K2R w KQ - 4 10",
+    "2r2rk1/pp1bqppp/2n1pn2/3p4/3P4/2PBPN2/P2N1PPP/R2Q1RK1 w - - 5 12",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r2qr1k1/1p1nbppp/p2pbn2/4p3/4P3/1NN1BP2/PPPQ2PP/2KR1B1R w - - 4 12",
+    "2kr3r/ppp2ppp/2n1b3/2b1p3/4P3/2P2N2/PP1N1PPP/R1B1KB1R w KQ - 2 11",
+    "r3k2r/pp1n1ppp/2pbpn2/q7/3P4/2NBPN2/PP3PPP/R2QK2R w KQkq - 4 10",
+    "8/8/4k3/3p4/3P4/4K3/8/8 w - - 0 1",
+    "8/5k2/8/2R5/8/8/3r4/4K3 w - - 0 1",
+    "6k1/5p2/6p1/8/7p/8/6PP/6K1 b - - 0 1",
+    "8/8/8/4k3/8/8/4P3/4K3 w - - 0 1",
+};
+
+#define NUM_BENCH_POSITIONS (sizeof(benchPositions) / sizeof(benchPositions[0]))
+
+/**
+ * Searches every bench position to a fixed depth on a single thread
+ *
+ * @param depth:        The depth to search each position to
+ * @param totalNodes:   Where to store the number of moves assessed
+ * @param elapsedMs:    Where to store the time spent searching, which leaves
+ *                      out clearing the tables between positions
+ *
+ * @return  STATUS_SUCCESS if every position was searched, STATUS_FAIL otherwise
+ */
+static uint64_t Bench_SearchPositions(uint64_t depth, uint64_t *totalNodes, uint64_t *elapsedMs)
+{
+    ChessBoard *cb = new ChessBoard();
+    moveType_t *rootMoves;
+    uint64_t status = STATUS_SUCCESS;
+    std::chrono::steady_clock::time_point startTime;
+
+    Util_Assert(cb != NULL, "Failed to allocate bench board");
+
+    *totalNodes = 0;
+    *elapsedMs = 0;
+    for(uint64_t i = 0; i < NUM_BENCH_POSITIONS; ++i)
+    {
+        if(cb->SetBoardFromFEN(benchPositions[i]) != STATUS_SUCCESS)
+        {
+            std::cout << "Bad bench position: " << benchPositions[i] << std::endl;
+            status = STATUS_FAIL;
+            continue;
+        }
+
+        ThreatMap_Clear();
+        ThreatMap_Generate(cb->GetPieces(), cb->GetOccupied());
+
+        // Each position starts afresh, so its count does not depend on the others
+        Search_ClearHistory();
+        Search_NewSearch();
+        SearchStats_Reset();
+        Search_SetTimeLimit(0);
+
+        startTime = std::chrono::steady_clock::now();
+        rootMoves = cb->GenerateMoves(cb->GetColorToMove());
+        cb->SearchFromRoot(depth, rootMoves);
+        FreeMoveList(rootMoves);
+        *elapsedMs += std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - startTime).count();
+
+        *totalNodes += SearchStats_Get()->nodes + SearchStats_Get()->qnodes;
+    }
+
+    delete cb;
+    return status;
+}
+
+/**
+ * Searches every bench position to a fixed depth on a single thread and
+ * reports the total number of moves assessed along with the speed. The node
+ * count acts as a signature of the search behaviour, so any change to it means
+ * the search itself changed, while the speed tracks performance.
+ *
+ * Since the work done is fixed, this is also the workload to train profile
+ * guided builds with, ie.
+ *
+ *      g++ -O2 -fprofile-generate ... && ./ChessRobot bench
+ *      g++ -O2 -fprofile-use ...
+ *
+ * @param depth:    The depth to search each position to
+ * @param hashMb:   The size of transposition table to search with
+ *
+ * @return  STATUS_SUCCESS if every position was searched, STATUS_FAIL otherwise
+ */
+uint64_t Bench_Run(uint64_t depth, uint64_t hashMb)
+{
+    uint64_t totalNodes, elapsedMs, status;
+
+    if(TT_Resize(hashMb) != STATUS_SUCCESS)
+    {
+        return STATUS_FAIL;
+    }
+
+    status = Bench_SearchPositions(depth, &totalNodes, &elapsedMs);
+
+    // Everything nightly tracking needs is on this one line
+    std::cout << "Nodes searched: " << totalNodes
+              << " Time (ms): " << elapsedMs
+              << " NPS: " << (totalNodes * 1000) / (elapsedMs ? elapsedMs : 1) << std::endl;
+
+    return status;
+}
+
+/**
+ * Runs the bench workload with the hardware performance counters running and
+ * reports them per search node as JSON, for comparing the memory and branch
+ * behaviour of changes such as threat map or table layouts. Where perf events
+ * are not permitted, ie. in most containers, the workload still runs and the
+ * counters are reported as unavailable.
+ *
+ * @param depth:    The depth to search each position to
+ *
+ * @return  STATUS_SUCCESS if every position was searched, STATUS_FAIL otherwise
+ */
+uint64_t Bench_Profile(uint64_t depth)
+{
+    perfCounters_t counters;
+    uint64_t totalNodes, elapsedMs, status;
+    bool countersOpen;
+
+    countersOpen = PerfCounters_Open(&counters) == STATUS_SUCCESS;
+    if(!countersOpen)
+    {
+        std::cout << "Performance counters are unavailable, check perf_event_paranoid" << std::endl;
+    }
+
+    PerfCounters_Start(&counters);
+    status = Bench_SearchPositions(depth, &totalNodes, &elapsedMs);
+    PerfCounters_Stop(&counters);
+
+    PerfCounters_Print(&counters, totalNodes, std::cout);
+    PerfCounters_Close(&counters);
+
+    return status;
+}
+
+/**
+ * Runs the bench workload as a soak test, verifying the full board state every
+ * so many moves throughout the search. Any inconsistency stops the program.
+ *
+ * @param depth:            The depth to search each position to
+ * @param verifyInterval:   Number of moves between board verifications
+ *
+ * @return  STATUS_SUCCESS if the whole workload ran, STATUS_FAIL otherwise
+ */
+uint64_t Bench_Soak(uint64_t depth, uint64_t verifyInterval)
+{
+    uint64_t status;
+
+    Util_Assert(verifyInterval > 0, "Soak test needs a verification interval");
+
+    Search_SetVerifyInterval(verifyInterval);
+    status = Bench_Run(depth, TT_DEFAULT_SIZE_MB);
+
+    std::cout << "Board verifications: " << Search_GetVerifyCount()
+              << " (every " << verifyInterval << " moves)" << std::endl;
+
+    Search_SetVerifyInterval(0);
+    return status;
+}
+
+/**
+ * Runs the bench workload twice on a transposition table of the given size,
+ * once with small pages and once with huge pages, and reports the speed of
+ * each. The node counts must match, only the memory backing the table differs.
+ *
+ * @param depth:    The depth to search each position to
+ * @param hashMb:   The size of the table, the bigger it is the more the TLB matters
+ *
+ * @return  STATUS_SUCCESS if both runs completed, STATUS_FAIL otherwise
+ */
+uint64_t Bench_CompareHugePages(uint64_t depth, uint64_t hashMb)
+{
+    uint64_t totalNodes[2], elapsedMs[2], status = STATUS_SUCCESS;
+
+    for(uint8_t i = 0; i < 2; ++i)
+    {
+        TT_SetHugePages(i == 1);
+        if(TT_Resize(hashMb) != STATUS_SUCCESS)
+        {
+            status = STATUS_FAIL;
+            break;
+        }
+
+        status |= Bench_SearchPositions(depth, &totalNodes[i], &elapsedMs[i]);
+        std::cout << "Hash (MB): " << TT_GetSizeMb() << " Pages: " << TT_GetPageModeName()
+                  << " Nodes searched: " << totalNodes[i]
+                  << " Time (ms): " << elapsedMs[i]
+                  << " NPS: " << (totalNodes[i] * 1000) / (elapsedMs[i] ? elapsedMs[i] : 1) << std::endl;
+    }
+
+    // Leave the default of asking for huge pages in place for whatever runs next
+    TT_SetHugePages(true);
+
+    if(status == STATUS_SUCCESS)
+    {
+        std::cout << "Speedup: "
+                  << ((double) elapsedMs[0] / (double) (elapsedMs[1] ? elapsedMs[1] : 1)) << "x" << std::endl;
+        Util_Assert(totalNodes[0] == totalNodes[1], "Page size changed the search");
+    }
+    return status;
+}
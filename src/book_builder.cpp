@@ -0,0 +1,467 @@
+/* This file is responsible for building Polyglot opening books from PGN collections */
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "chessboard.h"
+#include "pgn.h"
+#include "polyglot_book.h"
+#include "book_builder.h"
+
+/**
+ * State shared between the ingest threads. Files are handed out one at a
+ * time, and each thread sorts its records to disk itself once its share of
+ * the memory is full, so the archive never has to fit in memory.
+ */
+typedef struct bookBuilderShared_s
+{
+    const std::vector<std::string> *pgnPaths;
+    std::string outPath;
+    bookBuilderConfig_t config;
+    uint64_t recordsPerThread;
+
+    std::atomic<uint64_t> nextFile;
+    std::atomic<uint64_t> numGames;
+    std::atomic<uint64_t> numBadGames;
+    std::atomic<uint64_t> numRecords;
+    std::atomic<bool> failed;
+
+    std::mutex runLock;
+    std::vector<std::string> runPaths;
+} bookBuilderShared_t;
+
+/**
+ * An entry in the merge, the next record of one of the runs
+ */
+typedef struct bookBuilderMergeEntry_s
+{
+    bookBuilderRecord_t record;
+    uint64_t run;
+} bookBuilderMergeEntry_t;
+
+static inline bool BookBuilder_RecordLess(const bookBuilderRecord_t &a, const bookBuilderRecord_t &b)
+{
+    return (a.key != b.key) ? a.key < b.key : a.move < b.move;
+}
+
+static inline bool BookBuilder_MergeGreater(const bookBuilderMergeEntry_t &a, const bookBuilderMergeEntry_t &b)
+{
+    return BookBuilder_RecordLess(b.record, a.record);
+}
+
+static inline uint64_t BookBuilder_ToBigEndian64(uint64_t value)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap64(value);
+#else
+    return value;
+#endif
+}
+
+static inline uint16_t BookBuilder_ToBigEndian16(uint16_t value)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap16(value);
+#else
+    return value;
+#endif
+}
+
+/**
+ * Fills in the settings used when none are given
+ *
+ * @param config:   The settings to fill in
+ */
+void BookBuilder_DefaultConfig(bookBuilderConfig_t *config)
+{
+    Util_Assert(config != NULL, "NULL config given to BookBuilder_DefaultConfig");
+
+    config->maxPly = BOOK_BUILDER_DEFAULT_MAX_PLY;
+    config->minGames = BOOK_BUILDER_DEFAULT_MIN_GAMES;
+    config->numThreads = 0;
+    config->memoryMb = BOOK_BUILDER_DEFAULT_MEMORY_MB;
+}
+
+/**
+ * Sorts the records and adds together those for the same move from the same
+ * position, leaving the combined records at the front
+ *
+ * @param records:  The records to sort, shrunk down to the combined records
+ */
+static void BookBuilder_SortAndCombine(std::vector<bookBuilderRecord_t> *records)
+{
+    size_t numCombined = 0;
+
+    std::sort(records->begin(), records->end(), BookBuilder_RecordLess);
+
+    for(size_t i = 0; i < records->size(); ++i)
+    {
+        if(numCombined > 0 && (*records)[numCombined - 1].key == (*records)[i].key
+            && (*records)[numCombined - 1].move == (*records)[i].move)
+        {
+            (*records)[numCombined - 1].games += (*records)[i].games;
+            (*records)[numCombined - 1].score += (*records)[i].score;
+        }
+        else
+        {
+            (*records)[numCombined++] = (*records)[i];
+        }
+    }
+    records->resize(numCombined);
+}
+
+/**
+ * Sorts the records gathered so far and writes them out as a run to be merged
+ * at the end, emptying the buffer for the next batch
+ *
+ * @param shared:   The build state
+ * @param records:  The records to write out
+ *
+ * @return  STATUS_SUCCESS if the run was written, STATUS_FAIL otherwise
+ */
+static uint64_t BookBuilder_SpillRun(bookBuilderShared_t *shared, std::vector<bookBuilderRecord_t> *records)
+{
+    std::string runPath;
+    std::ofstream run;
+
+    if(records->empty())
+    {
+        return STATUS_SUCCESS;
+    }
+
+    BookBuilder_SortAndCombine(records);
+
+    {
+        std::lock_guard<std::mutex> lock(shared->runLock);
+        runPath = shared->outPath + ".run" + std::to_string(shared->runPaths.size()) + ".tmp";
+        shared->runPaths.push_back(runPath);
+    }
+
+    run.open(runPath, std::ios::binary | std::ios::trunc);
+    run.write((const char *) records->data(), records->size()*sizeof(bookBuilderRecord_t));
+    if(!run.good())
+    {
+        std::cout << "Unable to write " << runPath << std::endl;
+        return STATUS_FAIL;
+    }
+
+    records->clear();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Replays a single game, adding a record for each move in the opening
+ *
+ * @param cb:       A board to replay the game on
+ * @param game:     The game to replay
+ * @param records:  Where to add the records
+ *
+ * @return  STATUS_SUCCESS if every move of the game was played, STATUS_FAIL otherwise
+ */
+static uint64_t BookBuilder_ReplayGame(ChessBoard *cb, pgnGame_t *game, std::vector<bookBuilderRecord_t> *records)
+{
+    bookBuilderRecord_t record;
+    moveType_t move;
+    uint32_t whiteScore, blackScore;
+
+    switch(game->result)
+    {
+        case PGN_RESULT_WHITE_WIN:  whiteScore = 2; blackScore = 0; break;
+        case PGN_RESULT_BLACK_WIN:  whiteScore = 0; blackScore = 2; break;
+        case PGN_RESULT_DRAW:       whiteScore = 1; blackScore = 1; break;
+        default:                    return STATUS_FAIL;
+    }
+
+    if(Pgn_SetStartPosition(cb, game) != STATUS_SUCCESS)
+    {
+        return STATUS_FAIL;
+    }
+
+    // The reader has already checked every move, so they only need unpacking
+    for(uint64_t ply = 0; ply < game->numMoves; ++ply)
+    {
+        Pgn_DecodeMove(cb, game->moves[ply], &move);
+
+        record.key = PolyglotBook_ComputeKey(cb);
+        record.move = PolyglotBook_EncodeMove(&move);
+        record.games = 1;
+        record.score = (cb->GetColorToMove() == WHITE_PIECES) ? whiteScore : blackScore;
+        records->push_back(record);
+
+        cb->ApplyMoveToBoard(&move);
+    }
+
+    return game->truncated ? STATUS_FAIL : STATUS_SUCCESS;
+}
+
+/**
+ * Ingest thread. Takes files until there are none left, streaming the games
+ * out of each and spilling sorted runs whenever its buffer fills.
+ *
+ * @param shared:   The build state
+ */
+static void BookBuilder_IngestFiles(bookBuilderShared_t *shared)
+{
+    ChessBoard *cb = new ChessBoard();
+    pgnGame_t *game = new pgnGame_t;
+    std::vector<bookBuilderRecord_t> records;
+    pgnReader_t reader;
+    uint64_t fileIdx;
+
+    records.reserve(shared->recordsPerThread);
+
+    while((fileIdx = shared->nextFile.fetch_add(1)) < shared->pgnPaths->size() && !shared->failed)
+    {
+        if(Pgn_Open(&reader, (*shared->pgnPaths)[fileIdx]) != STATUS_SUCCESS)
+        {
+            std::cout << "Unable to open " << (*shared->pgnPaths)[fileIdx] << std::endl;
+            shared->failed = true;
+            break;
+        }
+
+        while(Pgn_ReadGame(&reader, cb, shared->config.maxPly, game) == STATUS_SUCCESS)
+        {
+            size_t numBefore = records.size();
+
+            if(BookBuilder_ReplayGame(cb, game, &records) == STATUS_SUCCESS)
+            {
+                ++shared->numGames;
+            }
+            else
+            {
+                // The moves before a bad one are still kept
+                ++shared->numBadGames;
+            }
+            shared->numRecords += records.size() - numBefore;
+
+            if(records.size() + shared->config.maxPly > shared->recordsPerThread
+                && BookBuilder_SpillRun(shared, &records) != STATUS_SUCCESS)
+            {
+                shared->failed = true;
+                break;
+            }
+        }
+
+        Pgn_Close(&reader);
+    }
+
+    if(!shared->failed && BookBuilder_SpillRun(shared, &records) != STATUS_SUCCESS)
+    {
+        shared->failed = true;
+    }
+
+    delete game;
+    delete cb;
+}
+
+/**
+ * Writes out the book entries for a single position, best move first
+ *
+ * @param book:     The book being written
+ * @param moves:    The combined statistics for each move from the position
+ * @param minGames: Games a move needs to be kept
+ *
+ * @return  The number of entries written
+ */
+static uint64_t BookBuilder_WritePosition(std::ofstream &book, std::vector<bookBuilderRecord_t> *moves, uint64_t minGames)
+{
+    polyglotEntry_t entry;
+    uint64_t maxScore = 0, weight, numWritten = 0;
+
+    moves->erase(std::remove_if(moves->begin(), moves->end(),
+        [minGames](const bookBuilderRecord_t &r) { return r.games < minGames; }), moves->end());
+
+    std::sort(moves->begin(), moves->end(),
+        [](const bookBuilderRecord_t &a, const bookBuilderRecord_t &b) { return a.score > b.score; });
+
+    for(size_t i = 0; i < moves->size(); ++i)
+    {
+        maxScore = std::max(maxScore, (uint64_t) (*moves)[i].score);
+    }
+
+    for(size_t i = 0; i < moves->size(); ++i)
+    {
+        // Weights are only 16 bits, so the busiest positions are scaled down to fit
+        weight = (*moves)[i].score;
+        if(maxScore > UINT16_MAX)
+        {
+            weight = weight*UINT16_MAX/maxScore;
+        }
+
+        // A move which never scored would never be played
+        if(weight == 0)
+        {
+            continue;
+        }
+
+        entry.key = BookBuilder_ToBigEndian64((*moves)[i].key);
+        entry.move = BookBuilder_ToBigEndian16((*moves)[i].move);
+        entry.weight = BookBuilder_ToBigEndian16((uint16_t) weight);
+        entry.learn = 0;
+        book.write((const char *) &entry, sizeof(entry));
+        ++numWritten;
+    }
+
+    moves->clear();
+    return numWritten;
+}
+
+/**
+ * Merges the sorted runs into the finished book. Every run is read in order
+ * at once, so memory use depends on the number of runs and not their size.
+ *
+ * @param shared:   The build state
+ *
+ * @return  STATUS_SUCCESS if the book was written, STATUS_FAIL otherwise
+ */
+static uint64_t BookBuilder_MergeRuns(bookBuilderShared_t *shared)
+{
+    std::priority_queue<bookBuilderMergeEntry_t, std::vector<bookBuilderMergeEntry_t>,
+                        decltype(&BookBuilder_MergeGreater)> queue(BookBuilder_MergeGreater);
+    std::vector<std::ifstream> runs(shared->runPaths.size());
+    std::vector<bookBuilderRecord_t> positionMoves;
+    bookBuilderMergeEntry_t next;
+    bookBuilderRecord_t current;
+    std::ofstream book(shared->outPath, std::ios::binary | std::ios::trunc);
+    uint64_t numEntries = 0, numPositions = 0, numWritten;
+    bool haveCurrent = false;
+
+    if(!book.is_open())
+    {
+        std::cout << "Unable to create " << shared->outPath << std::endl;
+        return STATUS_FAIL;
+    }
+
+    for(uint64_t i = 0; i < runs.size(); ++i)
+    {
+        runs[i].open(shared->runPaths[i], std::ios::binary);
+        next.run = i;
+        if(runs[i].read((char *) &next.record, sizeof(next.record)))
+        {
+            queue.push(next);
+        }
+    }
+
+    while(!queue.empty())
+    {
+        next = queue.top();
+        queue.pop();
+
+        if(haveCurrent && current.key == next.record.key && current.move == next.record.move)
+        {
+            current.games += next.record.games;
+            current.score += next.record.score;
+        }
+        else
+        {
+            if(haveCurrent)
+            {
+                positionMoves.push_back(current);
+            }
+            if(haveCurrent && current.key != next.record.key)
+            {
+                numWritten = BookBuilder_WritePosition(book, &positionMoves, shared->config.minGames);
+                numEntries += numWritten;
+                numPositions += (numWritten > 0) ? 1 : 0;
+            }
+            current = next.record;
+            haveCurrent = true;
+        }
+
+        if(runs[next.run].read((char *) &next.record, sizeof(next.record)))
+        {
+            queue.push(next);
+        }
+    }
+
+    if(haveCurrent)
+    {
+        positionMoves.push_back(current);
+        numWritten = BookBuilder_WritePosition(book, &positionMoves, shared->config.minGames);
+        numEntries += numWritten;
+        numPositions += (numWritten > 0) ? 1 : 0;
+    }
+
+    if(!book.good())
+    {
+        std::cout << "Unable to write " << shared->outPath << std::endl;
+        return STATUS_FAIL;
+    }
+
+    std::cout << "Wrote " << numEntries << " entries from " << numPositions << " positions" << std::endl;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Builds a Polyglot book from PGN files. Files are read in parallel, each
+ * thread replaying its games and spilling sorted runs of (position, move)
+ * records to disk as its memory fills, which are then merged into a book
+ * sorted by key. The Polyglot key table must already be loaded.
+ *
+ * @param pgnPaths: The PGN files to build from
+ * @param outPath:  Where to write the book
+ * @param config:   How to build the book
+ *
+ * @return  STATUS_SUCCESS if the book was written, STATUS_FAIL otherwise
+ */
+uint64_t BookBuilder_Build(std::vector<std::string> pgnPaths, std::string outPath, bookBuilderConfig_t *config)
+{
+    bookBuilderShared_t shared;
+    std::vector<std::thread> threads;
+    uint64_t numThreads, status;
+    ChessBoard *cb;
+
+    Util_Assert(config != NULL, "NULL config given to BookBuilder_Build");
+
+    cb = new ChessBoard();
+    status = (PolyglotBook_ComputeKey(cb) == 0) ? STATUS_FAIL : STATUS_SUCCESS;
+    delete cb;
+    if(status != STATUS_SUCCESS)
+    {
+        std::cout << "The Polyglot key table must be loaded to build a book" << std::endl;
+        return STATUS_FAIL;
+    }
+
+    numThreads = config->numThreads ? config->numThreads : std::thread::hardware_concurrency();
+    numThreads = std::max((uint64_t) 1, std::min(numThreads, (uint64_t) pgnPaths.size()));
+
+    shared.pgnPaths = &pgnPaths;
+    shared.outPath = outPath;
+    shared.config = *config;
+    shared.config.maxPly = std::min(shared.config.maxPly, (uint64_t) MAX_GAME_PLY - 1);
+    shared.recordsPerThread = std::max((uint64_t) 2*shared.config.maxPly,
+        (config->memoryMb << 20)/numThreads/sizeof(bookBuilderRecord_t));
+    shared.nextFile = 0;
+    shared.numGames = 0;
+    shared.numBadGames = 0;
+    shared.numRecords = 0;
+    shared.failed = false;
+
+    for(uint64_t i = 0; i < numThreads; ++i)
+    {
+        threads.emplace_back(BookBuilder_IngestFiles, &shared);
+    }
+    for(uint64_t i = 0; i < numThreads; ++i)
+    {
+        threads[i].join();
+    }
+
+    std::cout << "Read " << shared.numGames << " games (" << shared.numBadGames << " unusable), "
+              << shared.numRecords << " moves in " << shared.runPaths.size() << " runs" << std::endl;
+
+    status = shared.failed ? STATUS_FAIL : BookBuilder_MergeRuns(&shared);
+
+    for(size_t i = 0; i < shared.runPaths.size(); ++i)
+    {
+        std::remove(shared.runPaths[i].c_str());
+    }
+
+    return status;
+}
@@ -1,7 +1,14 @@
 #include <iostream>
+#include <algorithm>
 #include "util.h"
 #include "chessboard_defs.h"
 #include "chessboard.h"
+#include "zobrist.h"
+#include "piecetables.h"
+#include "pawns.h"
+#include "evaluation.h"
+#include "search_stats.h"
+#include "trace.h"
 
 static ChessBoard *cb;
 
@@ -44,8 +51,20 @@ ChessBoard::ChessBoard(void)
     this->occupied = BOARD_START_USED;
     this->empty = BOARD_START_EMPTY;
 
-    // Value is 0 at game start
-    this->value = EvaluateCurrentBoardValue(this);
+    // White moves first and has every castling option available
+    this->colorToMove = WHITE_PIECES;
+    this->castlingRights = CASTLE_WHITE_KING | CASTLE_WHITE_QUEEN
+                            | CASTLE_BLACK_KING | CASTLE_BLACK_QUEEN;
+    this->epIdx = EN_PASSANT_NONE;
+    this->historyLen = 0;
+    this->halfmoveClock = 0;
+    this->hashKey = this->ComputeHashKey();
+    this->pawnKey = this->ComputePawnKey();
+    this->scores = this->ComputeScores();
+    this->accumulator.generation = 0;
+
+    this->bestMove = NULL;
+    this->rootDepth = SEARCH_DEPTH;
 
 }
 
@@ -74,266 +93,485 @@ ChessBoard::ChessBoard(uint64_t *pieces, uint64_t occupied, uint64_t searchDepth
         return;
     }
 
+    this->accumulator.generation = 0;
     ChessBoard::EvaluateCurrentBoardValue(this);
 }
 
-
-
 /**
- * Utility function for determining if a piece can be moved to or attacked on
+ * Replaces the board state with the position described by a FEN string. Only
+ * the first four fields are required, which lets EPD records be passed in
+ * directly.
  * 
- * @param idxToEval:        The index for us to evaluate
- * @param friendlyPieces:   The pieceType of our allies
- * @param enemyPieces:      The pieceType of the enemy
+ * @param fen:  The FEN (or EPD position) to load
  * 
- * @return  The validity of the selected move
+ * @return  STATUS_SUCCESS if the position was loaded, STATUS_FAIL otherwise
  */
-uint8_t ChessBoard::CheckSpaceForMoveOrAttack(uint64_t idxToEval, uint8_t friendlyPieces, uint8_t enemyPieces)
+uint64_t ChessBoard::SetBoardFromFEN(std::string fen)
 {
+    uint64_t pieces[NUM_PIECE_TYPES + 2] = {0};
+    uint8_t pt, castlingRights = 0, epIdx = EN_PASSANT_NONE, colorToMove;
+    int32_t rank = 7, file = 0, halfmoveClock = 0;
+    size_t pos = 0;
 
-    uint64_t mask = ((uint64_t) 1 << idxToEval);
+    // 1) Piece placement, from the eighth rank down to the first
+    for(; pos < fen.length() && fen[pos] != ' '; ++pos)
+    {
+        if(fen[pos] == '/')
+        {
+            if(file != 8 || rank == 0)
+            {
+                return STATUS_FAIL;
+            }
+            --rank;
+            file = 0;
+            continue;
+        }
 
-    // We cannot move into our own team
-    if((mask & this->pieces[friendlyPieces]) != 0)
+        if(fen[pos] >= '1' && fen[pos] <= '8')
+        {
+            file += fen[pos] - '0';
+            continue;
+        }
+
+        switch(fen[pos])
+        {
+            case 'P': pt = WHITE_PAWN;   break;
+            case 'R': pt = WHITE_ROOK;   break;
+            case 'B': pt = WHITE_BISHOP; break;
+            case 'N': pt = WHITE_KNIGHT; break;
+            case 'Q': pt = WHITE_QUEEN;  break;
+            case 'K': pt = WHITE_KING;   break;
+            case 'p': pt = BLACK_PAWN;   break;
+            case 'r': pt = BLACK_ROOK;   break;
+            case 'b': pt = BLACK_BISHOP; break;
+            case 'n': pt = BLACK_KNIGHT; break;
+            case 'q': pt = BLACK_QUEEN;  break;
+            case 'k': pt = BLACK_KING;   break;
+            default:
+                return STATUS_FAIL;
+        }
+
+        if(file > 7)
+        {
+            return STATUS_FAIL;
+        }
+        pieces[pt] |= ((uint64_t) 1 << (rank*8 + file));
+        ++file;
+    }
+
+    if(rank != 0 || file != 8
+        || __builtin_popcountll(pieces[WHITE_KING]) != 1
+        || __builtin_popcountll(pieces[BLACK_KING]) != 1)
     {
-        return MOVE_INVALID;
+        return STATUS_FAIL;
     }
 
-    // Otherwise is this move a move into an empty space
-    if((mask & this->occupied == 0) && (mask & this->pieces[enemyPieces] == 0))
+    // 2) Side to move
+    if(pos + 2 > fen.length())
     {
-        return MOVE_VALID;
+        return STATUS_FAIL;
     }
-    else if((mask & this->pieces[friendlyPieces] == 0) && (mask & this->pieces[enemyPieces] != 0))
+    if(fen[pos + 1] == 'w')
     {
-        return MOVE_VALID_ATTACK;
-    }   
-    return MOVE_INVALID;
-}
-
-int64_t ChessBoard::EvaluateCurrentBoardValue(ChessBoard *cb)
-{
-    uint64_t idx, pieces;
-    int64_t value = 0, sign;
-    Util_Assert(cb != NULL, "NULL Chessboard provided to evaluation function");
-
-    for(idx = 0; idx < NUM_PIECE_TYPES; ++idx)
+        colorToMove = WHITE_PIECES;
+    }
+    else if(fen[pos + 1] == 'b')
     {
+        colorToMove = BLACK_PIECES;
+    }
+    else
+    {
+        return STATUS_FAIL;
+    }
+    pos += 3;
 
-        // Essentially our piece value table must be mirrored for black, so we handle
-        // that here
-        pieces = cb->pieces[idx];
-        if(idx < NUM_PIECE_TYPES / 2)
-        {
-            sign = 1;
-        }
-        else
+    // 3) Castling rights
+    for(; pos < fen.length() && fen[pos] != ' '; ++pos)
+    {
+        switch(fen[pos])
         {
-            // Our piece tables assume we are white player, so we spoof ourselves as white
-            Util_Reverse64BitInteger(&pieces);
-            sign = -1;
-        }
-        while(pieces != 0)
-        {  
-            value += sign*GetPositionValueFromTable(idx % 6, __builtin_ctzll(pieces));
-            pieces ^= (uint64_t) 1 << __builtin_ctzll(pieces);
+            case 'K': castlingRights |= CASTLE_WHITE_KING;  break;
+            case 'Q': castlingRights |= CASTLE_WHITE_QUEEN; break;
+            case 'k': castlingRights |= CASTLE_BLACK_KING;  break;
+            case 'q': castlingRights |= CASTLE_BLACK_QUEEN; break;
+            case '-': break;
+            default:
+                return STATUS_FAIL;
         }
     }
-    return value;
+
+    // 4) En passant square
+    if(pos + 2 < fen.length() && fen[pos + 1] >= 'a' && fen[pos + 1] <= 'h'
+        && fen[pos + 2] >= '1' && fen[pos + 2] <= '8')
+    {
+        epIdx = (fen[pos + 2] - '1')*8 + (fen[pos + 1] - 'a');
+    }
+
+    // 5) Halfmove clock, which EPD records leave out
+    for(++pos; pos < fen.length() && fen[pos] != ' '; ++pos);
+    for(++pos; pos < fen.length() && fen[pos] >= '0' && fen[pos] <= '9'; ++pos)
+    {
+        halfmoveClock = std::min(halfmoveClock*10 + (fen[pos] - '0'), FIFTY_MOVE_PLIES);
+    }
+
+    for(pt = 0; pt < NUM_PIECE_TYPES; ++pt)
+    {
+        this->pieces[pt] = pieces[pt];
+        (pt < (NUM_PIECE_TYPES/2)) ? pieces[WHITE_PIECES] |= pieces[pt] : pieces[BLACK_PIECES] |= pieces[pt];
+    }
+    this->pieces[WHITE_PIECES] = pieces[WHITE_PIECES];
+    this->pieces[BLACK_PIECES] = pieces[BLACK_PIECES];
+
+    this->occupied = pieces[WHITE_PIECES] | pieces[BLACK_PIECES];
+    this->empty = ~(this->occupied);
+
+    this->colorToMove = colorToMove;
+    this->castlingRights = castlingRights;
+    this->epIdx = epIdx;
+    this->historyLen = 0;
+    this->halfmoveClock = halfmoveClock;
+    this->hashKey = this->ComputeHashKey();
+    this->pawnKey = this->ComputePawnKey();
+    this->scores = this->ComputeScores();
+    this->accumulator.generation = 0;
+
+    this->bestMove = NULL;
+    this->rootDepth = SEARCH_DEPTH;
+
+    return STATUS_SUCCESS;
 }
 
-moveType_t *ConvertStringToMove(ChessBoard* cb, std::string str)
+/**
+ * Works out the Zobrist key of the position from scratch. Moves keep the key
+ * up to date as they go, so this is only needed when a position is set up.
+ *
+ * @return  The key of the position
+ */
+uint64_t ChessBoard::ComputeHashKey(void) const
 {
-    moveType_t *move;
-    uint64_t idxToFind, mask, count, shift = 1;
-    
-    Util_Assert(cb != NULL, "Was passed a bad chessboard");
-    Util_Assert(!str.empty(), "Was passed empty string");
-
-    move = new moveType_t;
-    Util_Assert(move != NULL, "Failed to allocate move");
-
-    move->endIdx = (str[str.length() - 2] - 'a') + ((int) str[str.length() - 1])*8;
-    
-    // Pawn move
-    if(!isupper(str[0]))
-    {
-        move->pt = WHITE_PAWN;
-    
-        // Capture
-        if(str[1] == 'x')
+    uint64_t key = zobristKeys.castling[this->castlingRights], pieces;
+
+    for(uint8_t pt = 0; pt < NUM_PIECE_TYPES; ++pt)
+    {
+        for(pieces = this->pieces[pt]; pieces; pieces &= pieces - 1)
         {
-            move->moveVal = MOVE_VALID_ATTACK;
-            if((str[str.length() - 2] - 'a') - (str[0] - '0') > 0)
-            {
-                move->startIdx = move->endIdx - 7;
-            }
-            else
-            {
-                move->startIdx = move->endIdx - 9;
-            }
+            key ^= zobristKeys.pieces[pt][__builtin_ctzll(pieces)];
         }
-        else
-        {
-            Util_Assert(((shift << move->endIdx) & cb->GetBlackPieces()) == 0, "ABS");
-
-            move->moveVal = MOVE_VALID;
+    }
 
-            // Pawn has to move forward, therefore find current index
-            mask = cb->GetPiece(WHITE_PAWN) & (((uint64_t) COLUMN_MASK) << (str[str.length() - 2] - 'a'));
-            mask ^= (uint64_t) 1 << move->endIdx;
+    if(this->epIdx != EN_PASSANT_NONE)
+    {
+        key ^= zobristKeys.enPassantFile[this->epIdx % 8];
+    }
+    if(this->colorToMove == BLACK_PIECES)
+    {
+        key ^= zobristKeys.blackToMove;
+    }
 
-            count = 1;
+    return key;
+}
 
-            // We now are looking two possibilities
-            while(mask > 0 && count <= 2)
-            {
-                if((cb->GetPiece(WHITE_PAWN) & ((uint64_t) 1 << (move->endIdx - 8*count))) > 0)
-                {
-                    // Are we in the fourth row
-                    if(count == 2 && move->endIdx/8 != 3)
-                    {
-                        count++;
-                        break;
-                    }
-                    move->startIdx = (move->endIdx - 8*count);
-                    break;
-                }
-                count++;
-            }
+/**
+ * Works out the key of the pawns alone from scratch, built from the same
+ * numbers as the full key
+ *
+ * @return  The pawn key of the position
+ */
+uint64_t ChessBoard::ComputePawnKey(void) const
+{
+    uint64_t key = 0, pieces;
 
-            Util_Assert(count <= 2, "Invalid incoming pawn move");
-        }
+    for(pieces = this->pieces[WHITE_PAWN]; pieces; pieces &= pieces - 1)
+    {
+        key ^= zobristKeys.pieces[WHITE_PAWN][__builtin_ctzll(pieces)];
     }
-    else
+    for(pieces = this->pieces[BLACK_PAWN]; pieces; pieces &= pieces - 1)
     {
-        if(str[0] == 'R')
-        {
-            move->pt = WHITE_ROOK;    
-        }
-        else if(str[0] == 'N')
-        {
-            move->pt = WHITE_KNIGHT;
-        }
-        else if(str[0] == 'B')
-        {
-            move->pt = WHITE_BISHOP;
-        }
-        else if(str[0] == 'Q')
-        {
-            move->pt = WHITE_QUEEN;
-        }
-        else if(str[0] == 'K')
-        {
-            move->pt = WHITE_KING;
-        }
-        else
-        {
-            Util_Assert(0, "Bad piece type provided in move");
-        }
+        key ^= zobristKeys.pieces[BLACK_PAWN][__builtin_ctzll(pieces)];
+    }
+    return key;
+}
 
-        Util_Assert(cb->GetPiece(move->pt) != 0, "Illegal move!");
+/**
+ * Works out the evaluation terms of the position from scratch. Like the key,
+ * moves keep these up to date, so this is only needed when a position is set up.
+ *
+ * @return  The evaluation terms of the position
+ */
+evalScores_t ChessBoard::ComputeScores(void) const
+{
+    evalScores_t scores = {};
+    uint64_t pieces;
+    uint8_t idx;
 
-        // If second in str is a lower case letter or number, we can tell immediately what our start idx
-        // if number
-        if(str[1] - '0' < 8)
-        {
-            move->startIdx = __builtin_ctzll(cb->GetPiece(move->pt) & (0xFF << (str[1] - '0')*8));
-        }
-        // else if lower case letter
-        else if(str[1] - 'a' < 8)
+    for(uint8_t pt = 0; pt < NUM_PIECE_TYPES; ++pt)
+    {
+        for(pieces = this->pieces[pt]; pieces; pieces &= pieces - 1)
         {
-            idxToFind = cb->GetPiece(move->pt);
-            while(__builtin_ctzll(idxToFind) % 8 != str[1] - 'a')
-            {
-                idxToFind ^= ((uint64_t) 1 << __builtin_ctzll(idxToFind));
-            }
-            move->startIdx = (uint64_t) 1 << __builtin_ctzll(idxToFind);
+            idx = __builtin_ctzll(pieces);
+            scores.midgame += pieceSquareTables.midgame[pt][idx];
+            scores.endgame += pieceSquareTables.endgame[pt][idx];
+            scores.phase += pieceSquareTables.phase[pt];
         }
-        else
+    }
+    return scores;
+}
+
+/**
+ * Determines if the position is drawn by the fifty move rule or by repeating
+ * an earlier one. Captures and pawn moves can never be undone, so only the
+ * positions since the last of them can repeat, and only every other one has
+ * the same side to move. A single repeat counts, as whatever was played to get
+ * back here could just be played again.
+ *
+ * @return  True if the position is a draw
+ */
+bool ChessBoard::IsDrawByRule(void) const
+{
+    uint64_t limit = std::min((uint64_t) this->halfmoveClock, this->historyLen);
+
+    if(this->halfmoveClock >= FIFTY_MOVE_PLIES)
+    {
+        return true;
+    }
+
+    // It takes at least four plies to get back to the same position
+    for(uint64_t back = 4; back <= limit; back += 2)
+    {
+        if(this->history[this->historyLen - back].hashKey == this->hashKey)
         {
-            // otherwise we need to find our start location. We know there wouldn't have been
-            // additional info in the move string iff there was only one piece that could make that move
-            idxToFind = cb->GetPiece(move->pt);
-            while(!cb->IsValidMove(move->pt, __builtin_ctzll(idxToFind), move->endIdx))
-            {
-                idxToFind ^= ((uint64_t) 1 << __builtin_ctzll(idxToFind));
-            }
-            move->startIdx = __builtin_ctzll(idxToFind);
+            return true;
         }
     }
-
-    return move;
+    return false;
 }
 
-std::string outputStr;
-std::string ConvertMoveToString(ChessBoard *cb, moveType_t *move)
-{
-    std::string moveStr;
-    uint64_t mask;
 
-    Util_Assert(move != NULL, "Move provided was NULL");    
-    Util_Assert(cb != NULL, "Chessboard provided was NULL");
 
-    outputStr.clear();
-    // temporary until I can flesh this out
-    outputStr.append("\npt: ");
-    outputStr.append( Util_ConvertPieceTypeToString(move->pt) + "\n");
-    outputStr.append("start: ");
-    outputStr.append(std::to_string(move->startIdx) + "\n");
-    outputStr.append("end: ");
-    outputStr.append(std::to_string(move->endIdx) + "\n");
+/**
+ * Checks every invariant of the board state, reporting the first one broken.
+ * This is far too slow for every node, it is run after every move in paranoid
+ * builds and every so often during soak tests.
+ * 
+ * @return  True if the board is consistent
+ */
+bool ChessBoard::VerifyBoardConsistency(void) const
+{
+    uint64_t whitePieces = 0, blackPieces = 0, seen = 0;
+    const char *failure = NULL;
+    evalScores_t scores = this->ComputeScores();
 
-    return outputStr;
+    for(uint8_t pt = 0; pt < NUM_PIECE_TYPES; ++pt)
+    {
+        if((seen & this->pieces[pt]) != 0)
+        {
+            failure = "Two piece types share a square";
+        }
+        seen |= this->pieces[pt];
+        (pt < (NUM_PIECE_TYPES/2)) ? whitePieces |= this->pieces[pt] : blackPieces |= this->pieces[pt];
+    }
 
-    // Is this a castle?
-    if(move->moveVal & MOVE_VALID_CASTLE_KING)
+    if(whitePieces != this->pieces[WHITE_PIECES] || blackPieces != this->pieces[BLACK_PIECES])
     {
-        moveStr = "O-O";
+        failure = "Color boards disagree with the piece boards";
     }
-    // Is this a castle?
-    else if(move->moveVal & MOVE_VALID_CASTLE_QUEEN)
+    else if(this->occupied != (whitePieces | blackPieces) || this->empty != ~(this->occupied))
     {
-        moveStr = "O-O-O";
-    }    
-    // Is this a capture?
-    else if(move->moveVal & MOVE_VALID_ATTACK)
+        failure = "Occupancy disagrees with the piece boards";
+    }
+    // A king can go missing along a search line, but there can never be two
+    else if(__builtin_popcountll(this->pieces[WHITE_KING]) > 1
+        || __builtin_popcountll(this->pieces[BLACK_KING]) > 1)
     {
-        moveStr = "x";
+        failure = "More than one king of a color";
     }
-    // Is this a regular move?
-    else if(move->moveVal & MOVE_VALID)
+    else if(((this->pieces[WHITE_PAWN] | this->pieces[BLACK_PAWN]) & 0xFF000000000000FFULL) != 0)
     {
-        moveStr = "";
+        failure = "Pawn on the first or last rank";
     }
-    else
+    else if(this->colorToMove != WHITE_PIECES && this->colorToMove != BLACK_PIECES)
     {
-        Util_Assert(0, "Invalid move the provided");
+        failure = "Bad color to move";
     }
-    
-    // Was this move a check move
-    if(move->moveVal & MOVE_VALID_CHECK)
+    else if(this->epIdx != EN_PASSANT_NONE && this->epIdx / 8 != 2 && this->epIdx / 8 != 5)
     {
+        failure = "En passant square off the third or sixth rank";
+    }
+    else if(this->hashKey != this->ComputeHashKey())
+    {
+        failure = "Position key disagrees with the board";
+    }
+    else if(this->pawnKey != this->ComputePawnKey())
+    {
+        failure = "Pawn key disagrees with the board";
+    }
+    else if(this->scores.midgame != scores.midgame || this->scores.endgame != scores.endgame
+        || this->scores.phase != scores.phase)
+    {
+        failure = "Evaluation terms disagree with the board";
+    }
+    else if(Nnue_IsCurrent(&this->accumulator) && !Nnue_VerifyAccumulator(&this->accumulator, this->pieces))
+    {
+        failure = "Network accumulator disagrees with the board";
+    }
 
+    if(failure != NULL)
+    {
+        std::cout << "Board verification failed: " << failure << std::endl;
+        return false;
     }
-    // Was this move a checkmate
-    else if(move->moveVal & MOVE_VALID_MATE)
+    return true;
+}
+
+/**
+ * Utility function for determining if a piece can be moved to or attacked on
+ * 
+ * @param idxToEval:        The index for us to evaluate
+ * @param friendlyPieces:   The pieceType of our allies
+ * @param enemyPieces:      The pieceType of the enemy
+ * 
+ * @return  The validity of the selected move
+ */
+uint8_t ChessBoard::CheckSpaceForMoveOrAttack(uint64_t idxToEval, uint8_t friendlyPieces, uint8_t enemyPieces)
+{
+
+    uint64_t mask = ((uint64_t) 1 << idxToEval);
+
+    // We cannot move into our own team
+    if((mask & this->pieces[friendlyPieces]) != 0)
     {
+        return MOVE_INVALID;
+    }
 
+    // Otherwise is this move a move into an empty space
+    if(((mask & this->occupied) == 0) && ((mask & this->pieces[enemyPieces]) == 0))
+    {
+        return MOVE_VALID;
     }
+    else if(((mask & this->pieces[friendlyPieces]) == 0) && ((mask & this->pieces[enemyPieces]) != 0))
+    {
+        return MOVE_VALID_ATTACK;
+    }   
+    return MOVE_INVALID;
+}
 
-    // Are there are pieces of the same type that can make this move?
-    if(move->pt % NUM_PIECE_TYPES/2 != 0 && move->pt % NUM_PIECE_TYPES/2 != 5)
+/**
+ * Evaluates the position, blending the middlegame and endgame scores by how
+ * much material is left. Material and placement are kept up to date by every
+ * move, the pawn terms come from the pawn hash table, leaving only the attack
+ * pass for mobility and king safety to do at a leaf. While a network is
+ * loaded it is used instead, and the terms here are only the fallback.
+ *
+ * @return  The value of the position, positive in white's favour
+ */
+int64_t ChessBoard::EvaluateCurrentBoardValue(ChessBoard *cb)
+{
+    if(Nnue_IsLoaded())
     {
-        
+        TRACE_SCOPE(TRACE_EVALUATE);
+        return Nnue_Evaluate(&cb->accumulator, cb->pieces, cb->colorToMove == WHITE_PIECES);
     }
+    return EvaluateBreakdown(cb, NULL);
+}
 
-    // If yes, specify at the start of move string
-        // Common row
-        // Common column
-        // Knight special case
+/**
+ * Evaluates the position for the search, which only needs to know the value
+ * exactly when it falls between alpha and beta. Material and placement come
+ * for free with the board, and when they alone put the position more than
+ * LAZY_EVAL_MARGIN out of the window they are taken as answer enough. The
+ * margin is a guess rather than a bound, the other terms can occasionally
+ * cover it. Full evaluations are kept in the evaluation cache, so a
+ * position reached again by another order of moves is not evaluated twice.
+ *
+ * @param cb:       The position to evaluate
+ * @param alpha:    Lowest value the search is still interested in
+ * @param beta:     Highest value the search is still interested in
+ *
+ * @return  The value of the position, positive in white's favour, only a
+ *          rough one if it is outside the window
+ */
+int64_t ChessBoard::EvaluateLazy(ChessBoard *cb, int32_t alpha, int32_t beta)
+{
+    int32_t phase = std::min(cb->scores.phase, (int32_t) PHASE_MAX);
+    int64_t value;
+#if LAZY_EVAL_CHECK
+    int64_t full;
+#endif
 
-    // Get row and column from the endIdx
+    if(Evaluation_ProbeCache(cb->hashKey, &value))
+    {
+        return value;
+    }
 
-    return moveStr;
-}
\ No newline at end of file
+#if LAZY_EVAL
+    // The network has no cheap part to look at first, it is always run whole
+    value = (cb->scores.midgame*phase + cb->scores.endgame*(PHASE_MAX - phase)) / PHASE_MAX;
+    if(!Nnue_IsLoaded() && (value + LAZY_EVAL_MARGIN <= alpha || value - LAZY_EVAL_MARGIN >= beta))
+    {
+        SearchStats_Get()->lazySkips++;
+#if LAZY_EVAL_CHECK
+        // The full value back across the bound means the margin was too small here
+        full = EvaluateCurrentBoardValue(cb);
+        if((value + LAZY_EVAL_MARGIN <= alpha) ? full > alpha : full < beta)
+        {
+            SearchStats_Get()->lazyMisses++;
+        }
+#endif
+        return value;
+    }
+#else
+    (void) phase;
+#endif
+
+    value = EvaluateCurrentBoardValue(cb);
+    Evaluation_StoreCache(cb->hashKey, value);
+    return value;
+}
+
+/**
+ * Evaluates the position as EvaluateCurrentBoardValue does, optionally
+ * keeping each term separately
+ *
+ * @param cb:           The position to evaluate
+ * @param breakdown:    Where to store the terms, NULL if not wanted
+ *
+ * @return  The value of the position, positive in white's favour
+ */
+int64_t ChessBoard::EvaluateBreakdown(ChessBoard *cb, evalBreakdown_t *breakdown)
+{
+    TRACE_SCOPE(TRACE_EVALUATE);
+    const pawnEntry_t *pawns;
+    int32_t phase, midgame, endgame;
+    int64_t value;
+    Util_Assert(cb != NULL, "NULL Chessboard provided to evaluation function");
+
+    midgame = cb->scores.midgame;
+    endgame = cb->scores.endgame;
+
+    {
+        TRACE_SCOPE(TRACE_EVAL_PAWNS);
+        pawns = Pawns_Evaluate(cb->pawnKey, cb->pieces[WHITE_PAWN], cb->pieces[BLACK_PAWN]);
+        midgame += pawns->midgame;
+        endgame += pawns->endgame;
+    }
+
+    {
+        TRACE_SCOPE(TRACE_EVAL_ACTIVITY);
+        Evaluation_PieceActivity(cb->pieces, cb->occupied, &midgame, &endgame, breakdown, NULL);
+    }
+
+    // Promotions can take the phase past its starting value
+    phase = std::min(cb->scores.phase, (int32_t) PHASE_MAX);
+    value = (midgame*phase + endgame*(PHASE_MAX - phase)) / PHASE_MAX;
+
+    if(breakdown != NULL)
+    {
+        breakdown->material[0] = cb->scores.midgame;
+        breakdown->material[1] = cb->scores.endgame;
+        breakdown->pawns[0] = pawns->midgame;
+        breakdown->pawns[1] = pawns->endgame;
+        breakdown->phase = phase;
+        breakdown->total = value;
+    }
+    return value;
+}
@@ -1,8 +1,448 @@
+/* This file is responsible for checking the board against positions with known answers */
+
 #include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include <unistd.h>
 #include "util.h"
 #include "chessboard.h"
+#include "notation.h"
+#include "nnue.h"
+#include "evaluation.h"
+#include "pawns.h"
+#include "threatmap.h"
+#include "transposition.h"
+
+// Plenty of pseudo-legal lines from here end with a king being taken
+#define TEST_NNUE_FEN   "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"
+#define TEST_NNUE_DEPTH 3
+
+// The search goes on through captures, so a shallower one covers as much
+#define TEST_NNUE_SEARCH_DEPTH  2
+
+/**
+ * A position along with the number of leaf positions reached by playing out
+ * every legal line to a depth, as published for checking move generators
+ */
+typedef struct testPerft_s
+{
+    const char *name;
+    const char *fen;
+    uint64_t depth;
+    uint64_t nodes;
+} testPerft_t;
+
+static const testPerft_t testPerftPositions[] =
+{
+    { "startpos",   "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",                 4, 197281 },
+    { "kiwipete",   "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",     3, 97862 },
+    { "position 3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",                                4, 43238 },
+    { "position 4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",         3, 9467 },
+    { "position 5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",                3, 62379 },
+};
+
+#define NUM_TEST_PERFT_POSITIONS (sizeof(testPerftPositions) / sizeof(testPerftPositions[0]))
+
+/**
+ * A move written in standard algebraic notation, and where it should take a
+ * piece from and to, or NUM_BOARD_INDICES for both if it must not parse
+ */
+typedef struct testSan_s
+{
+    const char *fen;
+    const char *san;
+    uint8_t startIdx;
+    uint8_t endIdx;
+} testSan_t;
+
+static const testSan_t testSanMoves[] =
+{
+    { "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", "e4",    12, 28 },
+    { "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", "Nf3",   6,  21 },
+
+    // Onto a square held by our own piece
+    { "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", "Nd2",   NUM_BOARD_INDICES, NUM_BOARD_INDICES },
+    { "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", "Qxd2",  NUM_BOARD_INDICES, NUM_BOARD_INDICES },
+
+    // The only knight which could go there is pinned to its king
+    { "4k3/4r3/8/8/8/8/4N3/4K3 w - - 0 1",                        "Nc3",   NUM_BOARD_INDICES, NUM_BOARD_INDICES },
+    { "4k3/4r3/8/8/8/8/4N3/4K3 w - - 0 1",                        "Kd1",   4,  3 },
+
+    // Castling needs the right, and the king may not pass through check
+    { "r3k2r/8/8/8/8/8/8/R3K2R w Qkq - 0 1",                      "O-O",   NUM_BOARD_INDICES, NUM_BOARD_INDICES },
+    { "r3k2r/8/8/8/8/8/8/R3K2R w Qkq - 0 1",                      "O-O-O", 4,  2 },
+    { "r3k2r/8/8/8/8/8/5r2/R3K2R w KQkq - 0 1",                   "O-O",   NUM_BOARD_INDICES, NUM_BOARD_INDICES },
+    { "r3k2r/8/8/8/8/8/5r2/R3K2R w KQkq - 0 1",                   "O-O-O", 4,  2 },
+    { "r3k2r/8/8/8/8/8/5R2/R3K2R b KQkq - 0 1",                   "O-O",   NUM_BOARD_INDICES, NUM_BOARD_INDICES },
+    { "r3k2r/8/8/8/8/8/8/R3K2R b KQkq - 0 1",                     "O-O",   60, 62 },
+};
+
+#define NUM_TEST_SAN_MOVES (sizeof(testSanMoves) / sizeof(testSanMoves[0]))
+
+/**
+ * A score stored in the transposition table at one depth, and what it should
+ * read back as at another. Mates are counted from the depth left when the
+ * king is taken, so they move with the depth they are read at.
+ */
+typedef struct testTTScore_s
+{
+    uint8_t storeDepth;
+    int32_t score;
+    uint8_t probeDepth;
+    int32_t expected;
+} testTTScore_t;
+
+static const testTTScore_t testTTScores[] =
+{
+    { 4, 150,                  9, 150 },
+    { 4, -150,                 9, -150 },
+
+    // King taken 2 plies below a node at depth 4, then read at depth 4 and 6
+    { 4, MATE_SCORE + 2,       4, MATE_SCORE + 2 },
+    { 4, MATE_SCORE + 2,       6, MATE_SCORE + 4 },
+    { 3, MATE_SCORE + 1,       5, MATE_SCORE + 3 },
+    { 4, -(MATE_SCORE + 2),    4, -(MATE_SCORE + 2) },
+    { 4, -(MATE_SCORE + 1),    7, -(MATE_SCORE + 4) },
+
+    // Read back shallower than the capture, and stored again further up
+    { 6, MATE_SCORE,           2, MATE_SCORE - 4 },
+    { 3, MATE_SCORE - 4,       3, MATE_SCORE - 4 },
+    { 3, -(MATE_SCORE - 4),    8, -(MATE_SCORE + 1) },
+};
+
+#define NUM_TEST_TT_SCORES (sizeof(testTTScores) / sizeof(testTTScores[0]))
+
+/**
+ * Counts the leaf positions of every legal line to a depth, verifying the
+ * whole board after each move is made and undone
+ *
+ * @param cb:           The position to count from
+ * @param depth:        The number of moves to play out
+ * @param consistent:   Cleared if the board failed verification along the way
+ *
+ * @return  The number of leaf positions
+ */
+static uint64_t Test_Perft(ChessBoard *cb, uint64_t depth, bool *consistent)
+{
+    moveType_t *moveList, *move;
+    uint8_t us = cb->GetColorToMove();
+    uint64_t nodes = 0;
+
+    if(depth == 0)
+    {
+        return 1;
+    }
+
+    moveList = cb->GenerateMoves(us);
+    for(move = moveList; move != NULL && move->legalMove; move = move->adjMove)
+    {
+        cb->ApplyMoveToBoard(move);
+        if(!cb->VerifyBoardConsistency())
+        {
+            *consistent = false;
+        }
+        if(!cb->IsInCheck(us))
+        {
+            nodes += Test_Perft(cb, depth - 1, consistent);
+        }
+        cb->UndoMoveFromBoard(move);
+        if(!cb->VerifyBoardConsistency())
+        {
+            *consistent = false;
+        }
+    }
+    FreeMoveList(moveList);
+
+    return nodes;
+}
+
+/**
+ * Checks move generation, application and undo against the published
+ * perft counts, which covers castling, en passant and promotion
+ *
+ * @return  STATUS_SUCCESS if every count matches, STATUS_FAIL otherwise
+ */
+static uint64_t Test_PerftPositions(ChessBoard *cb)
+{
+    uint64_t status = STATUS_SUCCESS, nodes;
+    bool consistent;
+
+    for(uint64_t i = 0; i < NUM_TEST_PERFT_POSITIONS; ++i)
+    {
+        const testPerft_t *test = &testPerftPositions[i];
+
+        consistent = true;
+        if(cb->SetBoardFromFEN(test->fen) != STATUS_SUCCESS)
+        {
+            std::cout << "Perft " << test->name << ": bad position" << std::endl;
+            status = STATUS_FAIL;
+            continue;
+        }
+
+        nodes = Test_Perft(cb, test->depth, &consistent);
+        if(nodes != test->nodes || !consistent)
+        {
+            std::cout << "Perft " << test->name << " depth " << test->depth << ": " << nodes
+                      << " nodes, expected " << test->nodes << (consistent ? "" : ", board inconsistent")
+                      << std::endl;
+            status = STATUS_FAIL;
+        }
+    }
+
+    return status;
+}
+
+/**
+ * Checks the SAN parser finds the move meant, and refuses moves which are
+ * not legal in the position
+ *
+ * @return  STATUS_SUCCESS if every move parses as expected, STATUS_FAIL otherwise
+ */
+static uint64_t Test_SanMoves(ChessBoard *cb)
+{
+    uint64_t status = STATUS_SUCCESS, parsed;
+    moveType_t move;
+    bool expectLegal;
+
+    for(uint64_t i = 0; i < NUM_TEST_SAN_MOVES; ++i)
+    {
+        const testSan_t *test = &testSanMoves[i];
+
+        if(cb->SetBoardFromFEN(test->fen) != STATUS_SUCCESS)
+        {
+            std::cout << "SAN " << test->san << ": bad position " << test->fen << std::endl;
+            status = STATUS_FAIL;
+            continue;
+        }
+
+        expectLegal = test->startIdx != NUM_BOARD_INDICES;
+        parsed = Notation_ParseSan(cb, test->san, strlen(test->san), &move);
+        if(expectLegal != (parsed == STATUS_SUCCESS)
+            || (expectLegal && (move.startIdx != test->startIdx || move.endIdx != test->endIdx)))
+        {
+            std::cout << "SAN " << test->san << " in " << test->fen << ": "
+                      << ((parsed == STATUS_SUCCESS) ? "parsed" : "refused")
+                      << ", expected " << (expectLegal ? "to parse" : "to be refused") << std::endl;
+            status = STATUS_FAIL;
+        }
+    }
+
+    return status;
+}
+
+/**
+ * Checks scores, mates for and against included, come back out of the
+ * transposition table meaning the same as they went in
+ *
+ * @return  STATUS_SUCCESS if every score reads back as expected, STATUS_FAIL otherwise
+ */
+static uint64_t Test_TranspositionScores(void)
+{
+    uint64_t status = STATUS_SUCCESS;
+    ttEntry_t entry;
+
+    if(TT_Resize(TT_DEFAULT_SIZE_MB) != STATUS_SUCCESS)
+    {
+        std::cout << "Transposition scores: unable to allocate the table" << std::endl;
+        return STATUS_FAIL;
+    }
+
+    for(uint64_t i = 0; i < NUM_TEST_TT_SCORES; ++i)
+    {
+        const testTTScore_t *test = &testTTScores[i];
+        uint64_t key = 0x9E3779B97F4A7C15ULL * (i + 1);
+
+        TT_Store(key, test->storeDepth, test->score, TT_BOUND_EXACT, 0);
+        if(!TT_Probe(key, test->probeDepth, &entry) || entry.score != test->expected)
+        {
+            std::cout << "Transposition score " << test->score << " stored at depth " << (int) test->storeDepth
+                      << " read back at depth " << (int) test->probeDepth << " as " << entry.score
+                      << ", expected " << test->expected << std::endl;
+            status = STATUS_FAIL;
+        }
+    }
+
+    TT_Clear();
+    return status;
+}
+
+/**
+ * Writes a section of a network file with made up values, padded out to
+ * NNUE_FILE_ALIGNMENT
+ */
+template<typename T>
+static void Test_WriteNetworkSection(std::ofstream &out, uint64_t count, int32_t range)
+{
+    static const char padding[NNUE_FILE_ALIGNMENT] = { 0 };
+    std::vector<T> values(count);
+    uint64_t size = count * sizeof(T);
+
+    for(uint64_t i = 0; i < count; ++i)
+    {
+        values[i] = (T) ((int32_t) ((i * 0x9E3779B97F4A7C15ULL) >> 40) % (2*range + 1) - range);
+    }
+    out.write((const char *) values.data(), size);
+    out.write(padding, (NNUE_FILE_ALIGNMENT - size % NNUE_FILE_ALIGNMENT) % NNUE_FILE_ALIGNMENT);
+}
+
+/**
+ * Writes a network with made up weights in the format Nnue_Load reads
+ *
+ * @return  STATUS_SUCCESS if the network was written, STATUS_FAIL otherwise
+ */
+static uint64_t Test_WriteNetwork(std::string path)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    static const char padding[NNUE_FILE_ALIGNMENT] = { 0 };
+    nnueFileHeader_t header;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = NNUE_FILE_MAGIC;
+    header.version = NNUE_FILE_VERSION;
+    header.numFeatures = NNUE_NUM_FEATURES;
+    header.halfDims = NNUE_HALF_DIMS;
+    header.hiddenDims = NNUE_HIDDEN_DIMS;
+    out.write((const char *) &header, sizeof(header));
+    out.write(padding, (NNUE_FILE_ALIGNMENT - sizeof(header) % NNUE_FILE_ALIGNMENT) % NNUE_FILE_ALIGNMENT);
+
+    Test_WriteNetworkSection<int16_t>(out, NNUE_HALF_DIMS, 64);
+    Test_WriteNetworkSection<int16_t>(out, (uint64_t) NNUE_NUM_FEATURES * NNUE_HALF_DIMS, 32);
+    Test_WriteNetworkSection<int32_t>(out, NNUE_HIDDEN_DIMS, 4096);
+    Test_WriteNetworkSection<int8_t>(out, NNUE_HIDDEN_DIMS * 2 * NNUE_HALF_DIMS, 16);
+    Test_WriteNetworkSection<int32_t>(out, NNUE_HIDDEN_DIMS, 4096);
+    Test_WriteNetworkSection<int8_t>(out, NNUE_HIDDEN_DIMS * NNUE_HIDDEN_DIMS, 16);
+    Test_WriteNetworkSection<int32_t>(out, 1, 4096);
+    Test_WriteNetworkSection<int8_t>(out, NNUE_HIDDEN_DIMS, 16);
+
+    return out.good() ? STATUS_SUCCESS : STATUS_FAIL;
+}
+
+/**
+ * Plays out every pseudo-legal line to a depth the way the search does, kings
+ * being taken included, evaluating each position and verifying the board,
+ * network accumulator and all, after every move is made and undone
+ *
+ * @return  The number of times the board failed verification
+ */
+static uint64_t Test_NetworkWalk(ChessBoard *cb, uint64_t depth)
+{
+    moveType_t *moveList, *move;
+    uint64_t failures = 0;
+
+    ChessBoard::EvaluateCurrentBoardValue(cb);
+    if(depth == 0)
+    {
+        return 0;
+    }
+
+    moveList = cb->GenerateMoves(cb->GetColorToMove());
+    for(move = moveList; move != NULL && move->legalMove; move = move->adjMove)
+    {
+        cb->ApplyMoveToBoard(move);
+        failures += !cb->VerifyBoardConsistency();
+        failures += Test_NetworkWalk(cb, depth - 1);
+        cb->UndoMoveFromBoard(move);
+        failures += !cb->VerifyBoardConsistency();
+    }
+    FreeMoveList(moveList);
+
+    return failures;
+}
+
+/**
+ * Forgets every value searches have stored, so a test's positions and scores
+ * neither depend on what ran before it nor carry on into real play
+ */
+static void Test_ClearSearchState(void)
+{
+    Evaluation_ClearCache();
+    Pawns_Clear();
+    Search_ClearHistory();
+}
+
+/**
+ * Checks the network accumulator is kept in step with the board through
+ * everything a search does to it, with a network of made up weights
+ *
+ * @return  STATUS_SUCCESS if the accumulator always matched, STATUS_FAIL otherwise
+ */
+static uint64_t Test_NetworkAccumulator(ChessBoard *cb)
+{
+    char path[] = "/tmp/ChessRobotTestXXXXXX";
+    moveType_t *rootMoves;
+    uint64_t failures;
+    int fd;
+
+    fd = mkstemp(path);
+    if(fd < 0)
+    {
+        std::cout << "Network accumulator: unable to create a network file" << std::endl;
+        return STATUS_FAIL;
+    }
+    close(fd);
+
+    if(Test_WriteNetwork(path) != STATUS_SUCCESS || Nnue_Load(path) != STATUS_SUCCESS)
+    {
+        std::cout << "Network accumulator: unable to load a network" << std::endl;
+        std::remove(path);
+        return STATUS_FAIL;
+    }
+    std::remove(path);
+    Test_ClearSearchState();
+
+    cb->SetBoardFromFEN(TEST_NNUE_FEN);
+    failures = Test_NetworkWalk(cb, TEST_NNUE_DEPTH);
+    if(failures != 0)
+    {
+        std::cout << "Network accumulator: " << failures << " board verifications failed" << std::endl;
+    }
+
+    // The search itself, which stops the program if the board ever disagrees
+    if(failures == 0 && TT_Resize(TT_DEFAULT_SIZE_MB) == STATUS_SUCCESS)
+    {
+        cb->SetBoardFromFEN(TEST_NNUE_FEN);
+        ThreatMap_Clear();
+        ThreatMap_Generate(cb->GetPieces(), cb->GetOccupied());
+
+        Search_NewSearch();
+        Search_SetTimeLimit(0);
+        Search_SetVerifyInterval(1);
+        rootMoves = cb->GenerateMoves(cb->GetColorToMove());
+        cb->SearchFromRoot(TEST_NNUE_SEARCH_DEPTH, rootMoves);
+        FreeMoveList(rootMoves);
+        Search_SetVerifyInterval(0);
+    }
+
+    // Values scored by the made up network must not outlive it
+    Nnue_Unload();
+    Test_ClearSearchState();
+    return (failures == 0) ? STATUS_SUCCESS : STATUS_FAIL;
+}
 
 uint64_t executeTestSuite(void)
 {
-    return STATUS_SUCCESS;
-}
\ No newline at end of file
+    ChessBoard *cb = new ChessBoard();
+    uint64_t status = STATUS_SUCCESS;
+
+    if(Test_PerftPositions(cb) != STATUS_SUCCESS)
+    {
+        status = STATUS_FAIL;
+    }
+    if(Test_SanMoves(cb) != STATUS_SUCCESS)
+    {
+        status = STATUS_FAIL;
+    }
+    if(Test_TranspositionScores() != STATUS_SUCCESS)
+    {
+        status = STATUS_FAIL;
+    }
+    if(Test_NetworkAccumulator(cb) != STATUS_SUCCESS)
+    {
+        status = STATUS_FAIL;
+    }
+
+    delete cb;
+    return status;
+}
@@ -0,0 +1,306 @@
+/* This file is responsible for running EPD test suites against the search */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "chessboard.h"
+#include "threatmap.h"
+#include "search_stats.h"
+#include "notation.h"
+#include "epd_suite.h"
+
+/**
+ * Escapes a string so it can be placed inside a JSON string literal
+ */
+static std::string EpdSuite_EscapeJson(std::string str)
+{
+    std::string escaped;
+
+    for(size_t i = 0; i < str.length(); ++i)
+    {
+        if(str[i] == '"' || str[i] == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += str[i];
+    }
+    return escaped;
+}
+
+/**
+ * Determines if a generated move is the move written in SAN
+ *
+ * @param cb:       The position the move is played from
+ * @param move:     The move generated by the engine
+ * @param san:      The move as written in the suite, ie. "Qg6", "exd5+", "Nbd7"
+ *
+ * @return  True if both describe the same move
+ */
+static bool EpdSuite_MoveMatchesSan(ChessBoard *cb, moveType_t *move, std::string san)
+{
+    moveType_t sanMove;
+
+    if(Notation_ParseSan(cb, san.c_str(), san.length(), &sanMove) != STATUS_SUCCESS)
+    {
+        return false;
+    }
+
+    return sanMove.startIdx == move->startIdx && sanMove.endIdx == move->endIdx
+        && sanMove.promotion == move->promotion;
+}
+
+/**
+ * Reads a single EPD record, ie.
+ *
+ *  2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - bm Qg6; id "WAC.001";
+ *
+ * @param line:         The EPD record
+ * @param position:     Where to store the position and its operations
+ *
+ * @return  STATUS_SUCCESS if the record held a position, STATUS_FAIL otherwise
+ */
+uint64_t EpdSuite_ParseLine(std::string line, epdPosition_t *position)
+{
+    std::istringstream fields(line);
+    std::string field, operations, operation, opCode, operand;
+    size_t start, end;
+
+    Util_Assert(position != NULL, "NULL position provided to EPD parser");
+
+    position->fen.clear();
+    position->id.clear();
+    position->bestMoves.clear();
+    position->avoidMoves.clear();
+
+    // The first four fields are the position itself
+    for(int i = 0; i < 4; ++i)
+    {
+        if(!(fields >> field))
+        {
+            return STATUS_FAIL;
+        }
+        position->fen += (i == 0) ? field : " " + field;
+    }
+
+    // The remainder is a list of operations, each terminated by a semicolon
+    std::getline(fields, operations);
+    start = 0;
+    while(start < operations.length())
+    {
+        end = operations.find(';', start);
+        if(end == std::string::npos)
+        {
+            end = operations.length();
+        }
+        operation = operations.substr(start, end - start);
+        start = end + 1;
+
+        std::istringstream operands(operation);
+        if(!(operands >> opCode))
+        {
+            continue;
+        }
+
+        while(operands >> operand)
+        {
+            if(opCode == "bm")
+            {
+                position->bestMoves.push_back(operand);
+            }
+            else if(opCode == "am")
+            {
+                position->avoidMoves.push_back(operand);
+            }
+            else if(opCode == "id")
+            {
+                position->id += (position->id.empty() ? "" : " ") + operand;
+            }
+        }
+    }
+
+    // Strip the quotes from around the id
+    if(position->id.length() >= 2 && position->id.front() == '"' && position->id.back() == '"')
+    {
+        position->id = position->id.substr(1, position->id.length() - 2);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Searches a suite position with iterative deepening until the time runs out
+ *
+ * @param position:             The position to solve
+ * @param timePerPositionMs:    Time allowed for the search
+ * @param maxDepth:             Deepest iteration to attempt
+ * @param result:               Where to record the outcome
+ *
+ * @return  STATUS_SUCCESS if the position could be searched, STATUS_FAIL otherwise
+ */
+uint64_t EpdSuite_SolvePosition(epdPosition_t *position, uint64_t timePerPositionMs,
+                                uint64_t maxDepth, epdResult_t *result)
+{
+    ChessBoard *cb;
+    moveType_t *rootMoves, bestMove;
+    char moveStr[NOTATION_MAX_MOVE_LENGTH];
+    uint64_t depth, elapsedMs;
+    bool isSolution;
+    std::chrono::steady_clock::time_point startTime;
+
+    Util_Assert(position != NULL && result != NULL, "NULL input to EpdSuite_SolvePosition");
+
+    *result = {};
+
+    cb = new ChessBoard();
+    if(cb->SetBoardFromFEN(position->fen) != STATUS_SUCCESS)
+    {
+        delete cb;
+        return STATUS_FAIL;
+    }
+
+    ThreatMap_Clear();
+    ThreatMap_Generate(cb->GetPieces(), cb->GetOccupied());
+
+    rootMoves = cb->GenerateMoves(cb->GetColorToMove());
+
+    // Positions of a suite are unrelated, nothing learnt from one helps another
+    Search_ClearHistory();
+    Search_NewSearch();
+    SearchStats_Reset();
+    Search_SetTimeLimit(timePerPositionMs);
+    startTime = std::chrono::steady_clock::now();
+
+    for(depth = 1; depth <= maxDepth; ++depth)
+    {
+        cb->SearchFromRoot(depth, rootMoves);
+
+        // Whatever the interrupted iteration found cannot be trusted
+        if(Search_WasAborted() || cb->GetAddrOfBestMove() == NULL)
+        {
+            break;
+        }
+
+        bestMove = *(cb->GetAddrOfBestMove());
+        elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - startTime).count();
+
+        result->depthReached = depth;
+        Notation_FormatUci(&bestMove, moveStr);
+        result->moveFound = moveStr;
+
+        // bm wants one of its moves played, am wants none of its moves played
+        isSolution = position->bestMoves.empty();
+        for(size_t i = 0; i < position->bestMoves.size(); ++i)
+        {
+            isSolution |= EpdSuite_MoveMatchesSan(cb, &bestMove, position->bestMoves[i]);
+        }
+        for(size_t i = 0; i < position->avoidMoves.size(); ++i)
+        {
+            isSolution &= !EpdSuite_MoveMatchesSan(cb, &bestMove, position->avoidMoves[i]);
+        }
+
+        // A solution only counts from the iteration it was found and then kept
+        if(isSolution && !result->solved)
+        {
+            result->solvedDepth = depth;
+            result->solvedNodes = SearchStats_Get()->nodes;
+            result->solvedTimeMs = elapsedMs;
+        }
+        else if(!isSolution)
+        {
+            result->solvedDepth = 0;
+            result->solvedNodes = 0;
+            result->solvedTimeMs = 0;
+        }
+        result->solved = isSolution;
+
+        if(elapsedMs >= timePerPositionMs)
+        {
+            break;
+        }
+    }
+
+    result->nodes = SearchStats_Get()->nodes;
+    result->timeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - startTime).count();
+
+    Search_SetTimeLimit(0);
+    FreeMoveList(rootMoves);
+    delete cb;
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Runs every position of an EPD suite and reports the outcome as JSON, one
+ * object per position followed by a summary object, so runs from different
+ * builds can be diffed directly.
+ *
+ * @param suitePath:            The EPD file to run
+ * @param timePerPositionMs:    Time allowed for each position
+ * @param maxDepth:             Deepest iteration to attempt on each position
+ *
+ * @return  STATUS_SUCCESS if the suite could be run, STATUS_FAIL otherwise
+ */
+uint64_t EpdSuite_Run(std::string suitePath, uint64_t timePerPositionMs, uint64_t maxDepth)
+{
+    std::ifstream suite(suitePath);
+    std::string line;
+    epdPosition_t position;
+    epdResult_t result;
+    uint64_t numPositions = 0, numSolved = 0, totalTimeMs = 0, totalNodes = 0, lineNum = 0;
+
+    if(!suite.is_open())
+    {
+        std::cout << "Unable to open EPD suite " << suitePath << std::endl;
+        return STATUS_FAIL;
+    }
+
+    while(std::getline(suite, line))
+    {
+        ++lineNum;
+        if(line.find_first_not_of(" \t\r") == std::string::npos || line[0] == '#')
+        {
+            continue;
+        }
+
+        if(EpdSuite_ParseLine(line, &position) != STATUS_SUCCESS
+            || EpdSuite_SolvePosition(&position, timePerPositionMs, maxDepth, &result) != STATUS_SUCCESS)
+        {
+            std::cout << "{\"line\":" << lineNum << ",\"error\":\"bad position\"}" << std::endl;
+            continue;
+        }
+
+        ++numPositions;
+        numSolved += result.solved ? 1 : 0;
+        totalTimeMs += result.timeMs;
+        totalNodes += result.nodes;
+
+        std::cout << "{\"id\":\"" << EpdSuite_EscapeJson(position.id) << "\""
+                  << ",\"fen\":\"" << EpdSuite_EscapeJson(position.fen) << "\""
+                  << ",\"solved\":" << (result.solved ? "true" : "false")
+                  << ",\"move\":\"" << result.moveFound << "\""
+                  << ",\"solvedDepth\":" << result.solvedDepth
+                  << ",\"solvedNodes\":" << result.solvedNodes
+                  << ",\"solvedTimeMs\":" << result.solvedTimeMs
+                  << ",\"depth\":" << result.depthReached
+                  << ",\"nodes\":" << result.nodes
+                  << ",\"timeMs\":" << result.timeMs
+                  << ",\"stats\":";
+        SearchStats_PrintJson(std::cout);
+        std::cout << "}" << std::endl;
+    }
+
+    std::cout << "{\"suite\":\"" << EpdSuite_EscapeJson(suitePath) << "\""
+              << ",\"positions\":" << numPositions
+              << ",\"solved\":" << numSolved
+              << ",\"solveRate\":" << (numPositions ? (double) numSolved / numPositions : 0.0)
+              << ",\"timePerPositionMs\":" << timePerPositionMs
+              << ",\"totalTimeMs\":" << totalTimeMs
+              << ",\"totalNodes\":" << totalNodes << "}" << std::endl;
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,299 @@
+/* This file is responsible for the weights of the hand written evaluation and reading and writing them */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <cstddef>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "piecetables.h"
+#include "pawns.h"
+#include "evaluation.h"
+#include "eval_params.h"
+
+static_assert(sizeof(evalTerms_t) == EVAL_NUM_TERMS * sizeof(int32_t), "Evaluation terms must be a flat vector");
+
+static const char *pieceNames[NUM_PIECE_TYPES/2] = { "pawn", "rook", "bishop", "knight", "queen", "king" };
+
+/**
+ * The hand written weights, used until a tuned set is loaded. Pawns grow in
+ * worth as the board empties and the minor pieces lose a little, the king is
+ * never traded so is worth nothing.
+ */
+evalParams_t evalParams =
+{
+    // Middlegame
+    {
+        { 100, 500, 330, 320, 900, 0 },
+        {
+            // Pawns
+            {
+              0,  0,  0,  0,  0,  0,  0,  0,
+             50, 50, 50, 50, 50, 50, 50, 50,
+             10, 10, 20, 30, 30, 20, 10, 10,
+              5,  5, 10, 25, 25, 10,  5,  5,
+              0,  0,  0, 20, 20,  0,  0,  0,
+              5, -5,-10,  0,  0,-10, -5,  5,
+              5, 10, 10,-20,-20, 10, 10,  5,
+              0,  0,  0,  0,  0,  0,  0,  0
+            },
+            // Rooks
+            {
+              0,  0,  0,  0,  0,  0,  0,  0,
+              5, 10, 10, 10, 10, 10, 10,  5,
+             -5,  0,  0,  0,  0,  0,  0, -5,
+             -5,  0,  0,  0,  0,  0,  0, -5,
+             -5,  0,  0,  0,  0,  0,  0, -5,
+             -5,  0,  0,  0,  0,  0,  0, -5,
+             -5,  0,  0,  0,  0,  0,  0, -5,
+              0,  0,  0,  5,  5,  0,  0,  0
+            },
+            // Bishops
+            {
+             -20,-10,-10,-10,-10,-10,-10,-20,
+             -10,  0,  0,  0,  0,  0,  0,-10,
+             -10,  0,  5, 10, 10,  5,  0,-10,
+             -10,  5,  5, 10, 10,  5,  5,-10,
+             -10,  0, 10, 10, 10, 10,  0,-10,
+             -10, 10, 10, 10, 10, 10, 10,-10,
+             -10,  5,  0,  0,  0,  0,  5,-10,
+             -20,-10,-10,-10,-10,-10,-10,-20,
+            },
+            // Knights
+            {
+             -50,-40,-30,-30,-30,-30,-40,-50,
+             -40,-20,  0,  0,  0,  0,-20,-40,
+             -30,  0, 10, 15, 15, 10,  0,-30,
+             -30,  5, 15, 20, 20, 15,  5,-30,
+             -30,  0, 15, 20, 20, 15,  0,-30,
+             -30,  5, 10, 15, 15, 10,  5,-30,
+             -40,-20,  0,  5,  5,  0,-20,-40,
+             -50,-40,-30,-30,-30,-30,-40,-50,
+            },
+            // Queen
+            {
+             -20,-10,-10, -5, -5,-10,-10,-20,
+             -10,  0,  0,  0,  0,  0,  0,-10,
+             -10,  0,  5,  5,  5,  5,  0,-10,
+              -5,  0,  5,  5,  5,  5,  0, -5,
+               0,  0,  5,  5,  5,  5,  0, -5,
+             -10,  5,  5,  5,  5,  5,  0,-10,
+             -10,  0,  5,  0,  0,  0,  0,-10,
+             -20,-10,-10, -5, -5,-10,-10,-20
+            },
+            // King
+            {
+             -30,-40,-40,-50,-50,-40,-40,-30,
+             -30,-40,-40,-50,-50,-40,-40,-30,
+             -30,-40,-40,-50,-50,-40,-40,-30,
+             -30,-40,-40,-50,-50,-40,-40,-30,
+             -20,-30,-30,-40,-40,-30,-30,-20,
+             -10,-20,-20,-20,-20,-20,-20,-10,
+              20, 20,  0,  0,  0,  0, 20, 20,
+              20, 30, 10,  0,  0, 10, 30, 20
+            }
+        },
+        -10, -10, -8, 5,
+        { 0, 5, 10, 15, 25, 45, 70, 0 },
+        { 0, 2, 5, 4, 1, 0 }
+    },
+
+    // Endgame, where only the king takes a different table
+    {
+        { 120, 550, 320, 300, 950, 0 },
+        {
+            // Pawns
+            {
+              0,  0,  0,  0,  0,  0,  0,  0,
+             50, 50, 50, 50, 50, 50, 50, 50,
+             10, 10, 20, 30, 30, 20, 10, 10,
+              5,  5, 10, 25, 25, 10,  5,  5,
+              0,  0,  0, 20, 20,  0,  0,  0,
+              5, -5,-10,  0,  0,-10, -5,  5,
+              5, 10, 10,-20,-20, 10, 10,  5,
+              0,  0,  0,  0,  0,  0,  0,  0
+            },
+            // Rooks
+            {
+              0,  0,  0,  0,  0,  0,  0,  0,
+              5, 10, 10, 10, 10, 10, 10,  5,
+             -5,  0,  0,  0,  0,  0,  0, -5,
+             -5,  0,  0,  0,  0,  0,  0, -5,
+             -5,  0,  0,  0,  0,  0,  0, -5,
+             -5,  0,  0,  0,  0,  0,  0, -5,
+             -5,  0,  0,  0,  0,  0,  0, -5,
+              0,  0,  0,  5,  5,  0,  0,  0
+            },
+            // Bishops
+            {
+             -20,-10,-10,-10,-10,-10,-10,-20,
+             -10,  0,  0,  0,  0,  0,  0,-10,
+             -10,  0,  5, 10, 10,  5,  0,-10,
+             -10,  5,  5, 10, 10,  5,  5,-10,
+             -10,  0, 10, 10, 10, 10,  0,-10,
+             -10, 10, 10, 10, 10, 10, 10,-10,
+             -10,  5,  0,  0,  0,  0,  5,-10,
+             -20,-10,-10,-10,-10,-10,-10,-20,
+            },
+            // Knights
+            {
+             -50,-40,-30,-30,-30,-30,-40,-50,
+             -40,-20,  0,  0,  0,  0,-20,-40,
+             -30,  0, 10, 15, 15, 10,  0,-30,
+             -30,  5, 15, 20, 20, 15,  5,-30,
+             -30,  0, 15, 20, 20, 15,  0,-30,
+             -30,  5, 10, 15, 15, 10,  5,-30,
+             -40,-20,  0,  5,  5,  0,-20,-40,
+             -50,-40,-30,-30,-30,-30,-40,-50,
+            },
+            // Queen
+            {
+             -20,-10,-10, -5, -5,-10,-10,-20,
+             -10,  0,  0,  0,  0,  0,  0,-10,
+             -10,  0,  5,  5,  5,  5,  0,-10,
+              -5,  0,  5,  5,  5,  5,  0, -5,
+               0,  0,  5,  5,  5,  5,  0, -5,
+             -10,  5,  5,  5,  5,  5,  0,-10,
+             -10,  0,  5,  0,  0,  0,  0,-10,
+             -20,-10,-10, -5, -5,-10,-10,-20
+            },
+            // King
+            {
+             -50,-40,-30,-20,-20,-30,-40,-50,
+             -30,-20,-10,  0,  0,-10,-20,-30,
+             -30,-10, 20, 30, 30, 20,-10,-30,
+             -30,-10, 30, 40, 40, 30,-10,-30,
+             -30,-10, 30, 40, 40, 30,-10,-30,
+             -30,-10, 20, 30, 30, 20,-10,-30,
+             -30,-30,  0,  0,  0,  0,-30,-30,
+             -50,-30,-30,-30,-30,-30,-30,-50
+            }
+        },
+        -20, -15, -10, 8,
+        { 0, 10, 20, 35, 60, 100, 150, 0 },
+        { 0, 4, 5, 4, 2, 0 }
+    }
+};
+
+/**
+ * Names a term of the flat vector, the way parameter files refer to it, ie.
+ * "material.knight", "square.pawn.e4", "pawn.passed.6" or "mobility.rook"
+ *
+ * @param term:     Index into the flat vector, below EVAL_NUM_TERMS
+ *
+ * @return  The name of the term
+ */
+std::string EvalParams_TermName(uint64_t term)
+{
+    uint64_t offset = term * sizeof(int32_t), idx;
+    std::string square;
+
+    if(offset < offsetof(evalTerms_t, squares))
+    {
+        return std::string("material.") + pieceNames[term];
+    }
+    if(offset < offsetof(evalTerms_t, doubled))
+    {
+        idx = (offset - offsetof(evalTerms_t, squares)) / sizeof(int32_t);
+        square += (char) ('a' + idx % 8);
+        square += (char) ('8' - (idx % NUM_BOARD_INDICES) / 8);
+        return std::string("square.") + pieceNames[idx / NUM_BOARD_INDICES] + "." + square;
+    }
+    if(offset == offsetof(evalTerms_t, doubled))     return "pawn.doubled";
+    if(offset == offsetof(evalTerms_t, isolated))    return "pawn.isolated";
+    if(offset == offsetof(evalTerms_t, backward))    return "pawn.backward";
+    if(offset == offsetof(evalTerms_t, connected))   return "pawn.connected";
+    if(offset < offsetof(evalTerms_t, mobility))
+    {
+        idx = (offset - offsetof(evalTerms_t, passed)) / sizeof(int32_t);
+        return "pawn.passed." + std::to_string(idx + 1);
+    }
+    return std::string("mobility.") + pieceNames[(offset - offsetof(evalTerms_t, mobility)) / sizeof(int32_t)];
+}
+
+/**
+ * Loads evaluation weights from a parameter file, as written by
+ * EvalParams_Save. Each line names a term and gives its middlegame and
+ * endgame weights, terms not named keep the weights they had. Boards set up
+ * before the load still hold material and placement scores from the old
+ * weights, and need their scores computed again.
+ *
+ * @param path:     The parameter file
+ *
+ * @return  STATUS_SUCCESS if the weights were loaded, STATUS_FAIL otherwise
+ */
+uint64_t EvalParams_Load(std::string path)
+{
+    std::ifstream in(path);
+    std::unordered_map<std::string, uint64_t> terms;
+    std::string line, name;
+    evalParams_t params = evalParams;
+    uint64_t lineNum = 0;
+    int32_t midgame, endgame;
+
+    if(!in.is_open())
+    {
+        std::cout << "Unable to open " << path << std::endl;
+        return STATUS_FAIL;
+    }
+
+    for(uint64_t term = 0; term < EVAL_NUM_TERMS; ++term)
+    {
+        terms[EvalParams_TermName(term)] = term;
+    }
+
+    while(std::getline(in, line))
+    {
+        std::istringstream fields(line);
+
+        ++lineNum;
+        if(!(fields >> name) || name[0] == '#')
+        {
+            continue;
+        }
+
+        if(terms.count(name) == 0 || !(fields >> midgame >> endgame))
+        {
+            std::cout << path << ":" << lineNum << ": expected a term this build knows and two weights" << std::endl;
+            return STATUS_FAIL;
+        }
+
+        EvalParams_Flat(&params.midgame)[terms[name]] = midgame;
+        EvalParams_Flat(&params.endgame)[terms[name]] = endgame;
+    }
+
+    // Everything built from the old weights has to go
+    evalParams = params;
+    PieceTables_Rebuild();
+    Pawns_Clear();
+    Evaluation_ClearCache();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Writes evaluation weights out as a parameter file
+ *
+ * @param path:     Where to write them
+ * @param params:   The weights
+ *
+ * @return  STATUS_SUCCESS if the file was written, STATUS_FAIL otherwise
+ */
+uint64_t EvalParams_Save(std::string path, const evalParams_t *params)
+{
+    std::ofstream out(path, std::ios::trunc);
+
+    out << "# term midgame endgame" << std::endl;
+    for(uint64_t term = 0; term < EVAL_NUM_TERMS; ++term)
+    {
+        out << EvalParams_TermName(term) << " " << EvalParams_Flat(&params->midgame)[term]
+            << " " << EvalParams_Flat(&params->endgame)[term] << "\n";
+    }
+
+    if(!out.good())
+    {
+        std::cout << "Unable to write " << path << std::endl;
+        return STATUS_FAIL;
+    }
+    return STATUS_SUCCESS;
+}
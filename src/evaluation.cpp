@@ -0,0 +1,173 @@
+/* This file is responsible for the evaluation terms which depend on what pieces attack */
+
+#include <algorithm>
+#include <cstring>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "attacks.h"
+#include "search_stats.h"
+#include "eval_params.h"
+#include "evaluation.h"
+
+#define FILE_A_MASK 0x0101010101010101ULL
+#define FILE_H_MASK 0x8080808080808080ULL
+
+// Mobility is counted relative to a typical number of safe squares for each
+// white piece type, so a piece of ordinary mobility scores nothing either way
+static const int32_t mobilityTypical[NUM_PIECE_TYPES/2] = { 0, 7, 6, 4, 13, 0 };
+
+// Attack units for each square of the enemy king zone a piece hits
+static const int32_t kingAttackWeights[NUM_PIECE_TYPES/2] = { 0, 3, 2, 2, 5, 0 };
+
+// Units beyond which the danger to the king stops growing
+#define KING_ATTACK_UNITS_MAX   40
+
+// Each searching thread keeps its own cache
+static thread_local evalCacheEntry_t evalCache[EVAL_CACHE_ENTRIES];
+
+/**
+ * The attack pass for one side. Every piece's attacks are worked out once and
+ * used for both its mobility and its share of the attack on the enemy king.
+ *
+ * @param pieces:       The piece boards of the position
+ * @param occupied:     Every piece on the board
+ * @param white:        True to score white's pieces, false for black's
+ * @param mobility:     Where to store the mobility score, { midgame, endgame }
+ * @param trace:        Added to with the mobility counts, negated for black, NULL if not wanted
+ *
+ * @return  The attack units against the enemy king
+ */
+static int32_t Evaluation_Side(const uint64_t *pieces, uint64_t occupied, bool white, int32_t mobility[2],
+                               evalTerms_t *trace)
+{
+    uint8_t base = white ? WHITE_PAWN : BLACK_PAWN, enemyBase = white ? BLACK_PAWN : WHITE_PAWN, idx;
+    uint64_t enemyPawns = pieces[enemyBase + WHITE_PAWN], enemyPawnAttacks, area, kingZone, attacks;
+    int32_t count, units = 0, numAttackers = 0;
+
+    // Squares guarded by an enemy pawn, or holding one of our own pieces, are
+    // no use to a piece
+    enemyPawnAttacks = white
+        ? ((enemyPawns & ~FILE_A_MASK) >> 9) | ((enemyPawns & ~FILE_H_MASK) >> 7)
+        : ((enemyPawns & ~FILE_H_MASK) << 9) | ((enemyPawns & ~FILE_A_MASK) << 7);
+    area = ~pieces[white ? WHITE_PIECES : BLACK_PIECES] & ~enemyPawnAttacks;
+
+    // The enemy king and the squares around it
+    kingZone = pieces[enemyBase + WHITE_KING];
+    if(kingZone != 0)
+    {
+        kingZone |= Attacks_King(__builtin_ctzll(kingZone));
+    }
+
+    mobility[0] = 0;
+    mobility[1] = 0;
+    for(uint8_t pt = WHITE_ROOK; pt <= WHITE_QUEEN; ++pt)
+    {
+        for(uint64_t bb = pieces[base + pt]; bb; bb &= bb - 1)
+        {
+            idx = __builtin_ctzll(bb);
+            switch(pt)
+            {
+                case WHITE_ROOK:    attacks = Attacks_Rook(idx, occupied);      break;
+                case WHITE_BISHOP:  attacks = Attacks_Bishop(idx, occupied);    break;
+                case WHITE_KNIGHT:  attacks = Attacks_Knight(idx);              break;
+                default:            attacks = Attacks_Queen(idx, occupied);     break;
+            }
+
+            count = __builtin_popcountll(attacks & area) - mobilityTypical[pt];
+            mobility[0] += count*evalParams.midgame.mobility[pt];
+            mobility[1] += count*evalParams.endgame.mobility[pt];
+            if(trace != NULL)
+            {
+                trace->mobility[pt] += white ? count : -count;
+            }
+
+            if(attacks & kingZone)
+            {
+                ++numAttackers;
+                units += kingAttackWeights[pt]*__builtin_popcountll(attacks & kingZone);
+            }
+        }
+    }
+
+    // A lone attacker is easily dealt with, it takes several to break through
+    return (numAttackers >= 2) ? std::min(units, (int32_t) KING_ATTACK_UNITS_MAX) : 0;
+}
+
+/**
+ * Scores piece mobility and the safety of each king, both taken from a single
+ * attack pass over the pieces of each side
+ *
+ * @param pieces:       The piece boards of the position
+ * @param occupied:     Every piece on the board
+ * @param midgame:      Added to with the middlegame score, in white's favour
+ * @param endgame:      Added to with the endgame score, in white's favour
+ * @param breakdown:    Where to store the terms separately, NULL if not wanted
+ * @param trace:        Added to with the mobility counts, white's less black's, NULL if not wanted
+ */
+void Evaluation_PieceActivity(const uint64_t *pieces, uint64_t occupied, int32_t *midgame, int32_t *endgame,
+                              evalBreakdown_t *breakdown, evalTerms_t *trace)
+{
+    int32_t whiteMobility[2], blackMobility[2], whiteUnits, blackUnits, kingSafety;
+
+    whiteUnits = Evaluation_Side(pieces, occupied, true, whiteMobility, trace);
+    blackUnits = Evaluation_Side(pieces, occupied, false, blackMobility, trace);
+
+    // Danger grows faster than the attack does, and matters little once the
+    // queens and rooks which would carry out a mating attack are gone
+    kingSafety = (whiteUnits*whiteUnits - blackUnits*blackUnits) / 4;
+
+    *midgame += whiteMobility[0] - blackMobility[0] + kingSafety;
+    *endgame += whiteMobility[1] - blackMobility[1];
+
+    if(breakdown != NULL)
+    {
+        breakdown->mobility[0] = whiteMobility[0] - blackMobility[0];
+        breakdown->mobility[1] = whiteMobility[1] - blackMobility[1];
+        breakdown->kingSafety[0] = kingSafety;
+        breakdown->kingSafety[1] = 0;
+    }
+}
+
+/**
+ * Looks a position up in the evaluation cache of the calling thread
+ *
+ * @param key:      The hash key of the position
+ * @param value:    Where to store the evaluation if it was found
+ *
+ * @return  True if the position was found
+ */
+bool Evaluation_ProbeCache(uint64_t key, int64_t *value)
+{
+    const evalCacheEntry_t *entry = &evalCache[key & (EVAL_CACHE_ENTRIES - 1)];
+    searchStats_t *stats = SearchStats_Get();
+
+    stats->evalProbes++;
+    if(entry->key != key)
+    {
+        return false;
+    }
+
+    stats->evalHits++;
+    *value = entry->value;
+    return true;
+}
+
+/**
+ * Keeps the full evaluation of a position, replacing whatever shared its slot
+ */
+void Evaluation_StoreCache(uint64_t key, int64_t value)
+{
+    evalCacheEntry_t *entry = &evalCache[key & (EVAL_CACHE_ENTRIES - 1)];
+
+    entry->key = key;
+    entry->value = value;
+}
+
+/**
+ * Empties the evaluation cache of the calling thread. Needed whenever the
+ * evaluation itself changes, as what is kept would no longer be right.
+ */
+void Evaluation_ClearCache(void)
+{
+    memset(evalCache, 0, sizeof(evalCache));
+}
@@ -1,14 +1,55 @@
 #include <iostream>
+#include <chrono>
+#include <iomanip>
+#include <fstream>
 #include "util.h"
 #include "chessboard.h"
 #include "chessboard_test.h"
 #include "threatmap.h"
+#include "search_stats.h"
+#include "epd_suite.h"
+#include "bench.h"
+#include "microbench.h"
+#include "trace.h"
+#include "polyglot_book.h"
+#include "book_builder.h"
+#include "notation.h"
+#include "pgn.h"
+#include "transposition.h"
+#include "piecetables.h"
+#include "nnue.h"
+#include "trainer.h"
+#include "tuner.h"
+#include "eval_params.h"
+#include "packed_position.h"
+#include "packed_file.h"
+#include "selfplay.h"
 
 void PlayGame(void);
+static void PlayGame_UpdateThreatMap(ChessBoard *cb, moveType_t *move);
+static int ExecuteCommand(int argc, char *argv[]);
+static int BookCommand(std::string bookPath, std::string randomsPath, std::string fen);
+static int BuildBookCommand(int argc, char *argv[]);
+static int TrainCommand(int argc, char *argv[]);
+static int TuneCommand(int argc, char *argv[]);
+static int SelfPlayCommand(int argc, char *argv[]);
+static int PgnCommand(int argc, char *argv[]);
+static int PackCommand(int argc, char *argv[]);
+static int UnpackCommand(int argc, char *argv[]);
+static int PackedCommand(int argc, char *argv[]);
+static int AnalyzeCommand(int argc, char *argv[]);
+static int EvalCommand(int argc, char *argv[]);
+static uint64_t LoadNetwork(std::string path, std::string kernels);
 
-int main() 
+int main(int argc, char *argv[]) 
 {
-    uint64_t status;
+    uint64_t status = STATUS_SUCCESS;
+
+    // Tooling commands run on their own, without the interactive game
+    if(argc > 1)
+    {
+        return ExecuteCommand(argc, argv);
+    }
 
     std::cout << "Welcome to the ChessRobot by David Pownall\n\n" << std::endl;
 
@@ -43,6 +84,843 @@ int main()
     return 0;
 }
 
+/**
+ * Runs a command given on the command line instead of playing a game
+ * 
+ *  epd <suite> [msPerPosition] [maxDepth]:  Runs an EPD test suite
+ *  bench [depth] [hashMb]:                 Runs the fixed search benchmark
+ *  microbench:                             Times each search node component
+ *  test:                                   Runs the test suite
+ *  soak [interval] [depth]:                Runs the benchmark verifying the board as it goes
+ *  perf [depth]:                           Runs the benchmark with the hardware counters on
+ *  hugepages [depth] [hashMb]:             Runs the benchmark with and without huge pages
+ *  trace <file> [depth]:                   Runs the benchmark and writes out a Chrome trace
+ *  book <book> <keys> [fen]:               Looks a position up in a Polyglot book
+ *  buildbook <keys> <out> [options] <pgn>...:  Builds a Polyglot book from PGN files
+ *  pgn <pgn>...:                           Reads every game of PGN files, reporting the rate
+ *  eval [fen] [-nnue file] [-params file]:  Prints each term of the evaluation of a position
+ *  analyze <depth> [fen] [options]:        Searches a position, loading and saving the transposition table
+ *                                          and evaluating with a network if one is given
+ *  train <out> [options] <data>...:        Trains a network from files of packed positions
+ *  tune <out> [options] <data>...:         Tunes the evaluation weights against game results
+ * 
+ * @return  The exit code for the program
+ */
+static int ExecuteCommand(int argc, char *argv[])
+{
+    std::string command = argv[1];
+
+    if(command == "epd" && argc >= 3)
+    {
+        return (int) EpdSuite_Run(argv[2],
+            (argc >= 4) ? std::stoull(argv[3]) : EPD_DEFAULT_TIME_PER_POSITION_MS,
+            (argc >= 5) ? std::stoull(argv[4]) : EPD_MAX_SEARCH_DEPTH);
+    }
+
+    if(command == "bench")
+    {
+        return (int) Bench_Run((argc >= 3) ? std::stoull(argv[2]) : BENCH_DEFAULT_DEPTH,
+            (argc >= 4) ? std::stoull(argv[3]) : TT_DEFAULT_SIZE_MB);
+    }
+
+    if(command == "microbench")
+    {
+        return (int) Microbench_Run();
+    }
+
+    if(command == "test")
+    {
+        return (int) executeTestSuite();
+    }
+
+    if(command == "soak")
+    {
+        return (int) Bench_Soak((argc >= 4) ? std::stoull(argv[3]) : BENCH_DEFAULT_DEPTH,
+            (argc >= 3) ? std::stoull(argv[2]) : BENCH_DEFAULT_VERIFY_INTERVAL);
+    }
+
+    if(command == "perf")
+    {
+        return (int) Bench_Profile((argc >= 3) ? std::stoull(argv[2]) : BENCH_DEFAULT_DEPTH);
+    }
+
+    if(command == "hugepages")
+    {
+        return (int) Bench_CompareHugePages((argc >= 3) ? std::stoull(argv[2]) : BENCH_DEFAULT_DEPTH,
+            (argc >= 4) ? std::stoull(argv[3]) : BENCH_DEFAULT_HUGE_PAGES_HASH_MB);
+    }
+
+    if(command == "trace" && argc >= 3)
+    {
+#if ENABLE_TRACE
+        uint64_t status;
+
+        Trace_Reset();
+        status = Bench_Run((argc >= 4) ? std::stoull(argv[3]) : BENCH_DEFAULT_DEPTH, TT_DEFAULT_SIZE_MB);
+        Trace_PrintSummary(std::cout);
+        return (int) (status | Trace_DumpChromeJson(argv[2]));
+#else
+        std::cout << "Tracing is not compiled in, rebuild with -DENABLE_TRACE=1" << std::endl;
+        return STATUS_FAIL;
+#endif
+    }
+
+    if(command == "book" && argc >= 4)
+    {
+        return (int) BookCommand(argv[2], argv[3], (argc >= 5) ? argv[4] : START_POSITION_FEN);
+    }
+
+    if(command == "buildbook" && argc >= 5)
+    {
+        return BuildBookCommand(argc, argv);
+    }
+
+    if(command == "pgn" && argc >= 3)
+    {
+        return PgnCommand(argc, argv);
+    }
+
+    if(command == "pack" && argc >= 4)
+    {
+        return PackCommand(argc, argv);
+    }
+
+    if(command == "unpack" && argc >= 4)
+    {
+        return UnpackCommand(argc, argv);
+    }
+
+    if(command == "packed" && argc >= 3)
+    {
+        return PackedCommand(argc, argv);
+    }
+
+    if(command == "eval")
+    {
+        return EvalCommand(argc, argv);
+    }
+
+    if(command == "analyze" && argc >= 3)
+    {
+        return AnalyzeCommand(argc, argv);
+    }
+
+    if(command == "train" && argc >= 4)
+    {
+        return TrainCommand(argc, argv);
+    }
+
+    if(command == "tune" && argc >= 4)
+    {
+        return TuneCommand(argc, argv);
+    }
+
+    if(command == "selfplay" && argc >= 3)
+    {
+        return SelfPlayCommand(argc, argv);
+    }
+
+    std::cout << "Usage: " << argv[0] << " [command]\n\n"
+              << "  epd <suite> [msPerPosition] [maxDepth]   Run an EPD test suite\n"
+              << "  bench [depth] [hashMb]                   Run the fixed search benchmark\n"
+              << "  microbench                               Time each search node component, as JSON\n"
+              << "  test                                     Run the test suite\n"
+              << "  soak [interval] [depth]                  Run the benchmark, verifying the board every interval moves\n"
+              << "  perf [depth]                             Run the benchmark, reporting hardware counters per node\n"
+              << "  hugepages [depth] [hashMb]               Run the benchmark with small then huge pages, comparing speed\n"
+              << "  trace <file> [depth]                     Run the benchmark, writing a Chrome trace to file\n"
+              << "  book <book> <keys> [fen]                 Look a position up in a Polyglot book\n"
+              << "  buildbook <keys> <out> [-ply N] [-min N] [-threads N] [-mem MB] <pgn>...\n"
+              << "                                           Build a Polyglot book from PGN files\n"
+              << "  pgn <pgn>...                             Read every game of PGN files, reporting moves per second\n"
+              << "  pack <epd> <out> [-append]               Convert EPD or FEN lines to packed positions\n"
+              << "  unpack <packed> <epd> [-shard i/n]       Convert packed positions to EPD lines\n"
+              << "  packed <packed>...                       Read every packed position of files, reporting read speed\n"
+              << "  eval [fen] [-nnue file] [-params file]   Print each term of the evaluation of a position\n"
+              << "  analyze <depth> [fen] [-hash MB] [-load file] [-save file] [-nnue file] [-kernels name] [-params file]\n"
+              << "                                           Search a position, loading and saving the transposition table\n"
+              << "  train <out> [-epochs N] [-batch N] [-threads N] [-lr x] [-lambda x] [-scale cp] [-seed N] <data>...\n"
+              << "                                           Train a network from files of packed positions\n"
+              << "  tune <out> [-iterations N] [-threads N] [-max N] [-lr x] [-scale cp] [-params file] <data>...\n"
+              << "                                           Tune the evaluation weights against the results of packed positions\n"
+              << "  selfplay <out> [-positions N] [-threads N] [-nodes N] [-random N] [-hash MB] [-seed N] [-nnue file] [-params file]\n"
+              << "                                           Play the engine against itself, adding its positions to a packed file" << std::endl;
+    return STATUS_FAIL;
+}
+
+
+/**
+ * Looks a position up in a Polyglot book and prints its key and the move the
+ * book would play
+ *
+ * @param bookPath:     The .bin book to probe
+ * @param randomsPath:  The Polyglot key table
+ * @param fen:          The position to look up
+ *
+ * @return  The exit code for the program
+ */
+static int BookCommand(std::string bookPath, std::string randomsPath, std::string fen)
+{
+    ChessBoard *cb = new ChessBoard();
+    moveType_t bookMove;
+    char moveStr[NOTATION_MAX_MOVE_LENGTH];
+    uint64_t status = STATUS_FAIL;
+
+    if(cb->SetBoardFromFEN(fen) != STATUS_SUCCESS)
+    {
+        std::cout << "Bad position: " << fen << std::endl;
+    }
+    else if(PolyglotBook_LoadRandoms(randomsPath) != STATUS_SUCCESS)
+    {
+        std::cout << "Unable to load Polyglot key table " << randomsPath << std::endl;
+    }
+    else if(PolyglotBook_Open(bookPath) != STATUS_SUCCESS)
+    {
+        std::cout << "Unable to open book " << bookPath << std::endl;
+    }
+    else
+    {
+        std::cout << "Key: " << std::hex << PolyglotBook_ComputeKey(cb) << std::dec << std::endl;
+        status = PolyglotBook_Probe(cb, BOOK_SELECT_BEST, &bookMove);
+        if(status == STATUS_SUCCESS)
+        {
+            Notation_FormatSan(cb, &bookMove, moveStr);
+            std::cout << "Book move: " << moveStr << std::endl;
+        }
+        else
+        {
+            std::cout << "Position not in book" << std::endl;
+        }
+        PolyglotBook_Close();
+    }
+
+    delete cb;
+    return (int) status;
+}
+
+/**
+ * Builds a Polyglot book from PGN files, ie.
+ *
+ *  buildbook polyglot_random64.txt book.bin -ply 24 -min 5 games1.pgn games2.pgn
+ *
+ * @return  The exit code for the program
+ */
+static int BuildBookCommand(int argc, char *argv[])
+{
+    bookBuilderConfig_t config;
+    std::vector<std::string> pgnPaths;
+    std::string option;
+
+    BookBuilder_DefaultConfig(&config);
+
+    for(int i = 4; i < argc; ++i)
+    {
+        option = argv[i];
+        if(option[0] == '-' && i + 1 < argc)
+        {
+            if(option == "-ply")            config.maxPly = std::stoull(argv[++i]);
+            else if(option == "-min")       config.minGames = std::stoull(argv[++i]);
+            else if(option == "-threads")   config.numThreads = std::stoull(argv[++i]);
+            else if(option == "-mem")       config.memoryMb = std::stoull(argv[++i]);
+            else
+            {
+                std::cout << "Unknown option " << option << std::endl;
+                return STATUS_FAIL;
+            }
+            continue;
+        }
+        pgnPaths.push_back(option);
+    }
+
+    if(pgnPaths.empty())
+    {
+        std::cout << "No PGN files given" << std::endl;
+        return STATUS_FAIL;
+    }
+
+    if(PolyglotBook_LoadRandoms(argv[2]) != STATUS_SUCCESS)
+    {
+        std::cout << "Unable to load Polyglot key table " << argv[2] << std::endl;
+        return STATUS_FAIL;
+    }
+
+    return (int) BookBuilder_Build(pgnPaths, argv[3], &config);
+}
+
+/**
+ * Trains a network from files of packed positions, ie.
+ *
+ *  train net.nnue -epochs 20 -threads 8 -lambda 0.5 selfplay1.bin selfplay2.bin
+ *
+ * @return  The exit code for the program
+ */
+static int TrainCommand(int argc, char *argv[])
+{
+    trainerConfig_t config;
+    std::vector<std::string> dataPaths;
+    std::string option;
+
+    Trainer_DefaultConfig(&config);
+
+    for(int i = 3; i < argc; ++i)
+    {
+        option = argv[i];
+        if(option[0] == '-' && i + 1 < argc)
+        {
+            if(option == "-epochs")         config.epochs = std::stoull(argv[++i]);
+            else if(option == "-batch")     config.batchSize = std::stoull(argv[++i]);
+            else if(option == "-threads")   config.numThreads = std::stoull(argv[++i]);
+            else if(option == "-lr")        config.learningRate = std::stod(argv[++i]);
+            else if(option == "-lambda")    config.lambda = std::stod(argv[++i]);
+            else if(option == "-scale")     config.scoreScale = std::stod(argv[++i]);
+            else if(option == "-seed")      config.seed = std::stoull(argv[++i]);
+            else
+            {
+                std::cout << "Unknown option " << option << std::endl;
+                return STATUS_FAIL;
+            }
+            continue;
+        }
+        dataPaths.push_back(option);
+    }
+
+    if(dataPaths.empty())
+    {
+        std::cout << "No data files given" << std::endl;
+        return STATUS_FAIL;
+    }
+
+    return (int) Trainer_Train(dataPaths, argv[2], &config);
+}
+
+/**
+ * Tunes the evaluation weights against the results of packed positions, ie.
+ *
+ *  tune tuned.txt -iterations 2000 -threads 8 selfplay1.bin selfplay2.bin
+ *
+ * @return  The exit code for the program
+ */
+static int TuneCommand(int argc, char *argv[])
+{
+    tunerConfig_t config;
+    std::vector<std::string> dataPaths;
+    std::string option;
+
+    Tuner_DefaultConfig(&config);
+
+    for(int i = 3; i < argc; ++i)
+    {
+        option = argv[i];
+        if(option[0] == '-' && i + 1 < argc)
+        {
+            if(option == "-iterations")     config.iterations = std::stoull(argv[++i]);
+            else if(option == "-threads")   config.numThreads = std::stoull(argv[++i]);
+            else if(option == "-max")       config.maxPositions = std::stoull(argv[++i]);
+            else if(option == "-lr")        config.learningRate = std::stod(argv[++i]);
+            else if(option == "-scale")     config.scale = std::stod(argv[++i]);
+            else if(option == "-params")
+            {
+                // Tuning carries on from the weights given
+                if(EvalParams_Load(argv[++i]) != STATUS_SUCCESS)
+                {
+                    return STATUS_FAIL;
+                }
+            }
+            else
+            {
+                std::cout << "Unknown option " << option << std::endl;
+                return STATUS_FAIL;
+            }
+            continue;
+        }
+        dataPaths.push_back(option);
+    }
+
+    if(dataPaths.empty())
+    {
+        std::cout << "No data files given" << std::endl;
+        return STATUS_FAIL;
+    }
+
+    return (int) Tuner_Tune(dataPaths, argv[2], &config);
+}
+
+/**
+ * Generates training data from games of the engine against itself, ie.
+ *
+ *  selfplay selfplay.bin -positions 10000000 -threads 8 -nodes 10000
+ *
+ * Running the same command again after it was stopped carries on from the
+ * positions already in the file.
+ *
+ * @return  The exit code for the program
+ */
+static int SelfPlayCommand(int argc, char *argv[])
+{
+    selfPlayConfig_t config;
+    std::string option, networkPath, paramsPath;
+
+    SelfPlay_DefaultConfig(&config);
+
+    for(int i = 3; i < argc; ++i)
+    {
+        option = argv[i];
+        if(option[0] == '-' && i + 1 < argc)
+        {
+            if(option == "-positions")      config.numPositions = std::stoull(argv[++i]);
+            else if(option == "-threads")   config.numThreads = std::stoull(argv[++i]);
+            else if(option == "-nodes")     config.nodesPerMove = std::stoull(argv[++i]);
+            else if(option == "-random")    config.randomPlies = std::stoull(argv[++i]);
+            else if(option == "-hash")      config.hashMb = std::stoull(argv[++i]);
+            else if(option == "-seed")      config.seed = std::stoull(argv[++i]);
+            else if(option == "-nnue")      networkPath = argv[++i];
+            else if(option == "-params")    paramsPath = argv[++i];
+            else
+            {
+                std::cout << "Unknown option " << option << std::endl;
+                return STATUS_FAIL;
+            }
+            continue;
+        }
+        std::cout << "Unexpected argument " << option << std::endl;
+        return STATUS_FAIL;
+    }
+
+    if(!paramsPath.empty() && EvalParams_Load(paramsPath) != STATUS_SUCCESS)
+    {
+        return STATUS_FAIL;
+    }
+    if(!networkPath.empty() && LoadNetwork(networkPath, "auto") != STATUS_SUCCESS)
+    {
+        return STATUS_FAIL;
+    }
+
+    return (int) SelfPlay_Generate(argv[2], &config);
+}
+
+/**
+ * Reads and plays out every game of PGN files, to check them and to measure
+ * how quickly games can be read
+ *
+ * @return  The exit code for the program
+ */
+static int PgnCommand(int argc, char *argv[])
+{
+    ChessBoard *cb = new ChessBoard();
+    pgnGame_t *game = new pgnGame_t;
+    pgnReader_t reader;
+    uint64_t numGames = 0, numTruncated = 0, numMoves = 0, elapsedMs, status = STATUS_SUCCESS;
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    for(int i = 2; i < argc; ++i)
+    {
+        if(Pgn_Open(&reader, argv[i]) != STATUS_SUCCESS)
+        {
+            std::cout << "Unable to open " << argv[i] << std::endl;
+            status = STATUS_FAIL;
+            continue;
+        }
+
+        while(Pgn_ReadGame(&reader, cb, PGN_ALL_MOVES, game) == STATUS_SUCCESS)
+        {
+            ++numGames;
+            numTruncated += game->truncated ? 1 : 0;
+            numMoves += game->numMoves;
+        }
+        Pgn_Close(&reader);
+    }
+
+    elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - startTime).count();
+
+    std::cout << "Games: " << numGames << " (" << numTruncated << " with unplayable moves)"
+              << " Moves: " << numMoves << " Time (ms): " << elapsedMs
+              << " Moves/s: " << numMoves*1000/(elapsedMs ? elapsedMs : 1) << std::endl;
+
+    delete game;
+    delete cb;
+    return (int) status;
+}
+
+/**
+ * Converts EPD lines, or FENs, to a packed position file, taking the score
+ * from each line's ce operation and the result from its c9, ie.
+ *
+ *  pack positions.epd positions.bin
+ *
+ * @return  The exit code for the program
+ */
+static int PackCommand(int argc, char *argv[])
+{
+    ChessBoard *cb = new ChessBoard();
+    std::ifstream in(argv[2]);
+    packedWriter_t writer;
+    packedPosition_t record;
+    std::string line;
+    uint64_t lineNum = 0, numSkipped = 0, status;
+
+    if(!in.is_open())
+    {
+        std::cout << "Unable to open " << argv[2] << std::endl;
+        delete cb;
+        return STATUS_FAIL;
+    }
+
+    if(PackedFile_OpenWriter(&writer, argv[3], argc >= 5 && std::string(argv[4]) == "-append") != STATUS_SUCCESS)
+    {
+        delete cb;
+        return STATUS_FAIL;
+    }
+
+    while(std::getline(in, line))
+    {
+        ++lineNum;
+        if(line.find_first_not_of(" \t\r") == std::string::npos)
+        {
+            continue;
+        }
+
+        if(PackedPosition_FromEpd(cb, line, &record) != STATUS_SUCCESS)
+        {
+            std::cout << argv[2] << ":" << lineNum << ": unable to pack position" << std::endl;
+            ++numSkipped;
+            continue;
+        }
+        PackedFile_Write(&writer, &record);
+    }
+
+    std::cout << "Records: " << writer.numRecords << " Skipped: " << numSkipped << std::endl;
+    status = PackedFile_CloseWriter(&writer);
+    delete cb;
+    return (int) status;
+}
+
+/**
+ * Converts a packed position file, or one shard of it, back to EPD lines, ie.
+ *
+ *  unpack positions.bin positions.epd -shard 0/4
+ *
+ * @return  The exit code for the program
+ */
+static int UnpackCommand(int argc, char *argv[])
+{
+    const packedPosition_t *records;
+    packedReader_t reader;
+    std::ofstream out;
+    std::string shard;
+    uint64_t numRecords, shardIdx = 0, numShards = 1;
+
+    if(argc >= 6 && std::string(argv[4]) == "-shard")
+    {
+        shard = argv[5];
+        if(shard.find('/') == std::string::npos)
+        {
+            std::cout << "Expected the shard as i/n" << std::endl;
+            return STATUS_FAIL;
+        }
+        shardIdx = std::stoull(shard.substr(0, shard.find('/')));
+        numShards = std::stoull(shard.substr(shard.find('/') + 1));
+        if(shardIdx >= numShards)
+        {
+            std::cout << "Shard " << shard << " does not exist" << std::endl;
+            return STATUS_FAIL;
+        }
+    }
+
+    if(PackedFile_OpenReader(&reader, argv[2]) != STATUS_SUCCESS)
+    {
+        return STATUS_FAIL;
+    }
+    PackedFile_SetShard(&reader, shardIdx, numShards);
+
+    out.open(argv[3], std::ios::trunc);
+    while((numRecords = PackedFile_Read(&reader, &records, PACKED_WRITER_BUFFER_RECORDS)) > 0)
+    {
+        for(uint64_t i = 0; i < numRecords; ++i)
+        {
+            out << PackedPosition_ToEpd(&records[i]) << "\n";
+        }
+    }
+    PackedFile_CloseReader(&reader);
+
+    if(!out.good())
+    {
+        std::cout << "Unable to write " << argv[3] << std::endl;
+        return STATUS_FAIL;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Reads every record of packed position files, checking each could be a
+ * position, to measure how quickly positions can be fed to training
+ *
+ * @return  The exit code for the program
+ */
+static int PackedCommand(int argc, char *argv[])
+{
+    const packedPosition_t *records;
+    packedReader_t reader;
+    uint64_t numPieces, numRead, total = 0, numBad = 0, results[3] = { 0, 0, 0 }, elapsedMs;
+    uint64_t status = STATUS_SUCCESS;
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    for(int i = 2; i < argc; ++i)
+    {
+        if(PackedFile_OpenReader(&reader, argv[i]) != STATUS_SUCCESS)
+        {
+            status = STATUS_FAIL;
+            continue;
+        }
+
+        while((numRead = PackedFile_Read(&reader, &records, PACKED_WRITER_BUFFER_RECORDS)) > 0)
+        {
+            for(uint64_t j = 0; j < numRead; ++j)
+            {
+                numPieces = __builtin_popcountll(records[j].occupied);
+                if(numPieces < 2 || numPieces > PACKED_MAX_PIECES
+                   || records[j].result < PACKED_RESULT_BLACK_WIN || records[j].result > PACKED_RESULT_WHITE_WIN)
+                {
+                    ++numBad;
+                    continue;
+                }
+                results[records[j].result - PACKED_RESULT_BLACK_WIN]++;
+            }
+            total += numRead;
+        }
+        PackedFile_CloseReader(&reader);
+    }
+
+    elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - startTime).count();
+
+    std::cout << "Records: " << total << " (" << numBad << " malformed)"
+              << " White wins: " << results[2] << " Draws: " << results[1] << " Black wins: " << results[0]
+              << " Time (ms): " << elapsedMs
+              << " Records/s: " << total*1000/(elapsedMs ? elapsedMs : 1)
+              << " MB/s: " << total*sizeof(packedPosition_t)*1000/(1024*1024)/(elapsedMs ? elapsedMs : 1) << std::endl;
+
+    return (int) ((numBad > 0) ? STATUS_FAIL : status);
+}
+
+/**
+ * Loads a network to evaluate with in place of the hand written terms
+ *
+ * @param path:     The network file
+ * @param kernels:  The kernels to run it on, "auto" for the widest supported
+ *
+ * @return  STATUS_SUCCESS if the network is ready, STATUS_FAIL otherwise
+ */
+static uint64_t LoadNetwork(std::string path, std::string kernels)
+{
+    if(Nnue_SelectKernels(kernels) != STATUS_SUCCESS)
+    {
+        std::cout << "Kernels " << kernels << " are not supported" << std::endl;
+        return STATUS_FAIL;
+    }
+    if(Nnue_Load(path) != STATUS_SUCCESS)
+    {
+        std::cout << "Unable to load network " << path << std::endl;
+        return STATUS_FAIL;
+    }
+
+    // Anything evaluated so far was by the other evaluation
+    Evaluation_ClearCache();
+    std::cout << "info string network " << path << " using " << Nnue_GetKernelsName() << std::endl;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Prints the evaluation of a position term by term, as middlegame and endgame
+ * scores in white's favour, along with the phase they are blended by. With a
+ * network given, its score is printed as well.
+ *
+ * @return  The exit code for the program
+ */
+static int EvalCommand(int argc, char *argv[])
+{
+    ChessBoard *cb = new ChessBoard();
+    evalBreakdown_t breakdown;
+    std::string fen = START_POSITION_FEN, option, networkPath, paramsPath;
+
+    for(int i = 2; i < argc; ++i)
+    {
+        option = argv[i];
+        if(option == "-nnue" && i + 1 < argc)
+        {
+            networkPath = argv[++i];
+            continue;
+        }
+        if(option == "-params" && i + 1 < argc)
+        {
+            paramsPath = argv[++i];
+            continue;
+        }
+        fen = option;
+    }
+
+    if((!networkPath.empty() && LoadNetwork(networkPath, "auto") != STATUS_SUCCESS)
+        || (!paramsPath.empty() && EvalParams_Load(paramsPath) != STATUS_SUCCESS))
+    {
+        delete cb;
+        return STATUS_FAIL;
+    }
+
+    if(cb->SetBoardFromFEN(fen) != STATUS_SUCCESS)
+    {
+        std::cout << "Bad position: " << fen << std::endl;
+        delete cb;
+        return STATUS_FAIL;
+    }
+
+    ChessBoard::EvaluateBreakdown(cb, &breakdown);
+
+    std::cout << "Term          Midgame  Endgame\n"
+              << "Material     " << std::setw(8) << breakdown.material[0] << " " << std::setw(8) << breakdown.material[1] << "\n"
+              << "Pawns        " << std::setw(8) << breakdown.pawns[0] << " " << std::setw(8) << breakdown.pawns[1] << "\n"
+              << "Mobility     " << std::setw(8) << breakdown.mobility[0] << " " << std::setw(8) << breakdown.mobility[1] << "\n"
+              << "King safety  " << std::setw(8) << breakdown.kingSafety[0] << " " << std::setw(8) << breakdown.kingSafety[1] << "\n"
+              << "Phase: " << breakdown.phase << "/" << PHASE_MAX << " Total: " << breakdown.total << std::endl;
+    if(Nnue_IsLoaded())
+    {
+        std::cout << "Network: " << ChessBoard::EvaluateCurrentBoardValue(cb) << std::endl;
+    }
+
+    delete cb;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Searches a single position, deepening one ply at a time. The transposition
+ * table can be loaded before the search and saved after it, so analysis can
+ * be carried on from one run to the next.
+ *
+ * @return  The exit code for the program
+ */
+static int AnalyzeCommand(int argc, char *argv[])
+{
+    ChessBoard *cb = new ChessBoard();
+    moveType_t *rootMoves;
+    char moveStr[NOTATION_MAX_MOVE_LENGTH];
+    std::string fen = START_POSITION_FEN, option, loadPath, savePath, networkPath, paramsPath, kernels = "auto";
+    uint64_t maxDepth = std::stoull(argv[2]), hashMb = TT_DEFAULT_SIZE_MB, status = STATUS_SUCCESS;
+    int32_t score;
+    std::chrono::steady_clock::time_point startTime;
+
+    for(int i = 3; i < argc; ++i)
+    {
+        option = argv[i];
+        if(option[0] == '-' && i + 1 < argc)
+        {
+            if(option == "-hash")           hashMb = std::stoull(argv[++i]);
+            else if(option == "-load")      loadPath = argv[++i];
+            else if(option == "-save")      savePath = argv[++i];
+            else if(option == "-nnue")      networkPath = argv[++i];
+            else if(option == "-kernels")   kernels = argv[++i];
+            else if(option == "-params")    paramsPath = argv[++i];
+            else
+            {
+                std::cout << "Unknown option " << option << std::endl;
+                delete cb;
+                return STATUS_FAIL;
+            }
+            continue;
+        }
+        fen = option;
+    }
+
+    // The board's scores are worked out from the weights, so they come first
+    if(!paramsPath.empty() && EvalParams_Load(paramsPath) != STATUS_SUCCESS)
+    {
+        delete cb;
+        return STATUS_FAIL;
+    }
+
+    if(cb->SetBoardFromFEN(fen) != STATUS_SUCCESS)
+    {
+        std::cout << "Bad position: " << fen << std::endl;
+        delete cb;
+        return STATUS_FAIL;
+    }
+
+    // A loaded table brings its own size along
+    if(!loadPath.empty())
+    {
+        if(TT_Load(loadPath) != STATUS_SUCCESS)
+        {
+            std::cout << "Unable to load transposition table " << loadPath << std::endl;
+            delete cb;
+            return STATUS_FAIL;
+        }
+        std::cout << "Loaded a " << TT_GetSizeMb() << "MB transposition table from " << loadPath << std::endl;
+    }
+    else if(TT_Resize(hashMb) != STATUS_SUCCESS)
+    {
+        delete cb;
+        return STATUS_FAIL;
+    }
+    std::cout << "info string hash " << TT_GetSizeMb() << "MB using " << TT_GetPageModeName() << std::endl;
+
+    if(!networkPath.empty() && LoadNetwork(networkPath, kernels) != STATUS_SUCCESS)
+    {
+        delete cb;
+        return STATUS_FAIL;
+    }
+
+    ThreatMap_Clear();
+    ThreatMap_Generate(cb->GetPieces(), cb->GetOccupied());
+
+    rootMoves = cb->GenerateMoves(cb->GetColorToMove());
+
+    Search_NewSearch();
+    SearchStats_Reset();
+    Search_SetTimeLimit(0);
+    startTime = std::chrono::steady_clock::now();
+    for(uint64_t depth = 1; depth <= maxDepth; ++depth)
+    {
+        // Scores are reported from the side to move
+        score = cb->SearchFromRoot(depth, rootMoves);
+        if(cb->GetAddrOfBestMove() != NULL)
+        {
+            Notation_FormatUci(cb->GetAddrOfBestMove(), moveStr);
+        }
+        SearchStats_PrintUciInfo(std::cout, (cb->GetColorToMove() == WHITE_PIECES) ? score : -score,
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - startTime).count(),
+            (cb->GetAddrOfBestMove() != NULL) ? moveStr : NULL);
+    }
+    FreeMoveList(rootMoves);
+
+    if(!savePath.empty())
+    {
+        status = TT_Save(savePath);
+        std::cout << ((status == STATUS_SUCCESS) ? "Saved" : "Unable to save")
+                  << " transposition table " << savePath << std::endl;
+    }
+
+    delete cb;
+    return (int) status;
+}
+
+/**
+ * Brings the threat map up to date with a move played in the game. The
+ * update only follows a single piece moving, so castling, en passant and
+ * promotions rebuild the map instead.
+ *
+ * @param cb:   The board, with the move already applied
+ * @param move: The move played
+ */
+static void PlayGame_UpdateThreatMap(ChessBoard *cb, moveType_t *move)
+{
+    if(move->promotion != PROMOTION_NONE || move->enPassant
+        || (move->moveVal & (MOVE_VALID_CASTLE_KING | MOVE_VALID_CASTLE_QUEEN)))
+    {
+        ThreatMap_Clear();
+        ThreatMap_Generate(cb->GetPieces(), cb->GetOccupied());
+        return;
+    }
+    ThreatMap_Update(move, cb->GetPieces(), cb->GetOccupied(), true);
+}
 
 /**
  * Entry point where we run the game from. Split into two stages
@@ -55,8 +933,11 @@ int main()
  */
 void PlayGame(void)
 {
-    moveType_t *tempMove, *ourMoves, selectedMove;
-    std::string str;
+    moveType_t opponentMove, *ourMoves, selectedMove;
+    char moveStr[NOTATION_MAX_MOVE_LENGTH];
+    std::string str, path;
+    int32_t score;
+    std::chrono::steady_clock::time_point startTime;
 
     // Get the board
     ChessBoard *cb = new ChessBoard();
@@ -67,6 +948,13 @@ void PlayGame(void)
 
     ThreatMap_Generate(cb->GetPieces(), cb->GetOccupied());
 
+    // The book is optional, without one every move is searched
+    if(PolyglotBook_LoadRandoms(POLYGLOT_DEFAULT_RANDOMS_PATH) == STATUS_SUCCESS
+        && PolyglotBook_Open(POLYGLOT_DEFAULT_BOOK_PATH) == STATUS_SUCCESS)
+    {
+        std::cout << "Using opening book " << POLYGLOT_DEFAULT_BOOK_PATH << std::endl;
+    }
+
     // Main loop of the chess game, we are playing as black
     while(true)
     {
@@ -75,35 +963,67 @@ void PlayGame(void)
         str.clear();
         std::cout << "Please enter move: ";
         std::cin >> str;
-        tempMove = ConvertStringToMove(cb, str);
 
-        Util_Assert(tempMove != NULL, "Received bad move!");
+        // The table can be kept between sessions, ie. to pick an analysis back up
+        if(str == "savett" || str == "loadtt")
+        {
+            std::cin >> path;
+            if(((str == "savett") ? TT_Save(path) : TT_Load(path)) != STATUS_SUCCESS)
+            {
+                std::cout << "Unable to " << ((str == "savett") ? "save" : "load")
+                          << " transposition table " << path << std::endl;
+            }
+            continue;
+        }
+
+        if(Notation_ParseSan(cb, str.c_str(), str.length(), &opponentMove) != STATUS_SUCCESS)
+        {
+            std::cout << "Not a legal move: " << str << std::endl;
+            continue;
+        }
+
+        cb->ApplyMoveToBoard(&opponentMove);
+        PlayGame_UpdateThreatMap(cb, &opponentMove);
+
+        // State 2, a book move needs no search at all
+        if(PolyglotBook_Probe(cb, BOOK_SELECT_WEIGHTED, &selectedMove) != STATUS_SUCCESS)
+        {
+            ourMoves = cb->GenerateMoves(BLACK_PIECES);
 
-        cb->ApplyMoveToBoard(tempMove);
-        ThreatMap_Update(tempMove, cb->GetPieces(), cb->GetOccupied(), true);
-        ourMoves = cb->GenerateMoves(BLACK_PIECES);
+            // Deepen one ply at a time so progress is reported as we go. The
+            // table and history carry over from the searches of earlier moves
+            Search_NewSearch();
+            SearchStats_Reset();
+            startTime = std::chrono::steady_clock::now();
+            for(uint64_t depth = 1; depth <= SEARCH_DEPTH; ++depth)
+            {
+                // We play black, the info line wants the score from our side
+                score = cb->SearchFromRoot(depth, ourMoves);
+                if(cb->GetAddrOfBestMove() != NULL)
+                {
+                    Notation_FormatUci(cb->GetAddrOfBestMove(), moveStr);
+                }
+                SearchStats_PrintUciInfo(std::cout, -score,
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - startTime).count(),
+                    (cb->GetAddrOfBestMove() != NULL) ? moveStr : NULL);
+            }
 
-        // State 2
-        cb->GetBestMove(SEARCH_DEPTH, false, ourMoves, INT32_MIN, INT32_MAX);
+            Util_Assert(cb->GetAddrOfBestMove() != NULL, "Failed to find valid move!");
 
-        Util_Assert(cb->GetAddrOfBestMove() != NULL, "Failed to find valid move!");
+            // Save a copy of our best move
+            selectedMove = *(cb->GetAddrOfBestMove());
+            FreeMoveList(ourMoves);
+        }
 
-        // Save a copy of our best move
-        selectedMove = *(cb->GetAddrOfBestMove());
+        // SAN depends on the position the move is played from, so write it out first
+        Notation_FormatSan(cb, &selectedMove, moveStr);
 
         // Actually apply our chosen move to the board
         cb->ApplyMoveToBoard(&selectedMove);
-        ThreatMap_Update(&selectedMove, cb->GetPieces(), cb->GetOccupied(), true);
-
-        // Cleanup
-        while(ourMoves != NULL && ourMoves->legalMove)
-        {
-            tempMove = ourMoves->adjMove;
-            delete ourMoves;
-            ourMoves = tempMove;
-        }
+        PlayGame_UpdateThreatMap(cb, &selectedMove);
 
         // State 3
-        std::cout << "Response:" << ConvertMoveToString(cb, &selectedMove) << std::endl;
+        std::cout << "Response: " << moveStr << std::endl;
     }
 }
\ No newline at end of file
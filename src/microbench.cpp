@@ -0,0 +1,295 @@
+/* This file is responsible for timing the individual components of a search node */
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "chessboard.h"
+#include "threatmap.h"
+#include "microbench.h"
+
+#define MICROBENCH_POSITIONS_PER_PHASE 6
+
+/**
+ * The positions each component is measured over, grouped by game phase since
+ * the cost of most components depends heavily on how much material is left
+ */
+typedef struct microbenchCorpus_s
+{
+    const char *phase;
+    const char *fens[MICROBENCH_POSITIONS_PER_PHASE];
+} microbenchCorpus_t;
+
+static const microbenchCorpus_t microbenchCorpus[] =
+{
+    {
+        "opening",
+        {
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+            "r1bqkbnr/pp1ppppp/2n5/2p5/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+            "rnbqkb1r/pp2pppp/3p1n2/8/3NP3/8/PPP2PPP/RNBQKB1R w KQkq - 1 5",
+            "rnbqk2r/ppp1bppp/4pn2/3p4/2PP4/2N2N2/PP2PPPP/R1BQKB1R w KQkq - 4 5",
+            "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP1B1PPP/R2QKB1R w KQ - 3 8",
+        }
+    },
+    {
+        "middlegame",
+        {
+            "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+            "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+            "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+            "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+            "r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16",
+            "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+        }
+    },
+    {
+        "endgame",
+        {
+            "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+            "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+            "8/pp2r1k1/2p1p3/3pP2p/1P1P1P1P/P5KR/8/8 w - - 0 1",
+            "6k1/6p1/P6p/r1N5/5p2/7P/1b3PP1/4R1K1 w - - 0 1",
+            "8/5k2/8/2R5/8/8/3r4/4K3 w - - 0 1",
+            "6k1/5p2/6p1/8/7p/8/6PP/6K1 b - - 0 1",
+        }
+    },
+};
+
+#define NUM_MICROBENCH_PHASES (sizeof(microbenchCorpus) / sizeof(microbenchCorpus[0]))
+
+// Keeps the compiler from discarding work whose result we never look at
+static volatile int64_t microbenchSink;
+
+/**
+ * Signature for a single component measurement over one position
+ *
+ * @param cb:           The board, set up with the position and its threat map
+ * @param elapsedNs:    Incremented by the time spent in the component itself
+ *
+ * @return  The number of operations which were timed
+ */
+typedef uint64_t (*microbenchFunc_t)(ChessBoard *cb, uint64_t *elapsedNs);
+
+static inline uint64_t Microbench_NowNs(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Rebuilds the threat map from scratch for the board
+ */
+static void Microbench_ResetThreatMap(ChessBoard *cb)
+{
+    ThreatMap_Clear();
+    ThreatMap_Generate(cb->GetPieces(), cb->GetOccupied());
+}
+
+static uint64_t Microbench_GenerateMoves(ChessBoard *cb, uint64_t *elapsedNs)
+{
+    moveType_t *moveLists[MICROBENCH_REPETITIONS];
+    uint64_t startNs;
+
+    startNs = Microbench_NowNs();
+    for(uint64_t r = 0; r < MICROBENCH_REPETITIONS; ++r)
+    {
+        moveLists[r] = cb->GenerateMoves(cb->GetColorToMove());
+    }
+    *elapsedNs += Microbench_NowNs() - startNs;
+
+    // Releasing the lists is not part of generation
+    for(uint64_t r = 0; r < MICROBENCH_REPETITIONS; ++r)
+    {
+        FreeMoveList(moveLists[r]);
+    }
+    return MICROBENCH_REPETITIONS;
+}
+
+static uint64_t Microbench_ApplyUndoMove(ChessBoard *cb, uint64_t *elapsedNs)
+{
+    moveType_t *moveList = cb->GenerateMoves(cb->GetColorToMove()), *move;
+    uint64_t startNs, numOps = 0;
+
+    startNs = Microbench_NowNs();
+    for(uint64_t r = 0; r < MICROBENCH_REPETITIONS; ++r)
+    {
+        for(move = moveList; move != NULL && move->legalMove; move = move->adjMove)
+        {
+            cb->ApplyMoveToBoard(move);
+            cb->UndoMoveFromBoard(move);
+            ++numOps;
+        }
+    }
+    *elapsedNs += Microbench_NowNs() - startNs;
+
+    FreeMoveList(moveList);
+    return numOps;
+}
+
+static uint64_t Microbench_EvaluateBoard(ChessBoard *cb, uint64_t *elapsedNs)
+{
+    uint64_t startNs;
+    int64_t sum = 0;
+
+    startNs = Microbench_NowNs();
+    for(uint64_t r = 0; r < MICROBENCH_REPETITIONS; ++r)
+    {
+        sum += ChessBoard::EvaluateCurrentBoardValue(cb);
+    }
+    *elapsedNs += Microbench_NowNs() - startNs;
+
+    microbenchSink = sum;
+    return MICROBENCH_REPETITIONS;
+}
+
+/**
+ * Times a threat map update for each move available in the position. Every
+ * update is made against a freshly generated map, so each call is timed on
+ * its own and the rebuild in between is left out.
+ */
+static uint64_t Microbench_UpdateThreatMap(ChessBoard *cb, uint64_t *elapsedNs)
+{
+    moveType_t *moveList = cb->GenerateMoves(cb->GetColorToMove()), *move;
+    uint64_t pieces[NUM_PIECE_TYPES + 2], occupied, startNs, numOps = 0;
+
+    for(move = moveList; move != NULL && move->legalMove; move = move->adjMove)
+    {
+        // The threat map only follows a single piece moving, special moves rebuild it
+        if(move->promotion != PROMOTION_NONE || move->enPassant
+            || (move->moveVal & (MOVE_VALID_CASTLE_KING | MOVE_VALID_CASTLE_QUEEN)))
+        {
+            continue;
+        }
+
+        cb->ApplyMoveToBoard(move);
+        std::copy(cb->GetPieces(), cb->GetPieces() + NUM_PIECE_TYPES + 2, pieces);
+        occupied = cb->GetOccupied();
+        cb->UndoMoveFromBoard(move);
+
+        startNs = Microbench_NowNs();
+        ThreatMap_Update(move, pieces, occupied, true);
+        *elapsedNs += Microbench_NowNs() - startNs;
+        ++numOps;
+
+        Microbench_ResetThreatMap(cb);
+    }
+
+    FreeMoveList(moveList);
+    return numOps;
+}
+
+static uint64_t Microbench_QueryThreatMap(ChessBoard *cb, uint64_t *elapsedNs)
+{
+    uint64_t occupied = cb->GetOccupied(), blackPieces = cb->GetBlackPieces(), pieces, startNs;
+    int64_t sum = 0;
+
+    // The question the search asks, whether the other side attacks each piece
+    startNs = Microbench_NowNs();
+    for(uint64_t r = 0; r < MICROBENCH_REPETITIONS; ++r)
+    {
+        for(pieces = occupied; pieces; pieces &= pieces - 1)
+        {
+            sum += ThreatMap_IsIndexUnderThreat(__builtin_ctzll(pieces), (blackPieces & (pieces & -pieces)) != 0);
+        }
+    }
+    *elapsedNs += Microbench_NowNs() - startNs;
+
+    microbenchSink = sum;
+    return MICROBENCH_REPETITIONS * __builtin_popcountll(occupied);
+}
+
+/**
+ * Components under measurement, along with the name they are reported as
+ */
+static const struct
+{
+    const char *name;
+    microbenchFunc_t func;
+} microbenchComponents[] =
+{
+    { "GenerateMoves",                  Microbench_GenerateMoves },
+    { "ApplyMoveToBoard+UndoMoveFromBoard", Microbench_ApplyUndoMove },
+    { "EvaluateCurrentBoardValue",      Microbench_EvaluateBoard },
+    { "ThreatMap_Update",               Microbench_UpdateThreatMap },
+    { "ThreatMap_IsIndexUnderThreat",   Microbench_QueryThreatMap },
+};
+
+#define NUM_MICROBENCH_COMPONENTS (sizeof(microbenchComponents) / sizeof(microbenchComponents[0]))
+
+/**
+ * Measures each search node component over every phase of the corpus and
+ * writes the results out as JSON. Each measurement is taken
+ * MICROBENCH_NUM_SAMPLES times, and the mean, standard deviation and minimum
+ * cost per operation across those samples are reported.
+ *
+ * @return  STATUS_SUCCESS if every position could be measured, STATUS_FAIL otherwise
+ */
+uint64_t Microbench_Run(void)
+{
+    ChessBoard *cb = new ChessBoard();
+    double samples[MICROBENCH_NUM_SAMPLES], mean, variance, minimum;
+    uint64_t elapsedNs, numOps;
+    bool firstResult = true;
+
+    Util_Assert(cb != NULL, "Failed to allocate microbench board");
+
+    std::cout << "{\"unit\":\"ns/op\",\"samples\":" << MICROBENCH_NUM_SAMPLES
+              << ",\"results\":[" << std::endl;
+
+    for(uint64_t c = 0; c < NUM_MICROBENCH_COMPONENTS; ++c)
+    {
+        for(uint64_t p = 0; p < NUM_MICROBENCH_PHASES; ++p)
+        {
+            for(uint64_t s = 0; s < MICROBENCH_NUM_SAMPLES; ++s)
+            {
+                elapsedNs = 0;
+                numOps = 0;
+                for(uint64_t i = 0; i < MICROBENCH_POSITIONS_PER_PHASE; ++i)
+                {
+                    if(cb->SetBoardFromFEN(microbenchCorpus[p].fens[i]) != STATUS_SUCCESS)
+                    {
+                        std::cout << "]}" << std::endl;
+                        delete cb;
+                        return STATUS_FAIL;
+                    }
+                    Microbench_ResetThreatMap(cb);
+
+                    numOps += microbenchComponents[c].func(cb, &elapsedNs);
+                }
+                samples[s] = numOps ? (double) elapsedNs / numOps : 0.0;
+            }
+
+            mean = 0.0;
+            minimum = samples[0];
+            for(uint64_t s = 0; s < MICROBENCH_NUM_SAMPLES; ++s)
+            {
+                mean += samples[s];
+                minimum = std::min(minimum, samples[s]);
+            }
+            mean /= MICROBENCH_NUM_SAMPLES;
+
+            variance = 0.0;
+            for(uint64_t s = 0; s < MICROBENCH_NUM_SAMPLES; ++s)
+            {
+                variance += (samples[s] - mean) * (samples[s] - mean);
+            }
+            variance /= MICROBENCH_NUM_SAMPLES;
+
+            std::cout << (firstResult ? "" : ",\n")
+                      << "{\"component\":\"" << microbenchComponents[c].name << "\""
+                      << ",\"phase\":\"" << microbenchCorpus[p].phase << "\""
+                      << ",\"mean\":" << mean
+                      << ",\"stddev\":" << std::sqrt(variance)
+                      << ",\"min\":" << minimum << "}";
+            firstResult = false;
+        }
+    }
+
+    std::cout << "\n]}" << std::endl;
+
+    delete cb;
+    return STATUS_SUCCESS;
+}
@@ -4,6 +4,78 @@
 #include "util.h"
 #include "chessboard_defs.h"
 #include "chessboard.h"
+#include "attacks.h"
+#include "zobrist.h"
+#include "piecetables.h"
+#include "nnue.h"
+#include "trace.h"
+
+/**
+ * The castling rights which survive a move touching each square. Anything
+ * moving from or to a king or rook start square gives up the rights that
+ * piece was needed for.
+ */
+static const uint8_t castlingRightsKept[NUM_BOARD_INDICES] =
+{
+    0xF & ~CASTLE_WHITE_QUEEN, 0xF, 0xF, 0xF,
+    0xF & ~(CASTLE_WHITE_KING | CASTLE_WHITE_QUEEN), 0xF, 0xF, 0xF & ~CASTLE_WHITE_KING,
+    0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF,
+    0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF,
+    0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF,
+    0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF,
+    0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF,
+    0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF, 0xF,
+    0xF & ~CASTLE_BLACK_QUEEN, 0xF, 0xF, 0xF,
+    0xF & ~(CASTLE_BLACK_KING | CASTLE_BLACK_QUEEN), 0xF, 0xF, 0xF & ~CASTLE_BLACK_KING,
+};
+
+/**
+ * Works out which network inputs a move takes away and adds
+ *
+ * @param move:         The move, as generated
+ * @param ptCaptured:   The piece type it took, NUM_PIECE_TYPES if none
+ * @param delta:        Where to store the changes
+ */
+static void ChessBoard_BuildNnueDelta(const moveType_t *move, uint8_t ptCaptured, nnueDelta_t *delta)
+{
+    bool white = move->pt < NUM_PIECE_TYPES/2;
+    uint8_t friendlyStart = white ? WHITE_PAWN : BLACK_PAWN, kingSide;
+
+    delta->numRemoved = 0;
+    delta->numAdded = 0;
+    delta->kingMoved = 0;
+
+    // Kings are not inputs, a king which moves or is taken changes nothing
+    // directly, but a moved king has its whole side rebuilt
+    if(move->pt % (NUM_PIECE_TYPES/2) == WHITE_KING)
+    {
+        delta->kingMoved = white ? WHITE_PIECES : BLACK_PIECES;
+    }
+    else
+    {
+        delta->removedPt[delta->numRemoved] = move->pt;
+        delta->removedIdx[delta->numRemoved++] = move->startIdx;
+        delta->addedPt[delta->numAdded] = (move->promotion != PROMOTION_NONE)
+                                            ? friendlyStart + move->promotion : move->pt;
+        delta->addedIdx[delta->numAdded++] = move->endIdx;
+    }
+
+    if(ptCaptured < NUM_PIECE_TYPES && ptCaptured % (NUM_PIECE_TYPES/2) != WHITE_KING)
+    {
+        delta->removedPt[delta->numRemoved] = ptCaptured;
+        delta->removedIdx[delta->numRemoved++] = move->enPassant
+            ? (white ? move->endIdx - 8 : move->endIdx + 8) : move->endIdx;
+    }
+
+    if((move->moveVal & (MOVE_VALID_CASTLE_KING | MOVE_VALID_CASTLE_QUEEN)) != 0)
+    {
+        kingSide = (move->moveVal & MOVE_VALID_CASTLE_KING) != 0;
+        delta->removedPt[delta->numRemoved] = friendlyStart + WHITE_ROOK;
+        delta->removedIdx[delta->numRemoved++] = kingSide ? move->startIdx + 3 : move->startIdx - 4;
+        delta->addedPt[delta->numAdded] = friendlyStart + WHITE_ROOK;
+        delta->addedIdx[delta->numAdded++] = kingSide ? move->startIdx + 1 : move->startIdx - 1;
+    }
+}
 
 /**
  * Applies the current move to the chessboard
@@ -14,8 +86,13 @@
  */
 uint64_t ChessBoard::ApplyMoveToBoard(moveType_t *moveToApply)
 {
+    TRACE_SCOPE(TRACE_APPLY_MOVE);
 
-    uint8_t friendlyPieces, enemyPieces, friendlyStart, enemyStart;
+    uint8_t friendlyPieces, enemyPieces, friendlyStart, enemyStart, ptLanding, captureIdx, rookStart, rookEnd, ptRook;
+    uint64_t startMask, endMask, rookMask, key, pawnKey;
+    evalScores_t scores;
+    nnueDelta_t delta;
+    undoState_t *undo;
 
     if(moveToApply == NULL)
     {
@@ -37,6 +114,9 @@ uint64_t ChessBoard::ApplyMoveToBoard(moveType_t *moveToApply)
         return STATUS_FAIL;        
     }
 
+    startMask = (uint64_t) 1 << moveToApply->startIdx;
+    endMask = (uint64_t) 1 << moveToApply->endIdx;
+
     // 2) Is our piecetype actually valid?
     if(moveToApply->pt >= NUM_PIECE_TYPES)
     {
@@ -46,7 +126,7 @@ uint64_t ChessBoard::ApplyMoveToBoard(moveType_t *moveToApply)
 
     // 3) Is there actually a piece of this piece type actually at the
     //    start index?
-    if(this->pieces[moveToApply->pt] & ((uint64_t) 1 << moveToApply->startIdx) == 0)
+    if((this->pieces[moveToApply->pt] & ((uint64_t) 1 << moveToApply->startIdx)) == 0)
     {
         std::cout << "No piece of piecetype at expexted startIdx" << std::endl;
         return STATUS_FAIL;        
@@ -66,59 +146,148 @@ uint64_t ChessBoard::ApplyMoveToBoard(moveType_t *moveToApply)
     }
 
     // 4) Is our end index occupied by our color
-    Util_Assert((this->pieces[friendlyPieces] & ((uint64_t) 1 << moveToApply->endIdx)) == 0,
+    Util_Assert((this->pieces[friendlyPieces] & endMask) == 0,
         "There was a friendly piece where we wanted to move!");
 
     Util_Assert((this->pieces[friendlyPieces] ^ this->pieces[enemyPieces]) == this->occupied,
         "Incoherence between piece states and state of actual board");
 
-    // Apply the move for our piece type
-    this->pieces[moveToApply->pt] ^= ((uint64_t) 1 << moveToApply->startIdx);
-    this->pieces[moveToApply->pt] |= ((uint64_t) 1 << moveToApply->endIdx);
+    if(this->historyLen >= MAX_GAME_PLY)
+    {
+        std::cout << "Too many moves applied to the board" << std::endl;
+        return STATUS_FAIL;
+    }
 
-    // Apply the move for our color
-    this->pieces[friendlyPieces] ^= ((uint64_t) 1 << moveToApply->startIdx);
-    this->pieces[friendlyPieces] |= ((uint64_t) 1 << moveToApply->endIdx);
+    // Keep what we need to put the board back
+    undo = &this->history[this->historyLen++];
+    undo->ptCaptured = NUM_PIECE_TYPES;
+    undo->castlingRights = this->castlingRights;
+    undo->epIdx = this->epIdx;
+    undo->hashKey = this->hashKey;
+    undo->halfmoveClock = this->halfmoveClock;
+    undo->scores = this->scores;
+    undo->pawnKey = this->pawnKey;
+    key = this->hashKey;
+    pawnKey = this->pawnKey;
+    scores = this->scores;
 
     if((moveToApply->moveVal & MOVE_VALID_ATTACK) != 0)
     {
-        // If we are taking a piece, clear that square
-        this->pieces[enemyPieces] &= ~((uint64_t) 1 << moveToApply->endIdx);
-        for(uint8_t i = enemyStart; i < enemyStart + NUM_PIECE_TYPES/2; ++i) // @todo bug here find it
+        // Taking en passant removes the pawn behind the square we land on
+        captureIdx = moveToApply->enPassant
+            ? ((friendlyPieces == WHITE_PIECES) ? moveToApply->endIdx - 8 : moveToApply->endIdx + 8)
+            : moveToApply->endIdx;
+
+        for(uint8_t i = enemyStart; i < enemyStart + NUM_PIECE_TYPES/2; ++i)
         {
             // We can only have at most 1 piece captured for a move
-            if((this->pieces[i] & ~((uint64_t) 1 << moveToApply->endIdx)) != 0)
+            if((this->pieces[i] & ((uint64_t) 1 << captureIdx)) != 0)
             {
-                moveToApply->ptCaptured = i;
-                this->pieces[i] &= ~((uint64_t) 1 << moveToApply->endIdx);
+                undo->ptCaptured = i;
+                key ^= zobristKeys.pieces[i][captureIdx];
+                pawnKey ^= (i % (NUM_PIECE_TYPES/2) == WHITE_PAWN) ? zobristKeys.pieces[i][captureIdx] : 0;
+                scores.midgame -= pieceSquareTables.midgame[i][captureIdx];
+                scores.endgame -= pieceSquareTables.endgame[i][captureIdx];
+                scores.phase -= pieceSquareTables.phase[i];
+                this->pieces[i] &= ~((uint64_t) 1 << captureIdx);
+                this->pieces[enemyPieces] &= ~((uint64_t) 1 << captureIdx);
                 break;
             }
         }
-        this->occupied ^= ((uint64_t) 1 << moveToApply->startIdx);
+        moveToApply->ptCaptured = undo->ptCaptured;
+    }
+
+    // Apply the move for our piece type, which changes if we are promoting
+    ptLanding = (moveToApply->promotion != PROMOTION_NONE)
+                    ? friendlyStart + moveToApply->promotion : moveToApply->pt;
+    this->pieces[moveToApply->pt] ^= startMask;
+    this->pieces[ptLanding] |= endMask;
+    key ^= zobristKeys.pieces[moveToApply->pt][moveToApply->startIdx]
+         ^ zobristKeys.pieces[ptLanding][moveToApply->endIdx];
+    scores.midgame += pieceSquareTables.midgame[ptLanding][moveToApply->endIdx]
+                    - pieceSquareTables.midgame[moveToApply->pt][moveToApply->startIdx];
+    scores.endgame += pieceSquareTables.endgame[ptLanding][moveToApply->endIdx]
+                    - pieceSquareTables.endgame[moveToApply->pt][moveToApply->startIdx];
+    scores.phase += pieceSquareTables.phase[ptLanding] - pieceSquareTables.phase[moveToApply->pt];
+    if(moveToApply->pt % (NUM_PIECE_TYPES/2) == WHITE_PAWN)
+    {
+        // A promoting pawn leaves the pawn structure altogether
+        pawnKey ^= zobristKeys.pieces[moveToApply->pt][moveToApply->startIdx]
+                 ^ ((ptLanding == moveToApply->pt) ? zobristKeys.pieces[ptLanding][moveToApply->endIdx] : 0);
+    }
+
+    // Apply the move for our color
+    this->pieces[friendlyPieces] ^= startMask;
+    this->pieces[friendlyPieces] |= endMask;
+
+    // Castling also brings the rook across the king
+    if((moveToApply->moveVal & (MOVE_VALID_CASTLE_KING | MOVE_VALID_CASTLE_QUEEN)) != 0)
+    {
+        rookStart = ((moveToApply->moveVal & MOVE_VALID_CASTLE_KING) != 0)
+            ? moveToApply->startIdx + 3 : moveToApply->startIdx - 4;
+        rookEnd = ((moveToApply->moveVal & MOVE_VALID_CASTLE_KING) != 0)
+            ? moveToApply->startIdx + 1 : moveToApply->startIdx - 1;
+        rookMask = ((uint64_t) 1 << rookStart) | ((uint64_t) 1 << rookEnd);
+        ptRook = friendlyStart + WHITE_ROOK;
+        this->pieces[ptRook] ^= rookMask;
+        this->pieces[friendlyPieces] ^= rookMask;
+        key ^= zobristKeys.pieces[ptRook][rookStart] ^ zobristKeys.pieces[ptRook][rookEnd];
+        scores.midgame += pieceSquareTables.midgame[ptRook][rookEnd] - pieceSquareTables.midgame[ptRook][rookStart];
+        scores.endgame += pieceSquareTables.endgame[ptRook][rookEnd] - pieceSquareTables.endgame[ptRook][rookStart];
+    }
+
+    // Moving the king or a rook, or losing a rook, gives up castling on that side
+    key ^= zobristKeys.castling[this->castlingRights];
+    this->castlingRights &= castlingRightsKept[moveToApply->startIdx] & castlingRightsKept[moveToApply->endIdx];
+    key ^= zobristKeys.castling[this->castlingRights];
+
+    // Only a double pawn push leaves a square behind to be taken en passant
+    if(this->epIdx != EN_PASSANT_NONE)
+    {
+        key ^= zobristKeys.enPassantFile[this->epIdx % 8];
     }
-    else if(((moveToApply->moveVal & MOVE_VALID_UNDO) != 0) && moveToApply->ptCaptured < NUM_PIECE_TYPES)
+    this->epIdx = EN_PASSANT_NONE;
+    if(moveToApply->pt % (NUM_PIECE_TYPES/2) == WHITE_PAWN
+        && (moveToApply->endIdx == moveToApply->startIdx + 16 || moveToApply->startIdx == moveToApply->endIdx + 16))
     {
-        Util_Assert((moveToApply->ptCaptured >= enemyStart)
-             && (moveToApply->ptCaptured < enemyStart + NUM_PIECE_TYPES/2),
-             "Passed in bad captured piece type when attempting to undo the move");
+        this->epIdx = (moveToApply->startIdx + moveToApply->endIdx) / 2;
+        key ^= zobristKeys.enPassantFile[this->epIdx % 8];
+    }
 
-        // return our board state
-        this->pieces[enemyPieces] |= ((uint64_t) 1 << moveToApply->startIdx);
-        this->pieces[moveToApply->ptCaptured] |= ((uint64_t) 1 << moveToApply->startIdx);
+    // Captures and pawn moves cannot be undone, so restart the fifty move count
+    if(undo->ptCaptured < NUM_PIECE_TYPES || moveToApply->pt % (NUM_PIECE_TYPES/2) == WHITE_PAWN)
+    {
+        this->halfmoveClock = 0;
     }
     else
     {
-        this->occupied ^= ((uint64_t) 1 << moveToApply->startIdx);
+        ++this->halfmoveClock;
     }
-    
-    this->occupied |= ((uint64_t) 1 << moveToApply->endIdx);
+
+    this->occupied = this->pieces[WHITE_PIECES] | this->pieces[BLACK_PIECES];
     this->empty = ~(this->occupied);
 
+    this->colorToMove = enemyPieces;
+    this->hashKey = key ^ zobristKeys.blackToMove;
+    this->scores = scores;
+    this->pawnKey = pawnKey;
+
+    // A side without its king cannot be kept up to date, and taking the
+    // king back would undo changes it never saw, so leave it all to rebuild
+    if(undo->ptCaptured < NUM_PIECE_TYPES && undo->ptCaptured % (NUM_PIECE_TYPES/2) == WHITE_KING)
+    {
+        this->accumulator.generation = 0;
+    }
+    else if(Nnue_IsCurrent(&this->accumulator))
+    {
+        ChessBoard_BuildNnueDelta(moveToApply, undo->ptCaptured, &delta);
+        Nnue_UpdateAccumulator(&this->accumulator, this->pieces, &delta, false);
+    }
+
     Util_Assert((this->pieces[BLACK_PIECES] & this->pieces[WHITE_PIECES]) == 0,
         "Pieces cannot overlap on the same spot");
 
-    Util_Assert((this->pieces[friendlyPieces] ^ this->pieces[enemyPieces]) == this->occupied,
-        "Incoherence between piece states and state of actual board");
+    Util_AssertParanoid(this->VerifyBoardConsistency(), "Board inconsistent after applying move");
 
     return STATUS_SUCCESS;
 
@@ -127,26 +296,134 @@ uint64_t ChessBoard::ApplyMoveToBoard(moveType_t *moveToApply)
 /**
  * Removes the last move applied to this chessboard.
  * 
+ * @param *moveToUndo:  The move to undo, which must be the last move applied
+ * 
  * @returns STATUS_SUCCESS if successful, STATUS_FAIL otherwise
  */
 uint64_t ChessBoard::UndoMoveFromBoard(moveType_t *moveToUndo)
 {
-    uint8_t idx, moveValCached;
+    uint8_t friendlyPieces, enemyPieces, friendlyStart, ptLanding, captureIdx;
+    uint64_t startMask, endMask, rookMask;
+    nnueDelta_t delta;
+    undoState_t *undo;
+
+    if(moveToUndo == NULL || this->historyLen == 0)
+    {
+        std::cout << "No move to undo!" << std::endl;
+        return STATUS_FAIL;
+    }
 
-    idx = moveToUndo->endIdx;
-    moveToUndo->endIdx = moveToUndo->startIdx;
-    moveToUndo->startIdx = idx;
+    undo = &this->history[--this->historyLen];
+    startMask = (uint64_t) 1 << moveToUndo->startIdx;
+    endMask = (uint64_t) 1 << moveToUndo->endIdx;
 
-    moveValCached = moveToUndo->moveVal;
-    moveToUndo->moveVal = MOVE_VALID_UNDO;
+    Util_AssignFriendAndFoe(moveToUndo->pt, &friendlyPieces, &enemyPieces);
+    friendlyStart = (friendlyPieces == WHITE_PIECES) ? WHITE_PAWN : BLACK_PAWN;
 
-    ApplyMoveToBoard(moveToUndo);
+    // Take our piece back to where it started, as a pawn if it promoted
+    ptLanding = (moveToUndo->promotion != PROMOTION_NONE)
+                    ? friendlyStart + moveToUndo->promotion : moveToUndo->pt;
+    this->pieces[ptLanding] &= ~endMask;
+    this->pieces[moveToUndo->pt] |= startMask;
+    this->pieces[friendlyPieces] &= ~endMask;
+    this->pieces[friendlyPieces] |= startMask;
+
+    if((moveToUndo->moveVal & (MOVE_VALID_CASTLE_KING | MOVE_VALID_CASTLE_QUEEN)) != 0)
+    {
+        rookMask = ((moveToUndo->moveVal & MOVE_VALID_CASTLE_KING) != 0)
+            ? ((uint64_t) 1 << (moveToUndo->startIdx + 3)) | ((uint64_t) 1 << (moveToUndo->startIdx + 1))
+            : ((uint64_t) 1 << (moveToUndo->startIdx - 4)) | ((uint64_t) 1 << (moveToUndo->startIdx - 1));
+        this->pieces[friendlyStart + WHITE_ROOK] ^= rookMask;
+        this->pieces[friendlyPieces] ^= rookMask;
+    }
+
+    // Return whatever we took
+    if(undo->ptCaptured < NUM_PIECE_TYPES)
+    {
+        captureIdx = moveToUndo->enPassant
+            ? ((friendlyPieces == WHITE_PIECES) ? moveToUndo->endIdx - 8 : moveToUndo->endIdx + 8)
+            : moveToUndo->endIdx;
+        this->pieces[undo->ptCaptured] |= (uint64_t) 1 << captureIdx;
+        this->pieces[enemyPieces] |= (uint64_t) 1 << captureIdx;
+    }
 
-    idx = moveToUndo->endIdx;
-    moveToUndo->endIdx = moveToUndo->startIdx;
-    moveToUndo->startIdx = idx;
-    moveToUndo->moveVal = moveValCached;
+    this->castlingRights = undo->castlingRights;
+    this->epIdx = undo->epIdx;
+    this->hashKey = undo->hashKey;
+    this->halfmoveClock = undo->halfmoveClock;
+    this->scores = undo->scores;
+    this->pawnKey = undo->pawnKey;
+
+    this->occupied = this->pieces[WHITE_PIECES] | this->pieces[BLACK_PIECES];
+    this->empty = ~(this->occupied);
+
+    this->colorToMove = friendlyPieces;
+
+    // Whatever the accumulator was built from while the king was gone, it
+    // cannot be taken back to the position with the king
+    if(undo->ptCaptured < NUM_PIECE_TYPES && undo->ptCaptured % (NUM_PIECE_TYPES/2) == WHITE_KING)
+    {
+        this->accumulator.generation = 0;
+    }
+    else if(Nnue_IsCurrent(&this->accumulator))
+    {
+        ChessBoard_BuildNnueDelta(moveToUndo, undo->ptCaptured, &delta);
+        Nnue_UpdateAccumulator(&this->accumulator, this->pieces, &delta, true);
+    }
+
+    Util_AssertParanoid(this->VerifyBoardConsistency(), "Board inconsistent after undoing move");
 
     return STATUS_SUCCESS;
+}
 
-}
\ No newline at end of file
+/**
+ * Determines if a square is attacked by any piece of a color
+ * 
+ * @param idx:      The square to look at
+ * @param byColor:  The attacking color, WHITE_PIECES or BLACK_PIECES
+ * 
+ * @return  True if the square is attacked
+ */
+bool ChessBoard::IsSquareAttacked(uint8_t idx, uint8_t byColor) const
+{
+    return Attacks_IsSquareAttacked(this->pieces, this->occupied, idx, byColor == WHITE_PIECES);
+}
+
+/**
+ * @param color:    The color whose king to look at, WHITE_PIECES or BLACK_PIECES
+ * 
+ * @return  True if that king is attacked. A king already taken is not in check.
+ */
+bool ChessBoard::IsInCheck(uint8_t color) const
+{
+    uint64_t king = this->pieces[(color == WHITE_PIECES) ? WHITE_KING : BLACK_KING];
+
+    if(king == 0)
+    {
+        return false;
+    }
+    return this->IsSquareAttacked(__builtin_ctzll(king), (color == WHITE_PIECES) ? BLACK_PIECES : WHITE_PIECES);
+}
+
+/**
+ * Determines if a generated move is legal, which the move generator alone
+ * does not promise as it can leave the king in check
+ * 
+ * @param move:     The move to check, for the side to move
+ * 
+ * @return  True if the move does not leave our own king attacked
+ */
+bool ChessBoard::IsMoveLegal(moveType_t *move)
+{
+    uint8_t us = this->colorToMove;
+    bool legal;
+
+    if(this->ApplyMoveToBoard(move) != STATUS_SUCCESS)
+    {
+        return false;
+    }
+    legal = !this->IsInCheck(us);
+    this->UndoMoveFromBoard(move);
+
+    return legal;
+}
@@ -72,7 +72,57 @@ void ChessBoard::BuildMove(uint8_t pt, uint8_t startIdx, uint8_t endIdx,
     // Add this move to the list of possible moves at this board position
     newMove->adjMove = *moveList;
     newMove->ptCaptured = 0xF;
+    newMove->promotion = PROMOTION_NONE;
+    newMove->enPassant = 0;
 
     *moveList = newMove;
 
-}
\ No newline at end of file
+}
+
+/**
+ * Generates a pawn move, which becomes one move for each piece we could
+ * promote to when the pawn reaches the last rank
+ * 
+ * @param pt:           The pawn type you are moving
+ * @param startIdx:     The start index of the pawn
+ * @param endIdx:       Where the pawn is going to go
+ * @param moveVal:      The type of move you are executing
+ * @param moveList      The current movelist
+ */
+void ChessBoard::BuildPawnMove(uint8_t pt, uint8_t startIdx, uint8_t endIdx,
+                                 uint8_t moveVal, moveType_t **moveList)
+{
+    // Built in reverse so the queen promotion comes first in the list
+    static const uint8_t promotions[] = { WHITE_BISHOP, WHITE_ROOK, WHITE_KNIGHT, WHITE_QUEEN };
+
+    if(endIdx >= 8 && endIdx < 56)
+    {
+        this->BuildMove(pt, startIdx, endIdx, moveVal, moveList);
+        return;
+    }
+
+    for(uint8_t i = 0; i < sizeof(promotions); ++i)
+    {
+        this->BuildMove(pt, startIdx, endIdx, moveVal, moveList);
+        (*moveList)->promotion = promotions[i];
+    }
+}
+
+/**
+ * Releases every move in a list produced by GenerateMoves, including the
+ * terminating marker move
+ * 
+ * @param moveList:     The list of moves to free
+ */
+void FreeMoveList(moveType_t *moveList)
+{
+    moveType_t *nextMove;
+
+    while(moveList != NULL)
+    {
+        // The end marker is the only move which is not legal, nothing follows it
+        nextMove = moveList->legalMove ? moveList->adjMove : NULL;
+        delete moveList;
+        moveList = nextMove;
+    }
+}
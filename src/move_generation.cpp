@@ -4,7 +4,8 @@
 #include "util.h"
 #include "chessboard_defs.h"
 #include "chessboard.h"
-#include "threatmap.h"
+#include "attacks.h"
+#include "trace.h"
 
 /**
  * Generates the valid moves for a given chessboard state and color
@@ -15,6 +16,7 @@
  */
 moveType_t *ChessBoard::GenerateMoves(uint8_t pt)
 {
+    TRACE_SCOPE(TRACE_GENERATE_MOVES);
     uint8_t nextPt;
     uint64_t i = 1;
     moveType_t *moveList = new moveType_t;
@@ -22,6 +24,7 @@ moveType_t *ChessBoard::GenerateMoves(uint8_t pt)
     // Use a known invalid move as a end marker
     Util_Assert(moveList != NULL, "Failed to allocate memory for a move");
     moveList->legalMove = false;
+    moveList->adjMove = NULL;
 
     if(pt == WHITE_PIECES)
     {
@@ -34,6 +37,7 @@ moveType_t *ChessBoard::GenerateMoves(uint8_t pt)
         GenerateKnightMoves(WHITE_KNIGHT, &moveList);
         GenerateQueenMoves(WHITE_QUEEN, &moveList);
         GenerateKingMoves(WHITE_KING, &moveList);
+        GenerateCastlingMoves(WHITE_KING, &moveList);
     }
     else if (pt == BLACK_PIECES)
     {
@@ -46,6 +50,7 @@ moveType_t *ChessBoard::GenerateMoves(uint8_t pt)
         GenerateKnightMoves(BLACK_KNIGHT, &moveList);
         GenerateQueenMoves(BLACK_QUEEN, &moveList);
         GenerateKingMoves(BLACK_KING, &moveList);
+        GenerateCastlingMoves(BLACK_KING, &moveList);
     }
     else
     {
@@ -69,7 +74,6 @@ void ChessBoard::GeneratePawnMoves(uint8_t pt, moveType_t **moveList)
 {
     // Pawns can move forward, or diagonally to strike, or en passant (tricky)
     uint64_t i, pawn, pawns = this->pieces[pt];   
-    moveType_t *lastMove;
 
     // All your pawns are dead, don't bother
     if(pawns == 0)
@@ -79,8 +83,6 @@ void ChessBoard::GeneratePawnMoves(uint8_t pt, moveType_t **moveList)
 
     Util_Assert(pt == WHITE_PAWN || pt == BLACK_PAWN, "Pawn move passed bad piecetype");
 
-    //lastMove = GetLastMove();
-
     if(pt == WHITE_PAWN)
     {
         while(pawns != 0)
@@ -96,51 +98,34 @@ void ChessBoard::GeneratePawnMoves(uint8_t pt, moveType_t **moveList)
                 && (this->pieces[WHITE_PIECES] & (pawn << 8)) == 0
                 && (this->pieces[BLACK_PIECES] & (pawn << 8)) == 0)
             {
-                this->BuildMove(WHITE_PAWN, __builtin_ctzll(pawn), i + 8, MOVE_VALID, moveList);
+                this->BuildPawnMove(WHITE_PAWN, __builtin_ctzll(pawn), i + 8, MOVE_VALID, moveList);
                 
                 if( i < 16 
                     && (this->pieces[WHITE_PIECES] & (pawn << 16)) == 0
                     && (this->pieces[BLACK_PIECES] & (pawn << 16)) == 0)
                 {
-                    this->BuildMove(WHITE_PAWN, __builtin_ctzll(pawn), i + 16, MOVE_VALID, moveList);
+                    this->BuildPawnMove(WHITE_PAWN, __builtin_ctzll(pawn), i + 16, MOVE_VALID, moveList);
                 }
             } 
 
             // Move left-diagonal to attack
             if( (i % 8 != 0) && (this->pieces[BLACK_PIECES] & (pawn << 7)) != 0)
             {
-                this->BuildMove(WHITE_PAWN, __builtin_ctzll(pawn), i + 7, MOVE_VALID_ATTACK, moveList);
+                this->BuildPawnMove(WHITE_PAWN, __builtin_ctzll(pawn), i + 7, MOVE_VALID_ATTACK, moveList);
             }
 
             if( (i % 8 != 7) && (this->pieces[BLACK_PIECES] & (pawn << 9)) != 0)
             {
-                this->BuildMove(WHITE_PAWN, __builtin_ctzll(pawn), i + 9, MOVE_VALID_ATTACK, moveList), moveList;
+                this->BuildPawnMove(WHITE_PAWN, __builtin_ctzll(pawn), i + 9, MOVE_VALID_ATTACK, moveList);
             }
 
-            // En passant check
-
-            // Check if this is the first move
-            if(lastMove == NULL)
+            // En passant, the square is only set after a black double push
+            if(this->epIdx / 8 == 5 && (Attacks_Pawn(i, true) & ((uint64_t) 1 << this->epIdx)) != 0)
             {
-                continue;
+                this->BuildMove(WHITE_PAWN, i, this->epIdx, MOVE_VALID, moveList);
+                (*moveList)->moveVal = MOVE_VALID_ATTACK;
+                (*moveList)->enPassant = 1;
             }
-
-            // Was the last move a black pawn pushing up by two
-            if( (lastMove != NULL)
-                && (lastMove->pt == BLACK_PAWN )
-                && (lastMove->endIdx == lastMove->startIdx - 16))
-            {
-                // Can we look to the left and did the pawn land there
-                if((i % 8 > 0) && ((i - lastMove->endIdx) == 1))
-                {
-                    this->BuildMove(WHITE_PAWN, __builtin_ctzll(pawn), i + 7, MOVE_VALID_ATTACK, moveList);
-                }
-                // Can we look to the right and did the pawn land there
-                if((i % 8 < 7) && ((lastMove->endIdx - i) == 1))
-                {
-                    this->BuildMove(WHITE_PAWN, __builtin_ctzll(pawn), i + 9, MOVE_VALID_ATTACK, moveList);
-                }          
-            }        
         }
     }
     else
@@ -155,50 +140,33 @@ void ChessBoard::GeneratePawnMoves(uint8_t pt, moveType_t **moveList)
             if( i >= 8
                 && ((this->occupied & (pawn >> 8)) == 0))
             {
-                this->BuildMove(BLACK_PAWN, i, i - 8, MOVE_VALID, moveList);
+                this->BuildPawnMove(BLACK_PAWN, i, i - 8, MOVE_VALID, moveList);
                 
                 if( i >= 48 
                     && (this->pieces[WHITE_PIECES] & (pawn >> 16)) == 0
                     && (this->pieces[BLACK_PIECES] & (pawn >> 16)) == 0)
                 {
-                    this->BuildMove(BLACK_PAWN, __builtin_ctzll(pawn), i - 16, MOVE_VALID, moveList);
+                    this->BuildPawnMove(BLACK_PAWN, __builtin_ctzll(pawn), i - 16, MOVE_VALID, moveList);
                 }
             } 
 
             // Move left-diagonal to attack
-            if( (i % 8 != 7) && ((this->pieces[WHITE_PIECES] & (pawn >> 9)) != 0))
+            if( (i % 8 != 0) && ((this->pieces[WHITE_PIECES] & (pawn >> 9)) != 0))
             {
-                this->BuildMove(BLACK_PAWN, __builtin_ctzll(pawn), i - 9, MOVE_VALID_ATTACK, moveList);
+                this->BuildPawnMove(BLACK_PAWN, __builtin_ctzll(pawn), i - 9, MOVE_VALID_ATTACK, moveList);
             }
 
-            if( (i % 8 != 0) && ((this->pieces[WHITE_PIECES] & (pawn >> 7)) != 0))
+            if( (i % 8 != 7) && ((this->pieces[WHITE_PIECES] & (pawn >> 7)) != 0))
             {
-                this->BuildMove(BLACK_PAWN, __builtin_ctzll(pawn), i - 7, MOVE_VALID_ATTACK, moveList);
+                this->BuildPawnMove(BLACK_PAWN, __builtin_ctzll(pawn), i - 7, MOVE_VALID_ATTACK, moveList);
             }
 
-            // En passant check
-
-            // Check if this is the first move
-            if(lastMove == NULL)
+            // En passant, the square is only set after a white double push
+            if(this->epIdx / 8 == 2 && (Attacks_Pawn(i, false) & ((uint64_t) 1 << this->epIdx)) != 0)
             {
-                continue;
-            }
-
-            // Was the last move a white pawn pushing up by two
-            if( (lastMove != NULL)
-                && (lastMove->pt == WHITE_PAWN )
-                && (lastMove->endIdx == lastMove->startIdx + 16))
-            {
-                // Can we look to the left and did the pawn land there
-                if((i % 8 > 0) && ((i - lastMove->endIdx) == 1))
-                {
-                    this->BuildMove(BLACK_PAWN, __builtin_ctzll(pawn), i - 9, MOVE_VALID_ATTACK, moveList);
-                }
-                // Can we look to the right and did the pawn land there
-                if((i % 8 < 7) && ((lastMove->endIdx - i) == 1))
-                {
-                    this->BuildMove(BLACK_PAWN, __builtin_ctzll(pawn), i - 7, MOVE_VALID_ATTACK, moveList);
-                }          
+                this->BuildMove(BLACK_PAWN, i, this->epIdx, MOVE_VALID, moveList);
+                (*moveList)->moveVal = MOVE_VALID_ATTACK;
+                (*moveList)->enPassant = 1;
             }
         }
     }   
@@ -313,7 +281,7 @@ void ChessBoard::GenerateRookMoves(uint8_t pt, moveType_t **moveList)
         do
         {
             // Cannot go up
-            if(rookIdx > 54)
+            if(rookIdx > 55)
             {
                 break;
             }
@@ -332,7 +300,7 @@ void ChessBoard::GenerateRookMoves(uint8_t pt, moveType_t **moveList)
             {
                 break;
             }
-        } while(temp <= 54);
+        } while(temp <= 55);
     }
 }
 
@@ -609,8 +577,15 @@ void ChessBoard::GenerateKingMoves(uint8_t pt, moveType_t **moveList)
 
     uint8_t friendlyPieces, enemyPieces, moveVal;
     uint64_t king = this->pieces[pt], shift = 1;
-    uint64_t kingIdx = __builtin_ctzll(king);
+    uint64_t kingIdx;
 
+    // Our king has been captured somewhere along the search line
+    if(king == 0)
+    {
+        return;
+    }
+
+    kingIdx = __builtin_ctzll(king);
     Util_AssignFriendAndFoe(pt, &friendlyPieces, &enemyPieces);
 
     /**
@@ -619,15 +594,16 @@ void ChessBoard::GenerateKingMoves(uint8_t pt, moveType_t **moveList)
      * 1) Can we move in that direction
      * 2) Are we blocked by a friendly
      * 3) Would be putting ourselves into check if we did that.
-     *    --> Note that the logic here does not take into account the fact
-     *        that we might be in check when we are making this move. That is 
-     *        handled when actually assessing which moves we want to take
+     *    --> This is worked out from the board itself rather than the threat
+     *        map, which only describes the position at the root. A king
+     *        stepping back along the line of a slider is not caught here,
+     *        IsMoveLegal is what settles that.
      */
 
     // left
     if((kingIdx % 8 != 0 )
         && ((this->pieces[friendlyPieces] & (shift << (kingIdx - 1))) == 0)
-        && (ThreatMap_IsIndexUnderThreat(kingIdx - 1, friendlyPieces == BLACK_PIECES) == false))
+        && !this->IsSquareAttacked(kingIdx - 1, enemyPieces))
     {
         moveVal = this->CheckSpaceForMoveOrAttack(kingIdx - 1, friendlyPieces, enemyPieces);
         if(moveVal != MOVE_INVALID)
@@ -639,7 +615,7 @@ void ChessBoard::GenerateKingMoves(uint8_t pt, moveType_t **moveList)
     // right
     if((kingIdx % 8 != 7 )
         && ((this->pieces[friendlyPieces] & (shift << (kingIdx + 1))) == 0)
-        && (ThreatMap_IsIndexUnderThreat(kingIdx + 1, friendlyPieces == BLACK_PIECES) == false))
+        && !this->IsSquareAttacked(kingIdx + 1, enemyPieces))
     {
         moveVal = this->CheckSpaceForMoveOrAttack(kingIdx + 1, friendlyPieces, enemyPieces);
         if(moveVal != MOVE_INVALID)
@@ -651,7 +627,7 @@ void ChessBoard::GenerateKingMoves(uint8_t pt, moveType_t **moveList)
     // up
     if((kingIdx < NUM_BOARD_INDICES - 8 )
         && ((this->pieces[friendlyPieces] & (shift << (kingIdx + 8))) == 0)
-        && (ThreatMap_IsIndexUnderThreat(kingIdx + 8, friendlyPieces == BLACK_PIECES) == false))
+        && !this->IsSquareAttacked(kingIdx + 8, enemyPieces))
     {
         moveVal = this->CheckSpaceForMoveOrAttack(kingIdx + 8, friendlyPieces, enemyPieces);
         if(moveVal != MOVE_INVALID)
@@ -663,7 +639,7 @@ void ChessBoard::GenerateKingMoves(uint8_t pt, moveType_t **moveList)
     // down
     if((kingIdx >= 8 )
         && ((this->pieces[friendlyPieces] & (shift << (kingIdx - 8))) == 0)
-        && (ThreatMap_IsIndexUnderThreat(kingIdx - 8, friendlyPieces == BLACK_PIECES) == false))
+        && !this->IsSquareAttacked(kingIdx - 8, enemyPieces))
     {
         moveVal = this->CheckSpaceForMoveOrAttack(kingIdx - 8, friendlyPieces, enemyPieces);
         if(moveVal != MOVE_INVALID)
@@ -675,7 +651,7 @@ void ChessBoard::GenerateKingMoves(uint8_t pt, moveType_t **moveList)
     // down left
     if((kingIdx % 8 != 0 && kingIdx >= 8 )
         && ((this->pieces[friendlyPieces] & (shift << (kingIdx - 9))) == 0)
-        && (ThreatMap_IsIndexUnderThreat(kingIdx - 9, friendlyPieces == BLACK_PIECES) == false))
+        && !this->IsSquareAttacked(kingIdx - 9, enemyPieces))
     {
         moveVal = this->CheckSpaceForMoveOrAttack(kingIdx - 9, friendlyPieces, enemyPieces);
         if(moveVal != MOVE_INVALID)
@@ -687,7 +663,7 @@ void ChessBoard::GenerateKingMoves(uint8_t pt, moveType_t **moveList)
     // down right
     if((kingIdx % 8 != 7 && kingIdx >= 8 )
         && ((this->pieces[friendlyPieces] & (shift << (kingIdx - 7))) == 0)
-        && (ThreatMap_IsIndexUnderThreat(kingIdx - 7, friendlyPieces == BLACK_PIECES) == false))
+        && !this->IsSquareAttacked(kingIdx - 7, enemyPieces))
     {
         moveVal = this->CheckSpaceForMoveOrAttack(kingIdx - 7, friendlyPieces, enemyPieces);
         if(moveVal != MOVE_INVALID)
@@ -699,7 +675,7 @@ void ChessBoard::GenerateKingMoves(uint8_t pt, moveType_t **moveList)
     // up left
     if((kingIdx % 8 != 0 && kingIdx < NUM_BOARD_INDICES - 8 )
         && ((this->pieces[friendlyPieces] & (shift << (kingIdx + 7))) == 0)
-        && (ThreatMap_IsIndexUnderThreat(kingIdx + 7, friendlyPieces == BLACK_PIECES) == false))
+        && !this->IsSquareAttacked(kingIdx + 7, enemyPieces))
     {
         moveVal = this->CheckSpaceForMoveOrAttack(kingIdx + 7, friendlyPieces, enemyPieces);
         if(moveVal != MOVE_INVALID)
@@ -711,7 +687,7 @@ void ChessBoard::GenerateKingMoves(uint8_t pt, moveType_t **moveList)
     // up right
     if((kingIdx % 8 != 7 && kingIdx < NUM_BOARD_INDICES - 8 )
         && ((this->pieces[friendlyPieces] & (shift << (kingIdx + 9))) == 0)
-        && (ThreatMap_IsIndexUnderThreat(kingIdx + 9, friendlyPieces == BLACK_PIECES) == false))
+        && !this->IsSquareAttacked(kingIdx + 9, enemyPieces))
     {
         moveVal = this->CheckSpaceForMoveOrAttack(kingIdx + 9, friendlyPieces, enemyPieces);
         if(moveVal != MOVE_INVALID)
@@ -721,4 +697,146 @@ void ChessBoard::GenerateKingMoves(uint8_t pt, moveType_t **moveList)
     }
 
 
-}
\ No newline at end of file
+}
+
+/**
+ * Generates castling for our king. Castling is only possible while the rights
+ * remain, the squares between king and rook are empty, and the king neither
+ * starts in, passes through nor lands in check.
+ * 
+ * @param pt:       The type of king to generate the move for
+ * @param moveList: The list of moves to append ours to
+ */
+void ChessBoard::GenerateCastlingMoves(uint8_t pt, moveType_t **moveList)
+{
+    uint8_t kingRight, queenRight, kingIdx, enemyPieces;
+
+    Util_Assert(pt == WHITE_KING || pt == BLACK_KING, "King type provided invalid");
+
+    if(pt == WHITE_KING)
+    {
+        kingRight = CASTLE_WHITE_KING;
+        queenRight = CASTLE_WHITE_QUEEN;
+        kingIdx = 4;
+        enemyPieces = BLACK_PIECES;
+    }
+    else
+    {
+        kingRight = CASTLE_BLACK_KING;
+        queenRight = CASTLE_BLACK_QUEEN;
+        kingIdx = 60;
+        enemyPieces = WHITE_PIECES;
+    }
+
+    if((this->castlingRights & (kingRight | queenRight)) == 0
+        || (this->pieces[pt] & ((uint64_t) 1 << kingIdx)) == 0
+        || this->IsSquareAttacked(kingIdx, enemyPieces))
+    {
+        return;
+    }
+
+    if((this->castlingRights & kingRight) != 0
+        && (this->pieces[pt + WHITE_ROOK - WHITE_KING] & ((uint64_t) 1 << (kingIdx + 3))) != 0
+        && (this->occupied & ((uint64_t) 0x3 << (kingIdx + 1))) == 0
+        && !this->IsSquareAttacked(kingIdx + 1, enemyPieces)
+        && !this->IsSquareAttacked(kingIdx + 2, enemyPieces))
+    {
+        this->BuildMove(pt, kingIdx, kingIdx + 2, MOVE_VALID_CASTLE_KING, moveList);
+    }
+
+    if((this->castlingRights & queenRight) != 0
+        && (this->pieces[pt + WHITE_ROOK - WHITE_KING] & ((uint64_t) 1 << (kingIdx - 4))) != 0
+        && (this->occupied & ((uint64_t) 0x7 << (kingIdx - 3))) == 0
+        && !this->IsSquareAttacked(kingIdx - 1, enemyPieces)
+        && !this->IsSquareAttacked(kingIdx - 2, enemyPieces))
+    {
+        this->BuildMove(pt, kingIdx, kingIdx - 2, MOVE_VALID_CASTLE_QUEEN, moveList);
+    }
+}
+
+/**
+ * Fills in a move for GenerateCaptures
+ */
+static inline void ChessBoard_FillCapture(moveType_t *move, uint8_t pt, uint8_t startIdx, uint8_t endIdx,
+                                          uint8_t moveVal, uint8_t promotion, bool enPassant)
+{
+    move->adjMove = NULL;
+    move->startIdx = startIdx;
+    move->endIdx = endIdx;
+    move->pt = pt;
+    move->ptCaptured = 0xF;
+    move->moveVal = moveVal;
+    move->legalMove = true;
+    move->promotion = promotion;
+    move->enPassant = enPassant;
+}
+
+/**
+ * Generates the captures, and the pushes which promote, for the side to move.
+ * This is all the quiescence search looks at, so unlike GenerateMoves the
+ * moves go into an array the caller owns and nothing is allocated. Pawns only
+ * ever promote to a queen here, the other promotions are left to the main search.
+ *
+ * @param captures:     Where to store the moves, room for SEARCH_MAX_MOVES
+ *
+ * @return  The number of moves stored
+ */
+uint64_t ChessBoard::GenerateCaptures(moveType_t *captures)
+{
+    TRACE_SCOPE(TRACE_GENERATE_MOVES);
+    bool white = this->colorToMove == WHITE_PIECES;
+    uint8_t base = white ? WHITE_PAWN : BLACK_PAWN, idx, endIdx;
+    uint64_t theirs = this->pieces[white ? BLACK_PIECES : WHITE_PIECES], targets, pushes;
+    uint64_t epMask = (this->epIdx != EN_PASSANT_NONE) ? (uint64_t) 1 << this->epIdx : 0;
+    uint64_t lastRank = white ? 0xFF00000000000000ULL : 0xFFULL, numCaptures = 0;
+
+    for(uint64_t pawns = this->pieces[base + WHITE_PAWN]; pawns; pawns &= pawns - 1)
+    {
+        idx = __builtin_ctzll(pawns);
+        for(targets = Attacks_Pawn(idx, white) & (theirs | epMask); targets; targets &= targets - 1)
+        {
+            endIdx = __builtin_ctzll(targets);
+            ChessBoard_FillCapture(&captures[numCaptures++], base + WHITE_PAWN, idx, endIdx, MOVE_VALID_ATTACK,
+                                   (((uint64_t) 1 << endIdx) & lastRank) ? WHITE_QUEEN : PROMOTION_NONE,
+                                   endIdx == this->epIdx);
+        }
+
+        pushes = (white ? (uint64_t) 1 << (idx + 8) : (uint64_t) 1 << (idx - 8)) & lastRank & this->empty;
+        if(pushes)
+        {
+            ChessBoard_FillCapture(&captures[numCaptures++], base + WHITE_PAWN, idx, __builtin_ctzll(pushes),
+                                   MOVE_VALID, WHITE_QUEEN, false);
+        }
+    }
+
+    for(uint8_t pt = WHITE_ROOK; pt <= WHITE_KING; ++pt)
+    {
+        for(uint64_t bb = this->pieces[base + pt]; bb; bb &= bb - 1)
+        {
+            idx = __builtin_ctzll(bb);
+            switch(pt)
+            {
+                case WHITE_ROOK:    targets = Attacks_Rook(idx, this->occupied);    break;
+                case WHITE_BISHOP:  targets = Attacks_Bishop(idx, this->occupied);  break;
+                case WHITE_KNIGHT:  targets = Attacks_Knight(idx);                  break;
+                case WHITE_QUEEN:   targets = Attacks_Queen(idx, this->occupied);   break;
+                default:            targets = Attacks_King(idx);                    break;
+            }
+            for(targets &= theirs; targets; targets &= targets - 1)
+            {
+                endIdx = __builtin_ctzll(targets);
+
+                // As in GenerateKingMoves, the king never steps onto an attacked square
+                if(pt == WHITE_KING && this->IsSquareAttacked(endIdx, white ? BLACK_PIECES : WHITE_PIECES))
+                {
+                    continue;
+                }
+                ChessBoard_FillCapture(&captures[numCaptures++], base + pt, idx, endIdx,
+                                       MOVE_VALID_ATTACK, PROMOTION_NONE, false);
+            }
+        }
+    }
+
+    Util_Assert(numCaptures <= SEARCH_MAX_MOVES, "Too many captures generated");
+    return numCaptures;
+}
@@ -1,78 +1,511 @@
 /* This file is responsible for determining the next best move given a chessboard state */
 
 #include <iostream>
+#include <chrono>
+#include <cstring>
 #include "util.h"
 #include "chessboard_defs.h"
 #include "chessboard.h"
+#include "search_stats.h"
+#include "transposition.h"
+#include "see.h"
+#include "trace.h"
 
-static uint64_t numMoves = 0;
+// How often (in moves) the search checks whether it has run out of time
+#define SEARCH_TIME_CHECK_MASK 0xFFF
+
+// History scores are halved once any of them passes this, keeping recent
+// cutoffs worth more than old ones
+#define SEARCH_HISTORY_MAX (1 << 20)
+
+// Move ordering scores, the move from the table first and captures ahead of
+// quiet moves, which can score at most SEARCH_HISTORY_MAX
+#define ORDER_TT_MOVE   INT32_MAX
+#define ORDER_CAPTURE   (SEARCH_HISTORY_MAX + 1)
+
+// Captures within this many pawns per ply of depth left are still searched
+// near the leaves, anything losing more is skipped
+#define SEE_PRUNE_DEPTH     2
+#define SEE_PRUNE_MARGIN    SEE_PAWN_VALUE
+
+// Rough worth of each piece type for ordering captures, indexed by white piece type
+static const int32_t orderPieceValues[NUM_PIECE_TYPES/2] = { 1, 5, 3, 3, 9, 20 };
+
+// Everything below belongs to the search running on this thread, so several
+// games can be searched at once, each by its own thread
+
+// Quiet moves which caused a cutoff, by piece type and end square. Kept from
+// one search to the next, though aged at the start of each.
+static thread_local int32_t historyScores[NUM_PIECE_TYPES][NUM_BOARD_INDICES];
+
+// Time limit for the current search, a zero limit means search until done
+static thread_local uint64_t searchTimeLimitMs = 0;
+static thread_local std::chrono::steady_clock::time_point searchStartTime;
+static thread_local bool searchAborted = false;
+
+// Node limit for the current search, quiescence nodes included, 0 for none
+static thread_local uint64_t searchNodeLimit = 0;
+
+// Soak testing verifies the whole board every this many moves, 0 for never
+static thread_local uint64_t verifyInterval = 0;
+static thread_local uint64_t numVerifications = 0;
+
+/**
+ * Starts the clock for a time limited search. Any search which runs past the
+ * limit unwinds immediately and must have its result discarded.
+ *
+ * @param timeLimitMs:  The time allowed from now, 0 for no limit
+ */
+void Search_SetTimeLimit(uint64_t timeLimitMs)
+{
+    searchTimeLimitMs = timeLimitMs;
+    searchStartTime = std::chrono::steady_clock::now();
+    searchAborted = false;
+}
+
+/**
+ * Limits the number of nodes the next searches may visit, counting
+ * quiescence nodes, until SearchStats_Reset starts the count again. A search
+ * which reaches the limit unwinds immediately and must have its result
+ * discarded, as for the time limit.
+ *
+ * @param maxNodes:     The nodes allowed, 0 for no limit
+ */
+void Search_SetNodeLimit(uint64_t maxNodes)
+{
+    searchNodeLimit = maxNodes;
+    searchAborted = false;
+}
+
+/**
+ * @return  True if the last search ran out of time or nodes before completing
+ */
+bool Search_WasAborted(void)
+{
+    return searchAborted;
+}
+
+/**
+ * Turns on soak testing, where the full board is verified every so often
+ * during the search. This works at every validation level, so release builds
+ * can be soaked too.
+ *
+ * @param interval:     Number of moves between verifications, 0 to turn off
+ */
+void Search_SetVerifyInterval(uint64_t interval)
+{
+    verifyInterval = interval;
+    numVerifications = 0;
+}
+
+/**
+ * @return  The number of board verifications made since soak testing started
+ */
+uint64_t Search_GetVerifyCount(void)
+{
+    return numVerifications;
+}
+
+/**
+ * Prepares for the next search of a game. What was learnt by earlier searches
+ * is kept, the transposition table entries are aged and the history scores
+ * halved, so the results of this search soon outweigh them.
+ */
+void Search_NewSearch(void)
+{
+    TT_NewSearch();
+    for(uint8_t pt = 0; pt < NUM_PIECE_TYPES; ++pt)
+    {
+        for(uint8_t idx = 0; idx < NUM_BOARD_INDICES; ++idx)
+        {
+            historyScores[pt][idx] /= 2;
+        }
+    }
+}
+
+/**
+ * Forgets everything learnt by earlier searches, ie. for a new game or a
+ * reproducible benchmark
+ */
+void Search_ClearHistory(void)
+{
+    TT_Clear();
+    memset(historyScores, 0, sizeof(historyScores));
+}
+
+/**
+ * Packs a move the way the transposition table keeps it
+ */
+static inline uint16_t Search_PackMove(const moveType_t *move)
+{
+    return move->startIdx | (move->endIdx << 6) | (move->promotion << 12);
+}
+
+/**
+ * @return  The piece type taken by a move, NUM_PIECE_TYPES if none
+ */
+static inline uint8_t Search_GetVictim(ChessBoard *cb, const moveType_t *move)
+{
+    uint8_t enemyBase = (move->pt < NUM_PIECE_TYPES/2) ? BLACK_PAWN : WHITE_PAWN;
+    uint64_t mask = (uint64_t) 1 << move->endIdx;
+
+    if(move->enPassant)
+    {
+        return enemyBase + WHITE_PAWN;
+    }
+    if((cb->GetOccupied() & mask) == 0)
+    {
+        return NUM_PIECE_TYPES;
+    }
+    for(uint8_t pt = enemyBase; pt < enemyBase + NUM_PIECE_TYPES/2; ++pt)
+    {
+        if(cb->GetPiece(pt) & mask)
+        {
+            return pt;
+        }
+    }
+    return NUM_PIECE_TYPES;
+}
+
+/**
+ * Credits a quiet move with causing a cutoff, deeper cutoffs counting for more
+ */
+static inline void Search_UpdateHistory(ChessBoard *cb, const moveType_t *move, uint64_t depth)
+{
+    int32_t *score;
+
+    if(move->promotion != PROMOTION_NONE || Search_GetVictim(cb, move) != NUM_PIECE_TYPES)
+    {
+        return;
+    }
+
+    score = &historyScores[move->pt][move->endIdx];
+    *score += (int32_t) (depth*depth);
+    if(*score > SEARCH_HISTORY_MAX)
+    {
+        for(uint8_t pt = 0; pt < NUM_PIECE_TYPES; ++pt)
+        {
+            for(uint8_t idx = 0; idx < NUM_BOARD_INDICES; ++idx)
+            {
+                historyScores[pt][idx] /= 2;
+            }
+        }
+    }
+}
+
+/**
+ * @return  The MVV-LVA ordering score of a capture or promotion
+ */
+static inline int32_t Search_CaptureScore(const moveType_t *move, uint8_t victim)
+{
+    return ORDER_CAPTURE
+           + ((move->promotion != PROMOTION_NONE) ? orderPieceValues[move->promotion] * 8 : 0)
+           + ((victim != NUM_PIECE_TYPES) ? orderPieceValues[victim % (NUM_PIECE_TYPES/2)] * 64 : 0)
+           - orderPieceValues[move->pt % (NUM_PIECE_TYPES/2)];
+}
+
+/**
+ * Puts the moves of a position in the order they should be searched: the best
+ * move the table knows of, then captures of the most valuable pieces by the
+ * least valuable ones, then quiet moves by their history, and last captures
+ * which lose material in the exchange, the worst of them last. The contents of the
+ * moves are swapped rather than the links, so the list keeps its head and
+ * can still be freed by whoever generated it.
+ *
+ * @param cb:       The position the moves are played from
+ * @param moves:    The moves to order
+ * @param ttMove:   The packed move from the transposition table, 0 for none
+ */
+static void Search_OrderMoves(ChessBoard *cb, moveType_t *moves, uint16_t ttMove)
+{
+    moveType_t *nodes[SEARCH_MAX_MOVES], contents[SEARCH_MAX_MOVES], *move;
+    int32_t scores[SEARCH_MAX_MOVES], score;
+    uint64_t numMoves = 0, j;
+    uint8_t victim;
+
+    for(move = moves; move != NULL && move->legalMove && numMoves < SEARCH_MAX_MOVES; move = move->adjMove)
+    {
+        victim = Search_GetVictim(cb, move);
+        if(ttMove != 0 && Search_PackMove(move) == ttMove)
+        {
+            score = ORDER_TT_MOVE;
+        }
+        else if(victim != NUM_PIECE_TYPES || move->promotion != PROMOTION_NONE)
+        {
+            // Quiet moves never score below zero, so losing captures go after them
+            score = See_Evaluate(cb, move);
+            score = (score < 0) ? score : Search_CaptureScore(move, victim);
+        }
+        else
+        {
+            score = historyScores[move->pt][move->endIdx];
+        }
+
+        // Insertion sort, lists are short and mostly arrive in order already
+        for(j = numMoves; j > 0 && scores[j - 1] < score; --j)
+        {
+            scores[j] = scores[j - 1];
+            contents[j] = contents[j - 1];
+        }
+        scores[j] = score;
+        contents[j] = *move;
+        nodes[numMoves++] = move;
+    }
+
+    for(j = 0; j < numMoves; ++j)
+    {
+        move = nodes[j]->adjMove;
+        *nodes[j] = contents[j];
+        nodes[j]->adjMove = move;
+    }
+}
+
+/**
+ * @return  True if the move is a capture which loses more than the pruning
+ *          margin allows at this depth
+ */
+static inline bool Search_IsLosingCapture(ChessBoard *cb, const moveType_t *move, uint64_t depth)
+{
+    if(Search_GetVictim(cb, move) == NUM_PIECE_TYPES && !move->enPassant)
+    {
+        return false;
+    }
+    return See_Evaluate(cb, move) < -(SEE_PRUNE_MARGIN * (int32_t) depth);
+}
+
+/**
+ * Checks the node count, and the clock every so often, so limited searches
+ * can unwind
+ */
+static inline void Search_CheckLimits(const searchStats_t *stats, uint64_t numMoves)
+{
+    if(searchNodeLimit != 0 && stats->nodes + stats->qnodes >= searchNodeLimit)
+    {
+        searchAborted = true;
+    }
+
+    if(searchTimeLimitMs == 0 || (numMoves & SEARCH_TIME_CHECK_MASK) != 0)
+    {
+        return;
+    }
+
+    if((uint64_t) std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - searchStartTime).count() >= searchTimeLimitMs)
+    {
+        searchAborted = true;
+    }
+}
+
+/**
+ * Verifies the board if soak testing is on and it is due
+ */
+static inline void Search_SoakVerify(ChessBoard *cb, uint64_t numMoves)
+{
+    if(__builtin_expect(verifyInterval == 0, 1) || (numMoves % verifyInterval) != 0)
+    {
+        return;
+    }
+
+    ++numVerifications;
+    if(!cb->VerifyBoardConsistency())
+    {
+        Util_AssertFailed("Soak test found an inconsistent board", __FILE__, __LINE__);
+    }
+}
+
+/**
+ * Searches the current position to a fixed depth for the side to move.
+ *
+ * @param depth         The search depth to look
+ * @param rootMoves     The moves available in the current position
+ *
+ * @return              The score of the best move found
+ *
+ * @note                The best move will be placed in the bestMove variable of the
+ *                      board, which is left NULL if there were no moves to make.
+ *                      Statistics accumulate until SearchStats_Reset is called, so
+ *                      calling this with increasing depths gives per iteration numbers
+ */
+int32_t ChessBoard::SearchFromRoot(uint64_t depth, moveType_t *rootMoves)
+{
+    int32_t score;
+
+    this->rootDepth = depth;
+    this->bestMove = NULL;
+
+    score = this->GetBestMove(depth, this->colorToMove == WHITE_PIECES, rootMoves, INT32_MIN, INT32_MAX);
+
+    if(!searchAborted)
+    {
+        SearchStats_CompleteIteration(depth);
+    }
+    return score;
+}
 
 /**
  * Determines the next best move via a minimax search algorithm.
- * 
+ *
  * @param depth                         The search depth to look
  * @param playerToMaximize              If we are attempting to maximize or minimize score
  *                                      for this search depth
  * @param movesToEvaluateAtThisDepth    See name
  * @param alpha                         Alpha param for alpha beta pruning
  * @param beta                          Beta param for alpha beta pruning
- * 
+ *
  * @return                  The score associated with the best move for this search
  *                          depth
- * 
- * @note                    At search depth 0, the move with the best score will be 
+ *
+ * @note                    At the root depth, the move with the best score will be
  *                          placed in a variable of the board bestMove;
  */
 int32_t ChessBoard::GetBestMove(uint64_t depth, bool playerToMaximize,
                                  moveType_t *movesToEvaluateAtThisDepth, int32_t alpha, int32_t beta)
 {
-    int32_t score, savedScore, value;
-    moveType_t *moveToEvaluate, *movesToEvaluateAtNextDepth, *tempMove;
-    bool evaluationNeeded = depth > 1;
+    TRACE_SCOPE(TRACE_SEARCH);
+    int32_t score, value, alphaOrig = alpha, betaOrig = beta;
+    moveType_t *moveToEvaluate, *movesToEvaluateAtNextDepth = NULL, *nodeBestMove = NULL;
+    ttEntry_t ttEntry;
+    uint16_t ttMove = 0;
+    ttBound_e bound;
+    bool evaluationNeeded = depth > 1, firstMove = true;
+    searchStats_t *stats = SearchStats_Get();
+    uint64_t ply = std::min(this->rootDepth - depth, (uint64_t) STATS_MAX_PLY - 1);
+
+    // After we move, it is the other color who has to respond
+    uint8_t nextColor = playerToMaximize ? BLACK_PIECES : WHITE_PIECES;
 
-    if(depth >= 6)
+    stats->selDepth = std::max(stats->selDepth, ply);
+
+    // A king was taken somewhere along this line, the game is over. Losing it
+    // closer to the root is worse, which is where the remaining depth comes in
+    if(this->pieces[WHITE_KING] == 0)
+    {
+        stats->pruned[PRUNE_KING_CAPTURED]++;
+        return -(MATE_SCORE + (int32_t) depth);
+    }
+    if(this->pieces[BLACK_KING] == 0)
     {
-        std::cout << "Assessing depth at: " << SEARCH_DEPTH - depth
-             << " # Moves Assessed: " << numMoves << std::endl;
+        stats->pruned[PRUNE_KING_CAPTURED]++;
+        return MATE_SCORE + (int32_t) depth;
     }
 
+    // Out of depth, but only quiet positions are fit to be evaluated
     if(depth == 0)
     {
-        return -EvaluateCurrentBoardValue(this);
+        return this->Quiescence(playerToMaximize, alpha, beta, ply);
     }
 
+    // Nothing to play from here, just take the board as it stands
+    if(movesToEvaluateAtThisDepth == NULL || !movesToEvaluateAtThisDepth->legalMove)
+    {
+        return EvaluateCurrentBoardValue(this);
+    }
+
+    // A deep enough result from an earlier visit may settle this node outright,
+    // but the root always searches so there is a best move to play
+    stats->ttProbes++;
+    if(TT_Probe(this->hashKey, depth, &ttEntry))
+    {
+        stats->ttHits++;
+        ttMove = ttEntry.move;
+
+        if(depth != this->rootDepth && ttEntry.depth >= depth
+            && (TT_ENTRY_BOUND(&ttEntry) == TT_BOUND_EXACT
+                || (TT_ENTRY_BOUND(&ttEntry) == TT_BOUND_LOWER && ttEntry.score >= beta)
+                || (TT_ENTRY_BOUND(&ttEntry) == TT_BOUND_UPPER && ttEntry.score <= alpha)))
+        {
+            return ttEntry.score;
+        }
+    }
+
+    Search_OrderMoves(this, movesToEvaluateAtThisDepth, ttMove);
+
     moveToEvaluate = movesToEvaluateAtThisDepth;
     if(playerToMaximize)
     {
         score = INT32_MIN;
         while(moveToEvaluate != NULL && moveToEvaluate->legalMove)
         {
-            numMoves++;
-            this->ApplyMoveToBoard(moveToEvaluate);
-            
-            // We only need to evaluate moves if we have at least 2 to go
-            if(evaluationNeeded)
+            // Near the leaves a capture which loses material is not worth a look
+            if(!firstMove && depth <= SEE_PRUNE_DEPTH && depth != this->rootDepth
+                && Search_IsLosingCapture(this, moveToEvaluate, depth))
             {
-                movesToEvaluateAtNextDepth = this->GenerateMoves(BLACK_PIECES);
+                stats->pruned[PRUNE_SEE]++;
+                moveToEvaluate = moveToEvaluate->adjMove;
+                continue;
             }
 
-            savedScore = score;
-            value = this->GetBestMove(depth - 1, !playerToMaximize, movesToEvaluateAtNextDepth, alpha, beta);
-            score = std::max(score, value);
-            alpha = std::max(alpha, value);
+            stats->nodes++;
+            stats->nodesAtPly[ply]++;
+            Search_CheckLimits(stats, stats->nodes);
+            // With no room left to keep its undo state the move cannot be
+            // made, so the line ends there as a draw with nothing to take back
+            if(this->ApplyMoveToBoard(moveToEvaluate) != STATUS_SUCCESS)
+            {
+                value = DRAW_SCORE;
+            }
+            else
+            {
+                Search_SoakVerify(this, stats->nodes);
 
-            if(depth == SEARCH_DEPTH && score >= savedScore)
+                // The child probes the table once its moves are generated, so
+                // start fetching its bucket now while that work goes on
+                if(evaluationNeeded)
+                {
+                    TT_Prefetch(this->hashKey);
+                }
+
+                // A drawn position ends the line, there is nothing below it to search
+                if(this->IsDrawByRule())
+                {
+                    stats->pruned[PRUNE_DRAW]++;
+                    value = DRAW_SCORE;
+                }
+                else
+                {
+                    // We only need to evaluate moves if we have at least 2 to go
+                    if(evaluationNeeded)
+                    {
+                        movesToEvaluateAtNextDepth = this->GenerateMoves(nextColor);
+                    }
+
+                    value = this->GetBestMove(depth - 1, !playerToMaximize, movesToEvaluateAtNextDepth, alpha, beta);
+
+                    if(evaluationNeeded)
+                    {
+                        FreeMoveList(movesToEvaluateAtNextDepth);
+                    }
+                }
+
+                this->UndoMoveFromBoard(moveToEvaluate);
+            }
+
+            if(value > score)
             {
-                this->bestMove = moveToEvaluate;
+                score = value;
+                nodeBestMove = moveToEvaluate;
+                if(depth == this->rootDepth)
+                {
+                    this->bestMove = moveToEvaluate;
+                }
             }
-            this->UndoMoveFromBoard(moveToEvaluate);
+            alpha = std::max(alpha, value);
 
             if(beta <= alpha)
+            {
+                Search_UpdateHistory(this, moveToEvaluate, depth);
+                stats->betaCutoffs++;
+                stats->firstMoveCutoffs += firstMove ? 1 : 0;
+                break;
+            }
+
+            if(searchAborted)
             {
                 break;
             }
 
             moveToEvaluate = moveToEvaluate->adjMove;
+            firstMove = false;
 
         }
     }
@@ -81,36 +514,206 @@ int32_t ChessBoard::GetBestMove(uint64_t depth, bool playerToMaximize,
         score = INT32_MAX;
         while(moveToEvaluate != NULL && moveToEvaluate->legalMove)
         {
-            numMoves++;
-            this->ApplyMoveToBoard(moveToEvaluate);
-            
-            if(evaluationNeeded)
+            // Near the leaves a capture which loses material is not worth a look
+            if(!firstMove && depth <= SEE_PRUNE_DEPTH && depth != this->rootDepth
+                && Search_IsLosingCapture(this, moveToEvaluate, depth))
             {
-                movesToEvaluateAtNextDepth = this->GenerateMoves(BLACK_PIECES);
+                stats->pruned[PRUNE_SEE]++;
+                moveToEvaluate = moveToEvaluate->adjMove;
+                continue;
             }
 
-            savedScore = score;
-            value = this->GetBestMove(depth - 1, !playerToMaximize, movesToEvaluateAtNextDepth, alpha, beta);
-            score = std::max(score, value);
-            beta = std::max(beta, value);
+            stats->nodes++;
+            stats->nodesAtPly[ply]++;
+            Search_CheckLimits(stats, stats->nodes);
+            // With no room left to keep its undo state the move cannot be
+            // made, so the line ends there as a draw with nothing to take back
+            if(this->ApplyMoveToBoard(moveToEvaluate) != STATUS_SUCCESS)
+            {
+                value = DRAW_SCORE;
+            }
+            else
+            {
+                Search_SoakVerify(this, stats->nodes);
 
-            if(depth == SEARCH_DEPTH && score >= savedScore)
+                // The child probes the table once its moves are generated, so
+                // start fetching its bucket now while that work goes on
+                if(evaluationNeeded)
+                {
+                    TT_Prefetch(this->hashKey);
+                }
+
+                // A drawn position ends the line, there is nothing below it to search
+                if(this->IsDrawByRule())
+                {
+                    stats->pruned[PRUNE_DRAW]++;
+                    value = DRAW_SCORE;
+                }
+                else
+                {
+                    // We only need to evaluate moves if we have at least 2 to go
+                    if(evaluationNeeded)
+                    {
+                        movesToEvaluateAtNextDepth = this->GenerateMoves(nextColor);
+                    }
+
+                    value = this->GetBestMove(depth - 1, !playerToMaximize, movesToEvaluateAtNextDepth, alpha, beta);
+
+                    if(evaluationNeeded)
+                    {
+                        FreeMoveList(movesToEvaluateAtNextDepth);
+                    }
+                }
+
+                this->UndoMoveFromBoard(moveToEvaluate);
+            }
+
+            if(value < score)
             {
-                this->bestMove = moveToEvaluate;
+                score = value;
+                nodeBestMove = moveToEvaluate;
+                if(depth == this->rootDepth)
+                {
+                    this->bestMove = moveToEvaluate;
+                }
             }
-            this->UndoMoveFromBoard(moveToEvaluate);
+            beta = std::min(beta, value);
 
             if(beta <= alpha)
+            {
+                Search_UpdateHistory(this, moveToEvaluate, depth);
+                stats->betaCutoffs++;
+                stats->firstMoveCutoffs += firstMove ? 1 : 0;
+                break;
+            }
+
+            if(searchAborted)
             {
                 break;
             }
 
             moveToEvaluate = moveToEvaluate->adjMove;
+            firstMove = false;
+
+        }
+    }
+
+    // A search cut short by the clock knows nothing reliable about the node
+    if(!searchAborted)
+    {
+        bound = (score <= alphaOrig) ? TT_BOUND_UPPER : (score >= betaOrig) ? TT_BOUND_LOWER : TT_BOUND_EXACT;
+        TT_Store(this->hashKey, depth, score, bound,
+                 (nodeBestMove != NULL && bound != TT_BOUND_UPPER) ? Search_PackMove(nodeBestMove) : 0);
+    }
+
+    return score;
+}
+
+/**
+ * Plays out the captures of a position until it is quiet enough to evaluate,
+ * so the search never stops in the middle of an exchange. The side to move
+ * may always stand pat on the board as it is, and captures which lose
+ * material in the exchange are never tried.
+ *
+ * @param playerToMaximize: If we are attempting to maximize or minimize score
+ * @param alpha:            Alpha param for alpha beta pruning
+ * @param beta:             Beta param for alpha beta pruning
+ * @param ply:              Distance from the root
+ *
+ * @return  The score of the position once quiet
+ */
+int32_t ChessBoard::Quiescence(bool playerToMaximize, int32_t alpha, int32_t beta, uint64_t ply)
+{
+    TRACE_SCOPE(TRACE_SEARCH);
+    moveType_t captures[SEARCH_MAX_MOVES], move;
+    int32_t scores[SEARCH_MAX_MOVES], score, value, see;
+    uint64_t numCaptures, numSearched = 0, i, j;
+    searchStats_t *stats = SearchStats_Get();
+
+    stats->selDepth = std::max(stats->selDepth, ply);
+
+    if(this->pieces[WHITE_KING] == 0)
+    {
+        stats->pruned[PRUNE_KING_CAPTURED]++;
+        return -MATE_SCORE;
+    }
+    if(this->pieces[BLACK_KING] == 0)
+    {
+        stats->pruned[PRUNE_KING_CAPTURED]++;
+        return MATE_SCORE;
+    }
+
+    // Not capturing at all is always an option, so the board as it stands is a bound
+    score = (int32_t) EvaluateLazy(this, alpha, beta);
+    if(playerToMaximize ? score >= beta : score <= alpha)
+    {
+        return score;
+    }
+    if(playerToMaximize)
+    {
+        alpha = std::max(alpha, score);
+    }
+    else
+    {
+        beta = std::min(beta, score);
+    }
+
+    // Keep the captures worth trying, best victims by the cheapest attackers first
+    numCaptures = this->GenerateCaptures(captures);
+    for(i = 0; i < numCaptures; ++i)
+    {
+        see = See_Evaluate(this, &captures[i]);
+        if(see < 0)
+        {
+            stats->pruned[PRUNE_SEE_QSEARCH]++;
+            continue;
+        }
+
+        move = captures[i];
+        value = Search_CaptureScore(&move, Search_GetVictim(this, &move));
+        for(j = numSearched; j > 0 && scores[j - 1] < value; --j)
+        {
+            scores[j] = scores[j - 1];
+            captures[j] = captures[j - 1];
+        }
+        scores[j] = value;
+        captures[j] = move;
+        ++numSearched;
+    }
+
+    for(i = 0; i < numSearched; ++i)
+    {
+        stats->qnodes++;
+        Search_CheckLimits(stats, stats->qnodes);
+        // With no room left to keep its undo state no capture can be made,
+        // which leaves standing pat
+        if(this->ApplyMoveToBoard(&captures[i]) != STATUS_SUCCESS)
+        {
+            break;
+        }
+        Search_SoakVerify(this, stats->qnodes);
+
+        value = this->Quiescence(!playerToMaximize, alpha, beta,
+                                 std::min(ply + 1, (uint64_t) STATS_MAX_PLY - 1));
 
+        this->UndoMoveFromBoard(&captures[i]);
+
+        if(playerToMaximize)
+        {
+            score = std::max(score, value);
+            alpha = std::max(alpha, value);
+        }
+        else
+        {
+            score = std::min(score, value);
+            beta = std::min(beta, value);
+        }
+
+        if(beta <= alpha || searchAborted)
+        {
+            break;
         }
     }
 
-//    std::cout << "Examined " << numMoves << " moves during search" << std::endl;
-//    numMoves = 0;
     return score;
 }
@@ -0,0 +1,606 @@
+/* This file is responsible for evaluating positions with an efficiently updatable neural network */
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "nnue.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NNUE_X86 (1)
+#else
+#define NNUE_X86 (0)
+#endif
+
+// Where each piece type sits among the first layer inputs, by white piece type.
+// Kings are not inputs, they pick which set of inputs the rest go to.
+#define NNUE_NO_KIND 0xFF
+static const uint8_t nnuePieceKinds[NUM_PIECE_TYPES/2] = { 0, 3, 2, 1, 4, NNUE_NO_KIND };
+
+nnueNetwork_t nnueNetwork;
+
+// Generation the next network loaded will take, never 0
+static uint32_t nnueNextGeneration = 1;
+
+/**
+ * The vector kernels the network runs on. The widest the processor supports
+ * are picked when the first network is loaded.
+ */
+typedef struct nnueKernels_s
+{
+    const char *name;
+
+    // Adds or takes away a first layer column, NNUE_HALF_DIMS wide
+    void (*addColumn)(int16_t *values, const int16_t *column);
+    void (*subColumn)(int16_t *values, const int16_t *column);
+
+    // Clips accumulator values to the activation range, length a multiple of 32
+    void (*clip)(const int16_t *values, uint8_t *output, uint32_t length);
+
+    // Sums each row of weights times the input, numInputs a multiple of 32
+    // and numOutputs a multiple of 4
+    void (*affine)(const uint8_t *input, uint32_t numInputs, const int8_t *weights,
+                   uint32_t numOutputs, int32_t *sums);
+} nnueKernels_t;
+
+static void Nnue_AddColumnScalar(int16_t *values, const int16_t *column)
+{
+    for(uint32_t i = 0; i < NNUE_HALF_DIMS; ++i)
+    {
+        values[i] += column[i];
+    }
+}
+
+static void Nnue_SubColumnScalar(int16_t *values, const int16_t *column)
+{
+    for(uint32_t i = 0; i < NNUE_HALF_DIMS; ++i)
+    {
+        values[i] -= column[i];
+    }
+}
+
+static void Nnue_ClipScalar(const int16_t *values, uint8_t *output, uint32_t length)
+{
+    for(uint32_t i = 0; i < length; ++i)
+    {
+        output[i] = (uint8_t) std::clamp((int32_t) values[i], 0, NNUE_ACTIVATION_MAX);
+    }
+}
+
+static void Nnue_AffineScalar(const uint8_t *input, uint32_t numInputs, const int8_t *weights,
+                              uint32_t numOutputs, int32_t *sums)
+{
+    for(uint32_t row = 0; row < numOutputs; ++row)
+    {
+        sums[row] = 0;
+        for(uint32_t i = 0; i < numInputs; ++i)
+        {
+            sums[row] += input[i] * weights[row * numInputs + i];
+        }
+    }
+}
+
+#if NNUE_X86
+
+__attribute__((target("sse2")))
+static void Nnue_AddColumnSse(int16_t *values, const int16_t *column)
+{
+    for(uint32_t i = 0; i < NNUE_HALF_DIMS; i += 8)
+    {
+        __m128i v = _mm_load_si128((const __m128i *) &values[i]);
+        _mm_store_si128((__m128i *) &values[i], _mm_add_epi16(v, _mm_load_si128((const __m128i *) &column[i])));
+    }
+}
+
+__attribute__((target("sse2")))
+static void Nnue_SubColumnSse(int16_t *values, const int16_t *column)
+{
+    for(uint32_t i = 0; i < NNUE_HALF_DIMS; i += 8)
+    {
+        __m128i v = _mm_load_si128((const __m128i *) &values[i]);
+        _mm_store_si128((__m128i *) &values[i], _mm_sub_epi16(v, _mm_load_si128((const __m128i *) &column[i])));
+    }
+}
+
+__attribute__((target("sse2")))
+static void Nnue_ClipSse(const int16_t *values, uint8_t *output, uint32_t length)
+{
+    const __m128i zero = _mm_setzero_si128(), top = _mm_set1_epi16(NNUE_ACTIVATION_MAX);
+    __m128i lo, hi;
+
+    for(uint32_t i = 0; i < length; i += 16)
+    {
+        lo = _mm_min_epi16(_mm_max_epi16(_mm_load_si128((const __m128i *) &values[i]), zero), top);
+        hi = _mm_min_epi16(_mm_max_epi16(_mm_load_si128((const __m128i *) &values[i + 8]), zero), top);
+        _mm_store_si128((__m128i *) &output[i], _mm_packus_epi16(lo, hi));
+    }
+}
+
+/**
+ * Multiplies unsigned inputs by signed weights in pairs, then widens the pair
+ * sums to 32 bits. Inputs never pass NNUE_ACTIVATION_MAX, so a pair can not
+ * saturate. Four rows are summed at once so they share one horizontal add.
+ */
+__attribute__((target("ssse3")))
+static void Nnue_AffineSsse3(const uint8_t *input, uint32_t numInputs, const int8_t *weights,
+                             uint32_t numOutputs, int32_t *sums)
+{
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i rowSums[4], in;
+
+    for(uint32_t row = 0; row < numOutputs; row += 4)
+    {
+        for(uint32_t r = 0; r < 4; ++r)
+        {
+            rowSums[r] = _mm_setzero_si128();
+        }
+        for(uint32_t i = 0; i < numInputs; i += 16)
+        {
+            in = _mm_load_si128((const __m128i *) &input[i]);
+            for(uint32_t r = 0; r < 4; ++r)
+            {
+                rowSums[r] = _mm_add_epi32(rowSums[r], _mm_madd_epi16(_mm_maddubs_epi16(in,
+                                _mm_load_si128((const __m128i *) &weights[(row + r) * numInputs + i])), ones));
+            }
+        }
+        _mm_storeu_si128((__m128i *) &sums[row], _mm_hadd_epi32(_mm_hadd_epi32(rowSums[0], rowSums[1]),
+                                                                 _mm_hadd_epi32(rowSums[2], rowSums[3])));
+    }
+}
+
+__attribute__((target("avx2")))
+static void Nnue_AddColumnAvx2(int16_t *values, const int16_t *column)
+{
+    for(uint32_t i = 0; i < NNUE_HALF_DIMS; i += 16)
+    {
+        __m256i v = _mm256_load_si256((const __m256i *) &values[i]);
+        _mm256_store_si256((__m256i *) &values[i],
+                           _mm256_add_epi16(v, _mm256_load_si256((const __m256i *) &column[i])));
+    }
+}
+
+__attribute__((target("avx2")))
+static void Nnue_SubColumnAvx2(int16_t *values, const int16_t *column)
+{
+    for(uint32_t i = 0; i < NNUE_HALF_DIMS; i += 16)
+    {
+        __m256i v = _mm256_load_si256((const __m256i *) &values[i]);
+        _mm256_store_si256((__m256i *) &values[i],
+                           _mm256_sub_epi16(v, _mm256_load_si256((const __m256i *) &column[i])));
+    }
+}
+
+__attribute__((target("avx2")))
+static void Nnue_ClipAvx2(const int16_t *values, uint8_t *output, uint32_t length)
+{
+    const __m256i zero = _mm256_setzero_si256(), top = _mm256_set1_epi16(NNUE_ACTIVATION_MAX);
+    __m256i lo, hi;
+
+    for(uint32_t i = 0; i < length; i += 32)
+    {
+        lo = _mm256_min_epi16(_mm256_max_epi16(_mm256_load_si256((const __m256i *) &values[i]), zero), top);
+        hi = _mm256_min_epi16(_mm256_max_epi16(_mm256_load_si256((const __m256i *) &values[i + 16]), zero), top);
+
+        // Packing works within each 128 bit lane, so put the quarters back in order
+        _mm256_store_si256((__m256i *) &output[i], _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8));
+    }
+}
+
+__attribute__((target("avx2")))
+static void Nnue_AffineAvx2(const uint8_t *input, uint32_t numInputs, const int8_t *weights,
+                            uint32_t numOutputs, int32_t *sums)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i rowSums[4], in, all;
+
+    for(uint32_t row = 0; row < numOutputs; row += 4)
+    {
+        for(uint32_t r = 0; r < 4; ++r)
+        {
+            rowSums[r] = _mm256_setzero_si256();
+        }
+        for(uint32_t i = 0; i < numInputs; i += 32)
+        {
+            in = _mm256_load_si256((const __m256i *) &input[i]);
+            for(uint32_t r = 0; r < 4; ++r)
+            {
+                rowSums[r] = _mm256_add_epi32(rowSums[r], _mm256_madd_epi16(_mm256_maddubs_epi16(in,
+                                _mm256_load_si256((const __m256i *) &weights[(row + r) * numInputs + i])), ones));
+            }
+        }
+        all = _mm256_hadd_epi32(_mm256_hadd_epi32(rowSums[0], rowSums[1]), _mm256_hadd_epi32(rowSums[2], rowSums[3]));
+        _mm_storeu_si128((__m128i *) &sums[row],
+                         _mm_add_epi32(_mm256_castsi256_si128(all), _mm256_extracti128_si256(all, 1)));
+    }
+}
+
+#endif // NNUE_X86
+
+static const nnueKernels_t nnueKernelSets[] =
+{
+#if NNUE_X86
+    { "avx2",   Nnue_AddColumnAvx2,     Nnue_SubColumnAvx2,     Nnue_ClipAvx2,      Nnue_AffineAvx2 },
+    { "sse",    Nnue_AddColumnSse,      Nnue_SubColumnSse,      Nnue_ClipSse,       Nnue_AffineSsse3 },
+#endif
+    { "scalar", Nnue_AddColumnScalar,   Nnue_SubColumnScalar,   Nnue_ClipScalar,    Nnue_AffineScalar },
+};
+
+static const nnueKernels_t *nnueKernels = NULL;
+
+/**
+ * @return  True if the processor can run a set of kernels
+ */
+static bool Nnue_KernelsSupported(const nnueKernels_t *kernels)
+{
+#if NNUE_X86
+    if(strcmp(kernels->name, "avx2") == 0)
+    {
+        return __builtin_cpu_supports("avx2");
+    }
+    if(strcmp(kernels->name, "sse") == 0)
+    {
+        return __builtin_cpu_supports("ssse3");
+    }
+#endif
+    return true;
+}
+
+/**
+ * Picks the kernels the network runs on
+ *
+ * @param name:     "avx2", "sse" or "scalar", or "auto" for the widest the
+ *                  processor supports
+ *
+ * @return  STATUS_SUCCESS if the kernels are known and supported, STATUS_FAIL otherwise
+ */
+uint64_t Nnue_SelectKernels(std::string name)
+{
+    for(const nnueKernels_t &kernels : nnueKernelSets)
+    {
+        if((name == "auto" || name == kernels.name) && Nnue_KernelsSupported(&kernels))
+        {
+            nnueKernels = &kernels;
+            return STATUS_SUCCESS;
+        }
+    }
+    return STATUS_FAIL;
+}
+
+/**
+ * @return  The name of the kernels the network runs on
+ */
+const char *Nnue_GetKernelsName(void)
+{
+    if(nnueKernels == NULL)
+    {
+        Nnue_SelectKernels("auto");
+    }
+    return nnueKernels->name;
+}
+
+/**
+ * @return  The bytes a section takes up in a network file, padding included
+ */
+static inline uint64_t Nnue_SectionSize(uint64_t size)
+{
+    return (size + NNUE_FILE_ALIGNMENT - 1) & ~((uint64_t) NNUE_FILE_ALIGNMENT - 1);
+}
+
+/**
+ * Maps a network file into memory and points the network at its sections.
+ * The weights are only ever read through the mapping, nothing is copied.
+ *
+ * @param path:     The network file
+ *
+ * @return  STATUS_SUCCESS if the network was loaded, STATUS_FAIL otherwise
+ */
+uint64_t Nnue_Load(std::string path)
+{
+    nnueFileHeader_t header;
+    struct stat st;
+    const char *section;
+    uint64_t expectedSize;
+    void *mapping;
+    int fd;
+
+    expectedSize = Nnue_SectionSize(sizeof(nnueFileHeader_t))
+                 + Nnue_SectionSize(NNUE_HALF_DIMS * sizeof(int16_t))
+                 + Nnue_SectionSize((uint64_t) NNUE_NUM_FEATURES * NNUE_HALF_DIMS * sizeof(int16_t))
+                 + Nnue_SectionSize(NNUE_HIDDEN_DIMS * sizeof(int32_t))
+                 + Nnue_SectionSize(NNUE_HIDDEN_DIMS * 2 * NNUE_HALF_DIMS)
+                 + Nnue_SectionSize(NNUE_HIDDEN_DIMS * sizeof(int32_t))
+                 + Nnue_SectionSize(NNUE_HIDDEN_DIMS * NNUE_HIDDEN_DIMS)
+                 + Nnue_SectionSize(sizeof(int32_t))
+                 + Nnue_SectionSize(NNUE_HIDDEN_DIMS);
+
+    fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return STATUS_FAIL;
+    }
+
+    if(fstat(fd, &st) != 0 || (uint64_t) st.st_size != expectedSize
+        || read(fd, &header, sizeof(header)) != (ssize_t) sizeof(header)
+        || header.magic != NNUE_FILE_MAGIC || header.version != NNUE_FILE_VERSION
+        || header.numFeatures != NNUE_NUM_FEATURES || header.halfDims != NNUE_HALF_DIMS
+        || header.hiddenDims != NNUE_HIDDEN_DIMS)
+    {
+        std::cout << path << " is not a network this build can use" << std::endl;
+        close(fd);
+        return STATUS_FAIL;
+    }
+
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        return STATUS_FAIL;
+    }
+
+    // Every position looks at the first layer somewhere, so have it all read in now
+    madvise(mapping, st.st_size, MADV_WILLNEED);
+
+    Nnue_Unload();
+    if(nnueKernels == NULL)
+    {
+        Nnue_SelectKernels("auto");
+    }
+
+    section = (const char *) mapping + Nnue_SectionSize(sizeof(nnueFileHeader_t));
+    nnueNetwork.featureBiases = (const int16_t *) section;
+    section += Nnue_SectionSize(NNUE_HALF_DIMS * sizeof(int16_t));
+    nnueNetwork.featureWeights = (const int16_t *) section;
+    section += Nnue_SectionSize((uint64_t) NNUE_NUM_FEATURES * NNUE_HALF_DIMS * sizeof(int16_t));
+    nnueNetwork.hidden1Biases = (const int32_t *) section;
+    section += Nnue_SectionSize(NNUE_HIDDEN_DIMS * sizeof(int32_t));
+    nnueNetwork.hidden1Weights = (const int8_t *) section;
+    section += Nnue_SectionSize(NNUE_HIDDEN_DIMS * 2 * NNUE_HALF_DIMS);
+    nnueNetwork.hidden2Biases = (const int32_t *) section;
+    section += Nnue_SectionSize(NNUE_HIDDEN_DIMS * sizeof(int32_t));
+    nnueNetwork.hidden2Weights = (const int8_t *) section;
+    section += Nnue_SectionSize(NNUE_HIDDEN_DIMS * NNUE_HIDDEN_DIMS);
+    nnueNetwork.outputBias = (const int32_t *) section;
+    section += Nnue_SectionSize(sizeof(int32_t));
+    nnueNetwork.outputWeights = (const int8_t *) section;
+
+    nnueNetwork.mapping = mapping;
+    nnueNetwork.mappingSize = st.st_size;
+    nnueNetwork.generation = nnueNextGeneration++;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Drops the loaded network, if any, which puts the evaluation back on the
+ * hand written terms. Every accumulator becomes stale.
+ */
+void Nnue_Unload(void)
+{
+    if(nnueNetwork.mapping != NULL)
+    {
+        munmap(nnueNetwork.mapping, nnueNetwork.mappingSize);
+    }
+    memset(&nnueNetwork, 0, sizeof(nnueNetwork));
+}
+
+/**
+ * @return  True if there is a network to evaluate with
+ */
+bool Nnue_IsLoaded(void)
+{
+    return nnueNetwork.generation != 0;
+}
+
+/**
+ * Finds the first layer input a piece feeds as seen from one side
+ *
+ * @param side:     0 for white's view, 1 for black's
+ * @param kingIdx:  Where that side's king stands
+ * @param pt:       The piece type
+ * @param idx:      Where the piece stands
+ *
+ * @return  The input, or NNUE_NO_FEATURE for a king, which is not an input
+ */
+uint32_t Nnue_FeatureIndex(uint8_t side, uint8_t kingIdx, uint8_t pt, uint8_t idx)
+{
+    uint8_t kind = nnuePieceKinds[pt % (NUM_PIECE_TYPES/2)], flip = (side == 0) ? 0 : 56;
+
+    if(kind == NNUE_NO_KIND)
+    {
+        return NNUE_NO_FEATURE;
+    }
+
+    // Each side sees the board from its own end, its own pieces first
+    kind = kind*2 + (((pt < NUM_PIECE_TYPES/2) ? 0 : 1) ^ side);
+    return ((uint32_t) (kingIdx ^ flip) * NNUE_PIECE_KINDS + kind) * NUM_BOARD_INDICES + (idx ^ flip);
+}
+
+/**
+ * @return  The first layer column of a piece as seen from one side, or NULL
+ *          for a king, which is not an input
+ */
+static inline const int16_t *Nnue_Column(uint8_t side, uint8_t kingIdx, uint8_t pt, uint8_t idx)
+{
+    uint32_t feature = Nnue_FeatureIndex(side, kingIdx, pt, idx);
+
+    if(feature == NNUE_NO_FEATURE)
+    {
+        return NULL;
+    }
+    return &nnueNetwork.featureWeights[(uint64_t) feature * NNUE_HALF_DIMS];
+}
+
+/**
+ * Builds one side's half of the accumulator from nothing
+ */
+static void Nnue_RefreshSide(int16_t *values, uint8_t side, const uint64_t *pieces)
+{
+    uint64_t king = pieces[(side == 0) ? WHITE_KING : BLACK_KING];
+    uint8_t kingIdx;
+
+    memcpy(values, nnueNetwork.featureBiases, NNUE_HALF_DIMS * sizeof(int16_t));
+
+    // Only a line the search has already lost has no king, and it is never evaluated
+    if(king == 0)
+    {
+        return;
+    }
+    kingIdx = __builtin_ctzll(king);
+
+    for(uint8_t pt = 0; pt < NUM_PIECE_TYPES; ++pt)
+    {
+        if(pt % (NUM_PIECE_TYPES/2) == WHITE_KING)
+        {
+            continue;
+        }
+        for(uint64_t bb = pieces[pt]; bb; bb &= bb - 1)
+        {
+            nnueKernels->addColumn(values, Nnue_Column(side, kingIdx, pt, __builtin_ctzll(bb)));
+        }
+    }
+}
+
+/**
+ * Builds an accumulator from nothing for the loaded network
+ *
+ * @param acc:      The accumulator to build
+ * @param pieces:   The piece boards of the position
+ */
+void Nnue_RefreshAccumulator(nnueAccumulator_t *acc, const uint64_t *pieces)
+{
+    Util_Assert(Nnue_IsLoaded(), "No network to build an accumulator for");
+
+    Nnue_RefreshSide(acc->values[0], 0, pieces);
+    Nnue_RefreshSide(acc->values[1], 1, pieces);
+    acc->generation = nnueNetwork.generation;
+}
+
+/**
+ * Brings an accumulator along with a move, or back with its undo. Only the
+ * columns of the pieces which changed are added and taken away, apart from
+ * the side whose king moved, which is built again from where it now stands.
+ *
+ * @param acc:      An accumulator current for the loaded network
+ * @param pieces:   The piece boards once the move is made, or undone
+ * @param delta:    The features the move takes away and adds
+ * @param undo:     True if the move is being undone, swapping what it added
+ *                  and took away
+ */
+void Nnue_UpdateAccumulator(nnueAccumulator_t *acc, const uint64_t *pieces, const nnueDelta_t *delta, bool undo)
+{
+    const uint8_t *addedPt = undo ? delta->removedPt : delta->addedPt;
+    const uint8_t *addedIdx = undo ? delta->removedIdx : delta->addedIdx;
+    const uint8_t *removedPt = undo ? delta->addedPt : delta->removedPt;
+    const uint8_t *removedIdx = undo ? delta->addedIdx : delta->removedIdx;
+    uint8_t numAdded = undo ? delta->numRemoved : delta->numAdded;
+    uint8_t numRemoved = undo ? delta->numAdded : delta->numRemoved;
+    uint8_t kingIdx;
+    uint64_t king;
+
+    for(uint8_t side = 0; side < 2; ++side)
+    {
+        if(delta->kingMoved == ((side == 0) ? WHITE_PIECES : BLACK_PIECES))
+        {
+            Nnue_RefreshSide(acc->values[side], side, pieces);
+            continue;
+        }
+
+        king = pieces[(side == 0) ? WHITE_KING : BLACK_KING];
+        if(king == 0)
+        {
+            continue;
+        }
+        kingIdx = __builtin_ctzll(king);
+
+        for(uint8_t i = 0; i < numRemoved; ++i)
+        {
+            nnueKernels->subColumn(acc->values[side], Nnue_Column(side, kingIdx, removedPt[i], removedIdx[i]));
+        }
+        for(uint8_t i = 0; i < numAdded; ++i)
+        {
+            nnueKernels->addColumn(acc->values[side], Nnue_Column(side, kingIdx, addedPt[i], addedIdx[i]));
+        }
+    }
+}
+
+/**
+ * @return  True if an accumulator current for the loaded network matches
+ *          one built from nothing. Sides without a king are not checked.
+ */
+bool Nnue_VerifyAccumulator(const nnueAccumulator_t *acc, const uint64_t *pieces)
+{
+    nnueAccumulator_t fresh;
+
+    Nnue_RefreshAccumulator(&fresh, pieces);
+    for(uint8_t side = 0; side < 2; ++side)
+    {
+        if(pieces[(side == 0) ? WHITE_KING : BLACK_KING] != 0
+            && memcmp(acc->values[side], fresh.values[side], sizeof(fresh.values[side])) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Runs a hidden layer of the network, clipping its outputs to the activation range
+ */
+static inline void Nnue_HiddenLayer(const uint8_t *input, uint32_t numInputs, const int8_t *weights,
+                                    const int32_t *biases, uint8_t *output)
+{
+    int32_t sums[NNUE_HIDDEN_DIMS];
+
+    nnueKernels->affine(input, numInputs, weights, NNUE_HIDDEN_DIMS, sums);
+    for(uint32_t i = 0; i < NNUE_HIDDEN_DIMS; ++i)
+    {
+        output[i] = (uint8_t) std::clamp((biases[i] + sums[i]) >> NNUE_WEIGHT_SHIFT, 0, NNUE_ACTIVATION_MAX);
+    }
+}
+
+/**
+ * Evaluates a position with the loaded network, building the accumulator
+ * first if it is stale
+ *
+ * @param acc:          The accumulator of the position
+ * @param pieces:       The piece boards of the position
+ * @param whiteToMove:  True if it is white to move, the network scores for
+ *                      the side to move
+ *
+ * @return  The value of the position, positive in white's favour
+ */
+int32_t Nnue_Evaluate(nnueAccumulator_t *acc, const uint64_t *pieces, bool whiteToMove)
+{
+    alignas(32) uint8_t input[2 * NNUE_HALF_DIMS];
+    alignas(32) uint8_t hidden1[NNUE_HIDDEN_DIMS], hidden2[NNUE_HIDDEN_DIMS];
+    uint8_t us = whiteToMove ? 0 : 1;
+    int32_t output;
+
+    Util_Assert(Nnue_IsLoaded(), "No network to evaluate with");
+
+    if(!Nnue_IsCurrent(acc))
+    {
+        Nnue_RefreshAccumulator(acc, pieces);
+    }
+
+    // The side to move's half goes first
+    nnueKernels->clip(acc->values[us], input, NNUE_HALF_DIMS);
+    nnueKernels->clip(acc->values[us ^ 1], &input[NNUE_HALF_DIMS], NNUE_HALF_DIMS);
+
+    Nnue_HiddenLayer(input, 2 * NNUE_HALF_DIMS, nnueNetwork.hidden1Weights, nnueNetwork.hidden1Biases, hidden1);
+    Nnue_HiddenLayer(hidden1, NNUE_HIDDEN_DIMS, nnueNetwork.hidden2Weights, nnueNetwork.hidden2Biases, hidden2);
+
+    // A single output is not worth a vector kernel
+    output = nnueNetwork.outputBias[0];
+    for(uint32_t i = 0; i < NNUE_HIDDEN_DIMS; ++i)
+    {
+        output += hidden2[i] * nnueNetwork.outputWeights[i];
+    }
+    output /= NNUE_OUTPUT_SCALE;
+    return whiteToMove ? output : -output;
+}
@@ -0,0 +1,567 @@
+/* This file is responsible for converting between moves and the ways they are written */
+
+#include <iostream>
+#include <cstring>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "chessboard.h"
+#include "attacks.h"
+#include "notation.h"
+
+#define FILE_A_MASK 0x0101010101010101ULL
+
+/**
+ * @return  The white piece type a SAN piece letter stands for, NUM_PIECE_TYPES if none
+ */
+static uint8_t Notation_PieceFromLetter(char letter)
+{
+    switch(letter)
+    {
+        case 'R': return WHITE_ROOK;
+        case 'B': return WHITE_BISHOP;
+        case 'N': return WHITE_KNIGHT;
+        case 'Q': return WHITE_QUEEN;
+        case 'K': return WHITE_KING;
+        default:  return NUM_PIECE_TYPES;
+    }
+}
+
+/**
+ * Fills in a move from its start and end squares, working out the piece and
+ * the kind of move from the board
+ *
+ * @param cb:           The position the move is played in, by the side to move
+ * @param startIdx:     Square the piece moves from
+ * @param endIdx:       Square the piece moves to
+ * @param promotion:    White piece type a pawn promotes to, PROMOTION_NONE otherwise
+ * @param move:         Where to store the move
+ *
+ * @return  STATUS_SUCCESS if the side to move has a piece on the start square,
+ *          STATUS_FAIL otherwise
+ *
+ * @note:   The move is not checked for legality
+ */
+uint64_t Notation_BuildMove(ChessBoard *cb, uint8_t startIdx, uint8_t endIdx, uint8_t promotion, moveType_t *move)
+{
+    uint8_t colorBase = (cb->GetColorToMove() == WHITE_PIECES) ? WHITE_PAWN : BLACK_PAWN;
+    uint8_t enemyPieces = (cb->GetColorToMove() == WHITE_PIECES) ? BLACK_PIECES : WHITE_PIECES;
+    uint8_t pt;
+
+    for(pt = colorBase; pt < colorBase + NUM_PIECE_TYPES/2; ++pt)
+    {
+        if(cb->GetPiece(pt) & ((uint64_t) 1 << startIdx))
+        {
+            break;
+        }
+    }
+    if(pt == colorBase + NUM_PIECE_TYPES/2)
+    {
+        return STATUS_FAIL;
+    }
+
+    move->adjMove = NULL;
+    move->startIdx = startIdx;
+    move->endIdx = endIdx;
+    move->pt = pt;
+    move->ptCaptured = 0xF;
+    move->legalMove = true;
+    move->promotion = promotion;
+    move->enPassant = 0;
+
+    if((cb->GetPiece(enemyPieces) & ((uint64_t) 1 << endIdx)) != 0)
+    {
+        move->moveVal = MOVE_VALID_ATTACK;
+    }
+    // A pawn moving diagonally onto an empty square can only be taking en passant
+    else if(pt - colorBase == WHITE_PAWN && startIdx % 8 != endIdx % 8)
+    {
+        move->moveVal = MOVE_VALID_ATTACK;
+        move->enPassant = 1;
+    }
+    // As can a king moving two squares only be castling
+    else if(pt - colorBase == WHITE_KING && endIdx == startIdx + 2)
+    {
+        move->moveVal = MOVE_VALID_CASTLE_KING;
+    }
+    else if(pt - colorBase == WHITE_KING && endIdx + 2 == startIdx)
+    {
+        move->moveVal = MOVE_VALID_CASTLE_QUEEN;
+    }
+    else
+    {
+        move->moveVal = MOVE_VALID;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Determines if the side to move may castle, the same conditions move
+ * generation puts on it
+ *
+ * @param cb:           The position
+ * @param kingSide:     Castling short rather than long
+ *
+ * @return  True if the right remains, king and rook are in place, the squares
+ *          between them are empty and the king neither starts in, passes
+ *          through nor lands in check
+ */
+static bool Notation_CanCastle(ChessBoard *cb, bool kingSide)
+{
+    bool white = cb->GetColorToMove() == WHITE_PIECES;
+    uint8_t colorBase = white ? WHITE_PAWN : BLACK_PAWN, enemyPieces = white ? BLACK_PIECES : WHITE_PIECES;
+    uint8_t kingIdx = white ? 4 : 60, right;
+    uint64_t rookMask, betweenMask;
+    int8_t step = kingSide ? 1 : -1;
+
+    if(kingSide)
+    {
+        right = white ? CASTLE_WHITE_KING : CASTLE_BLACK_KING;
+        rookMask = (uint64_t) 1 << (kingIdx + 3);
+        betweenMask = (uint64_t) 0x3 << (kingIdx + 1);
+    }
+    else
+    {
+        right = white ? CASTLE_WHITE_QUEEN : CASTLE_BLACK_QUEEN;
+        rookMask = (uint64_t) 1 << (kingIdx - 4);
+        betweenMask = (uint64_t) 0x7 << (kingIdx - 3);
+    }
+
+    return (cb->GetCastlingRights() & right) != 0
+        && (cb->GetPiece(colorBase + WHITE_KING) & ((uint64_t) 1 << kingIdx)) != 0
+        && (cb->GetPiece(colorBase + WHITE_ROOK) & rookMask) != 0
+        && (cb->GetOccupied() & betweenMask) == 0
+        && !cb->IsSquareAttacked(kingIdx, enemyPieces)
+        && !cb->IsSquareAttacked(kingIdx + step, enemyPieces)
+        && !cb->IsSquareAttacked(kingIdx + 2*step, enemyPieces);
+}
+
+/**
+ * Works out the move written in standard algebraic notation, ie. "e4",
+ * "Nbd7", "exd6", "O-O-O", "e8=Q+". The pieces able to make the move are found
+ * from their attacks rather than by generating every move, and each of them
+ * is then checked for leaving its king in check.
+ *
+ * @param cb:       The position the move is played in, by the side to move
+ * @param san:      The move as written, which need not be terminated
+ * @param length:   The number of characters in the move
+ * @param move:     Where to store the move
+ *
+ * @return  STATUS_SUCCESS if exactly one legal move matches, STATUS_FAIL otherwise
+ */
+uint64_t Notation_ParseSan(ChessBoard *cb, const char *san, size_t length, moveType_t *move)
+{
+    bool white = cb->GetColorToMove() == WHITE_PIECES;
+    uint8_t colorBase = white ? WHITE_PAWN : BLACK_PAWN, pt, endIdx, startIdx, promotion = PROMOTION_NONE;
+    uint64_t candidates, ours, occupied = cb->GetOccupied();
+    size_t pos = 0, end;
+    int8_t fromFile = -1, fromRank = -1;
+    moveType_t candidateMove, *match = NULL;
+    uint64_t numLegal = 0;
+
+    Util_Assert(cb != NULL && san != NULL && move != NULL, "NULL input to Notation_ParseSan");
+
+    // Check markers and annotations do not change which move it is
+    while(length > 0 && (san[length - 1] == '+' || san[length - 1] == '#'
+        || san[length - 1] == '!' || san[length - 1] == '?'))
+    {
+        --length;
+    }
+
+    if(length >= 3 && (san[0] == 'O' || san[0] == '0'))
+    {
+        if((length != 3 && length != 5) || san[1] != '-' || san[2] != san[0]
+            || (length == 5 && (san[3] != '-' || san[4] != san[0])))
+        {
+            return STATUS_FAIL;
+        }
+        startIdx = white ? 4 : 60;
+        endIdx = (length == 3) ? startIdx + 2 : startIdx - 2;
+        if(!Notation_CanCastle(cb, length == 3))
+        {
+            return STATUS_FAIL;
+        }
+        Notation_BuildMove(cb, startIdx, endIdx, PROMOTION_NONE, move);
+        return STATUS_SUCCESS;
+    }
+
+    // Promotions are written "e8=Q" or sometimes "e8Q"
+    end = length;
+    if(end >= 2 && Notation_PieceFromLetter(san[end - 1]) != NUM_PIECE_TYPES
+        && san[end - 1] != 'K' && ((san[end - 2] >= '1' && san[end - 2] <= '8') || san[end - 2] == '='))
+    {
+        promotion = Notation_PieceFromLetter(san[end - 1]);
+        end -= (san[end - 2] == '=') ? 2 : 1;
+    }
+
+    if(end < 2 || san[end - 2] < 'a' || san[end - 2] > 'h' || san[end - 1] < '1' || san[end - 1] > '8')
+    {
+        return STATUS_FAIL;
+    }
+    endIdx = (san[end - 1] - '1')*8 + (san[end - 2] - 'a');
+    if(cb->GetPiece(white ? WHITE_PIECES : BLACK_PIECES) & ((uint64_t) 1 << endIdx))
+    {
+        return STATUS_FAIL;
+    }
+
+    pt = Notation_PieceFromLetter(san[0]);
+    if(pt == NUM_PIECE_TYPES)
+    {
+        pt = WHITE_PAWN;
+    }
+    else
+    {
+        ++pos;
+    }
+
+    // Whatever sits between the piece and the destination narrows down the start
+    for(; pos < end - 2; ++pos)
+    {
+        if(san[pos] >= 'a' && san[pos] <= 'h')
+        {
+            fromFile = san[pos] - 'a';
+        }
+        else if(san[pos] >= '1' && san[pos] <= '8')
+        {
+            fromRank = san[pos] - '1';
+        }
+        else if(san[pos] != 'x' && san[pos] != '-')
+        {
+            return STATUS_FAIL;
+        }
+    }
+
+    ours = cb->GetPiece(colorBase + pt);
+    switch(pt)
+    {
+        case WHITE_PAWN:
+            if(fromFile >= 0 && fromFile != endIdx % 8)
+            {
+                // Pawns capture onto the square from where a pawn of the other color would attack
+                candidates = Attacks_Pawn(endIdx, !white) & ours;
+            }
+            else
+            {
+                candidates = 0;
+                if(white && endIdx >= 8 && (occupied & ((uint64_t) 1 << endIdx)) == 0)
+                {
+                    candidates = ours & ((uint64_t) 1 << (endIdx - 8));
+                    if(candidates == 0 && endIdx / 8 == 3 && (occupied & ((uint64_t) 1 << (endIdx - 8))) == 0)
+                    {
+                        candidates = ours & ((uint64_t) 1 << (endIdx - 16));
+                    }
+                }
+                else if(!white && endIdx < 56 && (occupied & ((uint64_t) 1 << endIdx)) == 0)
+                {
+                    candidates = ours & ((uint64_t) 1 << (endIdx + 8));
+                    if(candidates == 0 && endIdx / 8 == 4 && (occupied & ((uint64_t) 1 << (endIdx + 8))) == 0)
+                    {
+                        candidates = ours & ((uint64_t) 1 << (endIdx + 16));
+                    }
+                }
+            }
+            break;
+        case WHITE_KNIGHT:  candidates = Attacks_Knight(endIdx) & ours;           break;
+        case WHITE_BISHOP:  candidates = Attacks_Bishop(endIdx, occupied) & ours; break;
+        case WHITE_ROOK:    candidates = Attacks_Rook(endIdx, occupied) & ours;   break;
+        case WHITE_QUEEN:   candidates = Attacks_Queen(endIdx, occupied) & ours;  break;
+        case WHITE_KING:    candidates = Attacks_King(endIdx) & ours;             break;
+        default:            candidates = 0;                                       break;
+    }
+
+    // Only pawns reaching the last rank promote, and they always must
+    if((pt == WHITE_PAWN && (endIdx < 8 || endIdx >= 56)) != (promotion != PROMOTION_NONE))
+    {
+        return STATUS_FAIL;
+    }
+
+    if(fromFile >= 0)
+    {
+        candidates &= FILE_A_MASK << fromFile;
+    }
+    if(fromRank >= 0)
+    {
+        candidates &= (uint64_t) 0xFF << (8*fromRank);
+    }
+
+    while(candidates)
+    {
+        startIdx = __builtin_ctzll(candidates);
+        candidates &= candidates - 1;
+
+        Notation_BuildMove(cb, startIdx, endIdx, promotion, &candidateMove);
+        if(candidateMove.enPassant && endIdx != cb->GetEnPassantIdx())
+        {
+            continue;
+        }
+        if(!cb->IsMoveLegal(&candidateMove))
+        {
+            continue;
+        }
+
+        *move = candidateMove;
+        match = move;
+        ++numLegal;
+    }
+
+    return (match != NULL && numLegal == 1) ? STATUS_SUCCESS : STATUS_FAIL;
+}
+
+// Letters of the white piece types, in the order they are numbered
+static const char pieceLetters[NUM_PIECE_TYPES/2] = { 'P', 'R', 'B', 'N', 'Q', 'K' };
+
+/**
+ * Writes a board index out in coordinate form, ie. 0 -> "a1"
+ *
+ * @return  The number of characters written
+ */
+static inline size_t Notation_WriteSquare(uint8_t idx, char *buffer)
+{
+    buffer[0] = 'a' + idx % 8;
+    buffer[1] = '1' + idx / 8;
+    return 2;
+}
+
+/**
+ * Writes castling out as "O-O" or "O-O-O"
+ *
+ * @return  The number of characters written
+ */
+static inline size_t Notation_WriteCastle(const moveType_t *move, char *buffer)
+{
+    if(move->moveVal & MOVE_VALID_CASTLE_KING)
+    {
+        memcpy(buffer, "O-O", 3);
+        return 3;
+    }
+    memcpy(buffer, "O-O-O", 5);
+    return 5;
+}
+
+/**
+ * Determines if the side to move has any legal move at all, stopping at the
+ * first one found. Castling is never the only way out of check, so it is
+ * not looked at, and a pawn reaching the last rank is only tried as a queen.
+ */
+static bool Notation_HasLegalMove(ChessBoard *cb)
+{
+    bool white = cb->GetColorToMove() == WHITE_PIECES;
+    uint8_t colorBase = white ? WHITE_PAWN : BLACK_PAWN, startIdx, endIdx, promotion;
+    uint64_t ours = cb->GetPiece(white ? WHITE_PIECES : BLACK_PIECES);
+    uint64_t theirs = cb->GetPiece(white ? BLACK_PIECES : WHITE_PIECES);
+    uint64_t occupied = cb->GetOccupied(), pieces, targets, epMask = 0;
+    moveType_t move;
+
+    if(cb->GetEnPassantIdx() != EN_PASSANT_NONE)
+    {
+        epMask = (uint64_t) 1 << cb->GetEnPassantIdx();
+    }
+
+    for(uint8_t pt = WHITE_PAWN; pt < NUM_PIECE_TYPES/2; ++pt)
+    {
+        for(pieces = cb->GetPiece(colorBase + pt); pieces; pieces &= pieces - 1)
+        {
+            startIdx = __builtin_ctzll(pieces);
+            switch(pt)
+            {
+                case WHITE_PAWN:
+                    targets = Attacks_Pawn(startIdx, white) & (theirs | epMask);
+                    endIdx = white ? startIdx + 8 : startIdx - 8;
+                    if((occupied & ((uint64_t) 1 << endIdx)) == 0)
+                    {
+                        targets |= (uint64_t) 1 << endIdx;
+                        endIdx = white ? endIdx + 8 : endIdx - 8;
+                        if(startIdx / 8 == (white ? 1 : 6) && (occupied & ((uint64_t) 1 << endIdx)) == 0)
+                        {
+                            targets |= (uint64_t) 1 << endIdx;
+                        }
+                    }
+                    break;
+                case WHITE_KNIGHT:  targets = Attacks_Knight(startIdx) & ~ours;           break;
+                case WHITE_BISHOP:  targets = Attacks_Bishop(startIdx, occupied) & ~ours; break;
+                case WHITE_ROOK:    targets = Attacks_Rook(startIdx, occupied) & ~ours;   break;
+                case WHITE_QUEEN:   targets = Attacks_Queen(startIdx, occupied) & ~ours;  break;
+                default:            targets = Attacks_King(startIdx) & ~ours;             break;
+            }
+
+            for(; targets; targets &= targets - 1)
+            {
+                endIdx = __builtin_ctzll(targets);
+                promotion = (pt == WHITE_PAWN && (endIdx < 8 || endIdx >= 56)) ? WHITE_QUEEN : PROMOTION_NONE;
+                Notation_BuildMove(cb, startIdx, endIdx, promotion, &move);
+                if(cb->IsMoveLegal(&move))
+                {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Adds "+" or "#" to a move which gives check or mate
+ *
+ * @return  The number of characters written
+ */
+static size_t Notation_WriteCheck(ChessBoard *cb, moveType_t *move, char *buffer)
+{
+    size_t length = 0;
+
+    cb->ApplyMoveToBoard(move);
+    if(cb->IsInCheck(cb->GetColorToMove()))
+    {
+        buffer[length++] = Notation_HasLegalMove(cb) ? '+' : '#';
+    }
+    cb->UndoMoveFromBoard(move);
+
+    return length;
+}
+
+/**
+ * Writes a move in the long algebraic form UCI uses, ie. "e2e4", "e7e8q".
+ * Castling is written as the king's two square move.
+ *
+ * @param move:     The move to write
+ * @param buffer:   Where to write it, at least NOTATION_MAX_MOVE_LENGTH characters
+ *
+ * @return  The length of the move written, not counting the terminator
+ */
+size_t Notation_FormatUci(const moveType_t *move, char *buffer)
+{
+    size_t length = 0;
+
+    length += Notation_WriteSquare(move->startIdx, buffer + length);
+    length += Notation_WriteSquare(move->endIdx, buffer + length);
+    if(move->promotion != PROMOTION_NONE)
+    {
+        buffer[length++] = pieceLetters[move->promotion] - 'A' + 'a';
+    }
+    buffer[length] = '\0';
+
+    return length;
+}
+
+/**
+ * Writes a move in long algebraic notation, ie. "Ng1-f3", "e4xd5", "e7-e8=Q+"
+ *
+ * @param cb:       The position the move is played from, which is left as it was
+ * @param move:     The move to write
+ * @param buffer:   Where to write it, at least NOTATION_MAX_MOVE_LENGTH characters
+ *
+ * @return  The length of the move written, not counting the terminator
+ */
+size_t Notation_FormatLan(ChessBoard *cb, moveType_t *move, char *buffer)
+{
+    uint8_t pt = move->pt % (NUM_PIECE_TYPES/2);
+    size_t length = 0;
+
+    if(move->moveVal & (MOVE_VALID_CASTLE_KING | MOVE_VALID_CASTLE_QUEEN))
+    {
+        length = Notation_WriteCastle(move, buffer);
+    }
+    else
+    {
+        if(pt != WHITE_PAWN)
+        {
+            buffer[length++] = pieceLetters[pt];
+        }
+        length += Notation_WriteSquare(move->startIdx, buffer + length);
+        buffer[length++] = ((cb->GetOccupied() & ((uint64_t) 1 << move->endIdx)) || move->enPassant) ? 'x' : '-';
+        length += Notation_WriteSquare(move->endIdx, buffer + length);
+        if(move->promotion != PROMOTION_NONE)
+        {
+            buffer[length++] = '=';
+            buffer[length++] = pieceLetters[move->promotion];
+        }
+    }
+
+    length += Notation_WriteCheck(cb, move, buffer + length);
+    buffer[length] = '\0';
+
+    return length;
+}
+
+/**
+ * Writes a move in standard algebraic notation, ie. "Nf3", "exd5", "Rad1",
+ * "e8=Q#". The start square is only given where another piece of the same
+ * kind could legally make the move too.
+ *
+ * @param cb:       The position the move is played from, which is left as it was
+ * @param move:     The move to write
+ * @param buffer:   Where to write it, at least NOTATION_MAX_MOVE_LENGTH characters
+ *
+ * @return  The length of the move written, not counting the terminator
+ */
+size_t Notation_FormatSan(ChessBoard *cb, moveType_t *move, char *buffer)
+{
+    uint8_t pt = move->pt % (NUM_PIECE_TYPES/2), otherIdx;
+    uint64_t occupied = cb->GetOccupied(), others;
+    bool capture = (occupied & ((uint64_t) 1 << move->endIdx)) || move->enPassant;
+    bool ambiguous = false, sharesFile = false, sharesRank = false;
+    moveType_t otherMove;
+    size_t length = 0;
+
+    if(move->moveVal & (MOVE_VALID_CASTLE_KING | MOVE_VALID_CASTLE_QUEEN))
+    {
+        length = Notation_WriteCastle(move, buffer);
+    }
+    else if(pt == WHITE_PAWN)
+    {
+        if(capture)
+        {
+            buffer[length++] = 'a' + move->startIdx % 8;
+            buffer[length++] = 'x';
+        }
+        length += Notation_WriteSquare(move->endIdx, buffer + length);
+        if(move->promotion != PROMOTION_NONE)
+        {
+            buffer[length++] = '=';
+            buffer[length++] = pieceLetters[move->promotion];
+        }
+    }
+    else
+    {
+        switch(pt)
+        {
+            case WHITE_KNIGHT:  others = Attacks_Knight(move->endIdx);           break;
+            case WHITE_BISHOP:  others = Attacks_Bishop(move->endIdx, occupied); break;
+            case WHITE_ROOK:    others = Attacks_Rook(move->endIdx, occupied);   break;
+            case WHITE_QUEEN:   others = Attacks_Queen(move->endIdx, occupied);  break;
+            default:            others = 0;                                      break;
+        }
+        others &= cb->GetPiece(move->pt) & ~((uint64_t) 1 << move->startIdx);
+
+        // A piece pinned to its king does not make the move ambiguous
+        for(; others; others &= others - 1)
+        {
+            otherIdx = __builtin_ctzll(others);
+            Notation_BuildMove(cb, otherIdx, move->endIdx, PROMOTION_NONE, &otherMove);
+            if(cb->IsMoveLegal(&otherMove))
+            {
+                ambiguous = true;
+                sharesFile |= otherIdx % 8 == move->startIdx % 8;
+                sharesRank |= otherIdx / 8 == move->startIdx / 8;
+            }
+        }
+
+        buffer[length++] = pieceLetters[pt];
+        if(ambiguous && (!sharesFile || sharesRank))
+        {
+            buffer[length++] = 'a' + move->startIdx % 8;
+        }
+        if(ambiguous && sharesFile)
+        {
+            buffer[length++] = '1' + move->startIdx / 8;
+        }
+        if(capture)
+        {
+            buffer[length++] = 'x';
+        }
+        length += Notation_WriteSquare(move->endIdx, buffer + length);
+    }
+
+    length += Notation_WriteCheck(cb, move, buffer + length);
+    buffer[length] = '\0';
+
+    return length;
+}
@@ -0,0 +1,255 @@
+/* This file is responsible for reading and writing files of packed positions */
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "packed_position.h"
+#include "packed_file.h"
+
+/**
+ * Checks a header is one this build reads
+ *
+ * @param header:   The header
+ * @param path:     The file it came from, for the message
+ *
+ * @return  STATUS_SUCCESS if it is, STATUS_FAIL otherwise
+ */
+static uint64_t PackedFile_CheckHeader(const packedFileHeader_t *header, std::string &path)
+{
+    if(header->magic != PACKED_FILE_MAGIC)
+    {
+        std::cout << path << " is not a packed position file" << std::endl;
+        return STATUS_FAIL;
+    }
+    if(header->version != PACKED_FILE_VERSION || header->recordSize != sizeof(packedPosition_t))
+    {
+        std::cout << path << " is version " << header->version << " with " << header->recordSize
+                  << " byte records, expected version " << PACKED_FILE_VERSION << " with "
+                  << sizeof(packedPosition_t) << " byte records" << std::endl;
+        return STATUS_FAIL;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Opens a packed file to write records to. An existing file is either
+ * replaced or added to, in which case a record cut short by an earlier
+ * writer being stopped part way is dropped first.
+ *
+ * @param writer:   The writer to set up
+ * @param path:     The file
+ * @param append:   Add to the records already in the file rather than replace them
+ *
+ * @return  STATUS_SUCCESS if the file is ready for writing, STATUS_FAIL otherwise
+ */
+uint64_t PackedFile_OpenWriter(packedWriter_t *writer, std::string path, bool append)
+{
+    packedFileHeader_t header;
+    struct stat st;
+    std::ifstream in;
+
+    Util_Assert(writer != NULL, "NULL writer given to PackedFile_OpenWriter");
+
+    writer->buffer.resize(PACKED_WRITER_BUFFER_RECORDS);
+    writer->numBuffered = 0;
+    writer->numRecords = 0;
+    writer->failed = true;
+
+    if(append && stat(path.c_str(), &st) == 0 && st.st_size > 0)
+    {
+        in.open(path, std::ios::binary);
+        if(!in.read((char *) &header, sizeof(header)))
+        {
+            std::cout << path << " is not a packed position file" << std::endl;
+            return STATUS_FAIL;
+        }
+        in.close();
+        if(PackedFile_CheckHeader(&header, path) != STATUS_SUCCESS)
+        {
+            return STATUS_FAIL;
+        }
+
+        writer->numRecords = (st.st_size - sizeof(header)) / sizeof(packedPosition_t);
+        if(truncate(path.c_str(), sizeof(header) + writer->numRecords*sizeof(packedPosition_t)) != 0)
+        {
+            std::cout << "Unable to write " << path << std::endl;
+            return STATUS_FAIL;
+        }
+
+        writer->file.open(path, std::ios::binary | std::ios::app);
+    }
+    else
+    {
+        memset(&header, 0, sizeof(header));
+        header.magic = PACKED_FILE_MAGIC;
+        header.version = PACKED_FILE_VERSION;
+        header.recordSize = sizeof(packedPosition_t);
+
+        writer->file.open(path, std::ios::binary | std::ios::trunc);
+        writer->file.write((const char *) &header, sizeof(header));
+    }
+
+    if(!writer->file.is_open() || !writer->file.good())
+    {
+        std::cout << "Unable to write " << path << std::endl;
+        return STATUS_FAIL;
+    }
+
+    writer->failed = false;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Writes out the buffered records
+ *
+ * @param writer:   The writer
+ *
+ * @return  STATUS_SUCCESS, or STATUS_FAIL if writing has failed
+ */
+uint64_t PackedFile_Flush(packedWriter_t *writer)
+{
+    if(!writer->failed && writer->numBuffered > 0)
+    {
+        writer->file.write((const char *) writer->buffer.data(), writer->numBuffered*sizeof(packedPosition_t));
+        writer->file.flush();
+        writer->failed = !writer->file.good();
+    }
+    writer->numBuffered = 0;
+
+    return writer->failed ? STATUS_FAIL : STATUS_SUCCESS;
+}
+
+/**
+ * Writes out the buffered records and closes the file
+ *
+ * @param writer:   The writer
+ *
+ * @return  STATUS_SUCCESS if every record made it to the file, STATUS_FAIL otherwise
+ */
+uint64_t PackedFile_CloseWriter(packedWriter_t *writer)
+{
+    uint64_t status = PackedFile_Flush(writer);
+
+    if(writer->file.is_open())
+    {
+        writer->file.close();
+    }
+    writer->buffer.clear();
+    writer->buffer.shrink_to_fit();
+    return status;
+}
+
+/**
+ * Maps a packed file into memory for reading. A record cut short at the end
+ * of the file is left out.
+ *
+ * @param reader:   The reader to set up
+ * @param path:     The file
+ *
+ * @return  STATUS_SUCCESS if the file could be read, STATUS_FAIL otherwise
+ */
+uint64_t PackedFile_OpenReader(packedReader_t *reader, std::string path)
+{
+    struct stat st;
+    void *mapping;
+    int fd;
+
+    Util_Assert(reader != NULL, "NULL reader given to PackedFile_OpenReader");
+
+    memset(reader, 0, sizeof(packedReader_t));
+
+    fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        std::cout << "Unable to open " << path << std::endl;
+        return STATUS_FAIL;
+    }
+
+    if(fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(packedFileHeader_t))
+    {
+        close(fd);
+        std::cout << path << " is not a packed position file" << std::endl;
+        return STATUS_FAIL;
+    }
+
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        std::cout << "Unable to map " << path << std::endl;
+        return STATUS_FAIL;
+    }
+
+    if(PackedFile_CheckHeader((const packedFileHeader_t *) mapping, path) != STATUS_SUCCESS)
+    {
+        munmap(mapping, st.st_size);
+        return STATUS_FAIL;
+    }
+
+    // Reads walk forward through the file, so the kernel can read well ahead
+    madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+
+    reader->mapping = mapping;
+    reader->mappingSize = st.st_size;
+    reader->records = (const packedPosition_t *) ((const char *) mapping + sizeof(packedFileHeader_t));
+    reader->numRecords = (st.st_size - sizeof(packedFileHeader_t)) / sizeof(packedPosition_t);
+    reader->end = reader->numRecords;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Unmaps the file
+ *
+ * @param reader:   The reader
+ */
+void PackedFile_CloseReader(packedReader_t *reader)
+{
+    if(reader->mapping != NULL)
+    {
+        munmap(reader->mapping, reader->mappingSize);
+    }
+    memset(reader, 0, sizeof(packedReader_t));
+}
+
+/**
+ * Restricts reads to one of a number of equal, contiguous shards of the
+ * file, so that each of several readers sees its own part of it. Reading
+ * starts again from the first record of the shard.
+ *
+ * @param reader:       The reader
+ * @param shardIdx:     The shard to read, below numShards
+ * @param numShards:    How many shards the file is split into
+ */
+void PackedFile_SetShard(packedReader_t *reader, uint64_t shardIdx, uint64_t numShards)
+{
+    Util_Assert(shardIdx < numShards, "Shard out of range given to PackedFile_SetShard");
+
+    reader->start = (uint64_t) ((unsigned __int128) reader->numRecords * shardIdx / numShards);
+    reader->end = (uint64_t) ((unsigned __int128) reader->numRecords * (shardIdx + 1) / numShards);
+    reader->pos = reader->start;
+}
+
+/**
+ * Reads the next records of the shard. Nothing is copied, the records are
+ * handed back where they lie in the mapping and stay there until the reader
+ * is closed.
+ *
+ * @param reader:       The reader
+ * @param records:      Set to the first record read
+ * @param maxRecords:   Most records to read
+ *
+ * @return  The number of records read, 0 at the end of the shard
+ */
+uint64_t PackedFile_Read(packedReader_t *reader, const packedPosition_t **records, uint64_t maxRecords)
+{
+    uint64_t numRecords = std::min(maxRecords, reader->end - reader->pos);
+
+    *records = &reader->records[reader->pos];
+    reader->pos += numRecords;
+    return numRecords;
+}
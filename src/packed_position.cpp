@@ -0,0 +1,311 @@
+/* This file is responsible for packing positions into compact fixed size records */
+
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <sstream>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "chessboard.h"
+#include "packed_position.h"
+
+// FEN letter of each piece type
+static const char fenPieceChars[NUM_PIECE_TYPES + 1] = "PRBNQKprbnqk";
+
+/**
+ * Packs a position into a record
+ *
+ * @param cb:       The position
+ * @param score:    Its search score, positive in white's favour
+ * @param result:   Result of the game it came from, see PACKED_RESULT_*
+ * @param ply:      Plies into the game it came from
+ * @param record:   Where to store the record
+ *
+ * @return  STATUS_SUCCESS if the position fits in a record, STATUS_FAIL otherwise
+ */
+uint64_t PackedPosition_Pack(ChessBoard *cb, int32_t score, int8_t result, uint16_t ply, packedPosition_t *record)
+{
+    const uint64_t *pieces = cb->GetPieces();
+    uint64_t occupied = cb->GetOccupied();
+    uint8_t numPieces = 0, idx;
+
+    if(__builtin_popcountll(occupied) > PACKED_MAX_PIECES)
+    {
+        return STATUS_FAIL;
+    }
+
+    record->occupied = occupied;
+    for(uint8_t i = 0; i < PACKED_MAX_PIECES/2; ++i)
+    {
+        record->pieces[i] = 0;
+    }
+
+    for(uint64_t bb = occupied; bb; bb &= bb - 1, ++numPieces)
+    {
+        idx = __builtin_ctzll(bb);
+        for(uint8_t pt = 0; pt < NUM_PIECE_TYPES; ++pt)
+        {
+            if(pieces[pt] & ((uint64_t) 1 << idx))
+            {
+                record->pieces[numPieces / 2] |= pt << ((numPieces & 1) * 4);
+                break;
+            }
+        }
+    }
+
+    record->score = (int16_t) std::clamp(score, -PACKED_SCORE_MAX, PACKED_SCORE_MAX);
+    record->ply = ply;
+    record->flags = ((cb->GetColorToMove() == BLACK_PIECES) ? 0x1 : 0x0) | (cb->GetCastlingRights() << 4);
+    record->epIdx = cb->GetEnPassantIdx();
+    record->halfmoveClock = (uint8_t) std::min((uint16_t) UINT8_MAX, cb->GetHalfmoveClock());
+    record->result = result;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Lists the pieces of a record
+ *
+ * @param record:   The record
+ * @param pts:      Where to store the piece type of each, room for PACKED_MAX_PIECES
+ * @param idxs:     Where to store the square of each, room for PACKED_MAX_PIECES
+ *
+ * @return  The number of pieces
+ */
+uint8_t PackedPosition_GetPieces(const packedPosition_t *record, uint8_t *pts, uint8_t *idxs)
+{
+    uint8_t numPieces = 0;
+
+    for(uint64_t bb = record->occupied; bb && numPieces < PACKED_MAX_PIECES; bb &= bb - 1, ++numPieces)
+    {
+        idxs[numPieces] = __builtin_ctzll(bb);
+        pts[numPieces] = (record->pieces[numPieces / 2] >> ((numPieces & 1) * 4)) & 0xF;
+    }
+    return numPieces;
+}
+
+/**
+ * Writes a record out as FEN, the full move number worked out from its ply
+ *
+ * @param record:   The record
+ *
+ * @return  The FEN of the position
+ */
+std::string PackedPosition_ToFen(const packedPosition_t *record)
+{
+    uint8_t pts[PACKED_MAX_PIECES], idxs[PACKED_MAX_PIECES], numPieces, castling = PACKED_CASTLING_RIGHTS(record);
+    char board[NUM_BOARD_INDICES];
+    std::string fen;
+    int32_t empty;
+
+    memset(board, 0, sizeof(board));
+    numPieces = PackedPosition_GetPieces(record, pts, idxs);
+    for(uint8_t i = 0; i < numPieces; ++i)
+    {
+        board[idxs[i]] = (pts[i] < NUM_PIECE_TYPES) ? fenPieceChars[pts[i]] : '?';
+    }
+
+    for(int32_t rank = 7; rank >= 0; --rank)
+    {
+        empty = 0;
+        for(int32_t file = 0; file < 8; ++file)
+        {
+            if(board[rank*8 + file] == 0)
+            {
+                ++empty;
+                continue;
+            }
+            if(empty > 0)
+            {
+                fen += (char) ('0' + empty);
+                empty = 0;
+            }
+            fen += board[rank*8 + file];
+        }
+        if(empty > 0)
+        {
+            fen += (char) ('0' + empty);
+        }
+        if(rank > 0)
+        {
+            fen += '/';
+        }
+    }
+
+    fen += PACKED_BLACK_TO_MOVE(record) ? " b " : " w ";
+    if(castling & CASTLE_WHITE_KING)    fen += 'K';
+    if(castling & CASTLE_WHITE_QUEEN)   fen += 'Q';
+    if(castling & CASTLE_BLACK_KING)    fen += 'k';
+    if(castling & CASTLE_BLACK_QUEEN)   fen += 'q';
+    if(castling == 0)                   fen += '-';
+
+    if(record->epIdx < NUM_BOARD_INDICES)
+    {
+        fen += ' ';
+        fen += (char) ('a' + record->epIdx % 8);
+        fen += (char) ('1' + record->epIdx / 8);
+    }
+    else
+    {
+        fen += " -";
+    }
+
+    return fen + " " + std::to_string(record->halfmoveClock) + " " + std::to_string(record->ply / 2 + 1);
+}
+
+/**
+ * Sets a board up with the position of a record
+ *
+ * @param record:   The record
+ * @param cb:       The board to set up
+ *
+ * @return  STATUS_SUCCESS if the record held a position the board accepts,
+ *          STATUS_FAIL otherwise
+ */
+uint64_t PackedPosition_Unpack(const packedPosition_t *record, ChessBoard *cb)
+{
+    return cb->SetBoardFromFEN(PackedPosition_ToFen(record));
+}
+
+/**
+ * Packs a position given as FEN. The ply is worked out from the full move
+ * number, if the FEN has one.
+ *
+ * @param cb:       A board to set the position up on, overwritten
+ * @param fen:      The FEN, or just its first four fields
+ * @param score:    Search score of the position, positive in white's favour
+ * @param result:   Result of the game it came from, see PACKED_RESULT_*
+ * @param record:   Where to store the record
+ *
+ * @return  STATUS_SUCCESS if the position was packed, STATUS_FAIL otherwise
+ */
+uint64_t PackedPosition_FromFen(ChessBoard *cb, std::string fen, int32_t score, int8_t result,
+                                packedPosition_t *record)
+{
+    std::istringstream fields(fen);
+    std::string field;
+    uint64_t fullmove = 1;
+
+    if(cb->SetBoardFromFEN(fen) != STATUS_SUCCESS)
+    {
+        return STATUS_FAIL;
+    }
+
+    // Placement, side to move, castling, en passant, halfmove clock, full move
+    for(uint8_t i = 0; i < 6 && (fields >> field); ++i)
+    {
+        if(i == 5 && field.find_first_not_of("0123456789") == std::string::npos)
+        {
+            fullmove = std::max((uint64_t) 1, (uint64_t) std::stoull(field));
+        }
+    }
+
+    return PackedPosition_Pack(cb, score, result,
+        (uint16_t) std::min((uint64_t) UINT16_MAX, 2*(fullmove - 1) + ((cb->GetColorToMove() == BLACK_PIECES) ? 1 : 0)),
+        record);
+}
+
+/**
+ * Writes a record out as an EPD line, its score as the centipawn evaluation
+ * for the side to move and its result as the game result comment, ie.
+ *
+ *  rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 hmvc 0; fmvn 1; ce -25; c9 "1/2-1/2";
+ *
+ * @param record:   The record
+ *
+ * @return  The EPD line
+ */
+std::string PackedPosition_ToEpd(const packedPosition_t *record)
+{
+    std::string fen = PackedPosition_ToFen(record), epd;
+    size_t end = 0;
+
+    // The first four fields of the FEN are the EPD position
+    for(uint8_t i = 0; i < 4; ++i)
+    {
+        end = fen.find(' ', end + 1);
+    }
+    epd = fen.substr(0, end);
+
+    epd += " hmvc " + std::to_string(record->halfmoveClock) + ";";
+    epd += " fmvn " + std::to_string(record->ply / 2 + 1) + ";";
+    epd += " ce " + std::to_string(PACKED_BLACK_TO_MOVE(record) ? -record->score : record->score) + ";";
+    epd += (record->result == PACKED_RESULT_WHITE_WIN) ? " c9 \"1-0\";"
+         : (record->result == PACKED_RESULT_BLACK_WIN) ? " c9 \"0-1\";" : " c9 \"1/2-1/2\";";
+    return epd;
+}
+
+/**
+ * Packs a position given as an EPD line, reading its score from the ce
+ * operation and its result from c9 as PackedPosition_ToEpd writes them. A
+ * FEN with its last two fields is taken as well. Missing scores are 0 and
+ * missing results a draw.
+ *
+ * @param cb:       A board to set the position up on, overwritten
+ * @param line:     The EPD line
+ * @param record:   Where to store the record
+ *
+ * @return  STATUS_SUCCESS if the position was packed, STATUS_FAIL otherwise
+ */
+uint64_t PackedPosition_FromEpd(ChessBoard *cb, std::string line, packedPosition_t *record)
+{
+    std::istringstream fields(line), operation;
+    std::string field, position, opcode, operand, halfmove = "0", fullmove = "1";
+    int32_t score = 0;
+    int8_t result = PACKED_RESULT_DRAW;
+    size_t end = 0, next;
+
+    for(uint8_t i = 0; i < 4; ++i)
+    {
+        if(!(fields >> field))
+        {
+            return STATUS_FAIL;
+        }
+        position += (i == 0) ? field : " " + field;
+    }
+
+    // A plain FEN goes on with its two counters rather than operations
+    end = fields.tellg();
+    if((fields >> field) && field.find_first_not_of("0123456789") == std::string::npos)
+    {
+        halfmove = field;
+        if((fields >> field) && field.find_first_not_of("0123456789") == std::string::npos)
+        {
+            fullmove = field;
+        }
+        end = line.length();
+    }
+
+    // Each operation is an opcode, its operands, and a semicolon
+    for(; end < line.length(); end = next + 1)
+    {
+        next = line.find(';', end);
+        if(next == std::string::npos)
+        {
+            next = line.length();
+        }
+
+        operation.clear();
+        operation.str(line.substr(end, next - end));
+        if(!(operation >> opcode) || !(operation >> operand))
+        {
+            continue;
+        }
+
+        if(opcode == "ce")          score = std::stoi(operand);
+        else if(opcode == "hmvc")   halfmove = operand;
+        else if(opcode == "fmvn")   fullmove = operand;
+        else if(opcode == "c9")
+        {
+            result = (operand == "\"1-0\"") ? PACKED_RESULT_WHITE_WIN
+                   : (operand == "\"0-1\"") ? PACKED_RESULT_BLACK_WIN : PACKED_RESULT_DRAW;
+        }
+    }
+
+    // The evaluation is for the side to move
+    if(position.find(" b ") != std::string::npos)
+    {
+        score = -score;
+    }
+
+    return PackedPosition_FromFen(cb, position + " " + halfmove + " " + fullmove, score, result, record);
+}
@@ -0,0 +1,170 @@
+/* This file is responsible for evaluating pawn structure */
+
+#include <cstring>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "search_stats.h"
+#include "eval_params.h"
+#include "pawns.h"
+
+#define FILE_A_MASK 0x0101010101010101ULL
+#define FILE_H_MASK 0x8080808080808080ULL
+
+// Each searching thread keeps its own table
+static thread_local pawnEntry_t pawnHashTable[PAWN_HASH_ENTRIES];
+
+static inline uint64_t Pawns_NorthFill(uint64_t b)
+{
+    b |= b << 8;
+    b |= b << 16;
+    return b | (b << 32);
+}
+
+static inline uint64_t Pawns_SouthFill(uint64_t b)
+{
+    b |= b >> 8;
+    b |= b >> 16;
+    return b | (b >> 32);
+}
+
+static inline uint64_t Pawns_East(uint64_t b)
+{
+    return (b & ~FILE_H_MASK) << 1;
+}
+
+static inline uint64_t Pawns_West(uint64_t b)
+{
+    return (b & ~FILE_A_MASK) >> 1;
+}
+
+/**
+ * Scores the structure of one side, for pawns moving up the board. Black is
+ * scored by flipping the board over first, so one set of rules serves both.
+ *
+ * @param ours:     The pawns being scored
+ * @param theirs:   The opposing pawns
+ * @param midgame:  Added to with the middlegame score
+ * @param endgame:  Added to with the endgame score
+ * @param trace:    Added to with the count of each term times sign, NULL if not wanted
+ * @param sign:     1 for white's pawns, -1 for black's
+ *
+ * @return  The passed pawns among ours
+ */
+static uint64_t Pawns_EvaluateSide(uint64_t ours, uint64_t theirs, int32_t *midgame, int32_t *endgame,
+                                   evalTerms_t *trace, int32_t sign)
+{
+    const evalTerms_t *mg = &evalParams.midgame, *eg = &evalParams.endgame;
+    uint64_t ourFiles, ourAttacks, theirAttacks, theirFrontSpans, doubled, isolated, backward, connected, passed;
+    int32_t numDoubled, numIsolated, numBackward, numConnected;
+
+    ourFiles = Pawns_NorthFill(ours) | Pawns_SouthFill(ours);
+    ourAttacks = Pawns_East(ours << 8) | Pawns_West(ours << 8);
+    theirAttacks = Pawns_East(theirs >> 8) | Pawns_West(theirs >> 8);
+    theirFrontSpans = Pawns_SouthFill(theirs >> 8);
+
+    // Pawns with another of ours somewhere ahead of them on the file
+    doubled = ours & Pawns_SouthFill(ours >> 8);
+
+    // Pawns without any of ours on a neighbouring file to ever support them
+    isolated = ours & ~(Pawns_East(ourFiles) | Pawns_West(ourFiles));
+
+    // Pawns whose way forward is covered by theirs, while none of ours could
+    // ever come alongside to cover it back
+    backward = ((ours << 8) & theirAttacks & ~Pawns_NorthFill(ourAttacks)) >> 8;
+
+    // Pawns defended by, or standing beside, one of ours
+    connected = ours & (ourAttacks | Pawns_East(ours) | Pawns_West(ours));
+
+    // The front pawn of a file with none of theirs ahead on it or beside it
+    passed = ours & ~doubled & ~(theirFrontSpans | Pawns_East(theirFrontSpans) | Pawns_West(theirFrontSpans));
+
+    numDoubled = __builtin_popcountll(doubled);
+    numIsolated = __builtin_popcountll(isolated);
+    numBackward = __builtin_popcountll(backward & ~isolated);
+    numConnected = __builtin_popcountll(connected);
+
+    *midgame += numDoubled*mg->doubled + numIsolated*mg->isolated
+              + numBackward*mg->backward + numConnected*mg->connected;
+    *endgame += numDoubled*eg->doubled + numIsolated*eg->isolated
+              + numBackward*eg->backward + numConnected*eg->connected;
+
+    for(uint64_t pawns = passed; pawns; pawns &= pawns - 1)
+    {
+        *midgame += mg->passed[__builtin_ctzll(pawns) / 8];
+        *endgame += eg->passed[__builtin_ctzll(pawns) / 8];
+        if(trace != NULL)
+        {
+            trace->passed[__builtin_ctzll(pawns) / 8] += sign;
+        }
+    }
+
+    if(trace != NULL)
+    {
+        trace->doubled += sign*numDoubled;
+        trace->isolated += sign*numIsolated;
+        trace->backward += sign*numBackward;
+        trace->connected += sign*numConnected;
+    }
+
+    return passed;
+}
+
+/**
+ * Looks up the pawn structure terms of a position, working them out and
+ * keeping them if the structure is not in the table
+ *
+ * @param pawnKey:      The pawn key of the position
+ * @param whitePawns:   The white pawns
+ * @param blackPawns:   The black pawns
+ *
+ * @return  The terms of the structure, valid until the next call
+ */
+const pawnEntry_t *Pawns_Evaluate(uint64_t pawnKey, uint64_t whitePawns, uint64_t blackPawns)
+{
+    pawnEntry_t *entry = &pawnHashTable[pawnKey & (PAWN_HASH_ENTRIES - 1)];
+    searchStats_t *stats = SearchStats_Get();
+    int32_t midgame = 0, endgame = 0, blackMidgame = 0, blackEndgame = 0;
+    uint64_t passed;
+
+    // An empty entry is that of a board without pawns, which is right as it stands
+    stats->pawnProbes++;
+    if(entry->key == pawnKey)
+    {
+        stats->pawnHits++;
+        return entry;
+    }
+
+    passed = Pawns_EvaluateSide(whitePawns, blackPawns, &midgame, &endgame, NULL, 1);
+    passed |= __builtin_bswap64(Pawns_EvaluateSide(__builtin_bswap64(blackPawns), __builtin_bswap64(whitePawns),
+                                                   &blackMidgame, &blackEndgame, NULL, -1));
+
+    entry->key = pawnKey;
+    entry->passed = passed;
+    entry->midgame = midgame - blackMidgame;
+    entry->endgame = endgame - blackEndgame;
+    return entry;
+}
+
+/**
+ * Empties the pawn hash table of the calling thread
+ */
+void Pawns_Clear(void)
+{
+    memset(pawnHashTable, 0, sizeof(pawnHashTable));
+}
+
+/**
+ * Counts the pawn structure terms of a position, white's less black's,
+ * without going through the table
+ *
+ * @param whitePawns:   The white pawns
+ * @param blackPawns:   The black pawns
+ * @param trace:        Added to with the count of each term
+ */
+void Pawns_Trace(uint64_t whitePawns, uint64_t blackPawns, evalTerms_t *trace)
+{
+    int32_t midgame = 0, endgame = 0;
+
+    Pawns_EvaluateSide(whitePawns, blackPawns, &midgame, &endgame, trace, 1);
+    Pawns_EvaluateSide(__builtin_bswap64(blackPawns), __builtin_bswap64(whitePawns), &midgame, &endgame, trace, -1);
+}
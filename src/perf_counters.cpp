@@ -0,0 +1,227 @@
+/* This file is responsible for reading the hardware performance counters around a search */
+
+#include <iostream>
+#include <cstring>
+#include "util.h"
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const char *perfCounterNames[NUM_PERF_COUNTERS] =
+{
+    "cycles",
+    "instructions",
+    "cacheReferences",
+    "cacheMisses",
+    "branches",
+    "branchMisses",
+    "l1dReadMisses",
+};
+
+#ifdef __linux__
+/**
+ * The perf_event type and config for each counter
+ */
+static const struct
+{
+    uint32_t type;
+    uint64_t config;
+} perfCounterEvents[NUM_PERF_COUNTERS] =
+{
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                          | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+};
+#endif
+
+/**
+ * Opens every counter for the calling thread, in user space only so it works
+ * without elevated privileges where the kernel allows it. The counters start
+ * off disabled.
+ *
+ * @param counters:     The set to open
+ *
+ * @return  STATUS_SUCCESS if at least one counter opened, STATUS_FAIL otherwise
+ */
+uint64_t PerfCounters_Open(perfCounters_t *counters)
+{
+    uint64_t numOpened = 0;
+
+    Util_Assert(counters != NULL, "NULL counters given to PerfCounters_Open");
+
+    for(uint8_t i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+        counters->fds[i] = -1;
+        counters->values[i] = 0;
+    }
+
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    for(uint8_t i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = perfCounterEvents[i].type;
+        attr.config = perfCounterEvents[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        counters->fds[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        numOpened += (counters->fds[i] >= 0) ? 1 : 0;
+    }
+#endif
+
+    return (numOpened > 0) ? STATUS_SUCCESS : STATUS_FAIL;
+}
+
+/**
+ * Zeroes and starts every open counter
+ */
+void PerfCounters_Start(perfCounters_t *counters)
+{
+#ifdef __linux__
+    for(uint8_t i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+        if(counters->fds[i] >= 0)
+        {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+/**
+ * Stops every open counter and reads it. There are usually more events than
+ * hardware counters, in which case the kernel time slices them and each count
+ * is scaled up by the fraction of the run it was actually counting for.
+ */
+void PerfCounters_Stop(perfCounters_t *counters)
+{
+#ifdef __linux__
+    uint64_t readBuf[3]; // Value, time enabled, time running
+
+    for(uint8_t i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+        if(counters->fds[i] < 0)
+        {
+            continue;
+        }
+
+        ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        if(read(counters->fds[i], readBuf, sizeof(readBuf)) != sizeof(readBuf) || readBuf[2] == 0)
+        {
+            counters->values[i] = 0;
+            continue;
+        }
+        counters->values[i] = (uint64_t) ((double) readBuf[0] * readBuf[1] / readBuf[2]);
+    }
+#endif
+}
+
+/**
+ * Closes every open counter
+ */
+void PerfCounters_Close(perfCounters_t *counters)
+{
+#ifdef __linux__
+    for(uint8_t i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+        if(counters->fds[i] >= 0)
+        {
+            close(counters->fds[i]);
+            counters->fds[i] = -1;
+        }
+    }
+#endif
+}
+
+/**
+ * Writes out the counts of the last run as JSON, both as totals and per search
+ * node, along with the derived IPC and miss rates. Unavailable counters are
+ * written as null.
+ *
+ * @param counters:     The counters of the run
+ * @param nodes:        Number of moves searched during the run
+ * @param out:          Where to write the counts to
+ */
+void PerfCounters_Print(perfCounters_t *counters, uint64_t nodes, std::ostream &out)
+{
+    bool haveCycles = counters->fds[PERF_CYCLES] >= 0 && counters->values[PERF_CYCLES] != 0;
+    bool haveInstructions = counters->fds[PERF_INSTRUCTIONS] >= 0;
+    bool haveBranches = counters->fds[PERF_BRANCHES] >= 0 && counters->values[PERF_BRANCHES] != 0;
+    bool haveCacheRefs = counters->fds[PERF_CACHE_REFERENCES] >= 0 && counters->values[PERF_CACHE_REFERENCES] != 0;
+
+    out << "{\"nodes\":" << nodes << ",\"totals\":{";
+    for(uint8_t i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+        out << (i ? "," : "") << "\"" << perfCounterNames[i] << "\":";
+        if(counters->fds[i] >= 0)
+        {
+            out << counters->values[i];
+        }
+        else
+        {
+            out << "null";
+        }
+    }
+
+    out << "},\"perNode\":{";
+    for(uint8_t i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+        out << (i ? "," : "") << "\"" << perfCounterNames[i] << "\":";
+        if(counters->fds[i] >= 0 && nodes != 0)
+        {
+            out << (double) counters->values[i] / nodes;
+        }
+        else
+        {
+            out << "null";
+        }
+    }
+
+    out << "},\"ipc\":";
+    if(haveCycles && haveInstructions)
+    {
+        out << (double) counters->values[PERF_INSTRUCTIONS] / counters->values[PERF_CYCLES];
+    }
+    else
+    {
+        out << "null";
+    }
+
+    out << ",\"branchMissRate\":";
+    if(haveBranches && counters->fds[PERF_BRANCH_MISSES] >= 0)
+    {
+        out << (double) counters->values[PERF_BRANCH_MISSES] / counters->values[PERF_BRANCHES];
+    }
+    else
+    {
+        out << "null";
+    }
+
+    out << ",\"cacheMissRate\":";
+    if(haveCacheRefs && counters->fds[PERF_CACHE_MISSES] >= 0)
+    {
+        out << (double) counters->values[PERF_CACHE_MISSES] / counters->values[PERF_CACHE_REFERENCES];
+    }
+    else
+    {
+        out << "null";
+    }
+    out << "}" << std::endl;
+}
@@ -0,0 +1,334 @@
+/* This file is responsible for reading games from PGN files */
+
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "chessboard.h"
+#include "notation.h"
+#include "pgn.h"
+
+/**
+ * @return  True if the character ends a movetext token
+ */
+static inline bool Pgn_IsDelimiter(char c)
+{
+    switch(c)
+    {
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+        case '.':
+        case '{':
+        case '}':
+        case '(':
+        case ')':
+        case ';':
+        case '[':
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @return  The result a termination marker or Result tag value stands for
+ */
+static pgnResult_e Pgn_ParseResult(const char *token, size_t length)
+{
+    if(length == 3 && memcmp(token, "1-0", 3) == 0)
+    {
+        return PGN_RESULT_WHITE_WIN;
+    }
+    if(length == 3 && memcmp(token, "0-1", 3) == 0)
+    {
+        return PGN_RESULT_BLACK_WIN;
+    }
+    if(length == 7 && memcmp(token, "1/2-1/2", 7) == 0)
+    {
+        return PGN_RESULT_DRAW;
+    }
+    return PGN_RESULT_UNKNOWN;
+}
+
+/**
+ * @return  The position of the next line after pos, or the end of the file
+ */
+static inline size_t Pgn_SkipLine(pgnReader_t *reader, size_t pos)
+{
+    const char *newline = (const char *) memchr(reader->data + pos, '\n', reader->size - pos);
+    return (newline == NULL) ? reader->size : (newline - reader->data) + 1;
+}
+
+/**
+ * Reads a tag pair, ie. [Result "1-0"], keeping the tags we care about
+ *
+ * @return  The position just past the tag
+ */
+static size_t Pgn_ParseTag(pgnReader_t *reader, size_t pos, pgnGame_t *game)
+{
+    size_t lineEnd = Pgn_SkipLine(reader, pos), nameStart = pos + 1, nameEnd, valueStart, valueEnd;
+    const char *data = reader->data;
+
+    for(nameEnd = nameStart; nameEnd < lineEnd && data[nameEnd] != ' ' && data[nameEnd] != '"'; ++nameEnd);
+    for(valueStart = nameEnd; valueStart < lineEnd && data[valueStart] != '"'; ++valueStart);
+    for(valueEnd = valueStart + 1; valueEnd < lineEnd && data[valueEnd] != '"'; ++valueEnd)
+    {
+        valueEnd += (data[valueEnd] == '\\') ? 1 : 0;
+    }
+
+    if(valueEnd >= lineEnd)
+    {
+        return lineEnd;
+    }
+    ++valueStart;
+
+    if(nameEnd - nameStart == 6 && memcmp(data + nameStart, "Result", 6) == 0)
+    {
+        game->result = Pgn_ParseResult(data + valueStart, valueEnd - valueStart);
+    }
+    else if(nameEnd - nameStart == 3 && memcmp(data + nameStart, "FEN", 3) == 0)
+    {
+        game->fen = data + valueStart;
+        game->fenLength = valueEnd - valueStart;
+    }
+
+    return lineEnd;
+}
+
+/**
+ * Maps a PGN file into memory to be read one game at a time. The file is only
+ * ever read through the mapping, so no game is copied out of it.
+ *
+ * @param reader:   The reader to set up
+ * @param path:     The file to read
+ *
+ * @return  STATUS_SUCCESS if the file was mapped, STATUS_FAIL otherwise
+ */
+uint64_t Pgn_Open(pgnReader_t *reader, std::string path)
+{
+    struct stat st;
+    void *mapping;
+    int fd;
+
+    Util_Assert(reader != NULL, "NULL reader given to Pgn_Open");
+
+    reader->data = NULL;
+    reader->size = 0;
+    reader->pos = 0;
+
+    fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return STATUS_FAIL;
+    }
+
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return STATUS_FAIL;
+    }
+
+    // An empty file is simply one without any games
+    if(st.st_size == 0)
+    {
+        close(fd);
+        return STATUS_SUCCESS;
+    }
+
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        return STATUS_FAIL;
+    }
+
+    // We only ever walk forward through the file
+    madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+
+    reader->data = (const char *) mapping;
+    reader->size = st.st_size;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Unmaps the file of a reader. Games read from it can no longer be used.
+ */
+void Pgn_Close(pgnReader_t *reader)
+{
+    if(reader->data != NULL)
+    {
+        munmap((void *) reader->data, reader->size);
+    }
+    reader->data = NULL;
+    reader->size = 0;
+    reader->pos = 0;
+}
+
+/**
+ * Sets a board to the position a game starts from
+ *
+ * @return  STATUS_SUCCESS if the position could be set, STATUS_FAIL otherwise
+ */
+uint64_t Pgn_SetStartPosition(ChessBoard *cb, pgnGame_t *game)
+{
+    if(game->fen == NULL)
+    {
+        return cb->SetBoardFromFEN(START_POSITION_FEN);
+    }
+    return cb->SetBoardFromFEN(std::string(game->fen, game->fenLength));
+}
+
+/**
+ * Unpacks a move of a game, ready to be applied to the board it is played on
+ *
+ * @param cb:       The position the move is played from
+ * @param packed:   The move as kept in the game
+ * @param move:     Where to store the move
+ *
+ * @return  STATUS_SUCCESS if the move fits the position, STATUS_FAIL otherwise
+ */
+uint64_t Pgn_DecodeMove(ChessBoard *cb, pgnMove_t packed, moveType_t *move)
+{
+    return Notation_BuildMove(cb, PGN_MOVE_START(packed), PGN_MOVE_END(packed),
+                              PGN_MOVE_PROMOTION(packed), move);
+}
+
+/**
+ * Reads the next game from a mapped PGN file. Tags, comments, variations and
+ * annotations are stepped over in place, and each main line move is resolved
+ * by playing it on the board, so the game holds only moves known to be legal.
+ *
+ * @param reader:   The file to read from
+ * @param cb:       Board to play the moves on, left at the last move read
+ * @param maxPly:   Moves to resolve, any after are skipped over unread
+ * @param game:     Where to store the game
+ *
+ * @return  STATUS_SUCCESS if a game was read, STATUS_FAIL once the file is done
+ */
+uint64_t Pgn_ReadGame(pgnReader_t *reader, ChessBoard *cb, uint64_t maxPly, pgnGame_t *game)
+{
+    const char *data = reader->data, *token;
+    size_t pos = reader->pos, size = reader->size, length;
+    uint64_t variationDepth = 0;
+    pgnResult_e terminator;
+    moveType_t move;
+    bool inMoves = false, foundAny = false, done = false;
+
+    Util_Assert(cb != NULL && game != NULL, "NULL input to Pgn_ReadGame");
+
+    game->result = PGN_RESULT_UNKNOWN;
+    game->fen = NULL;
+    game->fenLength = 0;
+    game->truncated = false;
+    game->numMoves = 0;
+
+    maxPly = (maxPly < PGN_MAX_MOVES) ? maxPly : PGN_MAX_MOVES;
+
+    while(pos < size && !done)
+    {
+        switch(data[pos])
+        {
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\n':
+            case '.':
+            case '}':
+                ++pos;
+                continue;
+            case '[':
+                // The tags of the next game mean this one is over, even without a terminator
+                if(inMoves)
+                {
+                    done = true;
+                    continue;
+                }
+                pos = Pgn_ParseTag(reader, pos, game);
+                foundAny = true;
+                continue;
+            case '%':
+                // Escaped lines are for other programs
+                if(pos == 0 || data[pos - 1] == '\n')
+                {
+                    pos = Pgn_SkipLine(reader, pos);
+                    continue;
+                }
+                break;
+            case '{':
+                token = (const char *) memchr(data + pos, '}', size - pos);
+                pos = (token == NULL) ? size : (token - data) + 1;
+                continue;
+            case ';':
+                pos = Pgn_SkipLine(reader, pos);
+                continue;
+            case '(':
+                ++variationDepth;
+                ++pos;
+                continue;
+            case ')':
+                variationDepth -= (variationDepth > 0) ? 1 : 0;
+                ++pos;
+                continue;
+            default:
+                break;
+        }
+
+        token = data + pos;
+        for(length = 0; pos < size && !Pgn_IsDelimiter(data[pos]); ++pos, ++length);
+
+        inMoves = true;
+        foundAny = true;
+
+        terminator = Pgn_ParseResult(token, length);
+        if(terminator != PGN_RESULT_UNKNOWN || (length == 1 && token[0] == '*'))
+        {
+            if(variationDepth == 0)
+            {
+                if(terminator != PGN_RESULT_UNKNOWN)
+                {
+                    game->result = terminator;
+                }
+                done = true;
+            }
+            continue;
+        }
+
+        // Move numbers, NAGs and anything inside a variation are not main line
+        // moves, though castling may be written with zeros
+        if(variationDepth > 0 || token[0] == '$'
+            || (token[0] >= '0' && token[0] <= '9' && !(length >= 3 && token[0] == '0' && token[1] == '-')))
+        {
+            continue;
+        }
+
+        if(game->truncated || game->numMoves >= maxPly)
+        {
+            continue;
+        }
+
+        // The tags are all read by the first move, so we now know where to start
+        if(game->numMoves == 0 && Pgn_SetStartPosition(cb, game) != STATUS_SUCCESS)
+        {
+            game->truncated = true;
+            continue;
+        }
+
+        if(Notation_ParseSan(cb, token, length, &move) != STATUS_SUCCESS)
+        {
+            game->truncated = true;
+            continue;
+        }
+
+        game->moves[game->numMoves++] = PGN_MOVE(move.startIdx, move.endIdx, move.promotion);
+        cb->ApplyMoveToBoard(&move);
+    }
+
+    reader->pos = pos;
+    return foundAny ? STATUS_SUCCESS : STATUS_FAIL;
+}
@@ -2,93 +2,72 @@
 
 #include "chessboard_defs.h"
 #include "chessboard.h"
+#include "piecetables.h"
+#include "eval_params.h"
 #include "util.h"
 
-static const int64_t pieceValueTables[NUM_BOARD_INDICES][NUM_BOARD_INDICES] =
+static const int32_t phaseValues[NUM_PIECE_TYPES/2] = { 0, PHASE_ROOK, PHASE_BISHOP, PHASE_KNIGHT, PHASE_QUEEN, 0 };
+
+/**
+ * Folds material into the square tables, turned around for each color. The
+ * tables are drawn a8 first, which is where a white piece on h1 flipped to
+ * its rank finds its entry, while black sees the board the way it is drawn.
+ */
+static pieceSquareTables_t PieceTables_Build(void)
 {
-    // Pawns
-    {
-      0,  0,  0,  0,  0,  0,  0,  0,
-     50, 50, 50, 50, 50, 50, 50, 50,
-     10, 10, 20, 30, 30, 20, 10, 10,
-      5,  5, 10, 25, 25, 10,  5,  5,
-      0,  0,  0, 20, 20,  0,  0,  0,
-      5, -5,-10,  0,  0,-10, -5,  5,
-      5, 10, 10,-20,-20, 10, 10,  5,
-      0,  0,  0,  0,  0,  0,  0,  0
-    },
-    // Rooks
-    {
-      0,  0,  0,  0,  0,  0,  0,  0,
-      5, 10, 10, 10, 10, 10, 10,  5,
-     -5,  0,  0,  0,  0,  0,  0, -5,
-     -5,  0,  0,  0,  0,  0,  0, -5,
-     -5,  0,  0,  0,  0,  0,  0, -5,
-     -5,  0,  0,  0,  0,  0,  0, -5,
-     -5,  0,  0,  0,  0,  0,  0, -5,
-      0,  0,  0,  5,  5,  0,  0,  0
-    },
-    //Knights
-    {
-     -50,-40,-30,-30,-30,-30,-40,-50,
-     -40,-20,  0,  0,  0,  0,-20,-40,
-     -30,  0, 10, 15, 15, 10,  0,-30,
-     -30,  5, 15, 20, 20, 15,  5,-30,
-     -30,  0, 15, 20, 20, 15,  0,-30,
-     -30,  5, 10, 15, 15, 10,  5,-30,
-     -40,-20,  0,  5,  5,  0,-20,-40,
-     -50,-40,-30,-30,-30,-30,-40,-50,
-    },
-    // Bishops
-    {
-     -20,-10,-10,-10,-10,-10,-10,-20,
-     -10,  0,  0,  0,  0,  0,  0,-10,
-     -10,  0,  5, 10, 10,  5,  0,-10,
-     -10,  5,  5, 10, 10,  5,  5,-10,
-     -10,  0, 10, 10, 10, 10,  0,-10,
-     -10, 10, 10, 10, 10, 10, 10,-10,
-     -10,  5,  0,  0,  0,  0,  5,-10,
-     -20,-10,-10,-10,-10,-10,-10,-20,
-    },
-    // Queen
-    {
-     -20,-10,-10, -5, -5,-10,-10,-20,
-     -10,  0,  0,  0,  0,  0,  0,-10,
-     -10,  0,  5,  5,  5,  5,  0,-10,
-      -5,  0,  5,  5,  5,  5,  0, -5,
-       0,  0,  5,  5,  5,  5,  0, -5,
-     -10,  5,  5,  5,  5,  5,  0,-10,
-     -10,  0,  5,  0,  0,  0,  0,-10,
-     -20,-10,-10, -5, -5,-10,-10,-20
-    },
-    // King mid-game
-    {
-     -30,-40,-40,-50,-50,-40,-40,-30,
-     -30,-40,-40,-50,-50,-40,-40,-30,
-     -30,-40,-40,-50,-50,-40,-40,-30,
-     -30,-40,-40,-50,-50,-40,-40,-30,
-     -20,-30,-30,-40,-40,-30,-30,-20,
-     -10,-20,-20,-20,-20,-20,-20,-10,
-      20, 20,  0,  0,  0,  0, 20, 20,
-      20, 30, 10,  0,  0, 10, 30, 20
-    },
-    // King late-game
+    pieceSquareTables_t tables;
+    uint8_t base, tableIdx;
+    int32_t sign;
+
+    for(uint8_t pt = 0; pt < NUM_PIECE_TYPES; ++pt)
     {
-     -50,-40,-30,-20,-20,-30,-40,-50,
-     -30,-20,-10,  0,  0,-10,-20,-30,
-     -30,-10, 20, 30, 30, 20,-10,-30,
-     -30,-10, 30, 40, 40, 30,-10,-30,
-     -30,-10, 30, 40, 40, 30,-10,-30,
-     -30,-10, 20, 30, 30, 20,-10,-30,
-     -30,-30,  0,  0,  0,  0,-30,-30,
-     -50,-30,-30,-30,-30,-30,-30,-50
+        base = pt % (NUM_PIECE_TYPES/2);
+        sign = (pt < NUM_PIECE_TYPES/2) ? 1 : -1;
+        for(uint8_t idx = 0; idx < NUM_BOARD_INDICES; ++idx)
+        {
+            tableIdx = (sign > 0) ? (idx ^ 56) : idx;
+            tables.midgame[pt][idx] = sign*(evalParams.midgame.material[base]
+                + evalParams.midgame.squares[base][tableIdx]);
+            tables.endgame[pt][idx] = sign*(evalParams.endgame.material[base]
+                + evalParams.endgame.squares[base][tableIdx]);
+        }
+        tables.phase[pt] = phaseValues[base];
     }
-};
+    return tables;
+}
+
+/**
+ * Builds the tables again from the evaluation weights, once they have changed
+ */
+void PieceTables_Rebuild(void)
+{
+    pieceSquareTables = PieceTables_Build();
+}
 
-int64_t GetPositionValueFromTable(uint64_t pieceTypeBase, uint64_t idx)
+/**
+ * Counts the material and placement terms of a position, white's less
+ * black's, the way PieceTables_Build folds them into the tables
+ *
+ * @param pieces:   The piece boards of the position
+ * @param trace:    Added to with the count of each term
+ */
+void PieceTables_Trace(const uint64_t *pieces, evalTerms_t *trace)
 {
-    Util_Assert(pieceTypeBase < 7, "Incorrect piece type provided to position value function");
-    Util_Assert(idx < NUM_BOARD_INDICES, "Bad board idx provided to position value function");
+    uint8_t base;
+    int32_t sign;
+
+    for(uint8_t pt = 0; pt < NUM_PIECE_TYPES; ++pt)
+    {
+        base = pt % (NUM_PIECE_TYPES/2);
+        sign = (pt < NUM_PIECE_TYPES/2) ? 1 : -1;
+        for(uint64_t bb = pieces[pt]; bb; bb &= bb - 1)
+        {
+            trace->material[base] += sign;
+            trace->squares[base][(sign > 0) ? (__builtin_ctzll(bb) ^ 56) : __builtin_ctzll(bb)] += sign;
+        }
+    }
+}
 
-    return pieceValueTables[pieceTypeBase][idx];
-}
\ No newline at end of file
+// Only ever built from weights which are constant initialised, so they are
+// in place before this is
+pieceSquareTables_t pieceSquareTables = PieceTables_Build();
@@ -0,0 +1,426 @@
+/* This file is responsible for probing Polyglot opening books */
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "chessboard.h"
+#include "polyglot_book.h"
+
+static uint64_t polyglotRandoms[POLYGLOT_NUM_RANDOMS];
+static bool polyglotRandomsLoaded = false;
+
+// The book is mapped rather than read, so opening it costs nothing however big it is
+static const polyglotEntry_t *bookEntries = NULL;
+static uint64_t numBookEntries = 0;
+static size_t bookMappedSize = 0;
+
+static uint64_t bookRandomState = 1;
+
+/**
+ * Polyglot orders its pieces black pawn, white pawn, black knight, white
+ * knight and so on, which is not the order we keep them in
+ */
+static const uint8_t polyglotPieceKind[NUM_PIECE_TYPES] =
+{
+    1,  // WHITE_PAWN
+    7,  // WHITE_ROOK
+    5,  // WHITE_BISHOP
+    3,  // WHITE_KNIGHT
+    9,  // WHITE_QUEEN
+    11, // WHITE_KING
+    0,  // BLACK_PAWN
+    6,  // BLACK_ROOK
+    4,  // BLACK_BISHOP
+    2,  // BLACK_KNIGHT
+    8,  // BLACK_QUEEN
+    10, // BLACK_KING
+};
+
+// Polyglot numbers promotions knight, bishop, rook, queen from 1
+static const uint8_t polyglotPromotions[] =
+{
+    PROMOTION_NONE, WHITE_KNIGHT, WHITE_BISHOP, WHITE_ROOK, WHITE_QUEEN,
+};
+
+static inline uint64_t PolyglotBook_FromBigEndian64(uint64_t value)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap64(value);
+#else
+    return value;
+#endif
+}
+
+static inline uint16_t PolyglotBook_FromBigEndian16(uint16_t value)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap16(value);
+#else
+    return value;
+#endif
+}
+
+/**
+ * Loads the Polyglot key table. The table is the list of 781 64 bit numbers
+ * published with the Polyglot book format, written in hex one after another,
+ * with anything which is not a number ignored so the C array from the format
+ * description can be used as is.
+ *
+ * @param path:     The file holding the table
+ *
+ * @return  STATUS_SUCCESS if the table was read and produces the standard
+ *          start position key, STATUS_FAIL otherwise
+ */
+uint64_t PolyglotBook_LoadRandoms(std::string path)
+{
+    std::ifstream file(path);
+    std::string token;
+    uint64_t numRead = 0, startKey;
+    ChessBoard *cb;
+
+    polyglotRandomsLoaded = false;
+    if(!file.is_open())
+    {
+        return STATUS_FAIL;
+    }
+
+    while(numRead < POLYGLOT_NUM_RANDOMS && file >> token)
+    {
+        size_t pos = token.find("0x");
+        if(pos == std::string::npos)
+        {
+            pos = token.find("0X");
+        }
+        if(pos == std::string::npos)
+        {
+            continue;
+        }
+        polyglotRandoms[numRead++] = std::stoull(token.substr(pos + 2, 16), NULL, 16);
+    }
+
+    if(numRead != POLYGLOT_NUM_RANDOMS)
+    {
+        std::cout << "Polyglot key table " << path << " holds " << numRead
+                  << " numbers, expected " << POLYGLOT_NUM_RANDOMS << std::endl;
+        return STATUS_FAIL;
+    }
+
+    // Any other table would give keys which never match a real book
+    polyglotRandomsLoaded = true;
+    cb = new ChessBoard();
+    startKey = PolyglotBook_ComputeKey(cb);
+    delete cb;
+
+    if(startKey != POLYGLOT_START_KEY)
+    {
+        std::cout << "Polyglot key table " << path << " is not the standard table" << std::endl;
+        polyglotRandomsLoaded = false;
+        return STATUS_FAIL;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Works out the Polyglot key of a position
+ *
+ * @param cb:   The position to hash
+ *
+ * @return  The key, or 0 if the key table has not been loaded
+ */
+uint64_t PolyglotBook_ComputeKey(ChessBoard *cb)
+{
+    uint64_t key = 0, pieces, capturers = 0, epIdx;
+    uint8_t castlingRights, idx;
+
+    Util_Assert(cb != NULL, "NULL board given to PolyglotBook_ComputeKey");
+
+    if(!polyglotRandomsLoaded)
+    {
+        return 0;
+    }
+
+    for(uint8_t pt = 0; pt < NUM_PIECE_TYPES; ++pt)
+    {
+        pieces = cb->GetPiece(pt);
+        while(pieces)
+        {
+            idx = __builtin_ctzll(pieces);
+            key ^= polyglotRandoms[64*polyglotPieceKind[pt] + idx];
+            pieces &= pieces - 1;
+        }
+    }
+
+    castlingRights = cb->GetCastlingRights();
+    key ^= (castlingRights & CASTLE_WHITE_KING)  ? polyglotRandoms[POLYGLOT_RANDOM_CASTLE + 0] : 0;
+    key ^= (castlingRights & CASTLE_WHITE_QUEEN) ? polyglotRandoms[POLYGLOT_RANDOM_CASTLE + 1] : 0;
+    key ^= (castlingRights & CASTLE_BLACK_KING)  ? polyglotRandoms[POLYGLOT_RANDOM_CASTLE + 2] : 0;
+    key ^= (castlingRights & CASTLE_BLACK_QUEEN) ? polyglotRandoms[POLYGLOT_RANDOM_CASTLE + 3] : 0;
+
+    // The en passant file only counts if a pawn is actually there to take
+    epIdx = cb->GetEnPassantIdx();
+    if(epIdx != EN_PASSANT_NONE)
+    {
+        if(cb->GetColorToMove() == WHITE_PIECES)
+        {
+            capturers = ((epIdx % 8 != 0) ? 1ULL << (epIdx - 9) : 0)
+                      | ((epIdx % 8 != 7) ? 1ULL << (epIdx - 7) : 0);
+            capturers &= cb->GetWhitePawns();
+        }
+        else
+        {
+            capturers = ((epIdx % 8 != 0) ? 1ULL << (epIdx + 7) : 0)
+                      | ((epIdx % 8 != 7) ? 1ULL << (epIdx + 9) : 0);
+            capturers &= cb->GetBlackPawns();
+        }
+
+        if(capturers)
+        {
+            key ^= polyglotRandoms[POLYGLOT_RANDOM_EN_PASSANT + epIdx % 8];
+        }
+    }
+
+    if(cb->GetColorToMove() == WHITE_PIECES)
+    {
+        key ^= polyglotRandoms[POLYGLOT_RANDOM_TURN];
+    }
+
+    return key;
+}
+
+/**
+ * Maps a Polyglot book into memory. Pages are only read in as probes touch
+ * them, so there is no load time whatever the size of the book.
+ *
+ * @param path:     The .bin book to open
+ *
+ * @return  STATUS_SUCCESS if the book was mapped, STATUS_FAIL otherwise
+ */
+uint64_t PolyglotBook_Open(std::string path)
+{
+    struct stat st;
+    void *mapping;
+    int fd;
+
+    PolyglotBook_Close();
+
+    fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return STATUS_FAIL;
+    }
+
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(polyglotEntry_t))
+    {
+        close(fd);
+        return STATUS_FAIL;
+    }
+
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        return STATUS_FAIL;
+    }
+
+    // Probes jump around the file, reading ahead would only waste IO
+    madvise(mapping, st.st_size, MADV_RANDOM);
+
+    bookEntries = (const polyglotEntry_t *) mapping;
+    bookMappedSize = st.st_size;
+    numBookEntries = st.st_size / sizeof(polyglotEntry_t);
+
+    bookRandomState = std::chrono::steady_clock::now().time_since_epoch().count() | 1;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Unmaps the open book, if there is one
+ */
+void PolyglotBook_Close(void)
+{
+    if(bookEntries != NULL)
+    {
+        munmap((void *) bookEntries, bookMappedSize);
+    }
+    bookEntries = NULL;
+    bookMappedSize = 0;
+    numBookEntries = 0;
+}
+
+/**
+ * @return  True if a book can be probed
+ */
+bool PolyglotBook_IsOpen(void)
+{
+    return bookEntries != NULL && polyglotRandomsLoaded;
+}
+
+/**
+ * Finds the generated move a book move refers to. Polyglot writes castling as
+ * the king taking its own rook, which we write as the king's two square move.
+ * Our promotions must match theirs as well.
+ *
+ * @return  The matching move from the list, or NULL if it is not in the list
+ */
+static moveType_t *PolyglotBook_FindMove(ChessBoard *cb, moveType_t *moveList, uint16_t bookMove)
+{
+    uint8_t endIdx = bookMove & 0x3F, startIdx = (bookMove >> 6) & 0x3F;
+    uint8_t promotionCode = (bookMove >> 12) & 0x7, promotion;
+    uint8_t king = (cb->GetColorToMove() == WHITE_PIECES) ? WHITE_KING : BLACK_KING;
+
+    if(promotionCode >= sizeof(polyglotPromotions))
+    {
+        return NULL;
+    }
+    promotion = polyglotPromotions[promotionCode];
+
+    if((cb->GetPiece(king) & (1ULL << startIdx)) && (startIdx == 4 || startIdx == 60))
+    {
+        if(endIdx == startIdx + 3)
+        {
+            endIdx = startIdx + 2;
+        }
+        else if(endIdx == startIdx - 4)
+        {
+            endIdx = startIdx - 2;
+        }
+    }
+
+    for(; moveList != NULL && moveList->legalMove; moveList = moveList->adjMove)
+    {
+        if(moveList->startIdx == startIdx && moveList->endIdx == endIdx && moveList->promotion == promotion)
+        {
+            return moveList;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Writes a move in the form Polyglot books store it
+ *
+ * @param move:     The move to encode
+ *
+ * @return  The move as stored in a book entry
+ */
+uint16_t PolyglotBook_EncodeMove(moveType_t *move)
+{
+    uint8_t endIdx, promotionCode = 0;
+
+    Util_Assert(move != NULL, "NULL move given to PolyglotBook_EncodeMove");
+
+    endIdx = move->endIdx;
+
+    // Castling is written as the king taking its own rook
+    if(move->moveVal & MOVE_VALID_CASTLE_KING)
+    {
+        endIdx = move->startIdx + 3;
+    }
+    else if(move->moveVal & MOVE_VALID_CASTLE_QUEEN)
+    {
+        endIdx = move->startIdx - 4;
+    }
+
+    for(uint8_t i = 1; i < sizeof(polyglotPromotions); ++i)
+    {
+        if(move->promotion != PROMOTION_NONE && polyglotPromotions[i] == move->promotion)
+        {
+            promotionCode = i;
+        }
+    }
+
+    return (uint16_t) (endIdx | (move->startIdx << 6) | (promotionCode << 12));
+}
+
+/**
+ * Looks the position up in the open book
+ *
+ * @param cb:           The position to look up
+ * @param selection:    How to choose between several book moves
+ * @param bookMove:     Where to store the chosen move
+ *
+ * @return  STATUS_SUCCESS if the book had a playable move, STATUS_FAIL otherwise
+ */
+uint64_t PolyglotBook_Probe(ChessBoard *cb, bookSelect_e selection, moveType_t *bookMove)
+{
+    uint64_t key, low = 0, high = numBookEntries, mid, totalWeight = 0, pick;
+    uint16_t weight, bestWeight = 0;
+    moveType_t *moveList, *candidate, *chosen = NULL;
+
+    Util_Assert(cb != NULL && bookMove != NULL, "NULL input to PolyglotBook_Probe");
+
+    if(!PolyglotBook_IsOpen())
+    {
+        return STATUS_FAIL;
+    }
+
+    key = PolyglotBook_ComputeKey(cb);
+
+    // Entries are sorted by key, find the first with ours
+    while(low < high)
+    {
+        mid = low + (high - low) / 2;
+        if(PolyglotBook_FromBigEndian64(bookEntries[mid].key) < key)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    if(low >= numBookEntries || PolyglotBook_FromBigEndian64(bookEntries[low].key) != key)
+    {
+        return STATUS_FAIL;
+    }
+
+    moveList = cb->GenerateMoves(cb->GetColorToMove());
+
+    for(uint64_t i = low; i < numBookEntries && PolyglotBook_FromBigEndian64(bookEntries[i].key) == key; ++i)
+    {
+        weight = PolyglotBook_FromBigEndian16(bookEntries[i].weight);
+        candidate = PolyglotBook_FindMove(cb, moveList, PolyglotBook_FromBigEndian16(bookEntries[i].move));
+        if(candidate == NULL || weight == 0)
+        {
+            continue;
+        }
+
+        if(selection == BOOK_SELECT_BEST)
+        {
+            if(weight > bestWeight)
+            {
+                bestWeight = weight;
+                chosen = candidate;
+            }
+            continue;
+        }
+
+        // Reservoir sampling by weight, so each move is picked in proportion
+        // to its weight in a single pass
+        totalWeight += weight;
+        bookRandomState ^= bookRandomState >> 12;
+        bookRandomState ^= bookRandomState << 25;
+        bookRandomState ^= bookRandomState >> 27;
+        pick = (bookRandomState * 0x2545F4914F6CDD1DULL) % totalWeight;
+        if(pick < weight)
+        {
+            chosen = candidate;
+        }
+    }
+
+    if(chosen != NULL)
+    {
+        *bookMove = *chosen;
+        bookMove->adjMove = NULL;
+    }
+    FreeMoveList(moveList);
+
+    return (chosen != NULL) ? STATUS_SUCCESS : STATUS_FAIL;
+}
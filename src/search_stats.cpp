@@ -0,0 +1,188 @@
+/* This file is responsible for the statistics gathered while searching */
+
+#include <iostream>
+#include <cstring>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "search_stats.h"
+#include "evaluation.h"
+#include "transposition.h"
+
+// Every searching thread keeps its own statistics
+static thread_local searchStats_t searchStats;
+
+static const char *pruneTypeNames[NUM_PRUNE_TYPES] =
+{
+    "kingCaptured",
+    "draw",
+    "seeQsearch",
+    "see",
+};
+
+/**
+ * @return  The statistics block for the calling thread
+ */
+searchStats_t *SearchStats_Get(void)
+{
+    return &searchStats;
+}
+
+/**
+ * Clears the statistics for the calling thread, done before each new search
+ */
+void SearchStats_Reset(void)
+{
+    memset(&searchStats, 0, sizeof(searchStats));
+}
+
+/**
+ * Records that an iteration of iterative deepening has completed, so the
+ * branching factor between iterations can be worked out
+ *
+ * @param depth:    The depth of the iteration which completed
+ */
+void SearchStats_CompleteIteration(uint64_t depth)
+{
+    uint64_t previousNodes = 0;
+
+    Util_Assert(depth > 0 && depth < STATS_MAX_PLY, "Bad depth for a completed iteration");
+
+    for(uint64_t d = 1; d < depth; ++d)
+    {
+        previousNodes += searchStats.iterationNodes[d];
+    }
+
+    searchStats.iterationNodes[depth] = searchStats.nodes + searchStats.qnodes - previousNodes;
+    searchStats.depth = depth;
+}
+
+/**
+ * @return  The effective branching factor of the last completed iteration,
+ *          the ratio of its node count to that of the iteration before it
+ */
+double SearchStats_GetBranchingFactor(void)
+{
+    uint64_t depth = searchStats.depth;
+
+    if(depth == 0)
+    {
+        return 0.0;
+    }
+    if(depth == 1 || searchStats.iterationNodes[depth - 1] == 0)
+    {
+        return (double) searchStats.iterationNodes[depth];
+    }
+    return (double) searchStats.iterationNodes[depth] / searchStats.iterationNodes[depth - 1];
+}
+
+/**
+ * Writes the statistics out as UCI info strings. The standard fields go in a
+ * regular info line and everything else in an info string line.
+ *
+ * @param out:          Where to write the info to
+ * @param score:        Score of the iteration from the side to move's view
+ * @param elapsedMs:    Time spent searching so far
+ * @param pv:           The line found in UCI notation, NULL if there is none
+ */
+void SearchStats_PrintUciInfo(std::ostream &out, int32_t score, uint64_t elapsedMs, const char *pv)
+{
+    uint64_t totalNodes = searchStats.nodes + searchStats.qnodes;
+    int32_t pliesToCapture;
+
+    out << "info depth " << searchStats.depth
+        << " seldepth " << searchStats.selDepth;
+
+    // Mate scores count down the depth left when the king was taken, which
+    // goes negative for a mate the table found beyond this depth. Our mate
+    // in N takes their king on ply 2N+1, theirs takes ours on ply 2N+2
+    if(score >= MATE_SCORE - MAX_SEARCH_DEPTH)
+    {
+        pliesToCapture = (int32_t) searchStats.depth - (score - MATE_SCORE);
+        out << " score mate " << pliesToCapture / 2;
+    }
+    else if(score <= -(MATE_SCORE - MAX_SEARCH_DEPTH))
+    {
+        pliesToCapture = (int32_t) searchStats.depth - (-score - MATE_SCORE);
+        out << " score mate " << -((pliesToCapture - 1) / 2);
+    }
+    else
+    {
+        out << " score cp " << score;
+    }
+
+    out << " nodes " << totalNodes
+        << " nps " << (totalNodes * 1000) / (elapsedMs ? elapsedMs : 1)
+        << " time " << elapsedMs
+        << " hashfull " << TT_Hashfull();
+    if(pv != NULL)
+    {
+        out << " pv " << pv;
+    }
+    out << std::endl;
+
+    out << "info string qnodes " << searchStats.qnodes
+        << " cutoffs " << searchStats.betaCutoffs
+        << " firstmovecutoffs " << searchStats.firstMoveCutoffs
+        << " ebf " << SearchStats_GetBranchingFactor()
+        << " ttprobes " << searchStats.ttProbes
+        << " tthits " << searchStats.ttHits
+        << " pawnprobes " << searchStats.pawnProbes
+        << " pawnhits " << searchStats.pawnHits
+        << " evalprobes " << searchStats.evalProbes
+        << " evalhits " << searchStats.evalHits
+        << " lazyskips " << searchStats.lazySkips;
+#if LAZY_EVAL_CHECK
+    out << " lazymisses " << searchStats.lazyMisses;
+#endif
+    for(uint8_t i = 0; i < NUM_PRUNE_TYPES; ++i)
+    {
+        out << " pruned." << pruneTypeNames[i] << " " << searchStats.pruned[i];
+    }
+    out << std::endl;
+}
+
+/**
+ * Writes the statistics out as a single JSON object
+ *
+ * @param out:  Where to write the statistics to
+ */
+void SearchStats_PrintJson(std::ostream &out)
+{
+    out << "{\"depth\":" << searchStats.depth
+        << ",\"selDepth\":" << searchStats.selDepth
+        << ",\"nodes\":" << searchStats.nodes
+        << ",\"qnodes\":" << searchStats.qnodes
+        << ",\"betaCutoffs\":" << searchStats.betaCutoffs
+        << ",\"firstMoveCutoffs\":" << searchStats.firstMoveCutoffs
+        << ",\"firstMoveCutoffRate\":"
+        << (searchStats.betaCutoffs ? (double) searchStats.firstMoveCutoffs / searchStats.betaCutoffs : 0.0)
+        << ",\"branchingFactor\":" << SearchStats_GetBranchingFactor()
+        << ",\"ttProbes\":" << searchStats.ttProbes
+        << ",\"ttHits\":" << searchStats.ttHits
+        << ",\"pawnProbes\":" << searchStats.pawnProbes
+        << ",\"pawnHits\":" << searchStats.pawnHits
+        << ",\"evalProbes\":" << searchStats.evalProbes
+        << ",\"evalHits\":" << searchStats.evalHits
+        << ",\"lazySkips\":" << searchStats.lazySkips;
+#if LAZY_EVAL_CHECK
+    out << ",\"lazyMisses\":" << searchStats.lazyMisses;
+#endif
+    out << ",\"pruned\":{";
+    for(uint8_t i = 0; i < NUM_PRUNE_TYPES; ++i)
+    {
+        out << (i ? "," : "") << "\"" << pruneTypeNames[i] << "\":" << searchStats.pruned[i];
+    }
+
+    out << "},\"nodesAtPly\":[";
+    for(uint64_t ply = 0; ply < searchStats.selDepth && ply < STATS_MAX_PLY; ++ply)
+    {
+        out << (ply ? "," : "") << searchStats.nodesAtPly[ply];
+    }
+
+    out << "],\"iterationNodes\":[";
+    for(uint64_t d = 1; d <= searchStats.depth; ++d)
+    {
+        out << (d > 1 ? "," : "") << searchStats.iterationNodes[d];
+    }
+    out << "]}";
+}
@@ -0,0 +1,135 @@
+/* This file is responsible for static exchange evaluation of captures */
+
+#include <algorithm>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "chessboard.h"
+#include "attacks.h"
+#include "see.h"
+
+// Most captures an exchange on one square can take, one for every piece
+#define SEE_MAX_CAPTURES 32
+
+static const int32_t seeValues[NUM_PIECE_TYPES/2] =
+{
+    SEE_PAWN_VALUE, SEE_ROOK_VALUE, SEE_BISHOP_VALUE, SEE_KNIGHT_VALUE, SEE_QUEEN_VALUE, SEE_KING_VALUE
+};
+
+// The order attackers join an exchange in, cheapest first
+static const uint8_t seeAttackerOrder[NUM_PIECE_TYPES/2] =
+{
+    WHITE_PAWN, WHITE_KNIGHT, WHITE_BISHOP, WHITE_ROOK, WHITE_QUEEN, WHITE_KING
+};
+
+/**
+ * @return  The value of a piece type of either color in an exchange
+ */
+int32_t See_PieceValue(uint8_t pt)
+{
+    return seeValues[pt % (NUM_PIECE_TYPES/2)];
+}
+
+/**
+ * Works out what a capture wins or loses once every piece bearing on the
+ * square has had its turn to recapture, each side always recapturing with its
+ * cheapest piece and free to stop when carrying on would lose more. Pieces
+ * which join in are taken out of the occupancy, so sliders lined up behind
+ * them are found on the next look at the attackers.
+ *
+ * @param cb:       The position the move is played from
+ * @param move:     The capture, or promotion, to assess
+ *
+ * @return  The material the moving side comes out with, negative if it loses
+ */
+int32_t See_Evaluate(ChessBoard *cb, const moveType_t *move)
+{
+    const uint64_t *pieces = cb->GetPieces();
+    uint64_t occupied = cb->GetOccupied(), attackers, fromMask, candidates;
+    int32_t gain[SEE_MAX_CAPTURES], onSquare;
+    uint8_t target = move->endIdx, colorBase, depth = 0;
+    bool white = move->pt < NUM_PIECE_TYPES/2;
+
+    // The first capture is the move itself, whatever piece it uses
+    gain[0] = 0;
+    if(move->enPassant)
+    {
+        gain[0] = SEE_PAWN_VALUE;
+        occupied ^= (uint64_t) 1 << (white ? target - 8 : target + 8);
+    }
+    else if(occupied & ((uint64_t) 1 << target))
+    {
+        for(uint8_t pt = white ? BLACK_PAWN : WHITE_PAWN; pt < (white ? NUM_PIECE_TYPES : NUM_PIECE_TYPES/2); ++pt)
+        {
+            if(pieces[pt] & ((uint64_t) 1 << target))
+            {
+                gain[0] = See_PieceValue(pt);
+                break;
+            }
+        }
+    }
+
+    onSquare = See_PieceValue(move->pt);
+    if(move->promotion != PROMOTION_NONE)
+    {
+        gain[0] += seeValues[move->promotion] - SEE_PAWN_VALUE;
+        onSquare = seeValues[move->promotion];
+    }
+
+    fromMask = (uint64_t) 1 << move->startIdx;
+    while(true)
+    {
+        occupied ^= fromMask;
+        white = !white;
+
+        // Anything taken out of the occupancy drops out of the attackers,
+        // and anything it was hiding is found
+        attackers = Attacks_AttackersTo(pieces, occupied, target);
+        colorBase = white ? WHITE_PAWN : BLACK_PAWN;
+
+        fromMask = 0;
+        for(uint8_t i = 0; i < NUM_PIECE_TYPES/2; ++i)
+        {
+            candidates = attackers & pieces[colorBase + seeAttackerOrder[i]];
+            if(candidates != 0)
+            {
+                fromMask = candidates & (~candidates + 1);
+                break;
+            }
+        }
+
+        if(fromMask == 0 || depth + 1 >= SEE_MAX_CAPTURES)
+        {
+            break;
+        }
+
+        // Taking back wins whatever stands on the square, less what we had
+        // gained so far from the other side's point of view
+        ++depth;
+        gain[depth] = onSquare - gain[depth - 1];
+
+        // Whether this side takes back or not it is behind, so the other side
+        // keeps what it had and the exchange needs no further look
+        if(std::max(-gain[depth - 1], gain[depth]) < 0)
+        {
+            --depth;
+            break;
+        }
+
+        for(uint8_t pt = colorBase; pt < colorBase + NUM_PIECE_TYPES/2; ++pt)
+        {
+            if(pieces[pt] & fromMask)
+            {
+                onSquare = See_PieceValue(pt);
+                break;
+            }
+        }
+    }
+
+    // Each side only carries on with the exchange while it pays to
+    while(depth > 0)
+    {
+        gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+        --depth;
+    }
+    return gain[0];
+}
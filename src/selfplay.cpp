@@ -0,0 +1,367 @@
+/* This file is responsible for generating training data by having the engine play itself */
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "chessboard.h"
+#include "search_stats.h"
+#include "transposition.h"
+#include "packed_position.h"
+#include "packed_file.h"
+#include "selfplay.h"
+
+// Deepest iteration searched, the node limit normally ends the search well before
+#define SELFPLAY_MAX_DEPTH          64
+
+// Games still going after this many plies are called drawn
+#define SELFPLAY_MAX_PLIES          400
+
+// A game is over once the search gives one side this much for this many plies in a row
+#define SELFPLAY_RESIGN_SCORE       2000
+#define SELFPLAY_RESIGN_PLIES       6
+
+// Progress is reported every so many games
+#define SELFPLAY_REPORT_GAMES       100
+
+/**
+ * State shared between the game threads. Each thread plays whole games on
+ * its own board and tables, and only takes the lock to add a finished game
+ * to the output.
+ */
+typedef struct selfPlayShared_s
+{
+    const selfPlayConfig_t *config;
+    uint64_t numThreads;
+    uint64_t numStartRecords;           // Already in the output when the run started
+    std::chrono::steady_clock::time_point startTime;
+
+    std::mutex writerLock;
+    packedWriter_t writer;
+    uint64_t numGames;
+    uint64_t results[3];                // Black wins, draws and white wins
+    std::atomic<bool> done;
+} selfPlayShared_t;
+
+/**
+ * Fills in the settings used when none are given
+ *
+ * @param config:   The settings to fill in
+ */
+void SelfPlay_DefaultConfig(selfPlayConfig_t *config)
+{
+    config->numPositions = SELFPLAY_DEFAULT_POSITIONS;
+    config->numThreads = 0;
+    config->nodesPerMove = SELFPLAY_DEFAULT_NODES;
+    config->randomPlies = SELFPLAY_DEFAULT_RANDOM_PLIES;
+    config->hashMb = SELFPLAY_DEFAULT_HASH_MB;
+    config->seed = 1;
+}
+
+/**
+ * Generates the moves of the side to move, leaving out any which would leave
+ * its king in check
+ *
+ * @param cb:       The position
+ * @param numMoves: Where to store the number of moves
+ *
+ * @return  The move list, to be freed with FreeMoveList
+ */
+static moveType_t *SelfPlay_GenerateLegalMoves(ChessBoard *cb, uint64_t *numMoves)
+{
+    moveType_t *moves = cb->GenerateMoves(cb->GetColorToMove()), **link = &moves, *move;
+
+    *numMoves = 0;
+    while((*link)->legalMove)
+    {
+        move = *link;
+        if(!cb->IsMoveLegal(move))
+        {
+            *link = move->adjMove;
+            delete move;
+            continue;
+        }
+
+        ++(*numMoves);
+        link = &move->adjMove;
+    }
+    return moves;
+}
+
+/**
+ * Searches the position with iterative deepening until the node limit
+ * interrupts an iteration, keeping the result of the last one completed
+ *
+ * @param cb:           The position
+ * @param rootMoves:    Its legal moves, at least one
+ * @param maxNodes:     Nodes the search may visit
+ * @param bestMove:     Where to store the move to play
+ *
+ * @return  The score of the move, positive in white's favour
+ */
+static int32_t SelfPlay_Search(ChessBoard *cb, moveType_t *rootMoves, uint64_t maxNodes, moveType_t *bestMove)
+{
+    int32_t score, value;
+
+    // Too small a limit may not even finish the first iteration
+    *bestMove = *rootMoves;
+    score = (int32_t) ChessBoard::EvaluateCurrentBoardValue(cb);
+
+    Search_NewSearch();
+    SearchStats_Reset();
+    Search_SetNodeLimit(maxNodes);
+    for(uint64_t depth = 1; depth <= SELFPLAY_MAX_DEPTH; ++depth)
+    {
+        value = cb->SearchFromRoot(depth, rootMoves);
+        if(Search_WasAborted() || cb->GetAddrOfBestMove() == NULL)
+        {
+            break;
+        }
+
+        score = value;
+        *bestMove = *(cb->GetAddrOfBestMove());
+    }
+    Search_SetNodeLimit(0);
+
+    return score;
+}
+
+/**
+ * Plays one game from the standard start position, opening with random
+ * moves and then searching every move. Positions are kept where the side to
+ * move is not in check and the move found is quiet, so the score is one the
+ * evaluation can be expected to reach on its own.
+ *
+ * @param cb:           A board to play on
+ * @param config:       How to play
+ * @param rng:          Random number generator of the thread
+ * @param positions:    Where to store the positions kept, with the result of the game
+ *
+ * @return  The result of the game, see PACKED_RESULT_*
+ */
+static int8_t SelfPlay_PlayGame(ChessBoard *cb, const selfPlayConfig_t *config, std::mt19937_64 &rng,
+                              std::vector<packedPosition_t> *positions)
+{
+    moveType_t *moves, *move, bestMove;
+    packedPosition_t record;
+    uint64_t numMoves, numRandomPlies = config->randomPlies + (rng() & 1), ply, resignPlies = 0;
+    int32_t score, lastScore = 0;
+    int8_t result = PACKED_RESULT_DRAW;
+    uint8_t us;
+    bool quiet;
+
+    positions->clear();
+    cb->SetBoardFromFEN(START_POSITION_FEN);
+
+    // Nothing learnt in the last game carries over
+    Search_ClearHistory();
+
+    for(ply = 0; ; ++ply)
+    {
+        us = cb->GetColorToMove();
+        moves = SelfPlay_GenerateLegalMoves(cb, &numMoves);
+
+        if(numMoves == 0)
+        {
+            if(cb->IsInCheck(us))
+            {
+                result = (us == WHITE_PIECES) ? PACKED_RESULT_BLACK_WIN : PACKED_RESULT_WHITE_WIN;
+            }
+            FreeMoveList(moves);
+            break;
+        }
+        if(cb->IsDrawByRule() || __builtin_popcountll(cb->GetOccupied()) == 2 || ply >= SELFPLAY_MAX_PLIES)
+        {
+            FreeMoveList(moves);
+            break;
+        }
+
+        if(ply < numRandomPlies)
+        {
+            move = moves;
+            for(uint64_t i = rng() % numMoves; i > 0; --i)
+            {
+                move = move->adjMove;
+            }
+            bestMove = *move;
+        }
+        else
+        {
+            score = SelfPlay_Search(cb, moves, config->nodesPerMove, &bestMove);
+
+            quiet = !cb->IsInCheck(us) && !bestMove.enPassant && bestMove.promotion == PROMOTION_NONE
+                && (cb->GetOccupied() & ((uint64_t) 1 << bestMove.endIdx)) == 0;
+            if(quiet && std::abs(score) < PACKED_SCORE_MAX
+                && PackedPosition_Pack(cb, score, PACKED_RESULT_DRAW, (uint16_t) ply, &record) == STATUS_SUCCESS)
+            {
+                positions->push_back(record);
+            }
+
+            // Both sides agreeing for long enough settles it
+            resignPlies = (std::abs(score) >= SELFPLAY_RESIGN_SCORE && (score > 0) == (lastScore > 0))
+                        ? resignPlies + 1 : 0;
+            lastScore = score;
+            if(resignPlies >= SELFPLAY_RESIGN_PLIES)
+            {
+                result = (score > 0) ? PACKED_RESULT_WHITE_WIN : PACKED_RESULT_BLACK_WIN;
+                FreeMoveList(moves);
+                break;
+            }
+        }
+
+        FreeMoveList(moves);
+        cb->ApplyMoveToBoard(&bestMove);
+    }
+
+    for(size_t i = 0; i < positions->size(); ++i)
+    {
+        (*positions)[i].result = result;
+    }
+    return result;
+}
+
+/**
+ * Plays games until the output holds enough positions, adding each to the
+ * output as it finishes
+ *
+ * @param shared:       State shared between the game threads
+ * @param threadIdx:    Which of the threads this is
+ */
+static void SelfPlay_PlayGames(selfPlayShared_t *shared, uint64_t threadIdx)
+{
+    const selfPlayConfig_t *config = shared->config;
+    ChessBoard *cb = new ChessBoard();
+    std::vector<packedPosition_t> positions;
+    std::seed_seq seed{ config->seed, shared->numStartRecords, threadIdx };
+    std::mt19937_64 rng(seed);
+    uint64_t numPositions, elapsedMs;
+    int8_t result;
+
+    // The table belongs to this thread alone, as does the rest of the search
+    if(TT_Resize(config->hashMb) != STATUS_SUCCESS)
+    {
+        shared->done = true;
+        delete cb;
+        return;
+    }
+
+    while(!shared->done)
+    {
+        result = SelfPlay_PlayGame(cb, config, rng, &positions);
+
+        std::lock_guard<std::mutex> lock(shared->writerLock);
+
+        // Another thread may have finished the run while this game went on
+        if(shared->done)
+        {
+            break;
+        }
+
+        for(size_t i = 0; i < positions.size(); ++i)
+        {
+            PackedFile_Write(&shared->writer, &positions[i]);
+        }
+
+        // Whole games reach the file, so a stopped run only loses those being played
+        PackedFile_Flush(&shared->writer);
+        shared->numGames++;
+        shared->results[result - PACKED_RESULT_BLACK_WIN]++;
+
+        numPositions = shared->writer.numRecords - shared->numStartRecords;
+        if(shared->writer.failed || shared->writer.numRecords >= config->numPositions)
+        {
+            shared->done = true;
+        }
+
+        if(shared->numGames % SELFPLAY_REPORT_GAMES == 0 || shared->done)
+        {
+            elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::steady_clock::now() - shared->startTime).count();
+            elapsedMs = std::max((uint64_t) 1, elapsedMs);
+            std::cout << "Games: " << shared->numGames
+                      << " (+" << shared->results[2] << " =" << shared->results[1] << " -" << shared->results[0] << ")"
+                      << " Positions: " << shared->writer.numRecords << "/" << config->numPositions
+                      << " Positions/s: " << numPositions*1000/elapsedMs
+                      << " Per thread: " << numPositions*1000/elapsedMs/shared->numThreads << std::endl;
+        }
+    }
+
+    TT_Free();
+    delete cb;
+}
+
+/**
+ * Generates training data by having the engine play itself, one game on each
+ * thread with a board, transposition table and search state of its own.
+ * Each move is searched to a fixed number of nodes, so the data does not
+ * depend on the speed of the machine, and the quiet positions met are
+ * recorded with their scores and the result of the game. The output is
+ * added to rather than replaced, so a run which was stopped picks up where
+ * it left off when started again.
+ *
+ * @param outPath:  The packed position file to add to
+ * @param config:   How to generate the data
+ *
+ * @return  STATUS_SUCCESS if the output holds the positions asked for, STATUS_FAIL otherwise
+ */
+uint64_t SelfPlay_Generate(std::string outPath, selfPlayConfig_t *config)
+{
+    selfPlayShared_t shared;
+    std::vector<std::thread> threads;
+    uint64_t status;
+
+    Util_Assert(config != NULL, "NULL config given to SelfPlay_Generate");
+
+    if(PackedFile_OpenWriter(&shared.writer, outPath, true) != STATUS_SUCCESS)
+    {
+        return STATUS_FAIL;
+    }
+
+    shared.config = config;
+    shared.numThreads = config->numThreads ? config->numThreads : std::thread::hardware_concurrency();
+    shared.numThreads = std::max((uint64_t) 1, shared.numThreads);
+    shared.numStartRecords = shared.writer.numRecords;
+    shared.startTime = std::chrono::steady_clock::now();
+    shared.numGames = 0;
+    shared.results[0] = shared.results[1] = shared.results[2] = 0;
+    shared.done = shared.numStartRecords >= config->numPositions;
+
+    if(shared.done)
+    {
+        std::cout << outPath << " already holds " << shared.numStartRecords << " positions" << std::endl;
+        return PackedFile_CloseWriter(&shared.writer);
+    }
+    if(shared.numStartRecords > 0)
+    {
+        std::cout << "Resuming with " << shared.numStartRecords << " positions in " << outPath << std::endl;
+    }
+    std::cout << "Playing with " << shared.numThreads << " threads at " << config->nodesPerMove
+              << " nodes per move" << std::endl;
+
+    for(uint64_t i = 0; i < shared.numThreads; ++i)
+    {
+        threads.emplace_back(SelfPlay_PlayGames, &shared, i);
+    }
+    for(uint64_t i = 0; i < shared.numThreads; ++i)
+    {
+        threads[i].join();
+    }
+
+    status = PackedFile_CloseWriter(&shared.writer);
+    if(status != STATUS_SUCCESS)
+    {
+        std::cout << "Unable to write " << outPath << std::endl;
+    }
+    else if(shared.writer.numRecords < config->numPositions)
+    {
+        status = STATUS_FAIL;
+    }
+    return status;
+}
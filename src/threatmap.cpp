@@ -8,6 +8,7 @@
 #include "threatmap.h"
 #include "chessboard_defs.h"
 #include "chessboard.h"
+#include "trace.h"
 
 /**
  * Some thoughts:
@@ -40,11 +41,11 @@ static threatFunc_t threatJumpTable[NUM_PIECE_TYPES] =
  * Fourth level: Smart pointer to threat structure
  */
 
-// Our persistent threat map for the life of the program. Index 0 is the current state.
-static std::array<std::array<threatMapIndexList_t, NUM_BOARD_INDICES>, SEARCH_DEPTH + 1> threatMap;
+// Our persistent threat map for the life of the thread. Index 0 is the current state.
+static thread_local std::array<std::array<threatMapIndexList_t, NUM_BOARD_INDICES>, SEARCH_DEPTH + 1> threatMap;
 
 // Variable to keep track of search depth during traversal
-static uint8_t currentSearchDepth = 0;
+static thread_local uint8_t currentSearchDepth = 0;
 
 /**
  * Removes a provided threat from the threatmap
@@ -541,6 +542,7 @@ void ThreatMap_Generate(uint64_t *pieces, uint64_t occupied)
  */
 void ThreatMap_Update(moveType_t *moveApplied, uint64_t *pieces, uint64_t occupied, bool realMove)
 {
+    TRACE_SCOPE(TRACE_THREATMAP_UPDATE);
     uint64_t passThroughThreatMask, shift = 1;
 
     Util_Assert(moveApplied != NULL, "Move passed to threatmap update was NULL!");
@@ -644,7 +646,7 @@ void ThreatMap_Update(moveType_t *moveApplied, uint64_t *pieces, uint64_t occupi
  */
 uint64_t ThreatMap_AttackThroughPiecesTargetingIndex(uint8_t searchDepth, uint8_t idx)
 {
-    uint64_t mask, shift = 1;
+    uint64_t mask = 0, shift = 1;
 
     threatMapIndexList_t::iterator it = threatMap[searchDepth][idx].begin();
     while (it != threatMap[searchDepth][idx].end())
@@ -721,11 +723,11 @@ bool ThreatMap_IsIndexUnderThreat(uint8_t idx, bool whiteThreat)
         // For now, its just the king that uses this function and it does not care
         // which piece is attacking, just that there is a threat. May have come back
         // to this later when refining the search algorithm
-        if((*it)->threatPt < BLACK_PAWN && !whiteThreat)
+        if((*it)->threatPt < BLACK_PAWN && whiteThreat)
         {
             return true;
         }
-        else if((*it)->threatPt >= BLACK_PAWN && whiteThreat)
+        else if((*it)->threatPt >= BLACK_PAWN && !whiteThreat)
         {
             return true;
         }
@@ -762,6 +764,26 @@ void ThreatMap_WipeMap(void)
     currentSearchDepth = 0;
 }
 
+/**
+ * Drops every threat in the map, including the real board state. Used when a
+ * new position is loaded rather than reached by playing moves.
+ */
+void ThreatMap_Clear(void)
+{
+    threatMapIndexList_t::iterator it;
+
+    ThreatMap_WipeMap();
+
+    for(uint8_t j = 0; j < NUM_BOARD_INDICES; ++j)
+    {
+        for(it = threatMap[0][j].begin(); it != threatMap[0][j].end(); ++it)
+        {
+            delete(*it);
+        }
+        threatMap[0][j].clear();
+    }
+}
+
 /**
  * Is the provided king in check.
  * 
@@ -0,0 +1,186 @@
+/* This file is responsible for collecting and writing out hot path traces */
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include "util.h"
+#include "trace.h"
+
+// Rings of every thread which has traced, so they can all be dumped together
+static traceRing_t *traceRings[TRACE_MAX_THREADS];
+static std::atomic<uint64_t> numTraceRings(0);
+
+static thread_local traceRing_t *threadTraceRing = NULL;
+
+// Ring of a thread there was no room for, freed when the thread exits
+static thread_local std::unique_ptr<traceRing_t> untrackedTraceRing;
+
+// TSC and wall clock at the last reset, used to turn ticks into time
+static uint64_t traceStartTsc = 0;
+static std::chrono::steady_clock::time_point traceStartTime;
+
+static const char *traceEventNames[NUM_TRACE_EVENTS] =
+{
+    "Search",
+    "GenerateMoves",
+    "ThreatMap_Update",
+    "EvaluateCurrentBoardValue",
+    "EvaluatePawns",
+    "EvaluatePieceActivity",
+    "ApplyMoveToBoard",
+};
+
+/**
+ * Reads the tick counter the trace points use, whether or not they are compiled in
+ */
+static uint64_t Trace_Now(void)
+{
+#if ENABLE_TRACE
+    return Trace_ReadTsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @return  The ring of the calling thread, created the first time it traces.
+ *          Threads beyond TRACE_MAX_THREADS still get a ring to record to,
+ *          but it is left out of the dumps.
+ */
+traceRing_t *Trace_GetRing(void)
+{
+    uint64_t slot;
+
+    if(__builtin_expect(threadTraceRing != NULL, 1))
+    {
+        return threadTraceRing;
+    }
+
+    slot = numTraceRings.fetch_add(1);
+
+    if(slot < TRACE_MAX_THREADS)
+    {
+        threadTraceRing = new traceRing_t();
+        traceRings[slot] = threadTraceRing;
+    }
+    else
+    {
+        untrackedTraceRing.reset(new traceRing_t());
+        threadTraceRing = untrackedTraceRing.get();
+    }
+    threadTraceRing->threadId = slot + 1;
+    return threadTraceRing;
+}
+
+/**
+ * Throws away everything recorded so far and restarts the trace clock. Only
+ * to be called while no thread is searching.
+ */
+void Trace_Reset(void)
+{
+    uint64_t numRings = std::min(numTraceRings.load(), (uint64_t) TRACE_MAX_THREADS);
+
+    for(uint64_t i = 0; i < numRings; ++i)
+    {
+        traceRings[i]->head = 0;
+        memset(traceRings[i]->totalTsc, 0, sizeof(traceRings[i]->totalTsc));
+        memset(traceRings[i]->totalCount, 0, sizeof(traceRings[i]->totalCount));
+    }
+
+    traceStartTsc = Trace_Now();
+    traceStartTime = std::chrono::steady_clock::now();
+}
+
+/**
+ * @return  TSC ticks per microsecond, measured across the time since the last reset
+ */
+static double Trace_GetTicksPerUs(void)
+{
+    uint64_t elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - traceStartTime).count();
+
+    if(elapsedUs == 0 || Trace_Now() <= traceStartTsc)
+    {
+        return 1.0;
+    }
+    return (double) (Trace_Now() - traceStartTsc) / elapsedUs;
+}
+
+/**
+ * Writes every record still held in the rings out in the Chrome trace event
+ * format, which chrome://tracing and Perfetto can load directly. Only to be
+ * called while no thread is searching.
+ *
+ * @param path:     File to write the trace to
+ *
+ * @return  STATUS_SUCCESS if the trace was written, STATUS_FAIL otherwise
+ */
+uint64_t Trace_DumpChromeJson(std::string path)
+{
+    std::ofstream out(path);
+    uint64_t numRings = std::min(numTraceRings.load(), (uint64_t) TRACE_MAX_THREADS);
+    uint64_t first;
+    double ticksPerUs = Trace_GetTicksPerUs();
+    traceRecord_t *record;
+    bool firstEvent = true;
+
+    if(!out.is_open())
+    {
+        std::cout << "Unable to open trace file " << path << std::endl;
+        return STATUS_FAIL;
+    }
+
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for(uint64_t i = 0; i < numRings; ++i)
+    {
+        // Once the ring has wrapped only the newest records are left
+        first = (traceRings[i]->head > TRACE_RING_SIZE) ? traceRings[i]->head - TRACE_RING_SIZE : 0;
+        for(uint64_t r = first; r < traceRings[i]->head; ++r)
+        {
+            record = &traceRings[i]->records[r & (TRACE_RING_SIZE - 1)];
+            out << (firstEvent ? "\n" : ",\n")
+                << "{\"name\":\"" << traceEventNames[record->event] << "\""
+                << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << traceRings[i]->threadId
+                << ",\"ts\":" << (record->startTsc - traceStartTsc) / ticksPerUs
+                << ",\"dur\":" << record->durationTsc / ticksPerUs << "}";
+            firstEvent = false;
+        }
+    }
+    out << "\n]}" << std::endl;
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Writes out the time spent in each traced phase, summed over every thread.
+ * Phases nest, so the time of a phase includes the phases called from it.
+ *
+ * @param out:  Where to write the summary to
+ */
+void Trace_PrintSummary(std::ostream &out)
+{
+    uint64_t numRings = std::min(numTraceRings.load(), (uint64_t) TRACE_MAX_THREADS);
+    uint64_t totalTsc, totalCount;
+    double ticksPerUs = Trace_GetTicksPerUs();
+
+    for(uint8_t e = 0; e < NUM_TRACE_EVENTS; ++e)
+    {
+        totalTsc = 0;
+        totalCount = 0;
+        for(uint64_t i = 0; i < numRings; ++i)
+        {
+            totalTsc += traceRings[i]->totalTsc[e];
+            totalCount += traceRings[i]->totalCount[e];
+        }
+
+        out << traceEventNames[e]
+            << " calls: " << totalCount
+            << " total (ms): " << totalTsc / ticksPerUs / 1000
+            << " per call (ns): " << (totalCount ? totalTsc / ticksPerUs * 1000 / totalCount : 0.0)
+            << std::endl;
+    }
+}
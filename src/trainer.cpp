@@ -0,0 +1,789 @@
+/* This file is responsible for training the evaluation network from packed positions */
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <thread>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+#include <limits>
+#include <cstring>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "packed_position.h"
+#include "packed_file.h"
+#include "nnue.h"
+#include "trainer.h"
+
+/**
+ * The network is trained in floating point with activations clipped to
+ * [0, 1], which the engine holds as [0, NNUE_ACTIVATION_MAX]. Its output
+ * times TRAINER_OUTPUT_CP is the score in centipawns for the side to move.
+ */
+#define TRAINER_OUTPUT_CP       400.0f
+
+// What each layer's weights are multiplied by to quantise them
+#define TRAINER_FEATURE_SCALE   ((float) NNUE_ACTIVATION_MAX)
+#define TRAINER_HIDDEN_SCALE    ((float) (1 << NNUE_WEIGHT_SHIFT))
+#define TRAINER_OUTPUT_SCALE    (TRAINER_OUTPUT_CP * NNUE_OUTPUT_SCALE / NNUE_ACTIVATION_MAX)
+
+// Largest weights each layer can take and still fit its quantised type. The
+// first layer is kept to what a full board can sum without overflowing int16.
+#define TRAINER_FEATURE_MAX     (INT16_MAX / (TRAINER_FEATURE_SCALE * (PACKED_MAX_PIECES + 1)))
+#define TRAINER_HIDDEN_MAX      (INT8_MAX / TRAINER_HIDDEN_SCALE)
+#define TRAINER_OUTPUT_MAX      (INT8_MAX / TRAINER_OUTPUT_SCALE)
+
+// Range of the starting first layer weights, the biases start mid activation
+#define TRAINER_INIT_FEATURE    0.1f
+#define TRAINER_INIT_BIAS       0.5f
+
+#define TRAINER_ADAM_BETA1      0.9
+#define TRAINER_ADAM_BETA2      0.999
+#define TRAINER_ADAM_EPSILON    1e-8f
+
+// Where each layer sits among the parameters, in the order of the network file
+#define TRAINER_FT_WEIGHTS      ((uint64_t) 0)
+#define TRAINER_FT_BIASES       (TRAINER_FT_WEIGHTS + (uint64_t) NNUE_NUM_FEATURES * NNUE_HALF_DIMS)
+#define TRAINER_H1_WEIGHTS      (TRAINER_FT_BIASES + NNUE_HALF_DIMS)
+#define TRAINER_H1_BIASES       (TRAINER_H1_WEIGHTS + NNUE_HIDDEN_DIMS * 2 * NNUE_HALF_DIMS)
+#define TRAINER_H2_WEIGHTS      (TRAINER_H1_BIASES + NNUE_HIDDEN_DIMS)
+#define TRAINER_H2_BIASES       (TRAINER_H2_WEIGHTS + NNUE_HIDDEN_DIMS * NNUE_HIDDEN_DIMS)
+#define TRAINER_OUT_WEIGHTS     (TRAINER_H2_BIASES + NNUE_HIDDEN_DIMS)
+#define TRAINER_OUT_BIAS        (TRAINER_OUT_WEIGHTS + NNUE_HIDDEN_DIMS)
+#define TRAINER_NUM_PARAMS      (TRAINER_OUT_BIAS + 1)
+
+// Everything after the first layer weights is small enough for each thread
+// to keep its own gradient of, the first layer weights are only ever touched
+// a few rows at a time
+#define TRAINER_DENSE_PARAMS    (TRAINER_NUM_PARAMS - TRAINER_FT_BIASES)
+
+/**
+ * A position decoded to the inputs it feeds on each side, and the value it
+ * should have for the side to move
+ */
+typedef struct trainerSample_s
+{
+    uint32_t features[2][PACKED_MAX_PIECES];
+    uint8_t numFeatures[2];
+    uint8_t us;             // 0 if white is to move
+    float target;
+} trainerSample_t;
+
+/**
+ * The parameters being trained with their Adam moments
+ */
+typedef struct trainerModel_s
+{
+    std::vector<float> params;
+    std::vector<float> adamM;
+    std::vector<float> adamV;
+
+    // First layer gradient of the current batch, only the rows in use are
+    // ever nonzero, and each row belongs to one thread
+    std::vector<float> featureGrads;
+    std::vector<uint8_t> featureTouched;
+
+    uint64_t step;
+} trainerModel_t;
+
+/**
+ * What each thread keeps to itself while working through a batch
+ */
+typedef struct trainerWorker_s
+{
+    std::vector<float> denseGrads;      // [TRAINER_DENSE_PARAMS]
+    std::vector<uint32_t> touched;      // First layer rows it owns in use this batch
+    double loss;
+} trainerWorker_t;
+
+/**
+ * A batch being worked on. Each thread decodes and runs its own slice of the
+ * positions, then updates the first layer rows it owns.
+ */
+typedef struct trainerShared_s
+{
+    trainerModel_t *model;
+    const trainerConfig_t *config;
+    const packedPosition_t *records;
+    uint64_t numRecords;
+    uint64_t numThreads;
+    trainerSample_t *samples;
+    float *accGrads;                    // [numRecords][2][NNUE_HALF_DIMS], white's half first
+    trainerWorker_t *workers;
+    float stepSize;
+} trainerShared_t;
+
+/**
+ * Streams records from the data files one after another
+ */
+typedef struct trainerReader_s
+{
+    const std::vector<std::string> *paths;
+    uint64_t nextFile;
+    packedReader_t file;
+    bool failed;
+} trainerReader_t;
+
+/**
+ * Fills in the settings used when none are given
+ *
+ * @param config:   The settings to fill in
+ */
+void Trainer_DefaultConfig(trainerConfig_t *config)
+{
+    config->epochs = TRAINER_DEFAULT_EPOCHS;
+    config->batchSize = TRAINER_DEFAULT_BATCH_SIZE;
+    config->numThreads = 0;
+    config->learningRate = TRAINER_DEFAULT_LEARNING_RATE;
+    config->lambda = TRAINER_DEFAULT_LAMBDA;
+    config->scoreScale = TRAINER_DEFAULT_SCORE_SCALE;
+    config->seed = 1;
+}
+
+static inline float Trainer_Sigmoid(float x)
+{
+    return 1.0f / (1.0f + std::exp(-x));
+}
+
+static inline float Trainer_Clip(float x)
+{
+    return std::clamp(x, 0.0f, 1.0f);
+}
+
+static inline bool Trainer_IsLinear(float x)
+{
+    return x > 0.0f && x < 1.0f;
+}
+
+/**
+ * Starts the network off with small random weights
+ */
+static void Trainer_InitModel(trainerModel_t *model, uint64_t seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> features(-TRAINER_INIT_FEATURE, TRAINER_INIT_FEATURE);
+    std::uniform_real_distribution<float> hidden1(-std::sqrt(6.0f / (2*NNUE_HALF_DIMS + NNUE_HIDDEN_DIMS)),
+                                                  std::sqrt(6.0f / (2*NNUE_HALF_DIMS + NNUE_HIDDEN_DIMS)));
+    std::uniform_real_distribution<float> hidden2(-std::sqrt(6.0f / (2*NNUE_HIDDEN_DIMS)),
+                                                  std::sqrt(6.0f / (2*NNUE_HIDDEN_DIMS)));
+    std::uniform_real_distribution<float> output(-std::sqrt(6.0f / (NNUE_HIDDEN_DIMS + 1)),
+                                                 std::sqrt(6.0f / (NNUE_HIDDEN_DIMS + 1)));
+
+    model->params.assign(TRAINER_NUM_PARAMS, 0.0f);
+    model->adamM.assign(TRAINER_NUM_PARAMS, 0.0f);
+    model->adamV.assign(TRAINER_NUM_PARAMS, 0.0f);
+    model->featureGrads.assign(TRAINER_FT_BIASES, 0.0f);
+    model->featureTouched.assign(NNUE_NUM_FEATURES, 0);
+    model->step = 0;
+
+    for(uint64_t i = TRAINER_FT_WEIGHTS; i < TRAINER_FT_BIASES; ++i)
+    {
+        model->params[i] = features(rng);
+    }
+    for(uint64_t i = TRAINER_FT_BIASES; i < TRAINER_H1_WEIGHTS; ++i)
+    {
+        model->params[i] = TRAINER_INIT_BIAS;
+    }
+    for(uint64_t i = TRAINER_H1_WEIGHTS; i < TRAINER_H1_BIASES; ++i)
+    {
+        model->params[i] = std::clamp(hidden1(rng), -TRAINER_HIDDEN_MAX, TRAINER_HIDDEN_MAX);
+    }
+    for(uint64_t i = TRAINER_H2_WEIGHTS; i < TRAINER_H2_BIASES; ++i)
+    {
+        model->params[i] = std::clamp(hidden2(rng), -TRAINER_HIDDEN_MAX, TRAINER_HIDDEN_MAX);
+    }
+    for(uint64_t i = TRAINER_OUT_WEIGHTS; i < TRAINER_OUT_BIAS; ++i)
+    {
+        model->params[i] = std::clamp(output(rng), -TRAINER_OUTPUT_MAX, TRAINER_OUTPUT_MAX);
+    }
+}
+
+/**
+ * Reads up to a batch of records, carrying on into the next file as each
+ * runs out
+ *
+ * @return  The number of records read, 0 once every file has been read
+ */
+static uint64_t Trainer_ReadBatch(trainerReader_t *reader, packedPosition_t *records, uint64_t maxRecords)
+{
+    const packedPosition_t *mapped;
+    uint64_t numRecords = 0, numRead;
+
+    while(numRecords < maxRecords && !reader->failed)
+    {
+        if(reader->file.mapping == NULL)
+        {
+            if(reader->nextFile >= reader->paths->size())
+            {
+                break;
+            }
+
+            if(PackedFile_OpenReader(&reader->file, (*reader->paths)[reader->nextFile]) != STATUS_SUCCESS)
+            {
+                reader->failed = true;
+                break;
+            }
+            reader->nextFile++;
+        }
+
+        numRead = PackedFile_Read(&reader->file, &mapped, maxRecords - numRecords);
+        memcpy(&records[numRecords], mapped, numRead*sizeof(packedPosition_t));
+        numRecords += numRead;
+        if(numRecords < maxRecords)
+        {
+            PackedFile_CloseReader(&reader->file);
+        }
+    }
+
+    return numRecords;
+}
+
+/**
+ * Reads the next batch while the current one trains
+ */
+static void Trainer_LoadBatch(trainerReader_t *reader, packedPosition_t *records, uint64_t maxRecords,
+                              uint64_t *numRecords)
+{
+    *numRecords = Trainer_ReadBatch(reader, records, maxRecords);
+}
+
+/**
+ * Decodes a record to the inputs it feeds on each side, and blends its score
+ * and result into the value it should have for the side to move
+ */
+static void Trainer_Decode(const packedPosition_t *record, const trainerConfig_t *config, trainerSample_t *sample)
+{
+    uint8_t pts[PACKED_MAX_PIECES], idxs[PACKED_MAX_PIECES], kingIdx[2] = { 0, 0 };
+    uint8_t numPieces = PackedPosition_GetPieces(record, pts, idxs);
+    uint32_t feature;
+    float score, result;
+
+    for(uint8_t i = 0; i < numPieces; ++i)
+    {
+        if(pts[i] == WHITE_KING)
+        {
+            kingIdx[0] = idxs[i];
+        }
+        else if(pts[i] == BLACK_KING)
+        {
+            kingIdx[1] = idxs[i];
+        }
+    }
+
+    for(uint8_t side = 0; side < 2; ++side)
+    {
+        sample->numFeatures[side] = 0;
+        for(uint8_t i = 0; i < numPieces; ++i)
+        {
+            feature = Nnue_FeatureIndex(side, kingIdx[side], pts[i] % NUM_PIECE_TYPES, idxs[i]);
+            if(feature != NNUE_NO_FEATURE)
+            {
+                sample->features[side][sample->numFeatures[side]++] = feature;
+            }
+        }
+    }
+
+    sample->us = PACKED_BLACK_TO_MOVE(record) ? 1 : 0;
+    score = sample->us ? -record->score : record->score;
+    result = ((sample->us ? -record->result : record->result) + 1.0f) / 2.0f;
+    sample->target = config->lambda * Trainer_Sigmoid(score / config->scoreScale)
+                   + (1.0 - config->lambda) * result;
+}
+
+/**
+ * Runs a position forward through the network and its error back, adding
+ * to the gradients of the layers after the first and leaving the gradient
+ * of the accumulator for the first layer rows to pick up later
+ *
+ * @param params:       The network
+ * @param sample:       The position
+ * @param outputScale:  What the network output is multiplied by before the sigmoid
+ * @param denseGrads:   Gradients of everything after the first layer weights
+ * @param accGrad:      Where to store the gradient of the accumulator, white's half first
+ *
+ * @return  The squared error of the position
+ */
+static float Trainer_TrainSample(const float *params, const trainerSample_t *sample, float outputScale,
+                                 float *denseGrads, float *accGrad)
+{
+    float acc[2][NNUE_HALF_DIMS], input[2*NNUE_HALF_DIMS], dInput[2*NNUE_HALF_DIMS];
+    float z1[NNUE_HIDDEN_DIMS], h1[NNUE_HIDDEN_DIMS], dh1[NNUE_HIDDEN_DIMS];
+    float z2[NNUE_HIDDEN_DIMS], h2[NNUE_HIDDEN_DIMS];
+    float *grads = denseGrads - TRAINER_FT_BIASES;
+    const float *weights, *row;
+    float output, prediction, error, dOutput, dz;
+    uint8_t us = sample->us;
+
+    // Each side's half of the accumulator from its own inputs
+    for(uint8_t side = 0; side < 2; ++side)
+    {
+        memcpy(acc[side], &params[TRAINER_FT_BIASES], sizeof(acc[side]));
+        for(uint8_t i = 0; i < sample->numFeatures[side]; ++i)
+        {
+            row = &params[TRAINER_FT_WEIGHTS + (uint64_t) sample->features[side][i] * NNUE_HALF_DIMS];
+            for(uint32_t j = 0; j < NNUE_HALF_DIMS; ++j)
+            {
+                acc[side][j] += row[j];
+            }
+        }
+    }
+
+    // The side to move's half goes first, as in the engine
+    for(uint32_t j = 0; j < NNUE_HALF_DIMS; ++j)
+    {
+        input[j] = Trainer_Clip(acc[us][j]);
+        input[NNUE_HALF_DIMS + j] = Trainer_Clip(acc[us ^ 1][j]);
+    }
+
+    for(uint32_t i = 0; i < NNUE_HIDDEN_DIMS; ++i)
+    {
+        weights = &params[TRAINER_H1_WEIGHTS + i * 2*NNUE_HALF_DIMS];
+        z1[i] = params[TRAINER_H1_BIASES + i];
+        for(uint32_t j = 0; j < 2*NNUE_HALF_DIMS; ++j)
+        {
+            z1[i] += weights[j] * input[j];
+        }
+        h1[i] = Trainer_Clip(z1[i]);
+    }
+
+    for(uint32_t i = 0; i < NNUE_HIDDEN_DIMS; ++i)
+    {
+        weights = &params[TRAINER_H2_WEIGHTS + i * NNUE_HIDDEN_DIMS];
+        z2[i] = params[TRAINER_H2_BIASES + i];
+        for(uint32_t j = 0; j < NNUE_HIDDEN_DIMS; ++j)
+        {
+            z2[i] += weights[j] * h1[j];
+        }
+        h2[i] = Trainer_Clip(z2[i]);
+    }
+
+    output = params[TRAINER_OUT_BIAS];
+    for(uint32_t i = 0; i < NNUE_HIDDEN_DIMS; ++i)
+    {
+        output += params[TRAINER_OUT_WEIGHTS + i] * h2[i];
+    }
+
+    prediction = Trainer_Sigmoid(output * outputScale);
+    error = prediction - sample->target;
+    dOutput = 2.0f * error * prediction * (1.0f - prediction) * outputScale;
+
+    // Back through the output
+    grads[TRAINER_OUT_BIAS] += dOutput;
+    memset(dh1, 0, sizeof(dh1));
+    for(uint32_t i = 0; i < NNUE_HIDDEN_DIMS; ++i)
+    {
+        grads[TRAINER_OUT_WEIGHTS + i] += dOutput * h2[i];
+        if(!Trainer_IsLinear(z2[i]))
+        {
+            continue;
+        }
+
+        // And the second hidden layer
+        dz = dOutput * params[TRAINER_OUT_WEIGHTS + i];
+        weights = &params[TRAINER_H2_WEIGHTS + i * NNUE_HIDDEN_DIMS];
+        grads[TRAINER_H2_BIASES + i] += dz;
+        for(uint32_t j = 0; j < NNUE_HIDDEN_DIMS; ++j)
+        {
+            grads[TRAINER_H2_WEIGHTS + i * NNUE_HIDDEN_DIMS + j] += dz * h1[j];
+            dh1[j] += dz * weights[j];
+        }
+    }
+
+    // The first hidden layer, where most of the work is
+    memset(dInput, 0, sizeof(dInput));
+    for(uint32_t i = 0; i < NNUE_HIDDEN_DIMS; ++i)
+    {
+        if(!Trainer_IsLinear(z1[i]) || dh1[i] == 0.0f)
+        {
+            continue;
+        }
+
+        dz = dh1[i];
+        weights = &params[TRAINER_H1_WEIGHTS + i * 2*NNUE_HALF_DIMS];
+        grads[TRAINER_H1_BIASES + i] += dz;
+        for(uint32_t j = 0; j < 2*NNUE_HALF_DIMS; ++j)
+        {
+            grads[TRAINER_H1_WEIGHTS + i * 2*NNUE_HALF_DIMS + j] += dz * input[j];
+            dInput[j] += dz * weights[j];
+        }
+    }
+
+    // Back into the accumulator, each half where it belongs
+    for(uint32_t j = 0; j < NNUE_HALF_DIMS; ++j)
+    {
+        accGrad[us*NNUE_HALF_DIMS + j] = Trainer_IsLinear(acc[us][j]) ? dInput[j] : 0.0f;
+        accGrad[(us ^ 1)*NNUE_HALF_DIMS + j] = Trainer_IsLinear(acc[us ^ 1][j]) ? dInput[NNUE_HALF_DIMS + j] : 0.0f;
+        grads[TRAINER_FT_BIASES + j] += accGrad[j] + accGrad[NNUE_HALF_DIMS + j];
+    }
+
+    return error * error;
+}
+
+/**
+ * Takes an Adam step for a run of parameters
+ *
+ * @param model:    The network
+ * @param offset:   The first parameter
+ * @param grads:    Their gradients, summed over the batch
+ * @param count:    The number of parameters
+ * @param stepSize: The learning rate with the bias correction of this step
+ * @param gradScale:Brings the summed gradients to their mean
+ * @param limit:    Largest magnitude the parameters can take
+ */
+static void Trainer_Adam(trainerModel_t *model, uint64_t offset, const float *grads, uint64_t count,
+                         float stepSize, float gradScale, float limit)
+{
+    float *params = &model->params[offset], *m = &model->adamM[offset], *v = &model->adamV[offset];
+    float grad;
+
+    for(uint64_t i = 0; i < count; ++i)
+    {
+        grad = grads[i] * gradScale;
+        m[i] = TRAINER_ADAM_BETA1 * m[i] + (1.0f - TRAINER_ADAM_BETA1) * grad;
+        v[i] = TRAINER_ADAM_BETA2 * v[i] + (1.0f - TRAINER_ADAM_BETA2) * grad * grad;
+        params[i] = std::clamp(params[i] - stepSize * m[i] / (std::sqrt(v[i]) + TRAINER_ADAM_EPSILON),
+                               -limit, limit);
+    }
+}
+
+/**
+ * First half of a step for one thread: decodes its slice of the batch and
+ * runs it through the network
+ */
+static void Trainer_ForwardThread(trainerShared_t *shared, uint64_t threadIdx)
+{
+    trainerWorker_t *worker = &shared->workers[threadIdx];
+    const float *params = shared->model->params.data();
+    float outputScale = TRAINER_OUTPUT_CP / shared->config->scoreScale;
+    uint64_t start = shared->numRecords * threadIdx / shared->numThreads;
+    uint64_t end = shared->numRecords * (threadIdx + 1) / shared->numThreads;
+
+    worker->loss = 0.0;
+    for(uint64_t i = start; i < end; ++i)
+    {
+        Trainer_Decode(&shared->records[i], shared->config, &shared->samples[i]);
+        worker->loss += Trainer_TrainSample(params, &shared->samples[i], outputScale,
+                                            worker->denseGrads.data(), &shared->accGrads[i * 2*NNUE_HALF_DIMS]);
+    }
+}
+
+/**
+ * Second half of a step for one thread: gathers the gradients of the first
+ * layer rows it owns from the whole batch and updates them. Rows are split
+ * by index, so no two threads ever write the same one.
+ */
+static void Trainer_FeatureThread(trainerShared_t *shared, uint64_t threadIdx)
+{
+    trainerWorker_t *worker = &shared->workers[threadIdx];
+    trainerModel_t *model = shared->model;
+    const trainerSample_t *sample;
+    const float *accGrad;
+    float *row;
+    uint32_t feature;
+
+    for(uint64_t i = 0; i < shared->numRecords; ++i)
+    {
+        sample = &shared->samples[i];
+        for(uint8_t side = 0; side < 2; ++side)
+        {
+            accGrad = &shared->accGrads[(i*2 + side) * NNUE_HALF_DIMS];
+            for(uint8_t k = 0; k < sample->numFeatures[side]; ++k)
+            {
+                feature = sample->features[side][k];
+                if(feature % shared->numThreads != threadIdx)
+                {
+                    continue;
+                }
+
+                if(!model->featureTouched[feature])
+                {
+                    model->featureTouched[feature] = 1;
+                    worker->touched.push_back(feature);
+                }
+
+                row = &model->featureGrads[(uint64_t) feature * NNUE_HALF_DIMS];
+                for(uint32_t j = 0; j < NNUE_HALF_DIMS; ++j)
+                {
+                    row[j] += accGrad[j];
+                }
+            }
+        }
+    }
+
+    // Rows no position used this batch are left alone, moments and all
+    for(size_t i = 0; i < worker->touched.size(); ++i)
+    {
+        row = &model->featureGrads[(uint64_t) worker->touched[i] * NNUE_HALF_DIMS];
+        Trainer_Adam(model, TRAINER_FT_WEIGHTS + (uint64_t) worker->touched[i] * NNUE_HALF_DIMS, row,
+                     NNUE_HALF_DIMS, shared->stepSize, 1.0f / shared->numRecords, TRAINER_FEATURE_MAX);
+        memset(row, 0, NNUE_HALF_DIMS * sizeof(float));
+        model->featureTouched[worker->touched[i]] = 0;
+    }
+    worker->touched.clear();
+}
+
+/**
+ * Trains the network on one batch
+ *
+ * @return  The summed squared error of the batch, before the step
+ */
+static double Trainer_Step(trainerShared_t *shared)
+{
+    std::vector<std::thread> threads;
+    trainerModel_t *model = shared->model;
+    float *grads = shared->workers[0].denseGrads.data();
+    float gradScale = 1.0f / shared->numRecords;
+    double loss = 0.0;
+
+    model->step++;
+    shared->stepSize = shared->config->learningRate
+                     * std::sqrt(1.0 - std::pow(TRAINER_ADAM_BETA2, (double) model->step))
+                     / (1.0 - std::pow(TRAINER_ADAM_BETA1, (double) model->step));
+
+    for(uint64_t i = 0; i < shared->numThreads; ++i)
+    {
+        threads.emplace_back(Trainer_ForwardThread, shared, i);
+    }
+    for(uint64_t i = 0; i < shared->numThreads; ++i)
+    {
+        threads[i].join();
+    }
+    threads.clear();
+
+    for(uint64_t i = 0; i < shared->numThreads; ++i)
+    {
+        threads.emplace_back(Trainer_FeatureThread, shared, i);
+    }
+
+    // The small layers are updated while the first layer rows are
+    for(uint64_t i = 0; i < shared->numThreads; ++i)
+    {
+        loss += shared->workers[i].loss;
+        if(i == 0)
+        {
+            continue;
+        }
+        for(uint64_t j = 0; j < TRAINER_DENSE_PARAMS; ++j)
+        {
+            grads[j] += shared->workers[i].denseGrads[j];
+            shared->workers[i].denseGrads[j] = 0.0f;
+        }
+    }
+
+    grads -= TRAINER_FT_BIASES;
+    Trainer_Adam(model, TRAINER_FT_BIASES, &grads[TRAINER_FT_BIASES], NNUE_HALF_DIMS,
+                 shared->stepSize, gradScale, TRAINER_FEATURE_MAX);
+    Trainer_Adam(model, TRAINER_H1_WEIGHTS, &grads[TRAINER_H1_WEIGHTS], TRAINER_H1_BIASES - TRAINER_H1_WEIGHTS,
+                 shared->stepSize, gradScale, TRAINER_HIDDEN_MAX);
+    Trainer_Adam(model, TRAINER_H1_BIASES, &grads[TRAINER_H1_BIASES], NNUE_HIDDEN_DIMS,
+                 shared->stepSize, gradScale, FLT_MAX);
+    Trainer_Adam(model, TRAINER_H2_WEIGHTS, &grads[TRAINER_H2_WEIGHTS], TRAINER_H2_BIASES - TRAINER_H2_WEIGHTS,
+                 shared->stepSize, gradScale, TRAINER_HIDDEN_MAX);
+    Trainer_Adam(model, TRAINER_H2_BIASES, &grads[TRAINER_H2_BIASES], NNUE_HIDDEN_DIMS,
+                 shared->stepSize, gradScale, FLT_MAX);
+    Trainer_Adam(model, TRAINER_OUT_WEIGHTS, &grads[TRAINER_OUT_WEIGHTS], NNUE_HIDDEN_DIMS,
+                 shared->stepSize, gradScale, TRAINER_OUTPUT_MAX);
+    Trainer_Adam(model, TRAINER_OUT_BIAS, &grads[TRAINER_OUT_BIAS], 1,
+                 shared->stepSize, gradScale, FLT_MAX);
+    memset(&grads[TRAINER_FT_BIASES], 0, TRAINER_DENSE_PARAMS * sizeof(float));
+
+    for(uint64_t i = 0; i < shared->numThreads; ++i)
+    {
+        threads[i].join();
+    }
+
+    return loss;
+}
+
+/**
+ * Writes a section of a network file, padded out to NNUE_FILE_ALIGNMENT
+ */
+static void Trainer_WriteSection(std::ofstream &out, const void *data, uint64_t size)
+{
+    static const char padding[NNUE_FILE_ALIGNMENT] = { 0 };
+
+    out.write((const char *) data, size);
+    out.write(padding, (NNUE_FILE_ALIGNMENT - size % NNUE_FILE_ALIGNMENT) % NNUE_FILE_ALIGNMENT);
+}
+
+/**
+ * Quantises a run of parameters
+ */
+template<typename T>
+static std::vector<T> Trainer_Quantise(const trainerModel_t *model, uint64_t offset, uint64_t count, float scale)
+{
+    std::vector<T> values(count);
+
+    for(uint64_t i = 0; i < count; ++i)
+    {
+        values[i] = (T) std::clamp(std::round((double) model->params[offset + i] * scale),
+                                   (double) std::numeric_limits<T>::min(), (double) std::numeric_limits<T>::max());
+    }
+    return values;
+}
+
+/**
+ * Quantises the network and writes it out in the format Nnue_Load reads
+ *
+ * @return  STATUS_SUCCESS if the network was written, STATUS_FAIL otherwise
+ */
+static uint64_t Trainer_Export(const trainerModel_t *model, std::string outPath)
+{
+    std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+    nnueFileHeader_t header;
+    std::vector<int16_t> features;
+    std::vector<int32_t> biases;
+    std::vector<int8_t> weights;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = NNUE_FILE_MAGIC;
+    header.version = NNUE_FILE_VERSION;
+    header.numFeatures = NNUE_NUM_FEATURES;
+    header.halfDims = NNUE_HALF_DIMS;
+    header.hiddenDims = NNUE_HIDDEN_DIMS;
+    Trainer_WriteSection(out, &header, sizeof(header));
+
+    features = Trainer_Quantise<int16_t>(model, TRAINER_FT_BIASES, NNUE_HALF_DIMS, TRAINER_FEATURE_SCALE);
+    Trainer_WriteSection(out, features.data(), features.size() * sizeof(int16_t));
+    features = Trainer_Quantise<int16_t>(model, TRAINER_FT_WEIGHTS, TRAINER_FT_BIASES - TRAINER_FT_WEIGHTS,
+                                         TRAINER_FEATURE_SCALE);
+    Trainer_WriteSection(out, features.data(), features.size() * sizeof(int16_t));
+
+    // Hidden biases land on the scale of the sums of quantised weights and activations
+    biases = Trainer_Quantise<int32_t>(model, TRAINER_H1_BIASES, NNUE_HIDDEN_DIMS,
+                                       TRAINER_HIDDEN_SCALE * NNUE_ACTIVATION_MAX);
+    Trainer_WriteSection(out, biases.data(), biases.size() * sizeof(int32_t));
+    weights = Trainer_Quantise<int8_t>(model, TRAINER_H1_WEIGHTS, TRAINER_H1_BIASES - TRAINER_H1_WEIGHTS,
+                                       TRAINER_HIDDEN_SCALE);
+    Trainer_WriteSection(out, weights.data(), weights.size());
+
+    biases = Trainer_Quantise<int32_t>(model, TRAINER_H2_BIASES, NNUE_HIDDEN_DIMS,
+                                       TRAINER_HIDDEN_SCALE * NNUE_ACTIVATION_MAX);
+    Trainer_WriteSection(out, biases.data(), biases.size() * sizeof(int32_t));
+    weights = Trainer_Quantise<int8_t>(model, TRAINER_H2_WEIGHTS, TRAINER_H2_BIASES - TRAINER_H2_WEIGHTS,
+                                       TRAINER_HIDDEN_SCALE);
+    Trainer_WriteSection(out, weights.data(), weights.size());
+
+    biases = Trainer_Quantise<int32_t>(model, TRAINER_OUT_BIAS, 1, TRAINER_OUTPUT_SCALE * NNUE_ACTIVATION_MAX);
+    Trainer_WriteSection(out, biases.data(), sizeof(int32_t));
+    weights = Trainer_Quantise<int8_t>(model, TRAINER_OUT_WEIGHTS, NNUE_HIDDEN_DIMS, TRAINER_OUTPUT_SCALE);
+    Trainer_WriteSection(out, weights.data(), weights.size());
+
+    if(!out.good())
+    {
+        std::cout << "Unable to write " << outPath << std::endl;
+        return STATUS_FAIL;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Trains a network from files of packed positions and writes it out in the
+ * engine's network format after every epoch. The next batch is read in the
+ * background while the current one trains, and each batch is decoded and
+ * run by all the threads together.
+ *
+ * @param dataPaths:    Files of packedPosition_t records
+ * @param outPath:      Where to write the network
+ * @param config:       How to train
+ *
+ * @return  STATUS_SUCCESS if the network was written, STATUS_FAIL otherwise
+ */
+uint64_t Trainer_Train(std::vector<std::string> dataPaths, std::string outPath, trainerConfig_t *config)
+{
+    std::vector<packedPosition_t> records[2];
+    std::vector<trainerSample_t> samples;
+    std::vector<trainerWorker_t> workers;
+    std::vector<float> accGrads;
+    std::chrono::steady_clock::time_point startTime;
+    trainerModel_t *model;
+    trainerReader_t reader;
+    trainerShared_t shared;
+    std::thread loader;
+    uint64_t numRecords[2], numThreads, numPositions, elapsedMs, current;
+    double loss;
+
+    Util_Assert(config != NULL, "NULL config given to Trainer_Train");
+
+    numThreads = config->numThreads ? config->numThreads : std::thread::hardware_concurrency();
+    numThreads = std::max((uint64_t) 1, numThreads);
+    config->batchSize = std::max((uint64_t) 1, config->batchSize);
+
+    model = new trainerModel_t;
+    Trainer_InitModel(model, config->seed);
+
+    records[0].resize(config->batchSize);
+    records[1].resize(config->batchSize);
+    samples.resize(config->batchSize);
+    accGrads.resize(config->batchSize * 2*NNUE_HALF_DIMS);
+    workers.resize(numThreads);
+    for(uint64_t i = 0; i < numThreads; ++i)
+    {
+        workers[i].denseGrads.assign(TRAINER_DENSE_PARAMS, 0.0f);
+    }
+
+    shared.model = model;
+    shared.config = config;
+    shared.numThreads = numThreads;
+    shared.samples = samples.data();
+    shared.accGrads = accGrads.data();
+    shared.workers = workers.data();
+
+    reader.paths = &dataPaths;
+    reader.file.mapping = NULL;
+    reader.failed = false;
+
+    std::cout << "Training on " << dataPaths.size() << " files with " << numThreads << " threads" << std::endl;
+
+    for(uint64_t epoch = 1; epoch <= config->epochs; ++epoch)
+    {
+        startTime = std::chrono::steady_clock::now();
+        reader.nextFile = 0;
+        numPositions = 0;
+        loss = 0.0;
+        current = 0;
+
+        numRecords[current] = Trainer_ReadBatch(&reader, records[current].data(), config->batchSize);
+        while(numRecords[current] > 0)
+        {
+            loader = std::thread(Trainer_LoadBatch, &reader, records[current ^ 1].data(), config->batchSize,
+                                 &numRecords[current ^ 1]);
+
+            shared.records = records[current].data();
+            shared.numRecords = numRecords[current];
+            loss += Trainer_Step(&shared);
+            numPositions += numRecords[current];
+
+            loader.join();
+            current ^= 1;
+        }
+
+        if(reader.failed || numPositions == 0)
+        {
+            if(numPositions == 0 && !reader.failed)
+            {
+                std::cout << "No positions to train on" << std::endl;
+            }
+            delete model;
+            return STATUS_FAIL;
+        }
+
+        elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - startTime).count();
+        std::cout << "Epoch " << epoch << ": loss " << loss / numPositions << " over " << numPositions
+                  << " positions, " << numPositions * 1000 / std::max((uint64_t) 1, elapsedMs)
+                  << " positions/s" << std::endl;
+
+        if(Trainer_Export(model, outPath) != STATUS_SUCCESS)
+        {
+            delete model;
+            return STATUS_FAIL;
+        }
+    }
+
+    std::cout << "Wrote " << outPath << std::endl;
+    delete model;
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,448 @@
+/* This file is responsible for the transposition table shared by every search of a game */
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "transposition.h"
+
+// Marks a saved table, the version changes whenever the entry layout does
+#define TT_FILE_MAGIC           "CRTT0001"
+
+/**
+ * Written ahead of the buckets in a saved table. It is padded out to a whole
+ * bucket so the buckets of a mapped file stay aligned.
+ */
+typedef struct alignas(64) ttFileHeader_s
+{
+    char magic[8];
+    uint64_t numBuckets;
+    uint8_t generation;
+} ttFileHeader_t;
+
+/**
+ * The table lives in its own mapping, either anonymous memory or a saved
+ * table mapped straight from disk, and is kept from one search to the next.
+ * Each thread searches with a table of its own, which it must free before
+ * it exits.
+ */
+static thread_local ttBucket_t *ttBuckets = NULL;
+static thread_local uint64_t ttNumBuckets = 0;
+static thread_local void *ttMapping = NULL;
+static thread_local size_t ttMappingSize = 0;
+static thread_local uint8_t ttGeneration = 0;
+static thread_local ttPageMode_e ttPageMode = TT_PAGES_SMALL;
+
+// Whether new tables ask for huge pages
+static bool ttHugePagesEnabled = true;
+
+static const char *ttPageModeNames[] = { "small pages", "transparent huge pages", "hugetlbfs huge pages" };
+
+static inline ttBucket_t *TT_GetBucket(uint64_t key)
+{
+    // Scales the key onto the table, so any number of buckets will do
+    return &ttBuckets[(uint64_t) (((unsigned __int128) key * ttNumBuckets) >> 64)];
+}
+
+static inline uint8_t TT_GetAge(const ttEntry_t *entry)
+{
+    return (ttGeneration - (entry->boundAndGeneration >> 2)) & TT_GENERATION_MASK;
+}
+
+/**
+ * Chooses whether tables created from now on ask for huge pages. The current
+ * table is left as it is until the next TT_Resize.
+ */
+void TT_SetHugePages(bool enabled)
+{
+    ttHugePagesEnabled = enabled;
+}
+
+/**
+ * @return  The pages backing the current table
+ */
+ttPageMode_e TT_GetPageMode(void)
+{
+    return ttPageMode;
+}
+
+/**
+ * @return  The pages backing the current table, for reporting
+ */
+const char *TT_GetPageModeName(void)
+{
+    return ttPageModeNames[ttPageMode];
+}
+
+/**
+ * Maps anonymous memory backed by huge pages if at all possible. Reserved
+ * hugetlbfs pages are tried first as they are certain to be huge, failing
+ * that, which is usual as few systems reserve any, a 2MB aligned mapping is
+ * marked for transparent huge pages.
+ *
+ * @param size:     Bytes wanted, a whole number of huge pages
+ * @param mapping:  Where to store the start of the mapping, to unmap later
+ * @param mapSize:  Where to store the size of the mapping, to unmap later
+ *
+ * @return  The 2MB aligned memory, or NULL if none could be had
+ */
+static void *TT_MapHugePages(size_t size, void **mapping, size_t *mapSize)
+{
+    void *base;
+    uintptr_t aligned;
+
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(base != MAP_FAILED)
+    {
+        *mapping = base;
+        *mapSize = size;
+        ttPageMode = TT_PAGES_HUGETLB;
+        return base;
+    }
+
+    // Transparent huge pages only back whole aligned 2MB ranges, so map a page
+    // extra and start the table at the first boundary within it
+    base = mmap(NULL, size + TT_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(base == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    aligned = ((uintptr_t) base + TT_HUGE_PAGE_SIZE - 1) & ~((uintptr_t) TT_HUGE_PAGE_SIZE - 1);
+    *mapping = base;
+    *mapSize = size + TT_HUGE_PAGE_SIZE;
+    ttPageMode = (madvise((void *) aligned, size, MADV_HUGEPAGE) == 0) ? TT_PAGES_TRANSPARENT : TT_PAGES_SMALL;
+    return (void *) aligned;
+}
+
+/**
+ * Throws away the current table and maps a new, empty one, backed by huge
+ * pages unless they have been turned off. See TT_GetPageMode for what was had.
+ *
+ * @param sizeMb:   The size of the table in megabytes, rounded up to a whole
+ *                  number of huge pages when they are used
+ *
+ * @return  STATUS_SUCCESS if the table was created, STATUS_FAIL otherwise
+ */
+uint64_t TT_Resize(uint64_t sizeMb)
+{
+    size_t size = sizeMb << 20;
+    void *table = NULL, *mapping = NULL;
+    size_t mapSize = 0;
+
+    TT_Free();
+
+    if(size < sizeof(ttBucket_t))
+    {
+        return STATUS_FAIL;
+    }
+
+    // Anonymous mappings come zeroed, which is an empty table
+    if(ttHugePagesEnabled)
+    {
+        size = (size + TT_HUGE_PAGE_SIZE - 1) & ~((size_t) TT_HUGE_PAGE_SIZE - 1);
+        table = TT_MapHugePages(size, &mapping, &mapSize);
+    }
+    else
+    {
+        mapSize = size;
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        table = (mapping == MAP_FAILED) ? NULL : mapping;
+        ttPageMode = TT_PAGES_SMALL;
+    }
+
+    if(table == NULL)
+    {
+        std::cout << "Unable to allocate a " << sizeMb << "MB transposition table" << std::endl;
+        return STATUS_FAIL;
+    }
+
+    ttMapping = mapping;
+    ttMappingSize = mapSize;
+    ttBuckets = (ttBucket_t *) table;
+    ttNumBuckets = size / sizeof(ttBucket_t);
+    ttGeneration = 0;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Releases the table, leaving searches to run without one
+ */
+void TT_Free(void)
+{
+    if(ttMapping != NULL)
+    {
+        munmap(ttMapping, ttMappingSize);
+    }
+    ttMapping = NULL;
+    ttMappingSize = 0;
+    ttBuckets = NULL;
+    ttNumBuckets = 0;
+    ttPageMode = TT_PAGES_SMALL;
+}
+
+/**
+ * Empties the table, ie. for a new game or a reproducible benchmark
+ */
+void TT_Clear(void)
+{
+    if(ttBuckets != NULL)
+    {
+        memset((void *) ttBuckets, 0, ttNumBuckets*sizeof(ttBucket_t));
+    }
+    ttGeneration = 0;
+}
+
+/**
+ * Starts a new search. Entries from earlier searches are kept and still used,
+ * but they grow older with each search and are the first to be replaced.
+ * A table of the default size is created if there is none yet.
+ */
+void TT_NewSearch(void)
+{
+    if(ttBuckets == NULL)
+    {
+        TT_Resize(TT_DEFAULT_SIZE_MB);
+    }
+    ttGeneration = (ttGeneration + 1) & TT_GENERATION_MASK;
+}
+
+/**
+ * Starts bringing in the bucket of a position which is about to be probed.
+ * Nearly every probe misses the cache, so issuing this as early as the key
+ * is known lets the memory latency overlap whatever work comes before it.
+ *
+ * @param key:  The key of the position
+ */
+void TT_Prefetch(uint64_t key)
+{
+#if TT_PREFETCH
+    if(ttBuckets != NULL)
+    {
+        __builtin_prefetch(TT_GetBucket(key));
+    }
+#else
+    (void) key;
+#endif
+}
+
+/**
+ * @return  True if a score is a king capture, whether counted from the depth
+ *          left at the capture or relative to a node above it. The king is
+ *          always taken below the node, so relative scores fall under
+ *          MATE_SCORE, but never by more than the deepest search.
+ */
+static inline bool TT_IsMateScore(int32_t score)
+{
+    return score >= MATE_SCORE - MAX_SEARCH_DEPTH || score <= -(MATE_SCORE - MAX_SEARCH_DEPTH);
+}
+
+/**
+ * Looks a position up
+ *
+ * @param key:      The key of the position
+ * @param depth:    The depth left at the node, which mate scores are relative to
+ * @param entry:    Where to copy the entry if there is one
+ *
+ * @return  True if the position was found
+ */
+bool TT_Probe(uint64_t key, uint8_t depth, ttEntry_t *entry)
+{
+    ttBucket_t *bucket;
+
+    if(ttBuckets == NULL)
+    {
+        return false;
+    }
+
+    bucket = TT_GetBucket(key);
+    for(uint8_t i = 0; i < TT_BUCKET_ENTRIES; ++i)
+    {
+        if(bucket->entries[i].key != key || TT_ENTRY_BOUND(&bucket->entries[i]) == TT_BOUND_NONE)
+        {
+            continue;
+        }
+
+        // Still of use, so it should not be the first to go
+        bucket->entries[i].boundAndGeneration = TT_ENTRY_BOUND(&bucket->entries[i]) | (ttGeneration << 2);
+        *entry = bucket->entries[i];
+
+        // Mate scores are stored relative to the node, see TT_Store
+        if(TT_IsMateScore(entry->score))
+        {
+            entry->score += (entry->score > 0) ? depth : -depth;
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Stores a search result. The entry for the same position is replaced if
+ * there is one, otherwise the entry worth least, counting older searches as
+ * worth less than shallow ones.
+ *
+ * @param key:      The key of the position
+ * @param depth:    The depth searched to
+ * @param score:    The score found
+ * @param bound:    What the score says about the true score
+ * @param move:     The best move found, packed, 0 for none
+ */
+void TT_Store(uint64_t key, uint8_t depth, int32_t score, ttBound_e bound, uint16_t move)
+{
+    ttBucket_t *bucket;
+    ttEntry_t *replace;
+    int32_t worth, leastWorth = INT32_MAX;
+
+    if(ttBuckets == NULL)
+    {
+        return;
+    }
+
+    bucket = TT_GetBucket(key);
+    replace = &bucket->entries[0];
+    for(uint8_t i = 0; i < TT_BUCKET_ENTRIES; ++i)
+    {
+        if(bucket->entries[i].key == key)
+        {
+            replace = &bucket->entries[i];
+
+            // A result without a move still knows nothing better than the old one
+            move = (move == 0) ? replace->move : move;
+            break;
+        }
+
+        worth = (TT_ENTRY_BOUND(&bucket->entries[i]) == TT_BOUND_NONE)
+                    ? INT32_MIN : bucket->entries[i].depth - 8*TT_GetAge(&bucket->entries[i]);
+        if(worth < leastWorth)
+        {
+            leastWorth = worth;
+            replace = &bucket->entries[i];
+        }
+    }
+
+    // Mate scores count the depth left when the king went, which would be
+    // wrong when read back at another depth, so keep them relative to here
+    if(TT_IsMateScore(score))
+    {
+        score -= (score > 0) ? depth : -depth;
+    }
+
+    replace->key = key;
+    replace->score = score;
+    replace->move = move;
+    replace->depth = depth;
+    replace->boundAndGeneration = bound | (ttGeneration << 2);
+}
+
+/**
+ * @return  The size of the current table in megabytes
+ */
+uint64_t TT_GetSizeMb(void)
+{
+    return (ttNumBuckets*sizeof(ttBucket_t)) >> 20;
+}
+
+/**
+ * Estimates how full the table is with entries from the current search, in
+ * the per mille UCI reports it in
+ */
+uint64_t TT_Hashfull(void)
+{
+    uint64_t numSampled = std::min(ttNumBuckets, (uint64_t) 1000), numUsed = 0;
+
+    for(uint64_t i = 0; i < numSampled; ++i)
+    {
+        for(uint8_t j = 0; j < TT_BUCKET_ENTRIES; ++j)
+        {
+            numUsed += (TT_ENTRY_BOUND(&ttBuckets[i].entries[j]) != TT_BOUND_NONE
+                        && TT_GetAge(&ttBuckets[i].entries[j]) == 0) ? 1 : 0;
+        }
+    }
+    return numSampled ? (numUsed*1000) / (numSampled*TT_BUCKET_ENTRIES) : 0;
+}
+
+/**
+ * Writes the table out so a later session can carry on from it
+ *
+ * @param path:     The file to write
+ *
+ * @return  STATUS_SUCCESS if the table was written, STATUS_FAIL otherwise
+ */
+uint64_t TT_Save(std::string path)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    ttFileHeader_t header = {};
+
+    if(ttBuckets == NULL || !file.is_open())
+    {
+        return STATUS_FAIL;
+    }
+
+    memcpy(header.magic, TT_FILE_MAGIC, sizeof(header.magic));
+    header.numBuckets = ttNumBuckets;
+    header.generation = ttGeneration;
+
+    file.write((const char *) &header, sizeof(header));
+    file.write((const char *) ttBuckets, ttNumBuckets*sizeof(ttBucket_t));
+
+    return file.good() ? STATUS_SUCCESS : STATUS_FAIL;
+}
+
+/**
+ * Replaces the table with one saved by TT_Save. The file is mapped privately
+ * rather than read, so the load is instant whatever the size, pages are only
+ * read in as the search touches them, and the file itself is never changed.
+ * Pages of a file are always small ones, so a loaded table does without huge
+ * pages; resize the table afterwards if they matter more than the entries.
+ *
+ * @param path:     The file to load
+ *
+ * @return  STATUS_SUCCESS if the table was loaded, STATUS_FAIL otherwise, in
+ *          which case the current table is kept
+ */
+uint64_t TT_Load(std::string path)
+{
+    ttFileHeader_t header;
+    struct stat st;
+    void *mapping;
+    int fd;
+
+    fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return STATUS_FAIL;
+    }
+
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(header)
+        || read(fd, &header, sizeof(header)) != (ssize_t) sizeof(header)
+        || memcmp(header.magic, TT_FILE_MAGIC, sizeof(header.magic)) != 0
+        || header.numBuckets == 0
+        || (uint64_t) st.st_size != sizeof(header) + header.numBuckets*sizeof(ttBucket_t))
+    {
+        std::cout << path << " is not a saved transposition table" << std::endl;
+        close(fd);
+        return STATUS_FAIL;
+    }
+
+    mapping = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        return STATUS_FAIL;
+    }
+
+    TT_Free();
+    ttMapping = mapping;
+    ttMappingSize = st.st_size;
+    ttBuckets = (ttBucket_t *) ((char *) mapping + sizeof(header));
+    ttNumBuckets = header.numBuckets;
+    ttGeneration = header.generation;
+    return STATUS_SUCCESS;
+}
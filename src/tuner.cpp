@@ -0,0 +1,431 @@
+/* This file is responsible for tuning the weights of the hand written evaluation against game results */
+
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include "util.h"
+#include "chessboard_defs.h"
+#include "chessboard.h"
+#include "piecetables.h"
+#include "pawns.h"
+#include "evaluation.h"
+#include "eval_params.h"
+#include "packed_position.h"
+#include "packed_file.h"
+#include "see.h"
+#include "tuner.h"
+
+#define TUNER_ADAM_BETA1        0.9
+#define TUNER_ADAM_BETA2        0.999
+#define TUNER_ADAM_EPSILON      1e-8
+
+// Golden section steps taken fitting the scale, each narrowing the range by a third or so
+#define TUNER_SCALE_STEPS       30
+
+/**
+ * The count of one term in a position, white's less black's
+ */
+typedef struct tunerCoefficient_s
+{
+    uint16_t term;
+    int16_t count;
+} tunerCoefficient_t;
+
+/**
+ * A position reduced to what the evaluation makes of it: the weights are a
+ * linear function of its term counts, tapered by its phase
+ */
+typedef struct tunerPosition_s
+{
+    uint32_t firstCoefficient;
+    uint16_t numCoefficients;
+    uint8_t phase;
+    float result;           // 1 for a white win, 0.5 for a draw, 0 for a loss
+    float fixed;            // What the terms which are not tuned add, tapered already
+} tunerPosition_t;
+
+/**
+ * The positions each thread works on, and what it makes of them
+ */
+typedef struct tunerSlice_s
+{
+    std::vector<tunerPosition_t> positions;
+    std::vector<tunerCoefficient_t> coefficients;
+    std::vector<double> gradient;       // [2*EVAL_NUM_TERMS], midgame weights first
+    double error;
+    uint64_t numNoisy;                  // Records passed over as not quiet
+} tunerSlice_t;
+
+/**
+ * Fills in the settings used when none are given
+ *
+ * @param config:   The settings to fill in
+ */
+void Tuner_DefaultConfig(tunerConfig_t *config)
+{
+    config->iterations = TUNER_DEFAULT_ITERATIONS;
+    config->numThreads = 0;
+    config->maxPositions = 0;
+    config->learningRate = TUNER_DEFAULT_LEARNING_RATE;
+    config->scale = 0.0;
+}
+
+/**
+ * Evaluates a reduced position with a set of weights
+ *
+ * @return  The value of the position, positive in white's favour
+ */
+static inline double Tuner_Evaluate(const tunerPosition_t *position, const tunerCoefficient_t *coefficients,
+                                    const double *weights)
+{
+    double midgame = 0.0, endgame = 0.0;
+
+    for(uint16_t i = 0; i < position->numCoefficients; ++i)
+    {
+        midgame += coefficients[i].count * weights[coefficients[i].term];
+        endgame += coefficients[i].count * weights[EVAL_NUM_TERMS + coefficients[i].term];
+    }
+    return (midgame*position->phase + endgame*(PHASE_MAX - position->phase)) / PHASE_MAX + position->fixed;
+}
+
+/**
+ * @return  True if the side to move has nothing to resolve first: it is not
+ *          in check, and no capture wins material
+ */
+static bool Tuner_IsQuiet(ChessBoard *cb)
+{
+    moveType_t captures[SEARCH_MAX_MOVES];
+    uint64_t numCaptures;
+
+    if(cb->IsInCheck(cb->GetColorToMove()))
+    {
+        return false;
+    }
+
+    numCaptures = cb->GenerateCaptures(captures);
+    for(uint64_t i = 0; i < numCaptures; ++i)
+    {
+        if(See_Evaluate(cb, &captures[i]) > 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Reduces a thread's share of the records to their term counts, passing over
+ * any position which is not quiet, as its static evaluation says little about
+ * where the game went
+ */
+static void Tuner_LoadThread(tunerSlice_t *slice, const packedPosition_t *records, uint64_t numRecords)
+{
+    ChessBoard *cb = new ChessBoard();
+    evalBreakdown_t breakdown;
+    evalTerms_t trace;
+    tunerPosition_t position;
+    tunerCoefficient_t coefficient;
+    const int32_t *counts = EvalParams_Flat(&trace);
+    int32_t midgame, endgame;
+    double weights[2*EVAL_NUM_TERMS];
+
+    for(uint64_t term = 0; term < EVAL_NUM_TERMS; ++term)
+    {
+        weights[term] = EvalParams_Flat(&evalParams.midgame)[term];
+        weights[EVAL_NUM_TERMS + term] = EvalParams_Flat(&evalParams.endgame)[term];
+    }
+
+    slice->numNoisy = 0;
+    for(uint64_t i = 0; i < numRecords; ++i)
+    {
+        if(PackedPosition_Unpack(&records[i], cb) != STATUS_SUCCESS || !Tuner_IsQuiet(cb))
+        {
+            slice->numNoisy++;
+            continue;
+        }
+
+        memset(&trace, 0, sizeof(trace));
+        PieceTables_Trace(cb->GetPieces(), &trace);
+        Pawns_Trace(cb->GetWhitePawns(), cb->GetBlackPawns(), &trace);
+
+        // King safety is not linear in its weights, it is left as it stands
+        midgame = 0;
+        endgame = 0;
+        Evaluation_PieceActivity(cb->GetPieces(), cb->GetOccupied(), &midgame, &endgame, NULL, &trace);
+        ChessBoard::EvaluateBreakdown(cb, &breakdown);
+
+        position.firstCoefficient = slice->coefficients.size();
+        position.phase = (uint8_t) breakdown.phase;
+        position.result = (records[i].result + 1) / 2.0f;
+        position.fixed = (float) breakdown.kingSafety[0] * breakdown.phase / PHASE_MAX;
+        for(uint64_t term = 0; term < EVAL_NUM_TERMS; ++term)
+        {
+            if(counts[term] != 0)
+            {
+                coefficient.term = (uint16_t) term;
+                coefficient.count = (int16_t) counts[term];
+                slice->coefficients.push_back(coefficient);
+            }
+        }
+        position.numCoefficients = slice->coefficients.size() - position.firstCoefficient;
+
+        // The engine rounds each stage down, so the two can differ by a centipawn or so
+        Util_Assert(std::abs(Tuner_Evaluate(&position, &slice->coefficients[position.firstCoefficient], weights)
+                             - breakdown.total) < 2.0, "Traced terms do not add up to the evaluation");
+
+        slice->positions.push_back(position);
+    }
+
+    delete cb;
+}
+
+/**
+ * Works out a thread's share of the error of a set of weights, and if asked
+ * its share of the gradient of the error
+ */
+static void Tuner_ErrorThread(tunerSlice_t *slice, const double *weights, double scale, bool withGradient)
+{
+    const tunerPosition_t *position;
+    const tunerCoefficient_t *coefficients;
+    double sigmoid, error, midgameGrad, endgameGrad;
+
+    slice->error = 0.0;
+    if(withGradient)
+    {
+        std::fill(slice->gradient.begin(), slice->gradient.end(), 0.0);
+    }
+
+    for(size_t i = 0; i < slice->positions.size(); ++i)
+    {
+        position = &slice->positions[i];
+        coefficients = &slice->coefficients[position->firstCoefficient];
+        sigmoid = 1.0 / (1.0 + std::exp(-Tuner_Evaluate(position, coefficients, weights) / scale));
+        error = sigmoid - position->result;
+        slice->error += error * error;
+
+        if(!withGradient)
+        {
+            continue;
+        }
+
+        // The constant factors are left for the caller to apply once
+        midgameGrad = error * sigmoid * (1.0 - sigmoid) * position->phase;
+        endgameGrad = error * sigmoid * (1.0 - sigmoid) * (PHASE_MAX - position->phase);
+        for(uint16_t k = 0; k < position->numCoefficients; ++k)
+        {
+            slice->gradient[coefficients[k].term] += midgameGrad * coefficients[k].count;
+            slice->gradient[EVAL_NUM_TERMS + coefficients[k].term] += endgameGrad * coefficients[k].count;
+        }
+    }
+}
+
+/**
+ * Runs every slice through Tuner_ErrorThread, each on its own thread
+ *
+ * @return  The mean squared error over all the positions
+ */
+static double Tuner_Error(std::vector<tunerSlice_t> &slices, const double *weights, double scale,
+                          bool withGradient, uint64_t numPositions)
+{
+    std::vector<std::thread> threads;
+    double error = 0.0;
+
+    for(size_t i = 0; i < slices.size(); ++i)
+    {
+        threads.emplace_back(Tuner_ErrorThread, &slices[i], weights, scale, withGradient);
+    }
+    for(size_t i = 0; i < slices.size(); ++i)
+    {
+        threads[i].join();
+        error += slices[i].error;
+    }
+    return error / numPositions;
+}
+
+/**
+ * Finds the scale which best maps the evaluation as it stands onto the game
+ * results, by golden section search
+ */
+static double Tuner_FitScale(std::vector<tunerSlice_t> &slices, const double *weights, uint64_t numPositions)
+{
+    const double ratio = (std::sqrt(5.0) - 1.0) / 2.0;
+    double low = TUNER_SCALE_MIN, high = TUNER_SCALE_MAX, a, b, errorA, errorB;
+
+    a = high - ratio*(high - low);
+    b = low + ratio*(high - low);
+    errorA = Tuner_Error(slices, weights, a, false, numPositions);
+    errorB = Tuner_Error(slices, weights, b, false, numPositions);
+    for(uint64_t step = 0; step < TUNER_SCALE_STEPS; ++step)
+    {
+        if(errorA < errorB)
+        {
+            high = b;
+            b = a;
+            errorB = errorA;
+            a = high - ratio*(high - low);
+            errorA = Tuner_Error(slices, weights, a, false, numPositions);
+        }
+        else
+        {
+            low = a;
+            a = b;
+            errorA = errorB;
+            b = low + ratio*(high - low);
+            errorB = Tuner_Error(slices, weights, b, false, numPositions);
+        }
+    }
+    return (low + high) / 2.0;
+}
+
+/**
+ * Reads up to maxRecords records from the data files, all of them if 0
+ *
+ * @return  STATUS_SUCCESS if every file was read, STATUS_FAIL otherwise
+ */
+static uint64_t Tuner_ReadRecords(std::vector<std::string> &dataPaths, uint64_t maxRecords,
+                                  std::vector<packedPosition_t> *records)
+{
+    const packedPosition_t *mapped;
+    packedReader_t reader;
+    uint64_t numRecords;
+
+    for(size_t i = 0; i < dataPaths.size(); ++i)
+    {
+        if(maxRecords != 0 && records->size() >= maxRecords)
+        {
+            break;
+        }
+
+        if(PackedFile_OpenReader(&reader, dataPaths[i]) != STATUS_SUCCESS)
+        {
+            return STATUS_FAIL;
+        }
+
+        numRecords = PackedFile_Read(&reader, &mapped,
+                                     (maxRecords != 0) ? maxRecords - records->size() : reader.numRecords);
+        records->insert(records->end(), mapped, mapped + numRecords);
+        PackedFile_CloseReader(&reader);
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Tunes the weights of the hand written evaluation so that it predicts the
+ * results of the games its positions came from as well as it can, Texel's
+ * method. Each position is reduced once to its term counts, which turns the
+ * evaluation into a dot product with the flat weight vector, and the weights
+ * then take Adam steps down the gradient of the error over the whole set.
+ * Tuning starts from the weights in use, so from a loaded parameter file if
+ * there is one.
+ *
+ * @param dataPaths:    Files of packedPosition_t records
+ * @param outPath:      Where to write the tuned parameter file
+ * @param config:       How to tune
+ *
+ * @return  STATUS_SUCCESS if the parameters were written, STATUS_FAIL otherwise
+ */
+uint64_t Tuner_Tune(std::vector<std::string> dataPaths, std::string outPath, tunerConfig_t *config)
+{
+    std::vector<packedPosition_t> records;
+    std::vector<tunerSlice_t> slices;
+    std::vector<std::thread> threads;
+    std::vector<double> weights(2*EVAL_NUM_TERMS), adamM(2*EVAL_NUM_TERMS, 0.0), adamV(2*EVAL_NUM_TERMS, 0.0);
+    std::chrono::steady_clock::time_point startTime;
+    evalParams_t tuned;
+    uint64_t numThreads, numPositions = 0, numNoisy = 0;
+    double scale, error, gradient, stepSize;
+
+    Util_Assert(config != NULL, "NULL config given to Tuner_Tune");
+
+    if(Tuner_ReadRecords(dataPaths, config->maxPositions, &records) != STATUS_SUCCESS)
+    {
+        return STATUS_FAIL;
+    }
+
+    numThreads = config->numThreads ? config->numThreads : std::thread::hardware_concurrency();
+    numThreads = std::max((uint64_t) 1, std::min(numThreads, (uint64_t) records.size()));
+
+    for(uint64_t term = 0; term < EVAL_NUM_TERMS; ++term)
+    {
+        weights[term] = EvalParams_Flat(&evalParams.midgame)[term];
+        weights[EVAL_NUM_TERMS + term] = EvalParams_Flat(&evalParams.endgame)[term];
+    }
+
+    // Each thread reduces its own share of the records, and keeps it
+    startTime = std::chrono::steady_clock::now();
+    slices.resize(numThreads);
+    for(uint64_t i = 0; i < numThreads; ++i)
+    {
+        slices[i].gradient.assign(2*EVAL_NUM_TERMS, 0.0);
+        threads.emplace_back(Tuner_LoadThread, &slices[i], &records[records.size() * i / numThreads],
+                             records.size() * (i + 1) / numThreads - records.size() * i / numThreads);
+    }
+    for(uint64_t i = 0; i < numThreads; ++i)
+    {
+        threads[i].join();
+        numPositions += slices[i].positions.size();
+        numNoisy += slices[i].numNoisy;
+    }
+    records.clear();
+    records.shrink_to_fit();
+
+    std::cout << "Loaded " << numPositions << " quiet positions (" << numNoisy << " passed over) in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - startTime).count() << "ms" << std::endl;
+    if(numPositions == 0)
+    {
+        std::cout << "No positions to tune on" << std::endl;
+        return STATUS_FAIL;
+    }
+
+    scale = (config->scale > 0.0) ? config->scale : Tuner_FitScale(slices, weights.data(), numPositions);
+    std::cout << "Scale " << scale << "cp, starting error "
+              << Tuner_Error(slices, weights.data(), scale, false, numPositions) << std::endl;
+
+    startTime = std::chrono::steady_clock::now();
+    for(uint64_t iteration = 1; iteration <= config->iterations; ++iteration)
+    {
+        error = Tuner_Error(slices, weights.data(), scale, true, numPositions);
+        if(iteration % TUNER_REPORT_INTERVAL == 0 || iteration == 1)
+        {
+            std::cout << "Iteration " << iteration << ": error " << error << std::endl;
+        }
+
+        stepSize = config->learningRate * std::sqrt(1.0 - std::pow(TUNER_ADAM_BETA2, (double) iteration))
+                 / (1.0 - std::pow(TUNER_ADAM_BETA1, (double) iteration));
+        for(uint64_t k = 0; k < 2*EVAL_NUM_TERMS; ++k)
+        {
+            gradient = 0.0;
+            for(uint64_t i = 0; i < numThreads; ++i)
+            {
+                gradient += slices[i].gradient[k];
+            }
+            gradient *= 2.0 / (scale * PHASE_MAX * numPositions);
+
+            adamM[k] = TUNER_ADAM_BETA1*adamM[k] + (1.0 - TUNER_ADAM_BETA1)*gradient;
+            adamV[k] = TUNER_ADAM_BETA2*adamV[k] + (1.0 - TUNER_ADAM_BETA2)*gradient*gradient;
+            weights[k] -= stepSize * adamM[k] / (std::sqrt(adamV[k]) + TUNER_ADAM_EPSILON);
+        }
+    }
+
+    error = Tuner_Error(slices, weights.data(), scale, false, numPositions);
+    std::cout << "Final error " << error << " after " << config->iterations << " iterations in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - startTime).count() << "ms" << std::endl;
+
+    for(uint64_t term = 0; term < EVAL_NUM_TERMS; ++term)
+    {
+        EvalParams_Flat(&tuned.midgame)[term] = (int32_t) std::lround(weights[term]);
+        EvalParams_Flat(&tuned.endgame)[term] = (int32_t) std::lround(weights[EVAL_NUM_TERMS + term]);
+    }
+
+    if(EvalParams_Save(outPath, &tuned) != STATUS_SUCCESS)
+    {
+        return STATUS_FAIL;
+    }
+    std::cout << "Wrote " << outPath << std::endl;
+    return STATUS_SUCCESS;
+}
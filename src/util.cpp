@@ -1,5 +1,6 @@
 /* Useful utility functions */
 
+#include <cstdlib>
 #include "util.h"
 #include "chessboard.h"
 
@@ -136,25 +137,27 @@ void Util_AssignFriendAndFoe(uint8_t pt, uint8_t *friendlyPieces, uint8_t *enemy
 
 
 /**
- * Basic Util_Assertion function for catching runtime errors. I would
- * use the C++ Util_Assert but that terminates the program, and I would
- * rather hang execution so I can see the callstack immediately on
- * failure. 
+ * Reports a failed Util_Assert and stops the program. Aborting rather than
+ * returning leaves the callstack intact for a debugger or core dump. Building
+ * with -DASSERT_HANG_ON_FAILURE hangs instead, so a debugger can be attached
+ * to a process which is already running.
  * 
- * @param expr: The actual Util_Assertion which must be true
  * @param str:  The output string to go to console output
+ * @param file: The source file containing the failed assertion
+ * @param line: The line of the failed assertion
  */
-void Util_Assert(bool expr, std::string str)
+void Util_AssertFailed(const char *str, const char *file, int line)
 {
-#if DEBUG_BUILD
-    if(!expr)
+    std::cout << str << std::endl;
+    std::cout << "ASSERT -- " << file << ":" << line << std::endl;
+
+#ifdef ASSERT_HANG_ON_FAILURE
+    std::cout << "Program hanging" << std::endl;
+    while(true)
     {
-        std::cout << str << std::endl;
-        std::cout << "ASSERT -- Program hanging" << std::endl;
-        while(true)
-        {
-            ;
-        }
+        ;
     }
-#endif // DEBUG_BUILD
-}
\ No newline at end of file
+#else
+    std::abort();
+#endif // ASSERT_HANG_ON_FAILURE
+}
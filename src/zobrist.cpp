@@ -0,0 +1,50 @@
+/* This file is responsible for the random numbers behind position keys */
+
+#include "zobrist.h"
+
+// Any seed will do, a fixed one keeps keys the same from run to run
+#define ZOBRIST_SEED 0x9E3779B97F4A7C15ULL
+
+/**
+ * SplitMix64, which gives well mixed numbers from a simple counter
+ */
+static constexpr uint64_t Zobrist_NextRandom(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Fills in every key, done at compile time so no start up step is needed
+ */
+static constexpr zobristKeys_t Zobrist_Generate(void)
+{
+    zobristKeys_t keys = {};
+    uint64_t state = ZOBRIST_SEED;
+
+    for(uint8_t pt = 0; pt < NUM_PIECE_TYPES; ++pt)
+    {
+        for(uint8_t idx = 0; idx < NUM_BOARD_INDICES; ++idx)
+        {
+            keys.pieces[pt][idx] = Zobrist_NextRandom(&state);
+        }
+    }
+
+    // No rights at all leaves the key alone
+    for(uint8_t rights = 1; rights < 16; ++rights)
+    {
+        keys.castling[rights] = Zobrist_NextRandom(&state);
+    }
+
+    for(uint8_t file = 0; file < 8; ++file)
+    {
+        keys.enPassantFile[file] = Zobrist_NextRandom(&state);
+    }
+
+    keys.blackToMove = Zobrist_NextRandom(&state);
+    return keys;
+}
+
+const zobristKeys_t zobristKeys = Zobrist_Generate();